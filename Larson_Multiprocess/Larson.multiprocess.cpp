@@ -20,11 +20,12 @@
   * 
  */
   
+  
 /*
  * Larson_multiprocess
  * This program implements the classic "Larson (memorial) scanner",
- * albeit a 20 pin Raspberry Pi version, with two "eyes," each running in 
- * its own pthread It //requires// a Pi with a 40 pin GPIO bus, or it 
+ * albeit a 20 pin Raspberry Pi version, with its "eyes" each running in 
+ * its own process. It //requires// a Pi with a 40 pin GPIO bus, or it 
  * won't call the right pins in wiringPi.
  * Several modifications from Larson.cpp. First, we install a signal
  * handler to turn all the LEDs off when we get an interrupt signal.
@@ -32,27 +33,53 @@
  * It is no longer hardcoded to run forever, only as long as running is 
  * true, which it is until a SIGINT is caught. Then we clean up the LEDs
  * and exit.
+ * The worker processes don't write the pins themselves. Each writes 
+ * its segment of the frame into a shared_frame_class, and the parent
+ * flushes the whole frame to the pins, so the segments always change
+ * together.
+ * There can be any number of workers from 1 to LEDs, each scanning its
+ * own stretch of the array. The parent doesn't scan at all; it's the
+ * supervisor. It pins each worker to a CPU, starts a new one if a
+ * worker dies, and stops them all on SIGINT.
+ * 
+ * Usage: Larson.multiprocess [workers] [seconds]
+ * workers defaults to 2, which looks just like the old two eye version.
+ * If seconds is given, stop by ourselves after that long, so you can
+ * run it for 1, 2, 4 ... 20 workers and compare the timing numbers.
 */
 
 
 /* Iostream gives us cin and cout, which we might need for debugging.
  * wiringPi is the star of this show, the software interface to the 
- * GPIO pins. pthread.h gives us the Linux thread library. It's included
- * in wiringPi too, so we don't //technically// have to include it here,
- * but it's bad business to depend on declarations in other libraries.
+ * GPIO pins. 
+ * shared_frame.h has the frame the workers write into, realtime.h 
+ * has realtime_pin_process() and realtime_cpu_for() to give each 
+ * worker its own CPU, and sys/wait.h has waitpid(), so the supervisor
+ * can tell when a worker has died.
  * 
  * We define LEDs as 20, both to set the index of the pins array, and 
  * as the maximum index value of the loop that reads it.
  * Likewise delaymils is a constant value of how many milliseconds to
  * wait between changing LEDs.
+ * max_restarts is how many times we'll restart any one worker before
+ * deciding it's never going to work, and leaving its LEDs alone.
 */
 
 #include <iostream>
 #include <csignal>
+#include <stdlib.h>
 #include <wiringPi.h>
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../larson/larson_frames.h"
+#include "../frame_clock/frame_clock.h"
+#include "../shared_frame/shared_frame.h"
+#include "../realtime/realtime.h"
 #include <unistd.h>
+#include <sys/wait.h>
 #define LEDs 20
 #define delaymils 40
+#define flush_wait_ns (delaymils*1000000LL/4) //how long to wait for a slow worker.
+#define max_restarts 5
 
 /* 
  * We're only using one namespace in this program, so it's safe to set
@@ -66,94 +93,90 @@ using namespace std;
  * order they're plugged into the LED arrays to its own index value (from 
  * 0 to LEDs.)
 */ 
-int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+
+/*
+ * Each worker scans its own segment of the array, so each gets its own
+ * table of frames. We don't know how many workers there are until we
+ * run, so make_larson_table() does its work at run time. See 
+ * larson_frames.h. 
+ * 
+ * The supervisor keeps track of each worker's process ID and how many
+ * times it's been restarted. A worker that's gone for good has a 
+ * process ID of 0.
+*/
+larson_table worker_tables[LEDs];
+pid_t worker_pids[LEDs];
+int worker_restarts[LEDs];
+int worker_count=2;
+gpio_register_class gpio; //the mapped GPIO registers.
+frame_clock_class frame_clock; //this process's frame clock.
+timespec scan_epoch; //when the scan started. Set before we fork.
+shared_frame_class shared_frame; //the frame the workers write.
 volatile bool running=true;
 
-/* void scan(bool low_order_LEDs, bool start_low)
+/* int64_t frame_number()
+ * Returns which frame we're in, counting from scan_epoch. Every 
+ * process gets the same number at the same moment, including a worker
+ * that was only just started.
+ */
+int64_t frame_number(){
+	return (timespec_ns(clock_now())-timespec_ns(scan_epoch))/(delaymils*1000000LL);
+}
+
+/* int table_index(int segment, int64_t frame)
+ * Returns which frame of segment's table goes with frame number frame.
+ * Frames 0 to length/2-1 of the table are the low to high scan, and
+ * the rest are high to low. Even numbered segments start at length/2,
+ * scanning down, and odd ones start at 0, scanning up, so neighboring
+ * eyes bounce off each other.
+ */
+int table_index(int segment,int64_t frame){
+	const larson_table &table=worker_tables[segment];
+	int start=segment%2?0:table.length/2;
+	return (start+frame)%table.length;
+}
+
+/* void scan(int segment)
  * Parameters:
- * 	low_order_LEDs is a boolean that tells scan whether it's scanning
- * 		from the 0th LED to 10. If this parameter is false, we're scanning
- * 		from LED 10 to LED 20.
- * 	start_low is a boolean that tells scan whether to start at the 
- *  	lowest led and scan up, or the highest led and scan down. 
- * 		This only effects the //first// scan.
+ * 	segment is which worker we are, and so which stretch of the array 
+ * 		we scan.
  * Returns nothing.
  * 
  * How it Works:
  * -------------
- * Basically the guts of main() in Larson.cpp, but we have to do some
- * processing of local variables first.
- * Initialize c at 0 for safety. 
- * 
- * Declare localLEDs and ocalzero. These are the maximum and minimum 
- * leds this particular instantiation of scan should scan between.
- * 
- * Initialize localstart_low to start_low. If it's false, we start high
- * on the first scan.
- * 
- * Set up localzero and localLEDs. 
- * If we were passed low_order_LEDs as true, 
- * 		set localzero to 0 and localLEDs to LEDs divided by 2. (This 
- * 		value is probably 10, but who knows how many LEDs those wiley 
- * 		users have hooked up?)
- * Otherwise (low_order_LEDs is false), 
- * 		set localzero to LEDs divided by 2 and localLEDs to LEDs.
- *  
+ * Basically the guts of main() in Larson.cpp, but we have to pick the
+ * right table first.
+ * 
+ * Start the frame clock at the start of the current frame, delaymils 
+ * per frame. For the first workers that's scan_epoch. A restarted 
+ * worker starts later, and if we started its clock at scan_epoch, it
+ * would count every frame it missed as an overrun.
+ * 
  * Loop as long as running is true. It's set false by the signal handler.
- * (This means we may get as much as one full scan between the signal
- * being caught and scan exiting. That's ok.)
- * 		If localstart_low is TRUE
- * 			Scan Low to High LED #. Starting with localzero, 
- * 				turn the LED on, 
- * 				wait delaymils, 
- * 				then turn the previous LED off.
- * 		else set localstart_low TRUE.
- * 			(start_low and localstart_low only effect the first scan.)
- * 			Scan from high to low
- * 				Switch the current LED on, 
- * 				Wait delaymils, 
- * 				then switch the previous LED off. 
+ * 		Work out which frame this is from the time since scan_epoch.
+ * 		Since every process gets the same number for the same frame,
+ * 		the number picks which frame of our table to show, too, with
+ * 		table_index(). That way a worker that dropped frames, or was
+ * 		restarted, picks up exactly where it should be, and the number
+ * 		we stamp the frame with is always the one that picked it: when
+ * 		the flusher sees every stamp match, every segment really is at
+ * 		the same point in the scan.
+ * 		Write that frame into our segment of the shared frame, with 
+ * 		its number.
+ * 		Wait for our frame clock.
  */
-void scan(bool low_order_LEDs,bool start_low){
-	int c=0;			
-	int localLEDs;
-	int localzero;
-	bool localstart_low=start_low;
-	
-	//set up localzero and localLEDs
-	if (low_order_LEDs){
-		localzero=0;
-		localLEDs=(LEDs/2);
-	}else{
-		localzero=(LEDs/2);
-		localLEDs=LEDs;
-	}
+void scan(int segment){
+	int64_t frame_start_ns=timespec_ns(scan_epoch)+frame_number()*delaymils*1000000LL;
+	timespec frame_start;
+	frame_start.tv_sec=frame_start_ns/1000000000LL;
+	frame_start.tv_nsec=frame_start_ns%1000000000LL;
+	frame_clock.start(delaymils,frame_start);
+
 	while(running){ //loop forever as long as running is true.
-		if (localstart_low){
-			//if localstart_low is true, loop from localzero to 
-			// localLEDs - "scan" from low LED # to high.
-			for (c=localzero;c<localLEDs;c++){
-				//cout << "switching" << pins[c] <<"\n"<< flush;
-				digitalWrite(pins[c],LOW);
-				delay(delaymils);
-				if (c>localzero) digitalWrite(pins[c-1],HIGH);
-			}
-		}else{
-			//if localstart_low was false, we skipped the low-to-high
-			//part of the scan and came here. We only want this to 
-			//happen on the first scan, so when we GET here, set
-			//localstart_low true. Then do the high-to-low part
-			//of the scan as usual.
-			localstart_low=TRUE;
-		}
-		
-		//loop from localLEDs to localzero - scan from high LED # to low.
-		for (c=localLEDs-1;c>=localzero;c--){
-			//cout << "switching" << pins[c] <<"\n"<< flush;
-			digitalWrite(pins[c],LOW);
-			delay(delaymils);
-			if (c<localLEDs)digitalWrite(pins[c+1],HIGH);
-		}
+		int64_t frame=frame_number(); //the stamp, and so the frame.
+		shared_frame.write(segment,worker_tables[segment].frames[table_index(segment,frame)],frame);
+		frame_clock.wait();
 	}
 }
 
@@ -175,63 +198,192 @@ void SIGINT_handler(int signal_number){
 	running=false;
 }
 
+/* pid_t start_worker(int segment)
+ * Parameters:
+ * 	segment is which worker to start.
+ * Returns: the new worker's process ID, or -1 if fork() failed.
+ * 
+ * How it works:
+ * -------------
+ * Flush cout first, or the child gets a copy of whatever's waiting in
+ * it and prints it again. fork(). The child starts with a fresh frame
+ * clock: a restarted worker is forked from the supervisor, and would
+ * otherwise inherit the supervisor's histogram and worst frame. Then
+ * it pins itself to its CPU, scans until SIGINT, tells the user how 
+ * late its worst frame was, and exits. It never returns from here. 
+ * The parent just returns the child's process ID.
+ */
+pid_t start_worker(int segment){
+	cout<<flush;
+	pid_t process_id=fork();
+	if (process_id!=0) return process_id; //parent, or fork() failed.
+	
+	frame_clock=frame_clock_class(); //none of the supervisor's history.
+	int cpu=realtime_cpu_for(segment);
+	if (!realtime_pin_process(cpu)) cpu=-1;
+	scan(segment);
+	cout<<"Worker "<<segment<<" (CPU "<<cpu<<"): worst frame "
+		<<frame_clock.worst_late_ns()/1000<<"us late.\n"<<flush;
+	exit(0);
+}
+
+/* void reap_workers()
+ * 
+ * How it works:
+ * -------------
+ * Ask waitpid() about any worker that has exited, without waiting for
+ * one. For each, find which segment it was. If we're still running,
+ * it died on us: tell the user how, and start it again, unless it's 
+ * already been restarted max_restarts times. Then we give up on it,
+ * and its LEDs stay as they were.
+ */
+void reap_workers(){
+	int status;
+	pid_t process_id;
+	while ((process_id=waitpid(-1,&status,WNOHANG))>0){
+		int segment=0;
+		while (segment<worker_count && worker_pids[segment]!=process_id) segment++;
+		if (segment==worker_count) continue; //not one of ours.
+		worker_pids[segment]=0;
+		if (!running) continue;
+		
+		if (WIFSIGNALED(status)){
+			cout<<"Worker "<<segment<<" killed by signal "<<WTERMSIG(status);
+		}else{
+			cout<<"Worker "<<segment<<" exited with status "<<WEXITSTATUS(status);
+		}
+		if (worker_restarts[segment]==max_restarts){
+			cout<<". Restarted too often; giving up on it.\n"<<flush;
+			continue;
+		}
+		worker_restarts[segment]++;
+		worker_pids[segment]=start_worker(segment);
+		if (worker_pids[segment]<0) worker_pids[segment]=0;
+		cout<<". Restarted.\n"<<flush;
+	}
+}
+
 /*
  * Main()
- * Parameters: none
+ * Parameters: argc and argv. The first argument, if there is one, is
+ * 		the number of workers. The second is how many seconds to run.
  * Returns: an integer to tell the system its exit status.
  * 
  * How it works:
  * -------------
- * Declare the variable process_id as type pid_t. This is an integer
- * of some kind, but what kind exactly is platform specific. We 
- * initialize that variable with a call to fork(), which starts a
- * child process identical to the parent we're in, with all the same
- * variables except process_id. The child's process id is stored in the
- * parent's process_id variable. The child's own process_id varabile
- * will be set to 0. Forked processes start at the next 
- * 
- * Initialize wiringPi. Both the parent and child processes must do this.
- * If process_id is greater than 0, we're the parent process.
- * 		Initialize the pins. Only needs to happen once - there's only
- * 		one set.
- * 		scan the low order LEDs, starting with the highest one (LED 10,
- * 		most likely. (low_order_leds true, start_low false)
- * else
- * 		We don't need to initialize the pins again, and we already
- * 		initialized wiringPi, so just scan the high order LEDs starting
- * 		with the lowest one. (low_order_leds false, start_low true) 
- * 
- * Scan only returns if the signal handler sets running to false, so
- * if scan returns, turn all the LEDs off and exit.
+ * Connect up the signal handler. The workers inherit it when we fork.
+ * 
+ * Initialize wiringPi and map the GPIO registers. Only the supervisor
+ * writes them, but doing it before we fork means that if we can't, 
+ * there are no workers to clean up. Initialize the pins.
+ * 
+ * For each worker, work out its segment of the array (worker w gets 
+ * LEDs w*LEDs/workers up to (w+1)*LEDs/workers) and build its table.
+ * Set up the shared frame with one segment per worker. This has to
+ * happen before the fork so every process maps the same memory. Exit
+ * if we can't.
+ * 
+ * Set scan_epoch to now. Every worker gets a copy of it when we fork,
+ * so their frame clocks count from the same moment.
+ * 
+ * Start the workers. Each fork() starts a child process identical to 
+ * us, with all the same variables, which goes off and scans its 
+ * segment. See start_worker().
+ * 
+ * Then supervise. Start our own frame clock at scan_epoch, and every 
+ * frame,
+ * 		flush the shared frame to the pins, once every worker has 
+ * 		written this frame, or flush_wait_ns from now, whichever comes
+ * 		first,
+ * 		restart any worker that has died,
+ * 		if we were given a time limit and it's up, stop,
+ * 		wait for the frame clock.
+ * 
+ * When SIGINT sets running false, turn all the LEDs off. Send every 
+ * worker SIGINT (from the keyboard they got it already, but a kill of
+ * just the supervisor doesn't reach them) and wait for each. Print our
+ * frame clock's lateness histogram and the shared frame's counters, 
+ * and exit.
 */
   
-int main(void){
+int main(int argc,char *argv[]){
+	int seconds=0;
+	if (argc>1) worker_count=atoi(argv[1]);
+	if (argc>2) seconds=atoi(argv[2]);
+	if (worker_count<1 || worker_count>LEDs){
+		cout<<"Workers must be 1 to "<<LEDs<<". Exiting."<<endl;
+		return 1;
+	}
+	
 	//connect up the signal handler to fire on SIGINT.
 	signal(SIGINT,SIGINT_handler);
 	
-	//fork the child process and store its PID in process_id on the
-	//parent process. The fork() call returns 0 to the child process.
-	pid_t process_id=fork();
-	
 	//Initialize wiringPi
 	wiringPiSetupGpio();
 	
-	if (process_id>0){//parent process
-			//Initialize Pins.
+	//Map the GPIO registers. Only the supervisor writes them.
+	if (!gpio.setup()){
+		cout<<"Unable to map "<<gpiomem_path<<". Exiting."<<endl;
+		return 1;
+	}
+	
+	//Initialize Pins.
 	for (int c=0;c<LEDs;c++){
 		//cout<<"Setting pin "<<pins[c]<<"to output\n"<<flush;
-		pinMode (pins[c],OUTPUT);
-		digitalWrite(pins[c],HIGH);
+		gpio.output_mode(pins[c]);
+	}
+	
+	//Build each worker's table, and map the shared frame while 
+	//there's only one of us.
+	uint32_t segment_masks[LEDs];
+	for (int w=0;w<worker_count;w++){
+		int first=w*LEDs/worker_count;
+		int last=(w+1)*LEDs/worker_count;
+		worker_tables[w]=make_larson_table(pins,first,last);
+		segment_masks[w]=worker_tables[w].all_mask;
 	}
-		scan(true,false);
-	}else{ //child process
-		scan(false,true);
+	if (!shared_frame.setup(segment_masks,worker_count)){
+		cout<<"Unable to set up the shared frame. Exiting."<<endl;
+		return 1;
 	}
-	//If we get here, scan has exited, most likely because the signal 
-	//handler has set running to false. So turn all the LEDs off and 
-	//exit.
-	for (int c=0;c<LEDs;c++){
-		digitalWrite(pins[c],HIGH);
-	}	
+	gpio.write_leds(0,shared_frame.mask());
+	
+	//Every process counts its frames from right now.
+	scan_epoch=clock_now();
+	
+	//Start the workers.
+	for (int w=0;w<worker_count;w++){
+		worker_pids[w]=start_worker(w);
+		if (worker_pids[w]<0){
+			cout<<"Unable to start worker "<<w<<".\n"<<flush;
+			worker_pids[w]=0;
+			running=false;
+		}
+	}
+	cout<<"Supervising "<<worker_count<<" workers.\n"<<flush;
+	
+	//Supervise.
+	frame_clock.start(delaymils,scan_epoch);
+	while(running){
+		int64_t frame=frame_number();
+		shared_frame.flush(gpio,frame,flush_wait_ns);
+		reap_workers();
+		if (seconds>0 && frame>=seconds*1000LL/delaymils) running=false;
+		frame_clock.wait();
+	}
+	
+	//If we get here, the signal handler (or the time limit) has set
+	//running to false. So turn all the LEDs off, and stop the workers.
+	gpio.write_leds(0,shared_frame.mask());
+	for (int w=0;w<worker_count;w++){
+		if (worker_pids[w]>0){
+			kill(worker_pids[w],SIGINT);
+			waitpid(worker_pids[w],NULL,0);
+		}
+	}
+	
+	//Show how late our frames were, and how the sharing went.
+	frame_clock.dump("Supervisor");
+	shared_frame.dump("Shared frame");
 	return 0;
 }
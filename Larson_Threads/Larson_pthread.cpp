@@ -34,6 +34,9 @@
  * GPIO pins. pthread.h gives us the Linux thread library. It's included
  * in wiringPi too, so we don't //technically// have to include it here,
  * but it's bad business to depend on declarations in other libraries.
+ * realtime.h has what we need to run the eyes as real time threads, 
+ * pin_trace.h records every pin either eye changes, 
+ * and cstring gives us strcmp() to look for the --realtime option.
  * 
  * We define LEDs as 20, both to set the index of the pins array, and 
  * as the maximum index value of the loop that reads it.
@@ -42,11 +45,18 @@
 */
 
 #include <iostream>
-#include <csignal>
 #include <wiringPi.h>
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../larson/larson_frames.h"
+#include "../frame_clock/frame_clock.h"
+#include "../stop_signal/stop_signal.h"
+#include "../pin_trace/pin_trace.h"
+#include "../realtime/realtime.h"
 #include <pthread.h>
+#include <cstring>
 #define LEDs 20
 #define delaymils 40
+#define trace_path "larson_trace.bin" //where the pin trace gets dumped.
 
 /* 
  * We're only using one namespace in this program, so it's safe to set
@@ -60,9 +70,24 @@ using namespace std;
  * order they're plugged into the LED arrays to its own index value (from 
  * 0 to LEDs.)
 */ 
-int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
-volatile bool running=true;
-pthread_mutex_t running_lock; //declare our mutex.
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+
+/*
+ * Each eye scans its own half of the array, so each gets its own table
+ * of frames, worked out by the compiler. See larson_frames.h. 
+*/
+constexpr larson_table low_table=make_larson_table(pins,0,LEDs/2);
+constexpr larson_table high_table=make_larson_table(pins,LEDs/2,LEDs);
+static_assert(check_larson_table(low_table,pins,0,LEDs/2),
+			  "pins[] does not produce a valid low order scan.");
+static_assert(check_larson_table(high_table,pins,LEDs/2,LEDs),
+			  "pins[] does not produce a valid high order scan.");
+gpio_register_class gpio; //the mapped GPIO registers.
+frame_clock_class eye_clock[2]; //one frame clock per eye, low then high.
+timespec scan_epoch; //when the scan started. Both eyes count from here.
+bool realtime_mode=false; //set by the --realtime option.
+stop_signal_class stop_signal; //SIGINT, without a signal handler.
+pin_trace_class pin_trace; //every pin either eye changes. See pin_trace.h.
 
 /* void scan(bool low_order_LEDs, bool start_low)
  * Parameters:
@@ -76,91 +101,44 @@ pthread_mutex_t running_lock; //declare our mutex.
  * 
  * How it Works:
  * -------------
- * Basically the guts of main() in Larson.cpp, but we have to do some
- * processing of local variables first.
- * Initialize c at 0 for safety. 
+ * Basically the guts of main() in Larson.cpp, but we have to pick the
+ * right table first.
  * 
- * Declare localLEDs and localzero. These are the maximum and minimum 
- * leds this particular instantiation of scan should scan between.
- * Also declare local_running, so we can confine our access to running
- * to one spot.
+ * Point table at low_table if we were passed low_order_LEDs as true,
+ * otherwise at high_table. 
  * 
- * Initialize localstart_low to start_low. If it's false, we start high
- * on the first scan.
+ * Initialize first, the frame we start on, and c, the frame we're on.
+ * Frames 0 to length/2-1 of the table are the low to high scan, and
+ * the rest are high to low. So if start_low is false, start at
+ * length/2 and we skip the first low-to-high scan, just like before.
  * 
- * Set up localzero and localLEDs. 
- * If we were passed low_order_LEDs as true, 
- * 		set localzero to 0 and localLEDs to LEDs divided by 2. (This 
- * 		value is probably 10, but who knows how many LEDs those wiley 
- * 		users have hooked up?)
- * Otherwise (low_order_LEDs is false), 
- * 		set localzero to LEDs divided by 2 and localLEDs to LEDs.
- *  
- * Loop as long as local_running is true. If running is set false by
- * the signal handler, local_running will be set that way also.
- * (This means we may get as much as one full scan between the signal
- * being caught and scan exiting. That's ok.)
- * 		try the mutex lock on running_lock. If we can lock it
- * 			set local_running to running
- * 			unlock running_lock.
- * 		If localstart_low is TRUE
- * 			Scan Low to High LED #. Starting with localzero, 
- * 				turn the LED on, 
- * 				wait delaymils, 
- * 				then turn the previous LED off.
- * 		else set localstart_low TRUE.
- * 			(start_low and localstart_low only effect the first scan.)
- * 			Scan from high to low
- * 				Switch the current LED on, 
- * 				Wait delaymils, 
- * 				then switch the previous LED off. 
+ * Start our eye's frame clock at scan_epoch, delaymils per frame.
+ * 
+ * Loop until the stop signal goes off.
+ * 		Write frame c to our half of the LEDs, and record the pins
+ * 		that changed in the pin trace.
+ * 		Wait for our frame clock. It counts frames from scan_epoch, 
+ * 		so this eye stays in step with the other one no matter how
+ * 		long the writes take. It sleeps in stop_signal, so if SIGINT 
+ * 		arrives (or the other eye sees it first), the wait ends right
+ * 		then and returns false, and we're done.
+ * 		Work out c from the frame clock's frame_number(), not by
+ * 		stepping it: if we woke more than a frame late, the clock
+ * 		skipped the frames we missed, and so must we, or we'd fall
+ * 		behind the other eye and the wall clock.
  */
 void scan(bool low_order_LEDs,bool start_low){
-	int c=0;			
-	int localLEDs;
-	int localzero;
-	bool localstart_low=start_low;
-	bool local_running=true;
+	const larson_table &table=low_order_LEDs?low_table:high_table;
+	int first=start_low?0:table.length/2;
+	int c=first;
+	frame_clock_class &frame_clock=eye_clock[low_order_LEDs?0:1];
+	frame_clock.start(delaymils,scan_epoch);
 	
-	//set up localzero and localLEDs
-	if (low_order_LEDs){
-		localzero=0;
-		localLEDs=(LEDs/2);
-	}else{
-		localzero=(LEDs/2);
-		localLEDs=LEDs;
-	}
-
-	while(local_running){ //loop forever as long as local_running is true.
-		if (!pthread_mutex_trylock(&running_lock)){
-			local_running=running;
-			pthread_mutex_unlock(&running_lock);
-		}
-		if (localstart_low){
-			//if localstart_low is true, loop from localzero to 
-			// localLEDs - "scan" from low LED # to high.
-			for (c=localzero;c<localLEDs;c++){
-				//cout << "switching" << pins[c] <<"\n"<< flush;
-				digitalWrite(pins[c],LOW);
-				delay(delaymils);
-				if (c>localzero) digitalWrite(pins[c-1],HIGH);
-			}
-		}else{
-			//if localstart_low was false, we skipped the low-to-high
-			//part of the scan and came here. We only want this to 
-			//happen on the first scan, so when we GET here, set
-			//localstart_low true. Then do the high-to-low part
-			//of the scan as usual.
-			localstart_low=TRUE;
-		}
-		
-		//loop from localLEDs to localzero - scan from high LED # to low.
-		for (c=localLEDs-1;c>=localzero;c--){
-			//cout << "switching" << pins[c] <<"\n"<< flush;
-			digitalWrite(pins[c],LOW);
-			delay(delaymils);
-			if (c<localLEDs)digitalWrite(pins[c+1],HIGH);
-		}
+	while(true){ //loop until we're told to stop.
+		gpio.write_leds(table.frames[c],table.all_mask);
+		pin_trace.record(table.frames[c],table.all_mask);
+		if (!frame_clock.wait(&stop_signal)) break; //SIGINT.
+		c=(first+frame_clock.frame_number())%table.length;
 	}
 }
 
@@ -178,10 +156,12 @@ void scan(bool low_order_LEDs,bool start_low){
  * 
  * How it works:
  * -------------
+ * If we're in real time mode, prefault our stack.
  * call scan, tell it to use the low order LEDs, and to start low.
  * return a NULL pointer.
  */
 void *upper(void *vp){	
+	if (realtime_mode) realtime_prefault_stack();
 	scan(false,true);
 	return(NULL);
 }
@@ -200,49 +180,52 @@ void *upper(void *vp){
  * 
  * How it works:
  * -------------
+ * If we're in real time mode, prefault our stack.
  * call scan, tell it to use the high order LEDs, and to start low.
  * return a NULL pointer.
  */
 void *lower(void *vp){
+	if (realtime_mode) realtime_prefault_stack();
 	scan(true,false);
 	return(NULL);
 }
 
-/* SIGINT_handler
- * Parameters:
- * signal_number, an integer
- * Returns: nothing.
- * 
- * How it works
- * ------------
- * Very much like a wiringpiISR interrupt handler, signal_handler is 
- * called by a system event, namely a signal being raised. In this
- * case we're looking for SIGINT, a macro for the signal we get when
- * ctrl-c is pressed in the geany run window.
- * This handler only fires if SIGINT is raised, so no decoding logic
- * is needed.
- */
-void SIGINT_handler(int signal_number){
-	pthread_mutex_lock(&running_lock);
-	running=false;
-	pthread_mutex_unlock(&running_lock);
-}
-
 /*
  * Main()
- * Parameters: none
+ * Parameters: argc and argv. If the first argument is --realtime, we
+ * run the eyes in real time mode.
  * Returns: an integer to tell the system its exit status. We're 
  * actually using this status when we test to make sure the pthreads 
  * started properly.
  * 
  * How it works:
  * -------------
+ * Set up stop_signal, which blocks SIGINT and hands it to us through a
+ * file descriptor instead. Since that takes the place of a signal 
+ * handler, it has to be done before any threads exist.
+ * 
+ * Dump the pin trace to trace_path whenever SIGUSR1 arrives, so we
+ * can look at what the eyes did without stopping them.
+ * 
  * Set up wiringPi to use BCM GPIO numbers
  * 
  * Declare two pthread IDs, upper_thread and lower_thread.
  * 
+ * Map the GPIO registers, exiting if we can't.
+ * 
  * Initialize the GPIO pins as outputs and set them HIGH (off)
  * 
+ * If we were asked for real time mode, 
+ * 		lock all our memory into RAM, and
+ * 		set up a thread attribute object for each eye: SCHED_FIFO at
+ * 		realtime_priority, each pinned to its own CPU.
+ * 		If any of that fails (usually because we're not root), tell 
+ * 		the user and exit.
+ * Otherwise the attribute pointers stay NULL, which gets the defaults.
+ * 
+ * Set scan_epoch to now, so both threads' frame clocks start counting
+ * from the same moment.
+ * 
  * Tell the user we're creating the upper thread, then call 
  * pthread_create and create the thread. Notify the user and exit if 
  * we fail. This thread will light the LEDs from 10-20.
@@ -254,17 +237,27 @@ void SIGINT_handler(int signal_number){
  * Make a pithy comment to the user so they know the main thread is
  * proceeding on its own.
  * 
- * For our main thread, loop as long as running is true. Not much else
- * for the main thread to do. We could have processed one of the "eyes"
- * here, obviously.  
- * Check running every 100ms as long as it's true. If it's false, go
- * through all the pins again and set them HIGH to turn them off. Then
- * exit the process which will take the pthreads we created with it.
+ * For our main thread, wait on the stop signal. Not much else for the
+ * main thread to do. We could have processed one of the "eyes" here,
+ * obviously. When it goes off, the eyes stop too, in the middle of
+ * their frames. Join them, go through all the pins again and set them
+ * HIGH to turn them off, and tell the user how long it took from the
+ * signal being read to the LEDs going off. Print the lateness histogram
+ * from each eye's frame clock, and the worst wakeup latency of either
+ * eye, so we can compare real time mode with the defaults on a busy
+ * Pi. Dump the pin trace to trace_path. Then exit.
  */
   
-int main(void){
-	//hook up the SIGINT signal handler.
-	signal(SIGINT,SIGINT_handler);
+int main(int argc,char *argv[]){
+	//Take SIGINT through stop_signal. This has to happen before we 
+	//create any threads, so they don't get SIGINT delivered to them.
+	if (!stop_signal.setup()){
+		cout<<"Unable to set up the stop signal. Exiting.\n"<<flush;
+		return 1;
+	}
+	
+	//kill -USR1 dumps the pin trace on demand.
+	pin_trace.dump_on_signal(SIGUSR1,trace_path);
 	
 	//Initialize wiringPi
 	wiringPiSetupGpio();
@@ -273,26 +266,52 @@ int main(void){
 	pthread_t upper_thread;
 	pthread_t lower_thread;
 	
-	//Initialize the running_lock mutex
-	pthread_mutex_init(&running_lock,NULL);
+	//Map the GPIO registers.
+	if (!gpio.setup()){
+		cout<<"Unable to map "<<gpiomem_path<<". Exiting."<<endl;
+		return 1;
+	}
 	
 	//Initialize Pins.
 	for (int c=0;c<LEDs;c++){
 		//cout<<"Setting pin "<<pins[c]<<"to output\n"<<flush;
-		pinMode (pins[c],OUTPUT);
-		digitalWrite(pins[c],HIGH);
+		gpio.output_mode(pins[c]);
 	}
+	gpio.write_leds(0,low_table.all_mask|high_table.all_mask);
+	
+	//Set up real time mode if we were asked to.
+	pthread_attr_t upper_attr;
+	pthread_attr_t lower_attr;
+	pthread_attr_t *upper_attr_ptr=NULL; //NULL means default attributes.
+	pthread_attr_t *lower_attr_ptr=NULL;
+	if (argc>1 && strcmp(argv[1],"--realtime")==0){
+		realtime_mode=true;
+		if (!realtime_lock_memory() ||
+			!realtime_thread_attr(&upper_attr,realtime_priority,realtime_cpu_for(0)) ||
+			!realtime_thread_attr(&lower_attr,realtime_priority,realtime_cpu_for(1))){
+			cout<<"Unable to set up real time mode. Are you root?\n"<<flush;
+			return 1;
+		}
+		upper_attr_ptr=&upper_attr;
+		lower_attr_ptr=&lower_attr;
+		cout<<"Real time mode: SCHED_FIFO priority "<<realtime_priority
+			<<", CPUs "<<realtime_cpu_for(0)<<" and "<<realtime_cpu_for(1)
+			<<".\n"<<flush;
+	}
+	
+	//Both eyes count their frames from right now.
+	scan_epoch=clock_now();
 	
 	//Start the upper thread.
 	cout<<"Creating Thread Upper\n"<<flush;
-	if(pthread_create(&upper_thread,NULL,upper,NULL)){
+	if(pthread_create(&upper_thread,upper_attr_ptr,upper,NULL)){
 		cout<<"Error Creating thread.\n"<<flush;
 		return 1;
 	}
 	
 	//Start the lower thread.
 	cout<<"Creating Thread Lower\n";
-	if(pthread_create(&lower_thread,NULL,lower,NULL)){
+	if(pthread_create(&lower_thread,lower_attr_ptr,lower,NULL)){
 		cout<<"Error Creating thread.\n"<<flush;
 		return 1;
 	}
@@ -300,17 +319,37 @@ int main(void){
 	//Send a message to the user from the main thread (this thread)
 	cout<<"It's really hard to see like this...\n"<<flush;
 	
-	//Join the lower thread and block (sit here) until it exits. Then we
-	//cancel the upper thread explicitly and fall through to the LED 
-	//cleanup code. Could we have just monitored running from the main
-	//thread and canceled both upper_thread and lower_thread from here
-	//when it changed? Yes. But it makes a better demo this way.
+	//Wait for SIGINT. Both eyes see it through stop_signal at the 
+	//same moment we do, stop in the middle of whatever frame they're
+	//in, and exit. Join them both and fall through to the LED cleanup
+	//code.
+	stop_signal.wait();
 	pthread_join(lower_thread,NULL);
-	pthread_cancel(upper_thread);
+	pthread_join(upper_thread,NULL);
 
 	//Turn off all the LEDs by setting their pins HIGH.
-	for (int c=0;c<LEDs;c++){
-		digitalWrite(pins[c],HIGH);
+	gpio.write_leds(0,low_table.all_mask|high_table.all_mask);
+	cout<<"LEDs off "<<(timespec_ns(clock_now())-stop_signal.stop_time_ns())/1000
+		<<"us after we read SIGINT.\n"<<flush; //not counting the wakeup.
+	
+	//Show how late each eye's frames were.
+	eye_clock[0].dump("Lower eye");
+	eye_clock[1].dump("Upper eye");
+	
+	//Dump the pin trace. pin_trace_vcd turns it into a VCD file.
+	if (pin_trace.dump(trace_path)){
+		cout<<"Pin trace ("<<pin_trace.recorded()<<" transitions) dumped to "
+			<<trace_path<<".\n"<<flush;
+	}else{
+		cout<<"Unable to dump the pin trace to "<<trace_path<<".\n"<<flush;
+	}
+	int64_t worst_ns=eye_clock[0].worst_late_ns();
+	if (eye_clock[1].worst_late_ns()>worst_ns) worst_ns=eye_clock[1].worst_late_ns();
+	cout<<"Worst wakeup latency: "<<worst_ns/1000<<"us (real time mode "
+		<<(realtime_mode?"on":"off")<<").\n"<<flush;
+	if (realtime_mode){
+		pthread_attr_destroy(&upper_attr);
+		pthread_attr_destroy(&lower_attr);
 	}
 	
 	//Tell the user we're done and exit the whole process,
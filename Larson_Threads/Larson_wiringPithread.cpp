@@ -40,10 +40,15 @@
 */
 
 #include <iostream>
-#include <csignal>
 #include <wiringPi.h>
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../larson/larson_frames.h"
+#include "../frame_clock/frame_clock.h"
+#include "../stop_signal/stop_signal.h"
+#include "../pin_trace/pin_trace.h"
 #define LEDs 20
 #define delaymils 40
+#define trace_path "larson_trace.bin" //where the pin trace gets dumped.
 
 /* 
  * We're only using one namespace in this program, so it's safe to set
@@ -57,8 +62,24 @@ using namespace std;
  * order they're plugged into the LED arrays to its own index value (from 
  * 0 to LEDs.)
 */ 
-int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
-volatile bool running=true;
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+
+/*
+ * Each eye scans its own half of the array, so each gets its own table
+ * of frames, worked out by the compiler. See larson_frames.h. 
+*/
+constexpr larson_table low_table=make_larson_table(pins,0,LEDs/2);
+constexpr larson_table high_table=make_larson_table(pins,LEDs/2,LEDs);
+static_assert(check_larson_table(low_table,pins,0,LEDs/2),
+			  "pins[] does not produce a valid low order scan.");
+static_assert(check_larson_table(high_table,pins,LEDs/2,LEDs),
+			  "pins[] does not produce a valid high order scan.");
+gpio_register_class gpio; //the mapped GPIO registers.
+frame_clock_class eye_clock[2]; //one frame clock per eye, low then high.
+timespec scan_epoch; //when the scan started. Both eyes count from here.
+stop_signal_class stop_signal; //SIGINT, without a signal handler.
+pin_trace_class pin_trace; //every pin either eye changes. See pin_trace.h.
+std::atomic<int> eyes_scanning{2}; //each eye counts this down as it exits.
 
 /* void scan(bool low_order_LEDs, bool start_low)
  * Parameters:
@@ -72,85 +93,47 @@ volatile bool running=true;
  * 
  * How it Works:
  * -------------
- * Basically the guts of main() in Larson.cpp, but we have to do some
- * processing of local variables first.
- * Initialize c at 0 for safety. 
+ * Basically the guts of main() in Larson.cpp, but we have to pick the
+ * right table first.
+ * 
+ * Point table at low_table if we were passed low_order_LEDs as true,
+ * otherwise at high_table. 
  * 
- * Declare localLEDs and ocalzero. These are the maximum and minimum 
- * leds this particular instantiation of scan should scan between.
+ * Initialize first, the frame we start on, and c, the frame we're on.
+ * Frames 0 to length/2-1 of the table are the low to high scan, and
+ * the rest are high to low. So if start_low is false, start at
+ * length/2 and we skip the first low-to-high scan, just like before.
  * 
- * Initialize localstart_low to start_low. If it's false, we start high
- * on the first scan.
+ * Start our eye's frame clock at scan_epoch, delaymils per frame.
  * 
- * Set up localzero and localLEDs. 
- * If we were passed low_order_LEDs as true, 
- * 		set localzero to 0 and localLEDs to LEDs divided by 2. (This 
- * 		value is probably 10, but who knows how many LEDs those wiley 
- * 		users have hooked up?)
- * Otherwise (low_order_LEDs is false), 
- * 		set localzero to LEDs divided by 2 and localLEDs to LEDs.
- *  
- * Loop as long as running is true. It's set false by the signal handler.
- * (This means we may get as much as one full scan between the signal
- * being caught and scan exiting. That's ok.)
- * 		If localstart_low is TRUE
- * 			Scan Low to High LED #. Starting with localzero, 
- * 				turn the LED on, 
- * 				wait delaymils, 
- * 				then turn the previous LED off.
- * 		else set localstart_low TRUE.
- * 			(start_low and localstart_low only effect the first scan.)
- * 			Scan from high to low
- * 				Switch the current LED on, 
- * 				Wait delaymils, 
- * 				then switch the previous LED off. 
+ * Loop until the stop signal goes off.
+ * 		Write frame c to our half of the LEDs, and record the pins
+ * 		that changed in the pin trace.
+ * 		Wait for our frame clock. It counts frames from scan_epoch, 
+ * 		so this eye stays in step with the other one no matter how
+ * 		long the writes take. It sleeps in stop_signal, so if SIGINT 
+ * 		arrives (or the other eye sees it first), the wait ends right
+ * 		then and returns false, and we're done.
+ * 		Work out c from the frame clock's frame_number(), not by
+ * 		stepping it: if we woke more than a frame late, the clock
+ * 		skipped the frames we missed, and so must we, or we'd fall
+ * 		behind the other eye and the wall clock.
+ * Count eyes_scanning down, so main() knows we've stopped writing.
  */
 void scan(bool low_order_LEDs,bool start_low){
-	int c=0;			
-	int localLEDs;
-	int localzero;
-	bool localstart_low=start_low;
-	bool local_running=true;
+	const larson_table &table=low_order_LEDs?low_table:high_table;
+	int first=start_low?0:table.length/2;
+	int c=first;
+	frame_clock_class &frame_clock=eye_clock[low_order_LEDs?0:1];
+	frame_clock.start(delaymils,scan_epoch);
 	
-	//set up localzero and localLEDs
-	if (low_order_LEDs){
-		localzero=0;
-		localLEDs=(LEDs/2);
-	}else{
-		localzero=(LEDs/2);
-		localLEDs=LEDs;
-	}
-
-	while(local_running){ //loop forever as long as local_running is true.
-		piLock(0); //try to lock a mutex for running.
-		local_running=running;
-		piUnlock(0);
-		if (localstart_low){
-			//if localstart_low is true, loop from localzero to 
-			// localLEDs - "scan" from low LED # to high.
-			for (c=localzero;c<localLEDs;c++){
-				//cout << "switching" << pins[c] <<"\n"<< flush;
-				digitalWrite(pins[c],LOW);
-				delay(delaymils);
-				if (c>localzero) digitalWrite(pins[c-1],HIGH);
-			}
-		}else{
-			//if localstart_low was false, we skipped the low-to-high
-			//part of the scan and came here. We only want this to 
-			//happen on the first scan, so when we GET here, set
-			//localstart_low true. Then do the high-to-low part
-			//of the scan as usual.
-			localstart_low=TRUE;
-		}
-		
-		//loop from localLEDs to localzero - scan from high LED # to low.
-		for (c=localLEDs-1;c>=localzero;c--){
-			//cout << "switching" << pins[c] <<"\n"<< flush;
-			digitalWrite(pins[c],LOW);
-			delay(delaymils);
-			if (c<localLEDs)digitalWrite(pins[c+1],HIGH);
-		}
+	while(true){ //loop until we're told to stop.
+		gpio.write_leds(table.frames[c],table.all_mask);
+		pin_trace.record(table.frames[c],table.all_mask);
+		if (!frame_clock.wait(&stop_signal)) break; //SIGINT.
+		c=(first+frame_clock.frame_number())%table.length;
 	}
+	eyes_scanning--;
 }
 
 /* PI_THREAD (upper)
@@ -201,27 +184,6 @@ PI_THREAD(upper){
 	return(NULL);
 }
 
-/* SIGINT_handler
- * Parameters:
- * signal_number, an integer
- * Returns: nothing.
- * 
- * How it works
- * ------------
- * Very much like a wiringpiISR interrupt handler, signal_handler is 
- * called by a system event, namely a signal being raised. In this
- * case we're looking for SIGINT, a macro for the signal we get when
- * ctrl-c is pressed in the geany run window.
- * This handler only fires if SIGINT is raised, so no decoding logic
- * is needed.
- */
- 
-void SIGINT_handler(int signal_number){
-	piLock(0); //try to piLock a mutex for running.
-	running=false;
-	piUnlock(0);
-}
-
 /*
  * Main()
  * Parameters: none
@@ -231,10 +193,22 @@ void SIGINT_handler(int signal_number){
  * 
  * How it works:
  * -------------
+ * Set up stop_signal, which blocks SIGINT and hands it to us through a
+ * file descriptor instead. Since that takes the place of a signal 
+ * handler, it has to be done before any threads exist.
+ * 
+ * Dump the pin trace to trace_path whenever SIGUSR1 arrives, so we
+ * can look at what the eyes did without stopping them.
+ * 
  * Set up wiringPi to use BCM GPIO numbers
  * 
+ * Map the GPIO registers, exiting if we can't.
+ * 
  * Initialize the GPIO pins as outputs and set them HIGH (off)
  * 
+ * Set scan_epoch to now, so both threads' frame clocks start counting
+ * from the same moment.
+ * 
  * Tell the user we're creating the upper thread, then call 
  * piThread_Create and create the thread. Notify the user and exit if 
  * we fail. This thread will light the LEDs from 10-20.
@@ -246,27 +220,46 @@ void SIGINT_handler(int signal_number){
  * Make a pithy comment to the user so they know the main thread is
  * proceeding on its own.
  * 
- * For our main thread, loop as long as running is true. Not much else
- * for the main thread to do. We could have processed one of the "eyes"
- * here, obviously.  
- * Check running every 100ms as long as it's true. If it's false, go
- * through all the pins again and set them HIGH to turn them off. Then
- * exit the process which will take the pthreads we created with it.
+ * For our main thread, wait on the stop signal. Not much else for the
+ * main thread to do. We could have processed one of the "eyes" here,
+ * obviously. When it goes off, the eyes stop too, in the middle of
+ * their frames. We can't join a piThread, so wait for eyes_scanning to
+ * count down to 0 instead. Then go through all the pins again and set
+ * them HIGH to turn them off, and print the lateness histogram from 
+ * each eye's frame clock. Tell the user how long it took from the 
+ * signal being read to the LEDs going off. Dump the pin trace to
+ * trace_path. Then exit the process.
  */
   
 int main(void){
-	//hook up the SIGINT signal handler.
-	signal(SIGINT,SIGINT_handler);
+	//Take SIGINT through stop_signal. This has to happen before we 
+	//create any threads, so they don't get SIGINT delivered to them.
+	if (!stop_signal.setup()){
+		cout<<"Unable to set up the stop signal. Exiting.\n"<<flush;
+		return 1;
+	}
+	
+	//kill -USR1 dumps the pin trace on demand.
+	pin_trace.dump_on_signal(SIGUSR1,trace_path);
 	
 	//Initialize wiringPi
 	wiringPiSetupGpio();
 	
+	//Map the GPIO registers.
+	if (!gpio.setup()){
+		cout<<"Unable to map "<<gpiomem_path<<". Exiting."<<endl;
+		return 1;
+	}
+	
 	//Initialize Pins.
 	for (int c=0;c<LEDs;c++){
 		//cout<<"Setting pin "<<pins[c]<<"to output\n"<<flush;
-		pinMode (pins[c],OUTPUT);
-		digitalWrite(pins[c],HIGH);
+		gpio.output_mode(pins[c]);
 	}
+	gpio.write_leds(0,low_table.all_mask|high_table.all_mask);
+	
+	//Both eyes count their frames from right now.
+	scan_epoch=clock_now();
 	
 	//Start the upper thread.
 	cout<<"Creating Thread Upper\n"<<flush;
@@ -285,15 +278,27 @@ int main(void){
 	//Send a message to the user from the main thread (this thread)
 	cout<<"It's really hard to see like this...\n"<<flush;
 	
-	//Test running every 100ms to make sure it's still true. When it's
-	//not, the signal handler must have fired, so let the program exit
-	//gracefully. We could also have called scan directly from here
+	//Sleep until SIGINT. The eyes see it at the same moment we do and
+	//stop scanning. We could also have called scan directly from here
 	//in place of one of the threads we started.
-	while(running) delay(100);
+	stop_signal.wait();
+	while(eyes_scanning>0) delay(1); //piThreads can't be joined.
 
 	//Turn off all the LEDs by setting their pins HIGH.
-	for (int c=0;c<LEDs;c++){
-		digitalWrite(pins[c],HIGH);
+	gpio.write_leds(0,low_table.all_mask|high_table.all_mask);
+	cout<<"LEDs off "<<(timespec_ns(clock_now())-stop_signal.stop_time_ns())/1000
+		<<"us after we read SIGINT.\n"<<flush; //not counting the wakeup.
+	
+	//Show how late each eye's frames were.
+	eye_clock[0].dump("Lower eye");
+	eye_clock[1].dump("Upper eye");
+	
+	//Dump the pin trace. pin_trace_vcd turns it into a VCD file.
+	if (pin_trace.dump(trace_path)){
+		cout<<"Pin trace ("<<pin_trace.recorded()<<" transitions) dumped to "
+			<<trace_path<<".\n"<<flush;
+	}else{
+		cout<<"Unable to dump the pin trace to "<<trace_path<<".\n"<<flush;
 	}
 	
 	//Tell the user we're done and exit the whole process, including 
@@ -0,0 +1,228 @@
+ /*
+  * bam_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * bam_bench
+ * This program runs two brightness engines for a few seconds each
+ * against the file-backed stand-in for the GPIO registers, and reports
+ * what they cost and how well they did:
+ * 		bam		bam_engine_class: 8 frames per cycle.
+ * 		pwm		plain software PWM: 255 frames per cycle, one per
+ * 				tick, each lighting every LED whose brightness is
+ * 				higher than the tick number.
+ * Both use the same tick length, so they should flicker at the same
+ * frequency. For each we print:
+ * 		flicker		complete brightness cycles per second, measured.
+ * 		writes/sec	register frames written per second.
+ * 		cpu			CPU time used, as a percentage of one core.
+ * 		duty error	how far the measured brightness of any LED was
+ * 					from what we asked for, in 255ths.
+ * The duty cycle is measured by a sampler thread that reads the level
+ * word at random moments and counts how often each LED was lit.
+ *
+ * Usage: bam_bench [stand-in file] [tick in us] [seconds]
+ * Defaults are /tmp/gpiomem, 16us and 2 seconds. Needs two free cores
+ * for honest numbers, since the engine and the sampler both spin.
+ * Compile with:
+ * 		g++ -O2 -o bam_bench bam_bench.cpp -lpthread
+*/
+
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+#include <sys/resource.h> //getrusage(), for CPU time.
+#include "bam_engine.h"
+
+#define LEDs 20
+
+using namespace std;
+
+int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+uint8_t levels[LEDs]; //the brightness we ask for.
+
+gpio_register_class gpio;
+uint32_t all_mask;
+int64_t tick_ns;
+volatile bool pwm_running=false;
+volatile uint64_t pwm_cycles=0;
+volatile uint64_t pwm_writes=0;
+
+volatile bool sampling=false;
+uint64_t lit_samples[LEDs];
+uint64_t total_samples=0;
+double sampler_cpu=0; //CPU seconds the sampler used, set as it exits.
+
+/* void *pwm_engine(void *vp)
+ * The plain PWM engine, for comparison. For every tick t from 0 to 254
+ * of every cycle, light the LEDs whose level is more than t, and sleep
+ * to the end of the tick. An LED at level 200 is lit for ticks 0 to
+ * 199, 200 ticks out of 255, the same as BAM gives it.
+ */
+void *pwm_engine(void *vp){
+	int64_t deadline=bam_engine_class::now_ns();
+	while (pwm_running){
+		for (int t=0;t<255;t++){
+			uint32_t lit=0;
+			for (int c=0;c<LEDs;c++){
+				if (levels[c]>t) lit|=1u<<pins[c];
+			}
+			gpio.write_leds(lit,all_mask);
+			deadline+=tick_ns;
+			bam_engine_class::sleep_until(deadline);
+		}
+		pwm_writes=pwm_writes+255;
+		pwm_cycles=pwm_cycles+1;
+	}
+	gpio.write_leds(0,all_mask);
+	return(NULL);
+}
+
+/* void *sampler(void *vp)
+ * Read the level word over and over, a random number of spins apart
+ * so we don't lock on to the engine's rhythm, and count how many times
+ * each LED was lit (LOW). On the way out, record how much CPU time
+ * we used, so run() can leave it out of the engine's share.
+ */
+void *sampler(void *vp){
+	unsigned int seed=1;
+	while (sampling){
+		uint32_t levels_now=gpio.read_levels();
+		for (int c=0;c<LEDs;c++){
+			if (!(levels_now & (1u<<pins[c]))) lit_samples[c]++;
+		}
+		total_samples++;
+		for (int spin=rand_r(&seed)%200;spin>0;spin--){
+			__asm__ __volatile__("" ::: "memory"); //don't optimize me away.
+		}
+	}
+	timespec used;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID,&used);
+	sampler_cpu=used.tv_sec+used.tv_nsec/1e9;
+	return(NULL);
+}
+
+double cpu_seconds(){
+	rusage usage;
+	getrusage(RUSAGE_SELF,&usage);
+	return usage.ru_utime.tv_sec+usage.ru_utime.tv_usec/1e6+
+		   usage.ru_stime.tv_sec+usage.ru_stime.tv_usec/1e6;
+}
+
+/* void run(string name, bool use_bam, int seconds)
+ * Run one engine for seconds seconds with the sampler going, then
+ * print its numbers. The sampler's own CPU time is taken out of the
+ * total, since it's not part of the engine.
+ */
+void run(string name,bool use_bam,int seconds){
+	bam_engine_class bam;
+	pthread_t pwm_thread;
+	pthread_t sampler_thread;
+	uint64_t cycles,writes;
+
+	for (int c=0;c<LEDs;c++) lit_samples[c]=0;
+	total_samples=0;
+
+	if (use_bam){
+		bam.setup(&gpio,pins,LEDs,tick_ns);
+		bam.set_brightness(levels);
+	}
+	double cpu_start=cpu_seconds();
+	int64_t start=bam_engine_class::now_ns();
+	if (use_bam){
+		bam.start();
+	}else{
+		pwm_running=true;
+		pthread_create(&pwm_thread,NULL,pwm_engine,NULL);
+	}
+	sampling=true;
+	pthread_create(&sampler_thread,NULL,sampler,NULL);
+
+	sleep(seconds);
+
+	sampling=false;
+	pthread_join(sampler_thread,NULL);
+	if (use_bam){
+		bam.stop();
+		cycles=bam.cycle_count();
+		writes=bam.write_count();
+	}else{
+		pwm_running=false;
+		pthread_join(pwm_thread,NULL);
+		cycles=pwm_cycles;
+		writes=pwm_writes;
+	}
+	double elapsed=(bam_engine_class::now_ns()-start)/1e9;
+	double cpu=cpu_seconds()-cpu_start-sampler_cpu;
+
+	double worst_error=0;
+	for (int c=0;c<LEDs;c++){
+		double measured=255.0*lit_samples[c]/total_samples;
+		double error=measured-levels[c];
+		if (error<0) error=-error;
+		if (error>worst_error) worst_error=error;
+	}
+
+	cout<<name<<": flicker "<<(int)(cycles/elapsed)<<"Hz, "
+		<<(long)(writes/elapsed)<<" writes/sec, cpu "
+		<<(int)(100*cpu/elapsed)<<"%, duty error "<<worst_error
+		<<"/255 ("<<total_samples<<" samples)"<<endl;
+}
+
+/*
+ * Main()
+ * Parameters: optional stand-in file, tick length in us, and seconds
+ * per engine.
+ * Returns 0, or 1 if we can't map the stand-in.
+ *
+ * How it works:
+ * -------------
+ * Map the stand-in file. Fill levels[] with a fading Larson tail: full
+ * brightness at LED 10, halving every LED away from it, so there's
+ * something in every bit plane. Run BAM, then plain PWM, and print.
+ */
+int main(int argc,char *argv[]){
+	const char *path="/tmp/gpiomem";
+	int tick_us=16;
+	int seconds=2;
+	if (argc>1) path=argv[1];
+	if (argc>2) tick_us=atoi(argv[2]);
+	if (argc>3) seconds=atoi(argv[3]);
+	tick_ns=tick_us*1000LL;
+
+	if (!gpio.setup(path)){
+		cout<<"Unable to map "<<path<<". Exiting."<<endl;
+		return 1;
+	}
+	all_mask=gpio_register_class::pin_mask(pins,LEDs);
+	for (int c=0;c<LEDs;c++){
+		gpio.output_mode(pins[c]);
+		int distance=c>10?c-10:10-c;
+		levels[c]=distance>7?1:255>>distance;
+	}
+
+	cout<<"Tick "<<tick_us<<"us, cycle "<<tick_us*255
+		<<"us, expected flicker "<<(int)(1e6/(tick_us*255))<<"Hz."<<endl;
+	run("bam",true,seconds);
+	run("pwm",false,seconds);
+	return 0;
+}
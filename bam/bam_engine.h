@@ -0,0 +1,275 @@
+ /*
+  * bam_engine.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * bam_engine.h
+ * Our LEDs are either on or off. To make one look half as bright, we
+ * switch it on and off faster than the eye can follow, and leave it on
+ * half the time. The obvious way to do that (software PWM) splits each
+ * cycle into 256 ticks and, on every tick, switches off any LED whose
+ * brightness is lower than the tick number. That's 256 writes a cycle.
+ *
+ * Bit angle modulation (BAM) gets the same average with 8 writes. Look
+ * at brightness as 8 bits. Bit 0 is worth 1 tick, bit 1 is worth 2,
+ * bit 7 is worth 128. So split the cycle into 8 slots, 1, 2, 4 ... 128
+ * ticks long, and during slot b light exactly the LEDs that have bit b
+ * set. An LED at brightness 200 (11001000) is lit for 128+64+8 = 200
+ * ticks out of 255. Each slot is one frame, and gpio_register_class
+ * writes a whole frame in one go, so a full brightness cycle for all 20
+ * LEDs is 8 frames.
+ *
+ * bam_engine_class does this in its own thread. You hand it a
+ * framebuffer (one brightness byte per LED, in pins[] order) whenever
+ * you like with set_brightness(); it works out the 8 bit plane masks
+ * and the engine picks them up at the start of its next cycle.
+ *
+ * The tick length sets the flicker frequency: a cycle is 255 ticks, so
+ * 16us ticks make a 4.08ms cycle, or 245Hz. Slots longer than
+ * bam_spin_limit_ns are slept through with clock_nanosleep(); shorter
+ * ones are too short for the scheduler to hit, so we spin on the clock.
+*/
+
+#ifndef BAM_ENGINE_H
+#define BAM_ENGINE_H
+
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include "../gpio_mmap/gpio_mmap.h"
+
+#define bam_planes 8 //one per brightness bit.
+#define bam_spin_limit_ns 100000 //slots shorter than 100us are spun, not slept.
+
+/* bam_engine_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * gpio, pin_map, led_count, all_mask
+ * 					:Variables. Where to write, which pins the LEDs
+ * 					are on, how many there are, and the mask of all of
+ * 					them.
+ * tick_ns			:Variable. How long brightness 1 is lit per cycle.
+ * pending_planes[]	:Variable. Bit planes from set_brightness() that
+ * 					the engine hasn't picked up yet.
+ * pending			:Variable. true if pending_planes[] is new.
+ * planes_lock		:Variable. Mutex around the two above.
+ * running			:Variable. The engine thread runs while this is true.
+ * cycles, writes	:Variables. Counters for the benchmark. Only the
+ * 					engine thread writes them; they're atomic so the
+ * 					benchmark can read them while it runs.
+ * -------------------------------------------------------------------
+ * engine()			:Static Method
+ * 					The engine thread. Takes a pointer to the object,
+ * 					since pthreads can only hand us a void pointer.
+ * How it works:
+ * ------------
+ * Set the deadline to now. Loop while running is true:
+ * 		try to lock planes_lock. If we got it and there are pending
+ * 		planes, copy them into our own planes[]. If somebody else has
+ * 		the lock, they're halfway through a new frame; use the planes
+ * 		we have, and pick the new ones up next cycle. Either way, the
+ * 		engine never waits on the lock.
+ * 		For each bit b from 0 to 7,
+ * 			write plane b to the LEDs,
+ * 			move the deadline on tick_ns times 2 to the b,
+ * 			sleep until the deadline.
+ * Because the deadlines are absolute, a late slot is made up in the
+ * next one, and the cycle length stays right on average. If we fall a
+ * whole cycle behind (somebody else had the CPU), we don't try to make
+ * that up; we just start the next cycle from now.
+ * When running goes false, switch all the LEDs off.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * now_ns()			:Static Method
+ * 					Returns CLOCK_MONOTONIC in nanoseconds.
+ * -------------------------------------------------------------------
+ * sleep_until()	:Static Method
+ * 					Takes a deadline in nanoseconds of CLOCK_MONOTONIC
+ * 					and returns at (or just after) that time. Sleeps if
+ * 					it's far enough away, spins if it isn't.
+ * -------------------------------------------------------------------
+ * setup()			:Method
+ * 					Takes the gpio_register_class to write with, the
+ * 					pin map, how many LEDs, and the tick length in ns.
+ * 					Sets up the pins as outputs and the mutex.
+ * -------------------------------------------------------------------
+ * set_brightness()	:Method
+ * 					Takes an array of led_count brightness bytes.
+ * 					Returns nothing.
+ * How it works:
+ * ------------
+ * For each LED, for each bit b of its brightness, if the bit is set,
+ * set the LED's pin bit in plane b. Then lock planes_lock, copy the
+ * planes into pending_planes[], mark them pending, and unlock.
+ * The engine only ever holds the lock for a few copies, so this is
+ * quick.
+ * -------------------------------------------------------------------
+ * start() and stop()
+ * 					:Methods. Start the engine thread, or tell it to
+ * 					stop and wait for it. start() returns false if the
+ * 					thread couldn't be created. You can pass start() a
+ * 					pthread_attr_t if you want it real time.
+ * -------------------------------------------------------------------
+ * cycle_count() and write_count()
+ * 					:Methods. How many cycles and register frames the
+ * 					engine has done.
+ * -------------------------------------------------------------------
+ * cycle_ns()		:Method. How long one full cycle is, in ns. One
+ * 					second divided by this is the flicker frequency.
+ * -------------------------------------------------------------------
+ */
+class bam_engine_class {
+	private:
+ // ===================================================================
+	gpio_register_class *gpio=NULL;
+	const int *pin_map=NULL;
+	int led_count=0;
+	uint32_t all_mask=0;
+	int64_t tick_ns=0;
+	uint32_t pending_planes[bam_planes]={0};
+	bool pending=false;
+	pthread_mutex_t planes_lock;
+	std::atomic<bool> running{false};
+	pthread_t engine_thread;
+	std::atomic<uint64_t> cycles{0};
+	std::atomic<uint64_t> writes{0};
+ // -------------------------------------------------------------------
+	static void *engine(void *vp){
+		bam_engine_class *self=(bam_engine_class *)vp;
+		uint32_t planes[bam_planes]={0};
+		int64_t deadline=now_ns();
+
+		while (self->running.load(std::memory_order_relaxed)){
+			if (deadline<now_ns()-self->cycle_ns()){ //lost a whole cycle.
+				deadline=now_ns(); //start over rather than race to catch up.
+			}
+			if (!pthread_mutex_trylock(&self->planes_lock)){
+				if (self->pending){
+					for (int b=0;b<bam_planes;b++){
+						planes[b]=self->pending_planes[b];
+					}
+					self->pending=false;
+				}
+				pthread_mutex_unlock(&self->planes_lock);
+			}
+			for (int b=0;b<bam_planes;b++){
+				self->gpio->write_leds(planes[b],self->all_mask);
+				deadline+=self->tick_ns<<b;
+				sleep_until(deadline);
+			}
+			self->writes.store(self->writes.load(std::memory_order_relaxed)+bam_planes,
+							   std::memory_order_relaxed);
+			self->cycles.store(self->cycles.load(std::memory_order_relaxed)+1,
+							   std::memory_order_relaxed);
+		}
+		self->gpio->write_leds(0,self->all_mask); //all off.
+		return(NULL);
+	}
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	static int64_t now_ns(){
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		return (int64_t)now.tv_sec*1000000000LL+now.tv_nsec;
+	}
+ // -------------------------------------------------------------------
+	static void sleep_until(int64_t deadline){
+		int64_t remaining=deadline-now_ns();
+		if (remaining>bam_spin_limit_ns){ //long enough to sleep through.
+			timespec wake;
+			wake.tv_sec=deadline/1000000000LL;
+			wake.tv_nsec=deadline%1000000000LL;
+			while (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,
+								   &wake,NULL)==EINTR){
+				//interrupted. The deadline hasn't moved; sleep again.
+			}
+		}else{
+			while (now_ns()<deadline){
+				//too short to sleep. Spin.
+			}
+		}
+	}
+ // -------------------------------------------------------------------
+	void setup(gpio_register_class *the_gpio,const int *the_pin_map,
+			   int count,int64_t the_tick_ns){
+		gpio=the_gpio;
+		pin_map=the_pin_map;
+		led_count=count;
+		tick_ns=the_tick_ns;
+		all_mask=gpio_register_class::pin_mask(pin_map,led_count);
+		for (int c=0;c<led_count;c++){
+			gpio->output_mode(pin_map[c]);
+		}
+		gpio->write_leds(0,all_mask);
+		pthread_mutex_init(&planes_lock,NULL);
+	};
+ // -------------------------------------------------------------------
+	void set_brightness(const uint8_t *levels){
+		uint32_t planes[bam_planes]={0};
+		for (int c=0;c<led_count;c++){
+			for (int b=0;b<bam_planes;b++){
+				if (levels[c] & (1<<b)) planes[b]|=1u<<pin_map[c];
+			}
+		}
+		pthread_mutex_lock(&planes_lock);
+		for (int b=0;b<bam_planes;b++){
+			pending_planes[b]=planes[b];
+		}
+		pending=true;
+		pthread_mutex_unlock(&planes_lock);
+	};
+ // -------------------------------------------------------------------
+	bool start(const pthread_attr_t *attr=NULL){
+		running.store(true,std::memory_order_relaxed); //pthread_create() orders it.
+		if (pthread_create(&engine_thread,attr,engine,this)){
+			running.store(false,std::memory_order_relaxed);
+			return false;
+		}
+		return true;
+	};
+ // -------------------------------------------------------------------
+	void stop(void){
+		if (!running.load(std::memory_order_relaxed)) return;
+		running.store(false,std::memory_order_relaxed);
+		pthread_join(engine_thread,NULL);
+	};
+ // -------------------------------------------------------------------
+	uint64_t cycle_count(void){
+		return cycles.load(std::memory_order_relaxed);
+	};
+ // -------------------------------------------------------------------
+	uint64_t write_count(void){
+		return writes.load(std::memory_order_relaxed);
+	};
+ // -------------------------------------------------------------------
+	int64_t cycle_ns(void){
+		return tick_ns*255;
+	};
+ // -------------------------------------------------------------------
+}; //end of bam_engine_class
+
+#endif
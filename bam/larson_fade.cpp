@@ -0,0 +1,123 @@
+ /*
+  * larson_fade.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * larson_fade
+ * The Larson scanner the way it looked on TV: a bright eye sweeping
+ * back and forth with a tail that fades out behind it. The LEDs are
+ * still only on or off, so the fading is done by bam_engine_class,
+ * which switches them faster than we can see. All this program does
+ * is keep a brightness byte per LED and hand it to the engine every
+ * frame.
+ * Compile with:
+ * 		g++ -O2 -o larson_fade larson_fade.cpp -lpthread
+*/
+
+#include <iostream>
+#include <atomic>
+#include <csignal>
+#include <stdint.h>
+#include "bam_engine.h"
+#include "../frame_clock/frame_clock.h"
+#define LEDs 20
+#define delaymils 40
+#define bam_tick_ns 16000 //16us ticks, so the LEDs flicker at 245Hz.
+#define tail_fade 5 //each frame, the tail keeps tail_fade eighths.
+
+using namespace std;
+
+int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+std::atomic<bool> running{true}; //lock free, so the SIGINT handler can set it.
+
+/* SIGINT_handler
+ * Parameters:
+ * signal_number, an integer
+ * Returns: nothing.
+ *
+ * How it works
+ * ------------
+ * Set running false, so main() stops the engine and cleans up.
+ */
+void SIGINT_handler(int signal_number){
+	running.store(false,std::memory_order_relaxed);
+}
+
+/*
+ * Main()
+ * Parameters: none
+ * Returns: an integer to tell the system its exit status.
+ *
+ * How it works:
+ * -------------
+ * Map the GPIO registers, exiting if we can't. Set up the BAM engine
+ * on our pins and start it.
+ *
+ * Start a frame clock, delaymils per frame. Then, as long as running
+ * is true,
+ * 		fade every LED to tail_fade eighths of what it was,
+ * 		set the eye's LED to full brightness,
+ * 		hand the whole brightness array to the engine,
+ * 		move the eye one LED in the direction it's going, turning
+ * 		around at either end,
+ * 		wait for the frame clock.
+ *
+ * When SIGINT sets running false, stop the engine. It switches all
+ * the LEDs off on its way out.
+*/
+int main(void){
+	gpio_register_class gpio;
+	bam_engine_class bam;
+	frame_clock_class frame_clock;
+	uint8_t levels[LEDs]={0};
+	int eye=0;
+	int direction=1;
+
+	signal(SIGINT,SIGINT_handler);
+
+	if (!gpio.setup()){
+		cout<<"Unable to map "<<gpiomem_path<<". Exiting."<<endl;
+		return 1;
+	}
+	bam.setup(&gpio,pins,LEDs,bam_tick_ns);
+	if (!bam.start()){
+		cout<<"Error Creating thread.\n"<<flush;
+		return 1;
+	}
+
+	frame_clock.start(delaymils);
+	while(running.load(std::memory_order_relaxed)){
+		for (int c=0;c<LEDs;c++){
+			levels[c]=levels[c]*tail_fade/8;
+		}
+		levels[eye]=255;
+		bam.set_brightness(levels);
+
+		if (eye+direction<0 || eye+direction>=LEDs) direction=-direction;
+		eye+=direction;
+		frame_clock.wait();
+	}
+
+	bam.stop();
+	cout<<"Done.\n"<<flush;
+	return 0;
+}
@@ -26,6 +26,19 @@
  * This program is derived from button_polled and Larson.cpp, and is 
  * used to demonstrate wiringPi's interrupt functionality. Most of the
  * button_polled code has been replaced. 
+ *
+ * The ISR used to do the debouncing and the printing itself. But
+ * wiringPi calls it on its own thread, and only knows that an edge has
+ * happened since it last looked, not how many. So while the ISR sat
+ * waiting for cout, any edges that came in were folded into one call,
+ * and the debounce timer, read after the printing, was wrong too. Now
+ * the ISR only takes the time and pushes it onto a queue (see
+ * event_queue/spsc_queue.h), which never waits, and the main loop
+ * drains the queue between LEDs and does the debouncing and printing
+ * there. The ISR also times itself, and with each press we print how
+ * long it takes and how many events the queue had to drop. The ISR and
+ * its queue live in button_isr.h, so button_isr_bench can compare the
+ * very same ISR with the old one under a burst of edges.
 */
 
 
@@ -39,6 +52,7 @@
 */
 #include <iostream>
 #include <wiringPi.h>
+#include "button_isr.h"
 
 #define LEDs 20
 #define delaymils 40
@@ -48,13 +62,16 @@
  
 #define button_pin 12
 #define button_debounce_delay 100 //milliseconds
+#define button_queue_size 64 //edges. Lots of bounce between two drains.
 
-/* Define a static int to hold the number of button presses, and a 32
- * bit unsigned integer to hold the time value of the last time the 
- * interrupt fired. This is for debouncing.
+/* The ISR's queue to the main loop, and its timing (see button_isr.h).
+ * Then an int to hold the number of button presses, and a 32 bit
+ * unsigned integer to hold the time, in microseconds, of the last edge.
+ * These are for debouncing, and only main() uses them now.
  */
-volatile int button_presses=0;
-volatile uint32_t last_time_interrupt_fired=0;
+button_isr_class<button_queue_size> button_edges;
+int button_presses=0;
+uint32_t last_edge_micros=0;
 
 /* 
  * We're only using one namespace in this program, so it's safe to set
@@ -67,23 +84,40 @@ using namespace std;
  * 
  * How it works: 
  * ------------
- * First, we declare another 32 bit unsigned integer to hold the output
- * of millis(), since we'll use the value twice and we'd prefer it didn't
- * change. We store the value of millis() minus the value of 
- * the last_time_interrupt_fired static unsigned 32 bit integer in it.
- * Next, we update last_time_interrupt_fired with the current value of 
- * millis().
- * If time_since_last_interrupt is greater than the button_debounce_delay,
- * which is a preprocessor macro of some number of milliseconds, then
- * print a message on the screen and exit. If not, just exit.
+ * button_edges.isr() pushes an edge_event with the value of micros()
+ * onto the queue, and times itself. If the queue is full, the event is
+ * counted as dropped; we never wait for the main loop.
  */
 void button_ISR(void){
-	uint32_t time_since_last_interrupt=millis()-last_time_interrupt_fired;
-	last_time_interrupt_fired=millis();
-	
-	if (time_since_last_interrupt >button_debounce_delay){
-		cout<<"Time Since Last Interrupt:"<<time_since_last_interrupt<<endl;
-		cout<<"Button Pressed "<<++button_presses<<" Times."<<endl;
+	button_edges.isr();
+}
+
+/* void drain_edges()
+ * The part of the old ISR that took the time. Called from the main
+ * loop.
+ * 
+ * How it works:
+ * ------------
+ * For each edge_event in the queue, work out how long it was since the
+ * last edge, and remember this one. Every edge restarts the debounce
+ * timer, just as every interrupt did.
+ * If the time since the last edge is greater than the
+ * button_debounce_delay, print a message on the screen, and the ISR's
+ * timing and dropped events.
+ */
+void drain_edges(void){
+	edge_event edge;
+	while (button_edges.next(edge)){
+		uint32_t time_since_last_edge=edge.micros-last_edge_micros;
+		last_edge_micros=edge.micros;
+
+		if (time_since_last_edge>button_debounce_delay*1000u){
+			cout<<"Time Since Last Interrupt:"<<time_since_last_edge/1000<<endl;
+			cout<<"Button Pressed "<<++button_presses<<" Times."<<endl;
+			cout<<"ISR: "<<button_edges.call_count()<<" calls, average "
+				<<button_edges.average_ns()<<"ns, worst "<<button_edges.worst_ns()<<"ns, "
+				<<button_edges.dropped_count()<<" events dropped."<<endl;
+		}
 	}
 }
 
@@ -125,11 +159,13 @@ int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
  * 		Scan Low to High LED #. Starting with LED 0, 
  * 			turn the LED on, 
  * 			wait delaymils, 
+ * 			deal with any button edges,
  * 			then turn the previous LED off.
  
  * 		Scan High to Low by LED number. 
  * 			Switch the current LED on, 
  * 			Wait delaymils, 
+ * 			deal with any button edges,
  * 			then switch the previous LED off.
  * 
  * We'll never reach the return(0). 
@@ -140,8 +176,8 @@ int main(void){
 	//Initialize WiringPi.
 	wiringPiSetupGpio();
 	
-	//Initialize interrupt timer variable.
-	last_time_interrupt_fired=millis();
+	//Initialize the debounce timer.
+	last_edge_micros=micros();
 	
 	//Initialize Pins.
 	for (c=0;c<LEDs;c++){
@@ -163,6 +199,7 @@ int main(void){
 			//cout << "switching" << pins[c] <<"\n"<< flush;
 			digitalWrite(pins[c],LOW);
 			delay(delaymils);
+			drain_edges();
 			if (c>0) digitalWrite(pins[c-1],HIGH);
 		}
 		
@@ -171,6 +208,7 @@ int main(void){
 			//cout << "switching" << pins[c] <<"\n"<< flush;
 			digitalWrite(pins[c],LOW);
 			delay(delaymils);
+			drain_edges();
 			if (c<LEDs)digitalWrite(pins[c+1],HIGH);
 		}
 	}
@@ -0,0 +1,128 @@
+ /*
+  * button_isr.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * button_isr.h
+ * The ISR side of button_interrupt: the queue of edges, the ISR that
+ * fills it, and the ISR's timing. It's here rather than in
+ * button_interrupt.cpp so button_isr_bench can time the very same
+ * code button_interrupt runs.
+ *
+ * wiringPi wants a plain void function for an ISR, so a program makes
+ * one button_isr_class and a one line function that calls its isr():
+ * 		button_isr_class<64> button_edges;
+ * 		void button_ISR(void){ button_edges.isr(); }
+ *
+ * How it works:
+ * The ISR counts the call, reads the clock, pushes an edge_event with
+ * micros() onto an spsc_queue_class, which never waits (if it's full,
+ * the edge is counted as dropped), and adds how long it took to the
+ * totals. The call is counted before the push, and the push releases
+ * what came before it, so whoever pops an edge always sees at least
+ * that call counted. Only the ISR writes the counters, so a relaxed
+ * load and store will do; they're atomic so the main loop can read
+ * them safely.
+*/
+
+#ifndef BUTTON_ISR_H
+#define BUTTON_ISR_H
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#include <wiringPi.h>
+#include "../event_queue/spsc_queue.h"
+
+/* edge_event
+ * What the ISR pushes: when it was called, from micros().
+ */
+struct edge_event {
+	uint32_t micros;
+};
+
+/* button_isr_class declaration
+ * -------------------------------------------------------------------
+ * Takes the queue's capacity as a template parameter.
+ * Private members:
+ * ===================================================================
+ * queue			:Variable. Edges, from the ISR to the main loop.
+ * calls, total_ns, worst
+ * 					:Variables. How many times the ISR has been called,
+ * 					how long it took in all, and the slowest call.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * isr()			:Method
+ * 					The ISR. Call it from the function you hand
+ * 					wiringPiISR().
+ * -------------------------------------------------------------------
+ * next()			:Method
+ * 					For the main loop. Takes an edge_event to fill in,
+ * 					and returns true if there was one. Never waits.
+ * -------------------------------------------------------------------
+ * call_count(), average_ns(), worst_ns(), dropped_count()
+ * 					:Methods. The ISR's calls, its average and slowest
+ * 					time in ns (0 before the first call), and how many
+ * 					edges the queue had to drop.
+ * -------------------------------------------------------------------
+ */
+template <uint32_t capacity>
+class button_isr_class {
+	private:
+ // ===================================================================
+	spsc_queue_class<edge_event,capacity> queue;
+	std::atomic<uint64_t> calls{0};
+	std::atomic<uint64_t> total_ns{0};
+	std::atomic<uint64_t> worst{0};
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	void isr(void){
+		calls.store(calls.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+		timespec start,end;
+		clock_gettime(CLOCK_MONOTONIC,&start);
+		queue.push(edge_event{micros()});
+		clock_gettime(CLOCK_MONOTONIC,&end);
+
+		uint64_t took=(end.tv_sec-start.tv_sec)*1000000000LL+(end.tv_nsec-start.tv_nsec);
+		total_ns.store(total_ns.load(std::memory_order_relaxed)+took,std::memory_order_relaxed);
+		if (took>worst.load(std::memory_order_relaxed)){
+			worst.store(took,std::memory_order_relaxed);
+		}
+	};
+ // -------------------------------------------------------------------
+	bool next(edge_event &edge){
+		return queue.pop(edge);
+	};
+ // -------------------------------------------------------------------
+	uint64_t call_count(void){ return calls.load(std::memory_order_relaxed); };
+	uint64_t average_ns(void){
+		uint64_t n=calls.load(std::memory_order_relaxed);
+		return n==0?0:total_ns.load(std::memory_order_relaxed)/n;
+	};
+	uint64_t worst_ns(void){ return worst.load(std::memory_order_relaxed); };
+	uint64_t dropped_count(void){ return queue.dropped_count(); };
+ // -------------------------------------------------------------------
+}; //end of button_isr_class
+
+#endif
@@ -0,0 +1,297 @@
+ /*
+  * button_isr_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * button_isr_bench
+ * What happens to bursts of button edges (a bouncing contact) with each
+ * of the ISRs button_interrupt has had:
+ * 		printing	the old one, which debounced and printed with cout
+ * 					from inside the ISR, printing to standard output.
+ * 		stalled		the same, but with standard output a pipe that's
+ * 					full and drains at a byte a millisecond, about
+ * 					what a 9600 baud serial console takes, so cout
+ * 					blocks.
+ * 		queue 1024	the new one, button_isr_class from button_isr.h,
+ * 					the same code button_interrupt runs, which pushes
+ * 					the time onto an spsc_queue_class and leaves the
+ * 					rest to the main loop, which drains and debounces
+ * 					every delaymils.
+ * 		queue 64	the same, with a queue too small for the bursts, to
+ * 					show what dropping looks like.
+ * Each run scripts a number of presses, far enough apart to debounce,
+ * each one a burst of falling edges, and reports:
+ * 		how many ISR calls the edges got, and how many were coalesced,
+ * 		folded into another edge's call because the ISR was still busy
+ * 		(wiringPi only knows an edge happened, not how many),
+ * 		how many the queue dropped and how many the main loop drained,
+ * 		how many presses were counted, out of how many there were,
+ * 		and how long the ISR took: average, 99th percentile and worst.
+ *
+ * It runs against wiringPi_sim in real time, which calls ISRs from an
+ * input thread the way wiringPi does, and coalesces edges the same way.
+ * The simulation needs about 100us per edge to keep up on a Pi, so
+ * don't make gap_us much smaller than that.
+ * Whatever the printing ISR prints goes to standard output, and the
+ * results go to standard error:
+ * 		button_isr_bench [presses] [edges_per_press] [gap_us] > /dev/null
+ * Compile with:
+ * 		g++ -O2 -I../wiringPi_sim -o button_isr_bench button_isr_bench.cpp
+ * 			../wiringPi_sim/wiringPi_sim.cpp -lpthread
+*/
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h> //F_SETPIPE_SZ.
+#include <unistd.h>
+#include <wiringPi.h>
+#include "wiringPi_sim.h"
+#include "button_isr.h"
+
+#define button_pin 12
+#define button_debounce_delay 100 //milliseconds
+#define delaymils 40 //how often the main loop drains the queue.
+#define max_edges 100000
+#define press_gap_ms 150 //from the end of one press's edges to the next.
+#define settle_ms 200 //after the last press, for the ISR to catch up.
+#define stall_pipe_size 4096 //the smallest pipe Linux will make.
+
+using namespace std;
+
+button_isr_class<1024> big_edges;
+button_isr_class<64> small_edges;
+
+/* The ISR being measured, and its timings. timing_ISR() is what
+ * wiringPi calls; it times bench_isr. Only the input thread writes
+ * isr_samples, and main() only reads them once the burst is over and
+ * isr_busy says the last call has returned.
+ */
+void (*bench_isr)(void)=NULL;
+int64_t isr_samples[max_edges];
+std::atomic<int> isr_sample_count{0};
+std::atomic<bool> isr_busy{false};
+
+/* The old ISR, exactly as it was.
+ */
+volatile int button_presses=0;
+volatile uint32_t last_time_interrupt_fired=0;
+
+void printing_ISR(void){
+	uint32_t time_since_last_interrupt=millis()-last_time_interrupt_fired;
+	last_time_interrupt_fired=millis();
+
+	if (time_since_last_interrupt >button_debounce_delay){
+		cout<<"Time Since Last Interrupt:"<<time_since_last_interrupt<<endl;
+		cout<<"Button Pressed "<<++button_presses<<" Times."<<endl;
+	}
+}
+
+/* The new ISR, for either queue, the way button_interrupt hooks it up,
+ * and the main loop's side of it.
+ */
+template <typename edges_type,edges_type &edges>
+void queue_ISR(void){
+	edges.isr();
+}
+
+/* uint64_t drain<queue>()
+ * What button_interrupt's drain_edges() does, but counting instead of
+ * printing. Returns how many edges it popped.
+ */
+int queue_presses=0;
+uint32_t last_edge_micros=0;
+
+template <typename edges_type,edges_type &edges>
+uint64_t drain(void){
+	edge_event edge;
+	uint64_t drained=0;
+	while (edges.next(edge)){
+		uint32_t time_since_last_edge=edge.micros-last_edge_micros;
+		last_edge_micros=edge.micros;
+		if (time_since_last_edge>button_debounce_delay*1000u) queue_presses++;
+		drained++;
+	}
+	return drained;
+}
+
+int64_t now_ns(){
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec*1000000000LL+now.tv_nsec;
+}
+
+void timing_ISR(void){
+	isr_busy=true;
+	int64_t start=now_ns();
+	bench_isr();
+	int64_t took=now_ns()-start;
+	int n=isr_sample_count.load(std::memory_order_relaxed);
+	if (n<max_edges){
+		isr_samples[n]=took;
+		isr_sample_count.store(n+1,std::memory_order_release);
+	}
+	isr_busy=false;
+}
+
+/* stalled standard output
+ * stall_stdout() points standard output at a pipe we've made as small
+ * as we can and filled up, and starts a thread that reads a byte from
+ * it every millisecond. unstall_stdout() puts standard output back and
+ * tells the thread to stop dawdling, and once it has read what's left
+ * in the pipe, it sees the end of it and returns.
+ */
+int saved_stdout=-1;
+std::thread *stall_reader=NULL;
+std::atomic<bool> stalling{false};
+
+void stall_stdout(){
+	int ends[2];
+	if (pipe(ends)<0) return;
+	fcntl(ends[1],F_SETPIPE_SZ,stall_pipe_size);
+	fcntl(ends[1],F_SETFL,O_NONBLOCK);
+	char fill[stall_pipe_size]={0};
+	while (write(ends[1],fill,sizeof(fill))>0){
+		//until it's full.
+	}
+	fcntl(ends[1],F_SETFL,0);
+	cout<<flush;
+	saved_stdout=dup(1);
+	dup2(ends[1],1);
+	close(ends[1]);
+	int reader=ends[0];
+	stalling=true;
+	stall_reader=new std::thread([reader](){
+		char buffer[stall_pipe_size];
+		while (read(reader,buffer,stalling?1:sizeof(buffer))>0){
+			if (stalling) delay(1);
+		}
+		close(reader);
+	});
+}
+
+void unstall_stdout(){
+	if (stall_reader==NULL) return;
+	cout<<flush;
+	dup2(saved_stdout,1);
+	close(saved_stdout);
+	stalling=false;
+	stall_reader->join();
+	delete stall_reader;
+	stall_reader=NULL;
+}
+
+/* void run(name, isr, drain_queue, dropped, stall, presses, edges, gap_us)
+ * Stalls standard output if we're asked to. Scripts presses presses,
+ * each edges falling edges gap_us apart, starting a little from now,
+ * and sits in a loop like button_interrupt's, draining the queue (if
+ * there is one) every delaymils, until the presses are over and the
+ * ISR has had settle_ms to catch up. Then unstalls standard output,
+ * waits for the ISR to return, and prints what happened.
+ */
+void run(string name,void (*isr)(void),uint64_t (*drain_queue)(void),
+		 uint64_t (*dropped)(void),bool stall,int presses,int edges,int gap_us){
+	if (stall) stall_stdout();
+	isr_sample_count.store(0);
+	bench_isr=isr;
+	button_presses=0;
+	queue_presses=0;
+	last_time_interrupt_fired=millis();
+	last_edge_micros=micros();
+	uint64_t calls_before=sim_isr_count();
+	uint64_t coalesced_before=sim_coalesced_count();
+	uint64_t dropped_before=dropped?dropped():0;
+	wiringPiISR(button_pin,INT_EDGE_FALLING,&timing_ISR);
+
+	int64_t gap=gap_us*1000LL;
+	int64_t press_length=edges*gap+press_gap_ms*1000000LL;
+	int64_t start=sim_now_ns()+press_gap_ms*1000000LL;
+	for (int p=0;p<presses;p++){
+		int64_t at=start+p*press_length;
+		for (int c=0;c<edges;c++){
+			sim_script_input(button_pin,at+c*gap,HIGH);
+			sim_script_input(button_pin,at+c*gap+gap/2,LOW);
+		}
+	}
+	int64_t end=start+presses*press_length+settle_ms*1000000LL;
+	uint64_t drained=0;
+	while (sim_now_ns()<end){
+		delay(delaymils);
+		if (drain_queue) drained+=drain_queue();
+	}
+	if (stall) unstall_stdout();
+	while (isr_busy) delay(1);
+
+	uint64_t calls=sim_isr_count()-calls_before;
+	uint64_t coalesced=sim_coalesced_count()-coalesced_before;
+	int n=isr_sample_count.load(std::memory_order_acquire);
+	sort(isr_samples,isr_samples+n);
+	int64_t total=0;
+	for (int c=0;c<n;c++) total+=isr_samples[c];
+	cerr<<name<<": "<<presses*edges<<" edges, "<<calls<<" ISR calls, "<<coalesced
+		<<" coalesced";
+	if (drain_queue){
+		cerr<<", "<<dropped()-dropped_before<<" dropped, "<<drained<<" drained";
+	}
+	cerr<<", "<<(drain_queue?queue_presses:button_presses)<<"/"<<presses<<" presses";
+	if (n>0){
+		cerr<<". ISR average "<<total/n<<"ns, p99 "<<isr_samples[(int)(n*0.99)]
+			<<"ns, worst "<<isr_samples[n-1]<<"ns.";
+	}
+	cerr<<endl;
+}
+
+/*
+ * Main()
+ * Parameters: how many presses (10 if left out), how many edges each
+ * (100 if left out), and how far apart the edges are, in microseconds
+ * (200 if left out).
+ * Returns 0.
+ */
+int main(int argc,char *argv[]){
+	int presses=argc>1?atoi(argv[1]):10;
+	int edges=argc>2?atoi(argv[2]):100;
+	int gap_us=argc>3?atoi(argv[3]):200;
+	if (presses<1) presses=10;
+	if (edges<1) edges=100;
+	if (presses*edges>max_edges) presses=max_edges/edges;
+	if (gap_us<1) gap_us=200;
+
+	sim_set_virtual_time(false);
+	wiringPiSetupGpio();
+	pinMode(button_pin,INPUT);
+	pullUpDnControl(button_pin,PUD_DOWN);
+
+	run("printing",printing_ISR,NULL,NULL,false,presses,edges,gap_us);
+	run("stalled",printing_ISR,NULL,NULL,true,presses,edges,gap_us);
+	run("queue 1024",queue_ISR<decltype(big_edges),big_edges>,
+		drain<decltype(big_edges),big_edges>,
+		[]()->uint64_t{ return big_edges.dropped_count(); },false,presses,edges,gap_us);
+	run("queue 64",queue_ISR<decltype(small_edges),small_edges>,
+		drain<decltype(small_edges),small_edges>,
+		[]()->uint64_t{ return small_edges.dropped_count(); },false,presses,edges,gap_us);
+	return 0;
+}
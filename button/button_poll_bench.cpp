@@ -0,0 +1,239 @@
+ /*
+  * button_poll_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * button_poll_bench
+ * How long does a press take to come through button_sampler_class, and
+ * how many get through at all, at each sampling rate? Use it to pick
+ * the rate for button_polled.
+ *
+ * For each rate (1, 2, 5, 10 and 20kHz) we script the same presses on
+ * the button pin: 10 to 150ms long, 40 to 160ms apart, each press and
+ * release bouncing a few times, 200us apart, first. Then we run a
+ * loop like button_polled's, which checks the sampler after every
+ * delaymils, and match up the presses it gets with the presses we
+ * made. For each rate, we print:
+ * 		how many presses came through, and how many came through that
+ * 		we didn't make (bounce getting past the debouncer),
+ * 		press to detection: from the first edge of the press to when
+ * 		the sampler queued it, 50th, 90th, 99th percentile and worst,
+ * 		press to loop: to when the loop picked it up, which adds up to
+ * 		delaymils,
+ * 		how many ticks the sampler woke up too late for, and how many
+ * 		events it had to drop.
+ * Then the same for button_polled's old way, one read per 1.6 second
+ * bounce of the scanner. We work that one out from the script rather
+ * than run it, since it would take a minute a run.
+ *
+ * It runs against wiringPi_sim in real time, so the sampler's thread
+ * really sleeps and wakes, and the sample times are real.
+ * Usage: button_poll_bench [presses]
+ * Compile with:
+ * 		g++ -O2 -I../wiringPi_sim -o button_poll_bench button_poll_bench.cpp
+ * 			../wiringPi_sim/wiringPi_sim.cpp -lpthread
+*/
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <wiringPi.h>
+#include "wiringPi_sim.h"
+#include "button_sampler.h"
+
+#define button_pin 12
+#define delaymils 40
+#define sweep_ms 1600 //button_polled's old read interval: 40 LEDs at 40ms.
+#define bounce_us 200
+#define max_bounces 4
+#define lead_ms 20 //from scripting the presses to the first one.
+#define settle_ms 100 //after the last, for everything to come through.
+
+using namespace std;
+
+/* press
+ * -------------------------------------------------------------------
+ * start_us		when the first edge of the press is, from the start
+ * 				of the run.
+ * end_us		when the first edge of the release is.
+ * start_bounces, end_bounces
+ * 				how many times each of them bounces.
+ * -------------------------------------------------------------------
+ */
+struct press {
+	int64_t start_us;
+	int64_t end_us;
+	int start_bounces;
+	int end_bounces;
+};
+
+vector<press> presses;
+int buttons[1]={button_pin};
+
+/* uint32_t next_random()
+ * xorshift32. Seeded, so every run gets the same presses.
+ */
+uint32_t random_state=2463534242u;
+uint32_t next_random(){
+	random_state^=random_state<<13;
+	random_state^=random_state>>17;
+	random_state^=random_state<<5;
+	return random_state;
+}
+
+/* void make_presses(int count)
+ * The schedule, from the start of the run.
+ */
+void make_presses(int count){
+	int64_t t=0;
+	for (int c=0;c<count;c++){
+		t+=(40+next_random()%120)*1000LL;
+		int64_t length=(10+next_random()%140)*1000LL;
+		int start_bounces=next_random()%(max_bounces+1);
+		presses.push_back(press{t,t+length,start_bounces,(int)(next_random()%(max_bounces+1))});
+		t+=length;
+	}
+}
+
+/* void script_edge(at_ns, level, bounces)
+ * Scripts a bouncy edge to level: bounces quick flips first.
+ */
+void script_edge(int64_t at_ns,int level,int bounces){
+	for (int c=0;c<bounces;c++){
+		sim_script_input(button_pin,at_ns,level);
+		sim_script_input(button_pin,at_ns+bounce_us*500LL,!level);
+		at_ns+=bounce_us*1000LL;
+	}
+	sim_script_input(button_pin,at_ns,level);
+}
+
+/* string percentiles(vector<double> ms)
+ * "p50 x, p90 y, p99 z, worst w ms", or "none".
+ */
+string percentiles(vector<double> ms){
+	if (ms.empty()) return "none";
+	sort(ms.begin(),ms.end());
+	auto at=[&](double q){ return ms[min((size_t)(q*ms.size()),ms.size()-1)]; };
+	ostringstream text;
+	text<<fixed<<setprecision(2)<<"p50 "<<at(0.5)<<", p90 "<<at(0.9)
+		<<", p99 "<<at(0.99)<<", worst "<<ms.back()<<"ms";
+	return text.str();
+}
+
+/* void run(int hz)
+ * Sets up a sampler at hz, scripts the presses from a little after
+ * now, and loops like button_polled until they're over, collecting
+ * presses. Then matches each press we made with the first press event
+ * between its start and its end plus the settling time, and prints.
+ */
+void run(int hz){
+	button_sampler_class *sampler=new button_sampler_class;
+	if (!sampler->setup(buttons,1,hz) || !sampler->start()){
+		cout<<hz<<"Hz: unable to start the sampler."<<endl;
+		delete sampler;
+		return;
+	}
+	int64_t base_ns=sim_now_ns()+lead_ms*1000000LL;
+	for (size_t c=0;c<presses.size();c++){
+		script_edge(base_ns+presses[c].start_us*1000,HIGH,presses[c].start_bounces);
+		script_edge(base_ns+presses[c].end_us*1000,LOW,presses[c].end_bounces);
+	}
+	int64_t end_ns=base_ns+(presses.back().end_us+settle_ms*1000LL)*1000;
+
+	vector<int64_t> detected_us,seen_us; //from the start of the run.
+	int64_t base_us=base_ns/1000;
+	while (sim_now_ns()<end_ns){
+		delay(delaymils);
+		button_event event;
+		while (sampler->next(event)){
+			if (!event.pressed) continue;
+			//micros() wraps at 32 bits; the difference from base doesn't.
+			detected_us.push_back((int64_t)(int32_t)(event.micros-(uint32_t)base_us));
+			seen_us.push_back(sim_now_ns()/1000-base_us);
+		}
+	}
+	sampler->stop();
+
+	vector<double> detect_ms,loop_ms;
+	vector<bool> used(detected_us.size(),false);
+	int64_t window_us=sampler->settle_us()+max_bounces*bounce_us+sampler_debounce_us;
+	for (size_t p=0;p<presses.size();p++){
+		for (size_t e=0;e<detected_us.size();e++){
+			if (used[e] || detected_us[e]<presses[p].start_us) continue;
+			if (detected_us[e]>presses[p].end_us+window_us) break;
+			used[e]=true;
+			detect_ms.push_back((detected_us[e]-presses[p].start_us)/1000.0);
+			loop_ms.push_back((seen_us[e]-presses[p].start_us)/1000.0);
+			break;
+		}
+	}
+	size_t extra=detected_us.size()-detect_ms.size();
+	cout<<hz<<"Hz ("<<sampler->settle_us()<<"us to settle): "<<detect_ms.size()<<"/"
+		<<presses.size()<<" presses, "<<extra<<" extra, "<<sampler->missed_count()
+		<<" ticks missed, "<<sampler->dropped_count()<<" dropped.\n"
+		<<"\tpress to detection: "<<percentiles(detect_ms)<<"\n"
+		<<"\tpress to loop: "<<percentiles(loop_ms)<<endl;
+	delete sampler;
+}
+
+/* void old_way()
+ * One digitalRead() every sweep_ms, at a seeded random phase. A press
+ * is seen if a read lands inside it, and the loop sees it right then.
+ */
+void old_way(){
+	int64_t phase=(next_random()%sweep_ms)*1000LL;
+	vector<double> detect_ms;
+	for (size_t p=0;p<presses.size();p++){
+		int64_t read=phase;
+		if (read<presses[p].start_us){
+			read+=(presses[p].start_us-read+sweep_ms*1000LL-1)/(sweep_ms*1000LL)*sweep_ms*1000LL;
+		}
+		if (read<presses[p].end_us) detect_ms.push_back((read-presses[p].start_us)/1000.0);
+	}
+	cout<<"once a sweep (worked out, not run): "<<detect_ms.size()<<"/"<<presses.size()
+		<<" presses.\n\tpress to loop: "<<percentiles(detect_ms)<<endl;
+}
+
+/*
+ * Main()
+ * Parameters: how many presses (30 if left out).
+ * Returns 0.
+ */
+int main(int argc,char *argv[]){
+	int count=argc>1?atoi(argv[1]):30;
+	if (count<1) count=30;
+	make_presses(count);
+
+	sim_set_virtual_time(false);
+	wiringPiSetupGpio();
+	pinMode(button_pin,INPUT);
+	pullUpDnControl(button_pin,PUD_DOWN);
+
+	int rates[]={1000,2000,5000,10000,20000};
+	for (int hz:rates) run(hz);
+	old_way();
+	return 0;
+}
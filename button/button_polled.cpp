@@ -27,6 +27,18 @@
  * scanner project, save that it connects a momentary switch between 
  * BCM12 and the LED drive positive rail. I'll call the changes out 
  * where they appear.
+ *
+ * It used to read the button once before each bounce of the scanner,
+ * so a press took up to 1.6 seconds to show up, and a short one could
+ * come and go in between. Now button_sampler_class reads it on a
+ * thread of its own, thousands of times a second, debounces it, and
+ * queues each press for the scanner loop, which checks the queue
+ * after every LED without ever waiting for it. button_poll_bench
+ * measures how long presses take to come through at different rates.
+ *
+ * Usage: button_polled [hz]
+ * 		hz		how often to sample the button, 1000 to 20000.
+ * 				10000 if left out.
 */
 
 
@@ -39,7 +51,9 @@
  * wait between changing LEDs.
 */
 #include <iostream>
+#include <stdlib.h>
 #include <wiringPi.h>
+#include "button_sampler.h"
 #define LEDs 20
 #define delaymils 40
 
@@ -47,6 +61,7 @@
  * button is connected to. This way it can be changed easily.
  */
  #define button_pin 12
+ #define sample_hz 10000
 
 /* 
  * We're only using one namespace in this program, so it's safe to set
@@ -62,9 +77,25 @@ using namespace std;
 */ 
 int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
 
+/* The sampler, and the list of pins it watches, which is just the one.
+ */
+button_sampler_class sampler;
+int buttons[1]={button_pin};
+
+/* void check_button()
+ * Called after every LED. Prints a line for each press the sampler
+ * has queued since last time.
+ */
+void check_button(void){
+	button_event event;
+	while (sampler.next(event)){
+		if (event.pressed) cout<<"Button is Pressed"<<endl;
+	}
+}
+
 /*
  * Main()
- * Parameters: none
+ * Parameters: the sampling rate, optionally.
  * Returns: an integer to tell the system its exit status.
  * 
  * How it works:
@@ -79,7 +110,7 @@ int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
  * sets it up to use the Broadcom GPIO numbers instead of earlier wiringPi
  * specific pin numbers, physical pin numbers, or anything else.
  * New for button_poled: initialize button_pin as an input, and turn on 
- * the pin's pulldown resistor.
+ * the pin's pulldown resistor. Then set up the sampler, and start it.
  * 
  * Initialize pins
  * In a for loop, we set all the pins to output mode and high. We're
@@ -93,18 +124,21 @@ int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
  * 		Scan Low to High LED #. Starting with LED 0, 
  * 			turn the LED on, 
  * 			wait delaymils, 
+ * 			check for button presses,
  * 			then turn the previous LED off.
  
  * 		Scan High to Low by LED number. 
  * 			Switch the current LED on, 
  * 			Wait delaymils, 
+ * 			check for button presses,
  * 			then switch the previous LED off.
  * 
  * We'll never reach the return(0). 
 */
 
-int main(void){
+int main(int argc,char *argv[]){
 	int c=0;
+	int hz=argc>1?atoi(argv[1]):sample_hz;
 	//Initialize WiringPi.
 	wiringPiSetupGpio();
 	
@@ -116,17 +150,19 @@ int main(void){
 	}
 	pinMode(button_pin,INPUT); //set button_pin's pinmode to input.
 	pullUpDnControl(button_pin,PUD_DOWN);
+	if (!sampler.setup(buttons,1,hz) || !sampler.start()){
+		cout<<"Unable to sample at "<<hz<<"Hz. Exiting."<<endl;
+		return 1;
+	}
 	
 	//Loop forever switching the LEDs on and off in sequence.
 	while(true){
-		if((bool)digitalRead(button_pin)){
-			cout<< "Button is Pressed" << endl;
-		}
 		//loop from 0 to LEDs - "scan" from low LED # to high.
 		for (c=0;c<LEDs;c++){
 			//cout << "switching" << pins[c] <<"\n"<< flush;
 			digitalWrite(pins[c],LOW);
 			delay(delaymils);
+			check_button();
 			if (c>0) digitalWrite(pins[c-1],HIGH);
 		}
 		
@@ -135,6 +171,7 @@ int main(void){
 			//cout << "switching" << pins[c] <<"\n"<< flush;
 			digitalWrite(pins[c],LOW);
 			delay(delaymils);
+			check_button();
 			if (c<LEDs)digitalWrite(pins[c+1],HIGH);
 		}
 	}
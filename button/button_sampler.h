@@ -0,0 +1,258 @@
+ /*
+  * button_sampler.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * button_sampler.h
+ * button_polled used to read its button once per bounce of the
+ * scanner, 40 LEDs at 40ms, so a press took up to 1.6 seconds to
+ * notice, and a press that was over before the next read was never
+ * noticed at all.
+ *
+ * button_sampler_class reads the buttons on a thread of its own, at a
+ * steady rate you pick (1 to 20kHz), debounces them with
+ * debounce_class, and puts each press and release on an
+ * spsc_queue_class for the animation loop to pick up whenever it
+ * likes. The loop never waits for the sampler, and the sampler never
+ * waits for the loop: if the loop doesn't keep up, events are dropped
+ * and counted.
+ *
+ * How it works:
+ * The thread sleeps until each tick on an absolute deadline (with
+ * frame_clock_class::wait_until(), which also keeps track of how late
+ * it wakes), reads each button with digitalRead() into one word, bit n
+ * for BCM pin n, and hands the word to debounce_class. Each event it
+ * gets back goes on the queue with the time, from micros(). A tick we
+ * wake up for more than a whole period late is counted as missed, and
+ * we don't try to catch up, since one late sample is as good as two.
+ *
+ * The debounce time is about the same whatever the rate: setup() picks
+ * the fewest counter bits that make 2^bits samples at least
+ * debounce_us long. The counters only come in powers of two, so that's
+ * anywhere from debounce_us to twice it: for the 5ms default, 8ms at 1
+ * and 2kHz, and 6.4ms at 5, 10 and 20kHz. settle_us() says which. So
+ * a faster rate doesn't make a press come through sooner; it makes the
+ * time it takes steadier, and lets shorter presses through.
+ *
+ * The buttons are bits of one 32 bit word, so they have to be BCM pins
+ * 0 to 31, which is every pin on the header anyway.
+ *
+ * Call wiringPiSetupGpio() and set up the button pins before setup().
+*/
+
+#ifndef BUTTON_SAMPLER_H
+#define BUTTON_SAMPLER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+#include <wiringPi.h>
+#include "../debounce/debounce.h"
+#include "../event_queue/spsc_queue.h"
+#include "../frame_clock/frame_clock.h"
+
+#define sampler_max_pins 32
+#define sampler_min_hz 1000
+#define sampler_max_hz 20000
+#define sampler_queue_size 256 //events. Way more than a loop step's worth.
+#define sampler_debounce_us 5000
+
+/* button_event
+ * -------------------------------------------------------------------
+ * pin			the BCM pin number.
+ * pressed		true for a press, false for a release.
+ * micros		micros() when the sampler finished debouncing it.
+ * -------------------------------------------------------------------
+ */
+struct button_event {
+	int pin;
+	bool pressed;
+	uint32_t micros;
+};
+
+/* button_sampler_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * pins[], pin_count
+ * 					:Variables. The buttons, as BCM pin numbers.
+ * period_ns		:Variable. Time between samples.
+ * debounce			:Variable. The debounce_class.
+ * queue			:Variable. Events, from the thread to the loop.
+ * sample_clock		:Variable. The frame_clock_class the thread sleeps
+ * 					in. Only the thread touches it until stop().
+ * running			:Variable. The thread stops when this goes false.
+ * thread			:Variable. The thread.
+ * samples, missed	:Variables. Ticks sampled, and ticks we woke up
+ * 					more than a period late for.
+ * -------------------------------------------------------------------
+ * read_levels()	:Method
+ * 					digitalRead()s each button into one word.
+ * -------------------------------------------------------------------
+ * run()			:Static Method
+ * 					The thread. Takes the button_sampler_class.
+ * How it works:
+ * ------------
+ * Start the deadline at now. Until running goes false:
+ * 		move the deadline on a period, and if we're already more than
+ * 		a period past it, count a miss and move it on to now,
+ * 		sleep until the deadline,
+ * 		read the buttons and debounce them,
+ * 		push any events, with micros().
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Takes the pins array, how many pins, the sampling
+ * 					rate in Hz, and the debounce time in microseconds
+ * 					(sampler_debounce_us if left out). Sets up the
+ * 					debouncer from the buttons as they are now. Returns
+ * 					false if the rate, the number of pins or any pin
+ * 					is out of range, or the sampler is running.
+ * -------------------------------------------------------------------
+ * start()			:Method
+ * 					Starts the thread. Returns false if it couldn't.
+ * -------------------------------------------------------------------
+ * stop()			:Method
+ * 					Stops the thread and waits for it to finish.
+ * -------------------------------------------------------------------
+ * next()			:Method
+ * 					For the loop. Takes a button_event to fill in, and
+ * 					returns true if there was one. Never waits.
+ * -------------------------------------------------------------------
+ * rate_hz(), settle_us()
+ * 					:Methods. The sampling rate, and how long a clean
+ * 					press takes to come through: the debounce time,
+ * 					after rounding up to a power of two samples.
+ * -------------------------------------------------------------------
+ * sample_count(), missed_count(), dropped_count()
+ * 					:Methods. The counters.
+ * -------------------------------------------------------------------
+ * dump()			:Method
+ * 					After stop(), prints the counters and how late
+ * 					the samples were.
+ * -------------------------------------------------------------------
+ */
+class button_sampler_class {
+	private:
+ // ===================================================================
+	int pins[sampler_max_pins];
+	int pin_count=0;
+	int64_t period_ns=0;
+	debounce_class debounce;
+	spsc_queue_class<button_event,sampler_queue_size> queue;
+	frame_clock_class sample_clock;
+	std::atomic<bool> running{false};
+	pthread_t thread;
+	std::atomic<uint64_t> samples{0};
+	std::atomic<uint64_t> missed{0};
+ // -------------------------------------------------------------------
+	uint32_t read_levels(void){
+		uint32_t levels=0;
+		for (int c=0;c<pin_count;c++){
+			if (digitalRead(pins[c])==HIGH) levels|=1u<<pins[c];
+		}
+		return levels;
+	};
+ // -------------------------------------------------------------------
+	static void *run(void *self_pointer){
+		button_sampler_class &self=*(button_sampler_class *)self_pointer;
+		debounce_event events[sampler_max_pins];
+		int64_t deadline=timespec_ns(clock_now());
+		while (self.running.load(std::memory_order_relaxed)){
+			deadline+=self.period_ns;
+			int64_t now=timespec_ns(clock_now());
+			if (now-deadline>self.period_ns){
+				self.missed.store(self.missed.load(std::memory_order_relaxed)+1,
+								  std::memory_order_relaxed);
+				deadline=now;
+			}
+			self.sample_clock.wait_until(deadline);
+			self.samples.store(self.samples.load(std::memory_order_relaxed)+1,
+							   std::memory_order_relaxed);
+			if (!self.debounce.sample(self.read_levels())) continue;
+			uint32_t now_micros=micros();
+			int count=self.debounce.events(events,sampler_max_pins);
+			for (int c=0;c<count;c++){
+				self.queue.push(button_event{events[c].pin,events[c].pressed,now_micros});
+			}
+		}
+		return NULL;
+	};
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	bool setup(const int *pin_list,int count,int hz,int debounce_us=sampler_debounce_us){
+		if (running || count<1 || count>sampler_max_pins) return false;
+		if (hz<sampler_min_hz || hz>sampler_max_hz) return false;
+		for (int c=0;c<count;c++){
+			if (pin_list[c]<0 || pin_list[c]>=32) return false; //one bit each, of 32.
+		}
+		pin_count=count;
+		for (int c=0;c<count;c++) pins[c]=pin_list[c];
+		period_ns=1000000000LL/hz;
+		int bits=1;
+		while (bits<debounce_max_bits && ((int64_t)1<<bits)*period_ns<debounce_us*1000LL) bits++;
+		uint32_t mask=0;
+		for (int c=0;c<count;c++) mask|=1u<<pins[c];
+		return debounce.setup(mask,bits,read_levels());
+	};
+ // -------------------------------------------------------------------
+	bool start(void){
+		if (running || pin_count==0) return false;
+		running=true;
+		if (pthread_create(&thread,NULL,run,this)!=0){
+			running=false;
+			return false;
+		}
+		return true;
+	};
+ // -------------------------------------------------------------------
+	void stop(void){
+		if (!running) return;
+		running=false;
+		pthread_join(thread,NULL);
+	};
+ // -------------------------------------------------------------------
+	bool next(button_event &event){
+		return queue.pop(event);
+	};
+ // -------------------------------------------------------------------
+	int rate_hz(void){ return (int)(1000000000LL/period_ns); };
+	int settle_us(void){ return (int)(debounce.settle_samples()*period_ns/1000); };
+	uint64_t sample_count(void){ return samples.load(std::memory_order_relaxed); };
+	uint64_t missed_count(void){ return missed.load(std::memory_order_relaxed); };
+	uint64_t dropped_count(void){ return queue.dropped_count(); };
+ // -------------------------------------------------------------------
+	void dump(std::string name){
+		std::cout<<name<<": "<<sample_count()<<" samples at "<<rate_hz()<<"Hz, "
+				 <<missed_count()<<" missed, "<<dropped_count()<<" events dropped."
+				 <<std::endl;
+		sample_clock.dump(name);
+	};
+ // -------------------------------------------------------------------
+	~button_sampler_class(){
+		stop();
+	};
+}; //end of button_sampler_class
+
+#endif
@@ -0,0 +1,126 @@
+ /* Larson_compositor.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * Larson_compositor
+ * The same scanner as Larson_pthread, with as many eyes as you like
+ * and no threads at all. The array is split into one segment per eye,
+ * each eye bounces back and forth in its own segment, and
+ * compositor_class runs them all from main(), one register write per
+ * frame. Neighboring eyes start at opposite ends, so with two eyes it
+ * looks just like Larson_pthread.
+ *
+ * Usage: Larson_compositor [eyes]
+ * eyes is 1 to LEDs, and defaults to 2.
+ * Compile with:
+ * 		g++ -O2 -o Larson_compositor Larson_compositor.cpp -lwiringPi -lpthread
+*/
+
+#include <iostream>
+#include <stdlib.h>
+#include <wiringPi.h>
+#include "compositor.h"
+#define LEDs 20
+#define delaymils 40
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+
+/*
+ * The tables can't be worked out by the compiler this time, since we
+ * don't know how many eyes there are until we run. make_larson_table()
+ * works just as well at run time.
+ */
+larson_table eye_tables[LEDs];
+gpio_register_class gpio;
+stop_signal_class stop_signal;
+
+/*
+ * Main()
+ * Parameters: argc and argv. The first argument, if there is one, is
+ * the number of eyes.
+ * Returns: an integer to tell the system its exit status.
+ *
+ * How it works:
+ * -------------
+ * Set up stop_signal, so SIGINT comes to us through a file descriptor.
+ *
+ * Set up wiringPi to use BCM GPIO numbers, map the GPIO registers,
+ * and set our pins up as outputs, all off.
+ *
+ * For each eye, work out its segment of the array (eye e gets LEDs
+ * e*LEDs/eyes up to (e+1)*LEDs/eyes), build and check its table, and
+ * add it to the compositor. Even eyes start at the bottom of their
+ * segment going up, odd eyes at the top going down.
+ *
+ * Start the frame clock and run the compositor until SIGINT. Then
+ * switch the LEDs off, say how long that took, and print the frame
+ * clock's lateness histogram.
+ */
+int main(int argc,char *argv[]){
+	compositor_class compositor;
+	frame_clock_class frame_clock;
+	int eyes=2;
+	if (argc>1) eyes=atoi(argv[1]);
+	if (eyes<1 || eyes>LEDs){
+		cout<<"Eyes must be 1 to "<<LEDs<<". Exiting.\n"<<flush;
+		return 1;
+	}
+
+	if (!stop_signal.setup()){
+		cout<<"Unable to set up the stop signal. Exiting.\n"<<flush;
+		return 1;
+	}
+
+	wiringPiSetupGpio();
+	if (!gpio.setup()){
+		cout<<"Unable to map "<<gpiomem_path<<". Exiting."<<endl;
+		return 1;
+	}
+	for (int c=0;c<LEDs;c++){
+		gpio.output_mode(pins[c]);
+	}
+
+	for (int e=0;e<eyes;e++){
+		int first=e*LEDs/eyes;
+		int last=(e+1)*LEDs/eyes;
+		eye_tables[e]=make_larson_table(pins,first,last);
+		if (!check_larson_table(eye_tables[e],pins,first,last) ||
+			!compositor.add_eye(&eye_tables[e],e%2?eye_tables[e].length/2:0,1)){
+			cout<<"Bad table for eye "<<e<<". Exiting.\n"<<flush;
+			return 1;
+		}
+	}
+	gpio.write_leds(0,compositor.mask());
+	cout<<"Scanning with "<<eyes<<" eyes in one thread.\n"<<flush;
+
+	frame_clock.start(delaymils);
+	compositor.run(gpio,frame_clock,stop_signal);
+
+	gpio.write_leds(0,compositor.mask());
+	cout<<"LEDs off "<<(timespec_ns(clock_now())-stop_signal.stop_time_ns())/1000
+		<<"us after we read SIGINT.\n"<<flush; //not counting the wakeup.
+	frame_clock.dump("Compositor");
+	cout<<"Done.\n"<<flush;
+	return 0;
+}
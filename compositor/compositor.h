@@ -0,0 +1,181 @@
+ /*
+  * compositor.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * compositor.h
+ * The threaded scanners give every eye its own thread, and every
+ * thread writes its own pins whenever it wakes up. That works for two
+ * eyes on two halves of the array, but each new eye is another thread
+ * to schedule, and two eyes that share a pin fight over it: whichever
+ * wrote last wins, so one eye's LED flickers out under the other.
+ *
+ * An eye doesn't need a thread. All it ever does is step through its
+ * larson_table, one frame every so often. So compositor_class keeps
+ * each eye as a little state machine (which table, which frame, how
+ * many ticks until the next step) and runs all of them from one loop.
+ * Every tick it steps whichever eyes are due, ORs every eye's current
+ * frame together, and writes the result with one write_leds(). One
+ * thread, one register write per tick, however many eyes there are,
+ * and an LED is lit if ANY eye wants it lit.
+ *
+ * The tick is the compositor's frame period. An eye's speed is how
+ * many ticks it waits between steps, so give the compositor the
+ * fastest eye's delay as its tick and the slower eyes a multiple of it.
+*/
+
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <stdint.h>
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../larson/larson_frames.h"
+#include "../frame_clock/frame_clock.h"
+#include "../stop_signal/stop_signal.h"
+
+#define compositor_max_eyes 64
+
+/* larson_eye
+ * -------------------------------------------------------------------
+ * table			the frames this eye steps through.
+ * frame			which frame of the table it's showing.
+ * ticks_per_step	how many compositor ticks between steps. 1 is as
+ * 					fast as the compositor goes.
+ * ticks_left		ticks until the next step.
+ * -------------------------------------------------------------------
+ */
+struct larson_eye {
+	const larson_table *table;
+	int frame;
+	int ticks_per_step;
+	int ticks_left;
+};
+
+/* compositor_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * eyes[], eye_count:Variables. The eyes, and how many there are.
+ * all_mask			:Variable. Every pin any eye drives.
+ * ticks			:Variable. How many ticks we've done.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * add_eye()		:Method
+ * 					Takes a table, the frame to start on, and the
+ * 					ticks per step. Returns false if we already have
+ * 					compositor_max_eyes eyes, or the arguments make no
+ * 					sense. The table has to outlive the compositor; we
+ * 					only keep a pointer.
+ * -------------------------------------------------------------------
+ * compose()		:Method
+ * 					Returns the OR of every eye's current frame: the
+ * 					pins that should be lit right now.
+ * -------------------------------------------------------------------
+ * advance()		:Method
+ * 					Counts one tick off every eye, and steps the ones
+ * 					that reach zero to their next frame (back to 0
+ * 					after the last one).
+ * -------------------------------------------------------------------
+ * run()			:Method
+ * 					Takes the gpio to write, a frame clock that's been
+ * 					started at the tick period, and a stop signal.
+ * How it works:
+ * ------------
+ * Loop:
+ * 		write compose() to the LEDs,
+ * 		wait for the frame clock; if the stop signal goes off, we're
+ * 		done,
+ * 		advance().
+ * Returns when stopped, without touching the LEDs. Switching them off
+ * is up to the caller, with mask().
+ * -------------------------------------------------------------------
+ * mask(), eyes_running(), tick_count()
+ * 					:Methods. Every pin any eye drives, how many eyes
+ * 					we have, and how many ticks we've done.
+ * -------------------------------------------------------------------
+ */
+class compositor_class {
+	private:
+ // ===================================================================
+	larson_eye eyes[compositor_max_eyes];
+	int eye_count=0;
+	uint32_t all_mask=0;
+	uint64_t ticks=0;
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	bool add_eye(const larson_table *table,int start_frame,int ticks_per_step){
+		if (eye_count==compositor_max_eyes) return false;
+		if (start_frame<0 || start_frame>=table->length) return false;
+		if (ticks_per_step<1) return false;
+		larson_eye &eye=eyes[eye_count++];
+		eye.table=table;
+		eye.frame=start_frame;
+		eye.ticks_per_step=ticks_per_step;
+		eye.ticks_left=ticks_per_step;
+		all_mask|=table->all_mask;
+		return true;
+	};
+ // -------------------------------------------------------------------
+	uint32_t compose(void){
+		uint32_t lit=0;
+		for (int e=0;e<eye_count;e++){
+			lit|=eyes[e].table->frames[eyes[e].frame];
+		}
+		return lit;
+	};
+ // -------------------------------------------------------------------
+	void advance(void){
+		for (int e=0;e<eye_count;e++){
+			larson_eye &eye=eyes[e];
+			if (--eye.ticks_left>0) continue; //not due yet.
+			eye.ticks_left=eye.ticks_per_step;
+			if (++eye.frame==eye.table->length) eye.frame=0;
+		}
+		ticks++;
+	};
+ // -------------------------------------------------------------------
+	void run(gpio_register_class &gpio,frame_clock_class &frame_clock,
+			 stop_signal_class &stop_signal){
+		while(true){
+			gpio.write_leds(compose(),all_mask);
+			if (!frame_clock.wait(&stop_signal)) break; //SIGINT.
+			advance();
+		}
+	};
+ // -------------------------------------------------------------------
+	uint32_t mask(void){
+		return all_mask;
+	};
+ // -------------------------------------------------------------------
+	int eyes_running(void){
+		return eye_count;
+	};
+ // -------------------------------------------------------------------
+	uint64_t tick_count(void){
+		return ticks;
+	};
+ // -------------------------------------------------------------------
+}; //end of compositor_class
+
+#endif
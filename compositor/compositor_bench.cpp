@@ -0,0 +1,229 @@
+ /*
+  * compositor_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * compositor_bench
+ * What does an eye cost? This program runs 2, 8 and 64 eyes against
+ * the file-backed GPIO stand-in, two ways:
+ * 		threads		one thread per eye, each writing its own pins and
+ * 					sleeping to its own deadlines, like Larson_pthread.
+ * 		compositor	compositor_class: one thread, one write per tick.
+ * Eye e steps every 1+e%4 ticks, so they don't all wake at once, and
+ * scans a stretch of the array that overlaps its neighbors once there
+ * are more eyes than fit. For each run we print:
+ * 		cpu			CPU time used, as a percentage of one core.
+ * 		writes/sec	register frames written per second.
+ * 		jitter		how late the wakeups were: median, 99th percentile
+ * 					and worst, in us.
+ *
+ * Usage: compositor_bench [stand-in file] [tick in us] [seconds]
+ * Defaults are /tmp/gpiomem, 1000us and 2 seconds per run.
+ * Compile with:
+ * 		g++ -O2 -o compositor_bench compositor_bench.cpp -lpthread
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm> //sort().
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/resource.h> //getrusage(), for CPU time.
+#include "compositor.h"
+
+#define LEDs 20
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+larson_table eye_tables[compositor_max_eyes];
+gpio_register_class gpio;
+int64_t tick_ns;
+int64_t start_ns; //every eye's deadlines count from here.
+volatile bool running=false;
+volatile uint64_t writes=0;
+
+/* Each eye thread keeps its own lateness list, so nobody has to lock
+ * anything while the clock is running. The compositor uses list 0.
+ */
+struct eye_thread_data {
+	int eye;
+	vector<int64_t> late_ns;
+};
+eye_thread_data thread_data[compositor_max_eyes];
+
+double cpu_seconds(){
+	rusage usage;
+	getrusage(RUSAGE_SELF,&usage);
+	return usage.ru_utime.tv_sec+usage.ru_utime.tv_usec/1e6+
+		   usage.ru_stime.tv_sec+usage.ru_stime.tv_usec/1e6;
+}
+
+/* void sleep_to(int64_t deadline)
+ * clock_nanosleep() to an absolute deadline, like frame_clock_class.
+ */
+void sleep_to(int64_t deadline){
+	timespec wake;
+	wake.tv_sec=deadline/1000000000LL;
+	wake.tv_nsec=deadline%1000000000LL;
+	while (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&wake,NULL)==EINTR){
+		//same deadline, go back to sleep.
+	}
+}
+
+/* void *eye_thread(void *vp)
+ * One eye, the thread-per-eye way. Write our frame to our own pins,
+ * sleep to the next step, record how late we woke, step.
+ */
+void *eye_thread(void *vp){
+	eye_thread_data &data=*(eye_thread_data *)vp;
+	const larson_table &table=eye_tables[data.eye];
+	int64_t step_ns=tick_ns*(1+data.eye%4);
+	int64_t deadline=start_ns;
+	int c=0;
+	while (running){
+		gpio.write_leds(table.frames[c],table.all_mask);
+		__sync_fetch_and_add(&writes,1);
+		deadline+=step_ns;
+		sleep_to(deadline);
+		data.late_ns.push_back(timespec_ns(clock_now())-deadline);
+		if (++c==table.length) c=0;
+	}
+	return(NULL);
+}
+
+/* void *compositor_thread(void *vp)
+ * All the eyes, the compositor way. vp points at the compositor.
+ * This is compositor_class::run(), with our own clock so we can keep
+ * every lateness instead of a histogram.
+ */
+void *compositor_thread(void *vp){
+	compositor_class &compositor=*(compositor_class *)vp;
+	int64_t deadline=start_ns;
+	while (running){
+		gpio.write_leds(compositor.compose(),compositor.mask());
+		writes=writes+1;
+		deadline+=tick_ns;
+		sleep_to(deadline);
+		thread_data[0].late_ns.push_back(timespec_ns(clock_now())-deadline);
+		compositor.advance();
+	}
+	return(NULL);
+}
+
+/* void build_tables(int eyes)
+ * Give each eye a stretch of the array: LEDs/eyes wide, but never
+ * less than 2, so with more eyes than LEDs they overlap.
+ */
+void build_tables(int eyes){
+	int width=LEDs/eyes<2?2:LEDs/eyes;
+	for (int e=0;e<eyes;e++){
+		int first=e*LEDs/eyes;
+		if (first+width>LEDs) first=LEDs-width;
+		eye_tables[e]=make_larson_table(pins,first,first+width);
+	}
+}
+
+/* void run(int eyes, bool use_compositor, int seconds)
+ * Run one configuration for seconds seconds, then print its numbers.
+ */
+void run(int eyes,bool use_compositor,int seconds){
+	compositor_class compositor;
+	pthread_t threads[compositor_max_eyes];
+	int thread_count=use_compositor?1:eyes;
+	size_t expected=(size_t)(seconds*1000000000LL/tick_ns)+16;
+
+	build_tables(eyes);
+	for (int e=0;e<eyes;e++){
+		compositor.add_eye(&eye_tables[e],0,1+e%4);
+		thread_data[e].eye=e;
+		thread_data[e].late_ns.clear();
+		thread_data[e].late_ns.reserve(expected); //no allocating on the clock.
+	}
+
+	writes=0;
+	running=true;
+	double cpu_start=cpu_seconds();
+	start_ns=timespec_ns(clock_now());
+	for (int t=0;t<thread_count;t++){
+		if (use_compositor){
+			pthread_create(&threads[t],NULL,compositor_thread,&compositor);
+		}else{
+			pthread_create(&threads[t],NULL,eye_thread,&thread_data[t]);
+		}
+	}
+	sleep(seconds);
+	running=false;
+	for (int t=0;t<thread_count;t++){
+		pthread_join(threads[t],NULL);
+	}
+	double elapsed=(timespec_ns(clock_now())-start_ns)/1e9;
+	double cpu=cpu_seconds()-cpu_start;
+
+	vector<int64_t> late;
+	for (int t=0;t<thread_count;t++){
+		late.insert(late.end(),thread_data[t].late_ns.begin(),
+					thread_data[t].late_ns.end());
+	}
+	sort(late.begin(),late.end());
+	size_t n=late.size();
+
+	cout<<eyes<<" eyes, "<<(use_compositor?"compositor":"threads   ")
+		<<": cpu "<<100*cpu/elapsed<<"%, "<<(long)(writes/elapsed)
+		<<" writes/sec, jitter p50 "<<late[n/2]/1000<<"us, p99 "
+		<<late[n*99/100]/1000<<"us, max "<<late[n-1]/1000<<"us"<<endl;
+}
+
+/*
+ * Main()
+ * Parameters: optional stand-in file, tick in us, and seconds per run.
+ * Returns 0, or 1 if we can't map the stand-in.
+ */
+int main(int argc,char *argv[]){
+	const char *path="/tmp/gpiomem";
+	int tick_us=1000;
+	int seconds=2;
+	const int eye_counts[]={2,8,64};
+	if (argc>1) path=argv[1];
+	if (argc>2) tick_us=atoi(argv[2]);
+	if (argc>3) seconds=atoi(argv[3]);
+	if (tick_us<1) tick_us=1;
+	if (seconds<1) seconds=1;
+	tick_ns=tick_us*1000LL;
+
+	if (!gpio.setup(path)){
+		cout<<"Unable to map "<<path<<". Exiting."<<endl;
+		return 1;
+	}
+	for (int c=0;c<LEDs;c++){
+		gpio.output_mode(pins[c]);
+	}
+
+	cout<<"Tick "<<tick_us<<"us, "<<seconds<<" seconds per run."<<endl;
+	for (int eyes : eye_counts){
+		run(eyes,false,seconds);
+		run(eyes,true,seconds);
+	}
+	gpio.write_leds(0,gpio_register_class::pin_mask(pins,LEDs));
+	return 0;
+}
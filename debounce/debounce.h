@@ -0,0 +1,218 @@
+ /*
+  * debounce.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * debounce.h
+ * button_interrupt debounces its one button by ignoring any press that
+ * comes within 100ms of the last edge. That throws away real presses
+ * if you press quickly, and it takes a timer per button.
+ *
+ * debounce_class debounces up to 32 inputs at once, from samples of
+ * the whole GPLEV0 register taken at a steady rate (gpio_register_class
+ * read_levels(), say, every 100us). Each input has an integrating
+ * counter: every sample where the input disagrees with its debounced
+ * level counts up, every sample where it agrees counts down (but not
+ * below zero), and when the count reaches 2^bits, the debounced level
+ * flips and the count starts again from zero. Bounce, which disagrees
+ * and agrees by turns, goes nowhere; a real change gets there in 2^bits
+ * samples. At 10kHz with bits=6, that's 6.4ms, and presses can come as
+ * fast as the button can make them.
+ *
+ * How it works:
+ * We don't keep 32 counters. We keep bits words, and word b holds bit b
+ * of every input's counter: input n's count is bit n of count[0], plus
+ * twice bit n of count[1], and so on. These are called vertical
+ * counters. Then counting all 32 inputs up or down at once is the same
+ * logic as a ripple carry adder, done with AND, XOR and OR on whole
+ * words:
+ * 		delta = which inputs disagree with their debounced level,
+ * 		carry = delta (count these up),
+ * 		borrow = the inputs that agree and aren't at zero (count these
+ * 		down),
+ * 		for each bit b, flip count[b] wherever there's a carry or a
+ * 		borrow, then the carry goes on where count[b] was 1, and the
+ * 		borrow goes on where it was 0.
+ * Whatever carry comes out of the top bit is the inputs whose counts
+ * just reached 2^bits (and wrapped round to zero). Those flip. That's
+ * about five instructions a bit for all 32 inputs, however many of
+ * them are bouncing.
+ *
+ * A flip is a press or a release, depending on which way the input
+ * goes. Buttons wired like button_polled's (to the positive rail, with
+ * the pulldown on) are pressed when HIGH; tell setup() about any that
+ * are pressed when LOW.
+*/
+
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+
+#define debounce_max_bits 8 //counts up to 256 samples.
+
+/* debounce_event
+ * -------------------------------------------------------------------
+ * pin			the BCM pin number.
+ * pressed		true for a press, false for a release.
+ * tick			the number of the sample that finished debouncing it,
+ * 				counting from 1.
+ * -------------------------------------------------------------------
+ */
+struct debounce_event {
+	int pin;
+	bool pressed;
+	uint64_t tick;
+};
+
+/* debounce_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * inputs			:Variable. The mask of pins we debounce. Other bits
+ * 					of the samples are ignored.
+ * active_low		:Variable. The mask of pins that are pressed when
+ * 					LOW.
+ * bits				:Variable. How many bits the counters have.
+ * count[]			:Variable. The vertical counters. count[b] is bit b
+ * 					of every input's counter.
+ * state			:Variable. The debounced levels.
+ * changed			:Variable. The inputs that flipped on the last
+ * 					sample.
+ * ticks, presses, releases
+ * 					:Variables. Samples taken, and presses and releases
+ * 					seen.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Takes the mask of input pins, the counter bits (1
+ * 					to debounce_max_bits), the levels the inputs are at
+ * 					now, which become the debounced levels without any
+ * 					events, and optionally the mask of pins pressed
+ * 					when LOW. Returns false if bits is out of range.
+ * -------------------------------------------------------------------
+ * sample()			:Method
+ * 					Takes a sample of the levels (GPLEV0) and returns
+ * 					the mask of inputs whose debounced level flipped.
+ * 					Call it once a tick, at a steady rate.
+ * -------------------------------------------------------------------
+ * pressed_mask()	:Method
+ * 					The inputs that are pressed, debounced.
+ * -------------------------------------------------------------------
+ * press_mask(), release_mask()
+ * 					:Methods. The inputs pressed or released by the
+ * 					last sample.
+ * -------------------------------------------------------------------
+ * events()			:Method
+ * 					Takes an array of debounce_events and its size, and
+ * 					fills it in with the last sample's flips, lowest
+ * 					pin first. Returns how many it filled in.
+ * -------------------------------------------------------------------
+ * settle_samples()	:Method
+ * 					How many samples a clean change takes to come
+ * 					through: 2^bits.
+ * -------------------------------------------------------------------
+ * levels(), tick_count(), press_count(), release_count()
+ * 					:Methods. The debounced levels and the counters.
+ * -------------------------------------------------------------------
+ */
+class debounce_class {
+	private:
+ // ===================================================================
+	uint32_t inputs=0;
+	uint32_t active_low=0;
+	int bits=0;
+	uint32_t count[debounce_max_bits]={0};
+	uint32_t state=0;
+	uint32_t changed=0;
+	uint64_t ticks=0;
+	uint64_t presses=0;
+	uint64_t releases=0;
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	bool setup(uint32_t input_mask,int counter_bits,uint32_t levels,uint32_t low_mask=0){
+		if (counter_bits<1 || counter_bits>debounce_max_bits) return false;
+		inputs=input_mask;
+		active_low=low_mask & input_mask;
+		bits=counter_bits;
+		for (int b=0;b<debounce_max_bits;b++) count[b]=0;
+		state=levels & inputs;
+		changed=0;
+		ticks=presses=releases=0;
+		return true;
+	};
+ // -------------------------------------------------------------------
+	uint32_t sample(uint32_t levels){
+		uint32_t delta=(levels ^ state) & inputs;
+		uint32_t nonzero=0;
+		for (int b=0;b<bits;b++) nonzero|=count[b];
+		uint32_t carry=delta;
+		uint32_t borrow=~delta & nonzero;
+		for (int b=0;b<bits;b++){
+			uint32_t was=count[b];
+			count[b]=was ^ (carry | borrow);
+			carry&=was;
+			borrow&=~was;
+		}
+		changed=carry;
+		state^=changed;
+		ticks++;
+		if (changed){
+			presses+=__builtin_popcount(press_mask());
+			releases+=__builtin_popcount(release_mask());
+		}
+		return changed;
+	};
+ // -------------------------------------------------------------------
+	uint32_t pressed_mask(void){
+		return (state ^ active_low) & inputs;
+	};
+	uint32_t press_mask(void){
+		return changed & pressed_mask();
+	};
+	uint32_t release_mask(void){
+		return changed & ~pressed_mask();
+	};
+ // -------------------------------------------------------------------
+	int events(debounce_event *out,int size){
+		uint32_t left=changed;
+		uint32_t down=pressed_mask();
+		int made=0;
+		while (left && made<size){
+			int pin=__builtin_ctz(left);
+			left&=left-1; //clear the lowest set bit.
+			out[made++]=debounce_event{pin,(down>>pin & 1)!=0,ticks};
+		}
+		return made;
+	};
+ // -------------------------------------------------------------------
+	int settle_samples(void){ return 1<<bits; };
+	uint32_t levels(void){ return state; };
+	uint64_t tick_count(void){ return ticks; };
+	uint64_t press_count(void){ return presses; };
+	uint64_t release_count(void){ return releases; };
+ // -------------------------------------------------------------------
+}; //end of debounce_class
+
+#endif
@@ -0,0 +1,258 @@
+ /*
+  * debounce_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * debounce_bench
+ * Makes up seconds' worth of 10kHz samples of 32 bouncing buttons, and
+ * runs debounce_class over them:
+ * 		check		against a plain loop with one counter per pin,
+ * 					which must flip exactly the same pins on exactly
+ * 					the same samples, and against the buttons, which
+ * 					must get exactly the presses they were given. For
+ * 					comparison, how many of those presses
+ * 					button_interrupt's 100ms rule would have counted.
+ * 		flat out	how many samples a second each of the two can
+ * 					debounce, and what share of one CPU 10kHz would
+ * 					take.
+ * 		10kHz		a real sampling loop, a sample every 100us on
+ * 					frame_clock_class::wait_until() deadlines, for the
+ * 					same number of seconds: how late the samples were,
+ * 					how many ticks we missed, and how much CPU it took.
+ * The buttons: each is pressed for 30 to 150ms and let go for 30 to
+ * 150ms, over and over, and every press and release bounces at random
+ * for up to 3ms first. The last 150ms is quiet. The randomness is
+ * seeded, so every run gets the same buttons.
+ *
+ * Usage: debounce_bench [seconds] [bits]
+ * Compile with:
+ * 		g++ -O2 -o debounce_bench debounce_bench.cpp
+*/
+
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "debounce.h"
+#include "../frame_clock/frame_clock.h"
+
+#define sample_hz 10000
+#define bench_pins 32
+#define bounce_ticks 30 //3ms at 10kHz.
+#define shortest_ticks 300 //30ms.
+#define longest_ticks 1500 //150ms.
+#define lockout_ticks 1000 //button_interrupt's 100ms.
+#define flat_out_passes 20
+
+using namespace std;
+
+vector<uint32_t> samples; //the whole run, a word per tick.
+uint64_t presses_made=0;
+
+/* uint32_t next_random()
+ * xorshift32. Seeded, so every run is the same.
+ */
+uint32_t random_state=2463534242u;
+uint32_t next_random(){
+	random_state^=random_state<<13;
+	random_state^=random_state>>17;
+	random_state^=random_state<<5;
+	return random_state;
+}
+
+/* void make_samples(int ticks)
+ * For each pin, walk through the run, alternating pressed and let go
+ * for a random time each, with bounce_ticks of random levels at the
+ * start of each press and release. A press only starts if it ends
+ * longest_ticks before the run does, so the last release has time to
+ * debounce. Counts the presses.
+ */
+void make_samples(int ticks){
+	samples.assign(ticks,0);
+	for (int pin=0;pin<bench_pins;pin++){
+		uint32_t bit=1u<<pin;
+		int t=next_random()%longest_ticks; //so they don't all start together.
+		while (true){
+			int length=shortest_ticks+next_random()%(longest_ticks-shortest_ticks);
+			if (t+length>ticks-longest_ticks) break;
+			presses_made++;
+			for (int pressed=1;pressed>=0;pressed--){
+				int bounce=next_random()%bounce_ticks;
+				for (int c=0;c<length && t<ticks;c++,t++){
+					bool level=c<bounce?(next_random() & 1):pressed;
+					if (level) samples[t]|=bit;
+				}
+				length=shortest_ticks+next_random()%(longest_ticks-shortest_ticks);
+			}
+		}
+	}
+}
+
+/* scalar_debounce
+ * The same integrating debouncer, the obvious way: a counter per pin.
+ */
+struct scalar_debounce {
+	int counts[bench_pins]={0};
+	uint32_t state=0;
+	int limit=0;
+	uint32_t sample(uint32_t levels){
+		uint32_t changed=0;
+		for (int pin=0;pin<bench_pins;pin++){
+			uint32_t bit=1u<<pin;
+			if ((levels ^ state) & bit){
+				if (++counts[pin]==limit){
+					counts[pin]=0;
+					changed|=bit;
+				}
+			}else if (counts[pin]>0){
+				counts[pin]--;
+			}
+		}
+		state^=changed;
+		return changed;
+	}
+};
+
+double seconds_now(){
+	return timespec_ns(clock_now())/1e9;
+}
+
+double cpu_seconds_now(){
+	timespec now;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&now);
+	return now.tv_sec+now.tv_nsec/1e9;
+}
+
+/* bool check(bits)
+ * Runs both debouncers over the samples and compares them tick by
+ * tick, and counts presses three ways.
+ */
+bool check(int bits){
+	debounce_class debounce;
+	debounce.setup(0xffffffffu,bits,0);
+	scalar_debounce scalar;
+	scalar.limit=1<<bits;
+	uint64_t mismatches=0;
+	uint64_t lockout_presses=0;
+	uint64_t last_edge[bench_pins]={0};
+	uint32_t previous=0;
+	for (size_t t=0;t<samples.size();t++){
+		if (debounce.sample(samples[t])!=scalar.sample(samples[t])) mismatches++;
+		uint32_t rising=samples[t] & ~previous; //what would fire an interrupt.
+		while (rising){
+			int pin=__builtin_ctz(rising);
+			rising&=rising-1;
+			if (t-last_edge[pin]>lockout_ticks) lockout_presses++;
+			last_edge[pin]=t;
+		}
+		previous=samples[t];
+	}
+	cout<<"check: "<<samples.size()<<" samples of "<<bench_pins<<" buttons, "
+		<<presses_made<<" presses made. Debounced "<<debounce.press_count()
+		<<" presses, "<<debounce.release_count()<<" releases ("
+		<<debounce.settle_samples()*1000000/sample_hz<<"us to settle). "
+		<<"100ms rule: "<<lockout_presses<<" presses."<<endl;
+	if (mismatches){
+		cout<<"check: "<<mismatches<<" samples where the two debouncers disagree!"<<endl;
+		return false;
+	}
+	if (debounce.press_count()!=presses_made){
+		cout<<"check: debounced presses don't match the presses made!"<<endl;
+		return false;
+	}
+	return true;
+}
+
+/* void flat_out(bits)
+ * Both debouncers over the samples flat_out_passes times.
+ */
+void flat_out(int bits){
+	debounce_class debounce;
+	debounce.setup(0xffffffffu,bits,0);
+	scalar_debounce scalar;
+	scalar.limit=1<<bits;
+	uint64_t n=(uint64_t)samples.size()*flat_out_passes;
+	volatile uint32_t sink=0; //so the work isn't thrown away.
+
+	double start=seconds_now();
+	for (int p=0;p<flat_out_passes;p++){
+		for (size_t t=0;t<samples.size();t++) sink=sink^debounce.sample(samples[t]);
+	}
+	double vertical=seconds_now()-start;
+	start=seconds_now();
+	for (int p=0;p<flat_out_passes;p++){
+		for (size_t t=0;t<samples.size();t++) sink=sink^scalar.sample(samples[t]);
+	}
+	double per_pin=seconds_now()-start;
+
+	cout<<"flat out: vertical "<<(uint64_t)(n/vertical)<<" samples/sec ("
+		<<vertical*1e9/n<<"ns, "<<vertical*sample_hz*100/n<<"% of a CPU at 10kHz), "
+		<<"per pin "<<(uint64_t)(n/per_pin)<<" samples/sec ("
+		<<per_pin*1e9/n<<"ns, "<<per_pin*sample_hz*100/n<<"% of a CPU at 10kHz)."<<endl;
+}
+
+/* void real_time(bits)
+ * Samples at sample_hz for as long as the samples last, on absolute
+ * deadlines, so lateness doesn't add up. A tick we wake up for more
+ * than a whole period late is counted as missed, but still sampled.
+ */
+void real_time(int bits){
+	debounce_class debounce;
+	debounce.setup(0xffffffffu,bits,0);
+	frame_clock_class sample_clock;
+	int64_t period=1000000000LL/sample_hz;
+	int64_t deadline=timespec_ns(clock_now());
+	uint64_t missed=0;
+	double cpu_start=cpu_seconds_now();
+	double start=seconds_now();
+	for (size_t t=0;t<samples.size();t++){
+		deadline+=period;
+		sample_clock.wait_until(deadline);
+		if (timespec_ns(clock_now())-deadline>period) missed++;
+		debounce.sample(samples[t]);
+	}
+	double took=seconds_now()-start;
+	double cpu=cpu_seconds_now()-cpu_start;
+	cout<<"10kHz: "<<samples.size()<<" ticks in "<<took<<"s, "<<missed
+		<<" missed, worst "<<sample_clock.worst_late_ns()/1000<<"us late, "
+		<<cpu*100/took<<"% CPU (mostly sleeping and waking). "
+		<<debounce.press_count()<<" presses."<<endl;
+}
+
+/*
+ * Main()
+ * Parameters: how many seconds of samples (2 if left out), and how many
+ * counter bits (6 if left out).
+ * Returns 0, or 1 if the check fails.
+ */
+int main(int argc,char *argv[]){
+	double seconds=argc>1?atof(argv[1]):2;
+	int bits=argc>2?atoi(argv[2]):6;
+	if (seconds<=0) seconds=2;
+	if (bits<1 || bits>debounce_max_bits) bits=6;
+	make_samples((int)(seconds*sample_hz));
+	if (!check(bits)) return 1;
+	flat_out(bits);
+	real_time(bits);
+	return 0;
+}
@@ -0,0 +1,128 @@
+ /*
+  * debounce_watch.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * debounce_watch
+ * Watches a bank of buttons and prints every press and release, until
+ * SIGINT. The buttons are wired like button_polled's, between a GPIO
+ * and the positive rail, so they're pressed when HIGH. Pins are inputs
+ * unless something has made them outputs, but gpio_register_class
+ * doesn't do pulls, so turn the pulldowns on first (wiringPi's
+ * "gpio -g mode 12 down" does it). If you don't name any pins, we
+ * watch button_pin.
+ *
+ * How it works:
+ * Each tick, read GPLEV0, all the pins in one word, and hand it to
+ * debounce_class, which debounces all the buttons at once. Then print
+ * whatever it says changed. The ticks are on absolute deadlines, the
+ * way frame_clock_class does frames, so the debounce time stays what
+ * it says.
+ *
+ * Usage: debounce_watch [stand-in] [hz] [bits] [pin...]
+ * 		hz		samples a second, 10000 if left out.
+ * 		bits	counter bits, 6 if left out. A clean press takes 2^bits
+ * 				samples to come through: 6.4ms at 10kHz.
+ * Compile with:
+ * 		g++ -O2 -o debounce_watch debounce_watch.cpp
+*/
+
+#include <iostream>
+#include <stdlib.h>
+#include "debounce.h"
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../frame_clock/frame_clock.h"
+#include "../stop_signal/stop_signal.h"
+
+#define button_pin 12
+#define max_buttons 32
+
+using namespace std;
+
+gpio_register_class gpio;
+frame_clock_class sample_clock;
+stop_signal_class stop_signal;
+debounce_class debounce;
+
+/*
+ * Main()
+ * Parameters: the options above.
+ * Returns 0, or 1 if we can't set up.
+ *
+ * How it works:
+ * -------------
+ * Set up the stop signal, and map the GPIO.
+ * Set up the debouncer with the pins' levels now, so buttons that are
+ * already held don't count as presses.
+ * Loop until SIGINT: wait for the next tick, sample, print events.
+ * Print the totals and how late the ticks were.
+ */
+int main(int argc,char *argv[]){
+	if (!stop_signal.setup()){
+		cout<<"Unable to set up the stop signal. Exiting.\n"<<flush;
+		return 1;
+	}
+	const char *stand_in=argc>1?argv[1]:gpiomem_path;
+	int hz=argc>2?atoi(argv[2]):10000;
+	int bits=argc>3?atoi(argv[3]):6;
+	int buttons[max_buttons]={button_pin};
+	int button_count=1;
+	if (argc>4){
+		button_count=0;
+		for (int c=4;c<argc && button_count<max_buttons;c++){
+			buttons[button_count++]=atoi(argv[c]);
+		}
+	}
+	if (hz<1) hz=10000;
+
+	if (!gpio.setup(stand_in)){
+		cout<<"Unable to map "<<stand_in<<". Exiting."<<endl;
+		return 1;
+	}
+	uint32_t inputs=gpio_register_class::pin_mask(buttons,button_count);
+	if (!debounce.setup(inputs,bits,gpio.read_levels())){
+		cout<<"Counter bits must be 1 to "<<debounce_max_bits<<". Exiting."<<endl;
+		return 1;
+	}
+	cout<<"Watching "<<button_count<<" buttons at "<<hz<<"Hz, "
+		<<debounce.settle_samples()*1000000LL/hz<<"us to settle.\n"<<flush;
+
+	int64_t period=1000000000LL/hz;
+	int64_t start=timespec_ns(clock_now());
+	int64_t deadline=start;
+	debounce_event events[max_buttons];
+	while (true){
+		deadline+=period;
+		if (!sample_clock.wait_until(deadline,&stop_signal)) break; //SIGINT.
+		if (!debounce.sample(gpio.read_levels())) continue;
+		int count=debounce.events(events,max_buttons);
+		for (int c=0;c<count;c++){
+			cout<<(deadline-start)/1000000.0<<"ms: pin "<<events[c].pin
+				<<(events[c].pressed?" pressed":" released")<<endl;
+		}
+	}
+
+	cout<<debounce.press_count()<<" presses, "<<debounce.release_count()
+		<<" releases in "<<debounce.tick_count()<<" samples."<<endl;
+	sample_clock.dump("Samples");
+	return 0;
+}
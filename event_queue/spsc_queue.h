@@ -0,0 +1,147 @@
+ /*
+  * spsc_queue.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * spsc_queue.h
+ * A queue for handing things from exactly one thread (the producer) to
+ * exactly one other thread (the consumer), without either of them ever
+ * locking anything or waiting for the other. It's made for interrupt
+ * service routines: wiringPi calls an ISR on its own thread, and the
+ * ISR should get in and out as fast as it can, so it pushes what
+ * happened onto the queue and the main loop does the slow part (the
+ * printing) when it gets round to it.
+ *
+ * push() never waits. If the queue is full, the item is dropped and
+ * counted, because an ISR that waited for the main loop would be no
+ * better than one that printed. So pick a capacity that covers the
+ * longest burst you expect between two drains, and watch dropped_count().
+ *
+ * How it works:
+ * The items live in a ring of slots, capacity long (a power of two, so
+ * wrapping round is an AND, not a divide). There are two counters that
+ * only ever go up: head, the number of items ever pushed, which only
+ * the producer writes, and tail, the number ever popped, which only the
+ * consumer writes. head-tail is how many are in the queue, and the
+ * counters wrap round harmlessly, since the subtraction is unsigned.
+ * 		push() copies the item into slot head, THEN moves head on, with
+ * 		a release store, so the consumer can't see the new head before
+ * 		it can see the item.
+ * 		pop() reads head with an acquire load (pairing with that
+ * 		release), copies the item out of slot tail, THEN moves tail on,
+ * 		so the producer can't reuse the slot before we've read it.
+ * head and tail are on cache lines of their own, so the two threads
+ * aren't fighting over one line every time either of them moves.
+*/
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stdint.h>
+
+#define spsc_cache_line 64
+
+/* spsc_queue_class<T, capacity> declaration
+ * -------------------------------------------------------------------
+ * T is what we queue. It gets copied in and out, so keep it small and
+ * plain. capacity must be a power of two.
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * head				:Variable. Items ever pushed. The producer's.
+ * tail				:Variable. Items ever popped. The consumer's.
+ * dropped			:Variable. Items push() had no room for. Written
+ * 					only by the producer, but read by anybody.
+ * deepest			:Variable. The most items the queue has held at
+ * 					once. Also the producer's.
+ * slots[]			:Variable. The ring.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * push()			:Method. Producer only.
+ * 					Takes an item. Copies it into the queue and returns
+ * 					true, or counts it as dropped and returns false if
+ * 					the queue is full. Never waits.
+ * -------------------------------------------------------------------
+ * pop()			:Method. Consumer only.
+ * 					Takes a place to put an item. Copies the oldest
+ * 					item there and returns true, or returns false if
+ * 					the queue is empty. Never waits.
+ * -------------------------------------------------------------------
+ * size()			:Method
+ * 					How many items are in the queue. Only a snapshot,
+ * 					since the other thread may be moving it.
+ * -------------------------------------------------------------------
+ * dropped_count(), deepest_count()
+ * 					:Methods. The counters.
+ * -------------------------------------------------------------------
+ */
+template <typename T,uint32_t capacity>
+class spsc_queue_class {
+	static_assert(capacity>0 && (capacity & (capacity-1))==0,
+				  "spsc_queue_class capacity must be a power of two.");
+	private:
+ // ===================================================================
+	alignas(spsc_cache_line) std::atomic<uint32_t> head{0};
+	std::atomic<uint64_t> dropped{0};
+	std::atomic<uint32_t> deepest{0};
+	alignas(spsc_cache_line) std::atomic<uint32_t> tail{0};
+	alignas(spsc_cache_line) T slots[capacity];
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	bool push(const T &item){
+		uint32_t here=head.load(std::memory_order_relaxed); //only we write it.
+		uint32_t used=here-tail.load(std::memory_order_acquire);
+		if (used>=capacity){
+			dropped.store(dropped.load(std::memory_order_relaxed)+1,
+						  std::memory_order_relaxed);
+			return false;
+		}
+		slots[here & (capacity-1)]=item;
+		head.store(here+1,std::memory_order_release);
+		if (used+1>deepest.load(std::memory_order_relaxed)){
+			deepest.store(used+1,std::memory_order_relaxed);
+		}
+		return true;
+	};
+ // -------------------------------------------------------------------
+	bool pop(T &item){
+		uint32_t here=tail.load(std::memory_order_relaxed); //only we write it.
+		if (here==head.load(std::memory_order_acquire)) return false;
+		item=slots[here & (capacity-1)];
+		tail.store(here+1,std::memory_order_release);
+		return true;
+	};
+ // -------------------------------------------------------------------
+	uint32_t size(void){
+		uint32_t popped=tail.load(std::memory_order_acquire); //first, so it can't pass head.
+		return head.load(std::memory_order_acquire)-popped;
+	};
+ // -------------------------------------------------------------------
+	uint64_t dropped_count(void){ return dropped.load(std::memory_order_relaxed); };
+	uint32_t deepest_count(void){ return deepest.load(std::memory_order_relaxed); };
+ // -------------------------------------------------------------------
+}; //end of spsc_queue_class
+
+#endif
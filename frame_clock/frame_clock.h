@@ -0,0 +1,243 @@
+ /*
+  * frame_clock.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * frame_clock.h
+ * delay(40) waits 40 milliseconds from whenever you call it. So a
+ * scanner that writes its LEDs and then calls delay(40) actually takes
+ * 40ms, plus however long the writes took, plus however long the
+ * kernel took to wake it up. Every step is a little long, and the
+ * error adds up. Two threads doing it drift apart.
+ *
+ * frame_clock_class works out when each frame is SUPPOSED to start
+ * (the start time plus the frame number times the period) and sleeps
+ * until exactly then with clock_nanosleep(), using CLOCK_MONOTONIC and
+ * TIMER_ABSTIME. If one frame wakes up late, the next one is still
+ * aimed at the right time, so the error never adds up. Give two
+ * threads the same start time and they stay in step forever.
+ *
+ * If you hand wait() a stop_signal_class, it sleeps in that instead,
+ * so a SIGINT wakes it straight away rather than at the end of the
+ * frame.
+ *
+ * Every time it wakes up, it records how late it was in a histogram,
+ * which dump() prints. Each bucket is twice as wide as the one before,
+ * from under 1 microsecond up.
+*/
+
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include "../stop_signal/stop_signal.h"
+
+#define lateness_buckets 24 //bucket 23 is 2^22us (4 seconds) and up.
+
+/* timespec clock_now()
+ * Returns CLOCK_MONOTONIC right now. Use it to give several clocks
+ * the same start time.
+ */
+inline timespec clock_now(){
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now;
+}
+
+/* int64_t timespec_ns(timespec t)
+ * Returns t in nanoseconds, which is a lot easier to do math on.
+ */
+inline int64_t timespec_ns(timespec t){
+	return (int64_t)t.tv_sec*1000000000LL+t.tv_nsec;
+}
+
+/* frame_clock_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * period_ns		:Variable. How long a frame is, in nanoseconds.
+ * start_ns		:Variable. The start time, in ns.
+ * next_deadline	:Variable. When the next frame starts, in ns.
+ * histogram[]		:Variable. How many frames woke up in each lateness
+ * 					bucket.
+ * frames, overruns, worst_ns
+ * 					:Variables. How many frames we've waited for, how
+ * 					many frames we missed entirely because we were more
+ * 					than a whole period late, and the latest we've ever
+ * 					woken up.
+ * -------------------------------------------------------------------
+ * record()			:Method. Puts one wakeup in the histogram.
+ * -------------------------------------------------------------------
+ * sleep()			:Method
+ * 					Sleeps until a deadline, in stop_signal if we have
+ * 					one, or clock_nanosleep() if not. Returns false if
+ * 					the stop signal went off.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * start()			:Method
+ * 					Takes the period in milliseconds and the start
+ * 					time (now, if you leave it out). The first frame
+ * 					ends one period after the start time.
+ * -------------------------------------------------------------------
+ * wait()			:Method
+ * 					Sleeps until the end of the current frame. Takes
+ * 					an optional stop_signal_class. Returns true at the
+ * 					end of the frame, or false if the stop signal went
+ * 					off while we slept.
+ * How it works:
+ * ------------
+ * If we have a stop signal, sleep in its sleep_until(), and if that
+ * says we're stopping, return false straight away.
+ * Otherwise turn next_deadline into a timespec and hand it to 
+ * clock_nanosleep() with TIMER_ABSTIME. If a signal interrupts the
+ * sleep, just go back to sleep; the deadline hasn't moved, so we won't
+ * oversleep.
+ * When we wake up, see how late we are and record it.
+ * Then move the deadline on one period. If we're so late that the new
+ * deadline has already gone by, keep moving it on a period at a time
+ * and count each one as an overrun. That drops frames rather than
+ * trying to catch up by rushing through them. So after an overrun,
+ * don't count the returns to know which frame you're on: ask
+ * frame_number().
+ * -------------------------------------------------------------------
+ * frame_number()	:Method
+ * 					Returns which frame has just started, counting
+ * 					from 0 at the start time, skipped frames included.
+ * 					Two clocks with the same start time and period
+ * 					always agree on it, however late either wakes.
+ * -------------------------------------------------------------------
+ * wait_until()		:Method
+ * 					Takes a deadline in ns of CLOCK_MONOTONIC and an
+ * 					optional stop_signal_class, and sleeps until then,
+ * 					the same way wait() does, recording how late we
+ * 					woke. For schedules that aren't one period apart,
+ * 					like a trace being replayed. A deadline that's
+ * 					already gone by returns at once, late. Doesn't
+ * 					touch the periodic deadline or count overruns.
+ * -------------------------------------------------------------------
+ * dump()			:Method
+ * 					Takes a name and prints the histogram to cout,
+ * 					skipping empty buckets.
+ * -------------------------------------------------------------------
+ * worst_late_ns()	:Method
+ * 					Returns the latest we've ever woken up, in ns.
+ * -------------------------------------------------------------------
+ */
+class frame_clock_class {
+	private:
+ // ===================================================================
+	int64_t period_ns=0;
+	int64_t start_ns=0;
+	int64_t next_deadline=0;
+	uint32_t histogram[lateness_buckets]={0};
+	uint64_t frames=0;
+	uint64_t overruns=0;
+	int64_t worst_ns=0;
+ // -------------------------------------------------------------------
+	void record(int64_t late_ns){
+		int bucket=0;
+		int64_t late_us=late_ns/1000;
+		while (late_us>0 && bucket<lateness_buckets-1){ //log2, roughly.
+			late_us>>=1;
+			bucket++;
+		}
+		histogram[bucket]++;
+		frames++;
+		if (late_ns>worst_ns) worst_ns=late_ns;
+	}
+ // -------------------------------------------------------------------
+	bool sleep(int64_t deadline_ns,stop_signal_class *stop){
+		if (stop!=NULL) return stop->sleep_until(deadline_ns);
+		timespec deadline;
+		deadline.tv_sec=deadline_ns/1000000000LL;
+		deadline.tv_nsec=deadline_ns%1000000000LL;
+		while (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,
+							   &deadline,NULL)==EINTR){
+			//a signal woke us early. Same deadline, go back to sleep.
+		}
+		return true;
+	}
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	void start(int period_ms,timespec start_time=clock_now()){
+		period_ns=(int64_t)period_ms*1000000LL;
+		start_ns=timespec_ns(start_time);
+		next_deadline=start_ns+period_ns;
+	};
+ // -------------------------------------------------------------------
+	bool wait(stop_signal_class *stop=NULL){
+		if (!sleep(next_deadline,stop)) return false;
+
+		int64_t now=timespec_ns(clock_now());
+		record(now-next_deadline);
+
+		next_deadline+=period_ns;
+		while (next_deadline<=now){ //we missed a whole frame. Skip it.
+			next_deadline+=period_ns;
+			overruns++;
+		}
+		return true;
+	};
+ // -------------------------------------------------------------------
+	bool wait_until(int64_t deadline_ns,stop_signal_class *stop=NULL){
+		int64_t now=timespec_ns(clock_now());
+		if (deadline_ns<=now){ //already late. Don't sleep at all.
+			if (stop!=NULL && stop->stop_requested()) return false;
+		}else{
+			if (!sleep(deadline_ns,stop)) return false;
+			now=timespec_ns(clock_now());
+		}
+		record(now-deadline_ns);
+		return true;
+	};
+ // -------------------------------------------------------------------
+	int64_t frame_number(void){
+		return (next_deadline-start_ns)/period_ns-1;
+	};
+ // -------------------------------------------------------------------
+	void dump(std::string name){
+		std::cout<<name<<": "<<frames<<" frames, "<<overruns
+				 <<" overruns, worst "<<worst_ns/1000<<"us late."<<std::endl;
+		for (int c=0;c<lateness_buckets;c++){
+			if (histogram[c]==0) continue;
+			if (c==0){
+				std::cout<<"\t      <1us late: ";
+			}else{
+				std::cout<<"\t"<<(1L<<(c-1))<<"-"<<(1L<<c)<<"us late: ";
+			}
+			std::cout<<histogram[c]<<std::endl;
+		}
+	};
+ // -------------------------------------------------------------------
+	int64_t worst_late_ns(void){
+		return worst_ns;
+	};
+ // -------------------------------------------------------------------
+}; //end of frame_clock_class
+
+#endif
@@ -0,0 +1,520 @@
+ /*
+  * gpio_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * gpio_bench
+ * How fast is each way this archive has of putting something on the
+ * LEDs? This program runs each one flat out (no delays) for a while,
+ * timing every call, against backends that record what the pins did:
+ * 		digitalWrite		one step of larson.cpp's original loop: turn
+ * 							one LED on and the last one off, a
+ * 							digitalWrite() each.
+ * 		gpio_class_write	gpio_class::gpio_write() from Socket.cpp and
+ * 							Displaypost.cpp: clear_pins() (pinMode and
+ * 							digitalWrite on all 20 pins) then pow() for
+ * 							each of 8 bits. One byte per call.
+ * 		register_frame		one frame of larson.cpp as it is now: one
+ * 							gpio_register_class::write_leds().
+ * 		register_frame_traced
+ * 							the same, plus pin_trace_class::record(),
+ * 							which is what Larson_Threads does now.
+ * 		threads				Larson_pthread: two threads, each writing
+ * 							its half of the array with write_leds().
+ * 		processes			Larson.multiprocess: two processes, each
+ * 							writing its half into a shared_frame_class.
+ * 							(The flush is one write_leds(), which
+ * 							register_frame already measures.)
+ * The digitalWrite paths run against the simulated wiringPi, which
+ * records every transition; the register paths run against the
+ * file-backed GPIO stand-in, and we count the pins each frame changes.
+ *
+ * It prints one CSV line per path:
+ * 		path,calls,toggles_per_sec,frames_per_sec,bytes_per_sec,
+ * 		p50_ns,p99_ns,p999_ns
+ * A frame is one call. Bytes are LED states shown: a frame of 20 LEDs
+ * is 2.5 bytes, a gpio_write() of 8 LEDs is 1. The percentiles are of
+ * the time each call took, to within 1/16th.
+ *
+ * Given a baseline (a CSV from an earlier run, see --save-baseline),
+ * each line gets three more columns: the baseline's frames_per_sec,
+ * the change in percent, and ok, improved, regressed or new. A path
+ * is regressed if it's slower than the baseline by more than the
+ * tolerance. If any path regressed, we exit with status 3, so a script
+ * can tell. baseline.csv in this directory came from a build off the
+ * Pi, on one x86 core; make your own on the machine you care about.
+ *
+ * Usage: gpio_bench [--seconds s] [--stand-in file] [--baseline file]
+ * 					 [--save-baseline file] [--tolerance percent]
+ * Defaults are 1 second per path, /tmp/gpiomem and 10 percent.
+ * Compile with:
+ * 		g++ -O2 -I../wiringPi_sim -o gpio_bench gpio_bench.cpp \
+ * 			../wiringPi_sim/wiringPi_sim.cpp -lpthread
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <stdlib.h>
+#include <math.h> //pow(), for gpio_class.
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <wiringPi.h>
+#include "../wiringPi_sim/wiringPi_sim.h"
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../larson/larson_frames.h"
+#include "../shared_frame/shared_frame.h"
+#include "../pin_trace/pin_trace.h"
+
+#define LEDs 20
+#define latency_buckets (16+16*44) //exact to 16ns, then 16 per power of 2.
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+constexpr larson_table full_table=make_larson_table(pins,0,LEDs);
+constexpr larson_table low_table=make_larson_table(pins,0,LEDs/2);
+constexpr larson_table high_table=make_larson_table(pins,LEDs/2,LEDs);
+
+gpio_register_class gpio;
+pin_trace_class pin_trace;
+double run_seconds=1.0;
+
+inline int64_t now_ns(){
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (int64_t)now.tv_sec*1000000000LL+now.tv_nsec;
+}
+
+/* latency_histogram
+ * -------------------------------------------------------------------
+ * Call times, in buckets 1/16th of a power of two wide, so we can keep
+ * every call of a run in a few KB and still get percentiles to within
+ * about 6%. Plain data, so it can live in shared memory.
+ * -------------------------------------------------------------------
+ * record()		adds one call that took ns.
+ * merge()		adds another histogram to this one.
+ * percentile()	returns the ns that fraction p of the calls took no
+ * 				longer than (the top of that bucket).
+ * -------------------------------------------------------------------
+ */
+struct latency_histogram {
+	uint64_t counts[latency_buckets];
+	uint64_t total;
+
+	static int bucket(int64_t ns){
+		if (ns<16) return ns<0?0:(int)ns;
+		int power=63-__builtin_clzll((uint64_t)ns); //4 and up.
+		int sixteenth=(int)(ns>>(power-4))&15;
+		int b=16+(power-4)*16+sixteenth;
+		return b<latency_buckets?b:latency_buckets-1;
+	}
+	static int64_t top(int b){
+		if (b<16) return b;
+		int power=4+(b-16)/16;
+		int64_t sixteenth=(b-16)%16;
+		return ((16+sixteenth+1)<<(power-4))-1;
+	}
+	void record(int64_t ns){
+		counts[bucket(ns)]++;
+		total++;
+	}
+	void merge(const latency_histogram &other){
+		for (int b=0;b<latency_buckets;b++) counts[b]+=other.counts[b];
+		total+=other.total;
+	}
+	int64_t percentile(double p){
+		uint64_t rank=(uint64_t)ceil(p*total);
+		uint64_t seen=0;
+		for (int b=0;b<latency_buckets;b++){
+			seen+=counts[b];
+			if (seen>=rank && seen>0) return top(b);
+		}
+		return 0;
+	}
+};
+
+/* bench_result
+ * -------------------------------------------------------------------
+ * What one path did: how many calls, how long it took, how many pin
+ * transitions it made, how many LEDs each call shows, and how long
+ * each call took.
+ * -------------------------------------------------------------------
+ */
+struct bench_result {
+	string path;
+	uint64_t calls;
+	double seconds;
+	uint64_t toggles;
+	double leds_per_call;
+	latency_histogram latency;
+};
+
+/* gpio_class
+ * Copied from socket/Socket.cpp, with the debug output and delays
+ * taken out, and gpio_write() made public so we can call it.
+ */
+class gpio_class {
+	private:
+	int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+	public:
+	void gpio_write(uint8_t data){ //send data to the GPIO pins.
+		uint8_t mask=0;  //all the bits of mask start off as 0s.
+		clear_pins(); //make sure nothing is displayed already.
+		for (int c=0;c<8;c++){ //for 8 bits, we'll get 2^c.
+			mask=(uint8_t)pow(2.0,(float)c); //and switch on one bit only.
+			if (data & mask){ //and that one bit with data
+				digitalWrite(pins[8-c],LOW);  //if data had that bit set
+			}                                 //turn on that led.
+		}
+	}
+	void clear_pins(void){
+		for (int c=0;c<LEDs;c++){ //iterate through all the pins.
+			pinMode (pins[c],OUTPUT); //set them as OUTPUTS
+			digitalWrite(pins[c],HIGH); //And turn
+		}
+	};
+};
+
+/* int toggles(uint32_t before, uint32_t after, uint32_t mask)
+ * How many of the pins in mask are different.
+ */
+inline int toggles(uint32_t before,uint32_t after,uint32_t mask){
+	return __builtin_popcount((before^after)&mask);
+}
+
+/* bench_result bench_digitalWrite()
+ * larson.cpp's original loop, one step per call: up the array turning
+ * each LED on and the one below it off, then back down turning each
+ * on and the one above it off. The transitions come from the
+ * simulation's record.
+ */
+bench_result bench_digitalWrite(){
+	bench_result result{"digitalWrite",0,0,0,LEDs,{}};
+	for (int c=0;c<LEDs;c++){
+		pinMode(pins[c],OUTPUT);
+		digitalWrite(pins[c],HIGH);
+	}
+	uint64_t transitions_before=sim_recorded_count(); //not the trace, which stops at sim_trace_limit.
+	int c=0;
+	bool up=true;
+	int64_t start=now_ns();
+	int64_t end=start+(int64_t)(run_seconds*1e9);
+	int64_t after=start;
+	while (after<end){
+		int64_t before=now_ns();
+		digitalWrite(pins[c],LOW);
+		if (up && c>0) digitalWrite(pins[c-1],HIGH);
+		if (!up && c<LEDs-1) digitalWrite(pins[c+1],HIGH);
+		after=now_ns();
+		result.latency.record(after-before);
+		result.calls++;
+		if (up){
+			if (++c==LEDs){ c=LEDs-1; up=false; }
+		}else{
+			if (--c<0){ c=0; up=true; }
+		}
+	}
+	result.seconds=(after-start)/1e9;
+	result.toggles=sim_recorded_count()-transitions_before;
+	sim_clear_transitions(); //don't let the record eat all our memory.
+	return result;
+}
+
+/* bench_result bench_gpio_class()
+ * gpio_class::gpio_write() on every byte value in turn.
+ */
+bench_result bench_gpio_class(){
+	bench_result result{"gpio_class_write",0,0,0,8,{}};
+	gpio_class gpio_pins;
+	uint64_t transitions_before=sim_recorded_count(); //not the trace, which stops at sim_trace_limit.
+	uint8_t data=0;
+	int64_t start=now_ns();
+	int64_t end=start+(int64_t)(run_seconds*1e9);
+	int64_t after=start;
+	while (after<end){
+		int64_t before=now_ns();
+		gpio_pins.gpio_write(data++);
+		after=now_ns();
+		result.latency.record(after-before);
+		result.calls++;
+	}
+	result.seconds=(after-start)/1e9;
+	result.toggles=sim_recorded_count()-transitions_before;
+	sim_clear_transitions();
+	return result;
+}
+
+/* void run_frames(table, result, traced)
+ * The register paths' loop: write_leds() each frame of table in turn,
+ * and record it in pin_trace if traced is true, timing each, and
+ * count the pins each frame changes.
+ */
+void run_frames(const larson_table &table,bench_result &result,bool traced=false){
+	uint32_t shown=0;
+	int c=0;
+	int64_t start=now_ns();
+	int64_t end=start+(int64_t)(run_seconds*1e9);
+	int64_t after=start;
+	while (after<end){
+		int64_t before=now_ns();
+		gpio.write_leds(table.frames[c],table.all_mask);
+		if (traced) pin_trace.record(table.frames[c],table.all_mask);
+		after=now_ns();
+		result.latency.record(after-before);
+		result.calls++;
+		result.toggles+=toggles(shown,table.frames[c],table.all_mask);
+		shown=table.frames[c];
+		if (++c==table.length) c=0;
+	}
+	result.seconds=(after-start)/1e9;
+}
+
+bench_result bench_register_frame(){
+	bench_result result{"register_frame",0,0,0,LEDs,{}};
+	run_frames(full_table,result);
+	return result;
+}
+
+bench_result bench_register_frame_traced(){
+	bench_result result{"register_frame_traced",0,0,0,LEDs,{}};
+	run_frames(full_table,result,true);
+	return result;
+}
+
+/* bench_result bench_threads()
+ * Two threads, one per half, both running run_frames() at once. The
+ * calls and toggles add up; the run takes as long as the slower one.
+ */
+void *frames_thread(void *vp){
+	bench_result &half=*(bench_result *)vp;
+	run_frames(half.path=="low"?low_table:high_table,half);
+	return(NULL);
+}
+
+bench_result bench_threads(){
+	bench_result result{"threads",0,0,0,LEDs/2,{}};
+	bench_result *halves=new bench_result[2]{{"low",0,0,0,0,{}},{"high",0,0,0,0,{}}};
+	pthread_t threads[2];
+	for (int t=0;t<2;t++) pthread_create(&threads[t],NULL,frames_thread,&halves[t]);
+	for (int t=0;t<2;t++){
+		pthread_join(threads[t],NULL);
+		result.calls+=halves[t].calls;
+		result.toggles+=halves[t].toggles;
+		if (halves[t].seconds>result.seconds) result.seconds=halves[t].seconds;
+		result.latency.merge(halves[t].latency);
+	}
+	delete[] halves;
+	return result;
+}
+
+/* bench_result bench_processes()
+ * Two processes, one per half, each writing its half into a shared
+ * frame as fast as it can. Each one's counts and histogram go in
+ * shared memory, so we can add them up once they've exited.
+ */
+struct process_counts {
+	uint64_t calls;
+	uint64_t toggles;
+	double seconds;
+	latency_histogram latency;
+};
+
+bench_result bench_processes(){
+	bench_result result{"processes",0,0,0,LEDs/2,{}};
+	shared_frame_class shared_frame;
+	const uint32_t masks[2]={low_table.all_mask,high_table.all_mask};
+	process_counts *counts=(process_counts *)mmap(NULL,2*sizeof(process_counts),
+		PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+	if (counts==MAP_FAILED || !shared_frame.setup(masks,2)){
+		cerr<<"Unable to set up shared memory for the processes path."<<endl;
+		return result;
+	}
+	memset(counts,0,2*sizeof(process_counts));
+
+	cout<<flush;
+	pid_t workers[2];
+	for (int w=0;w<2;w++){
+		workers[w]=fork();
+		if (workers[w]!=0) continue;
+		const larson_table &table=w?high_table:low_table;
+		process_counts &mine=counts[w];
+		uint32_t shown=0;
+		int64_t start=now_ns();
+		int64_t end=start+(int64_t)(run_seconds*1e9);
+		int64_t after=start;
+		while (after<end){
+			int c=mine.calls%table.length; //the frame goes with its stamp.
+			int64_t before=now_ns();
+			shared_frame.write(w,table.frames[c],(int64_t)mine.calls);
+			after=now_ns();
+			mine.latency.record(after-before);
+			mine.calls++;
+			mine.toggles+=toggles(shown,table.frames[c],table.all_mask);
+			shown=table.frames[c];
+		}
+		mine.seconds=(after-start)/1e9;
+		_exit(0); //skip the atexit handlers; they belong to the parent.
+	}
+	for (int w=0;w<2;w++){
+		waitpid(workers[w],NULL,0);
+		result.calls+=counts[w].calls;
+		result.toggles+=counts[w].toggles;
+		if (counts[w].seconds>result.seconds) result.seconds=counts[w].seconds;
+		result.latency.merge(counts[w].latency);
+	}
+	munmap(counts,2*sizeof(process_counts));
+	return result;
+}
+
+/* string csv_line(bench_result &result)
+ * The eight columns everybody gets.
+ */
+string csv_line(bench_result &result){
+	ostringstream line;
+	double seconds=result.seconds>0?result.seconds:1;
+	line<<result.path<<","<<result.calls<<","
+		<<(uint64_t)(result.toggles/seconds)<<","
+		<<(uint64_t)(result.calls/seconds)<<","
+		<<(uint64_t)(result.calls*result.leds_per_call/8/seconds)<<","
+		<<result.latency.percentile(0.5)<<","
+		<<result.latency.percentile(0.99)<<","
+		<<result.latency.percentile(0.999);
+	return line.str();
+}
+
+/* bool load_baseline(path, frames_per_sec)
+ * Read a CSV we wrote before, and fill frames_per_sec with each path's
+ * frames/sec. Skips the header. Returns false if we can't open it.
+ */
+bool load_baseline(const char *path,map<string,double> &frames_per_sec){
+	ifstream file(path);
+	if (!file.is_open()) return false;
+	string line;
+	while (getline(file,line)){
+		vector<string> fields;
+		istringstream columns(line);
+		string field;
+		while (getline(columns,field,',')) fields.push_back(field);
+		if (fields.size()<4 || fields[0]=="path") continue;
+		frames_per_sec[fields[0]]=atof(fields[3].c_str());
+	}
+	return true;
+}
+
+/*
+ * Main()
+ * Parameters: the options above.
+ * Returns 0, 1 if we couldn't set up, or 3 if anything regressed.
+ *
+ * How it works:
+ * -------------
+ * Read the options. Set up the simulated wiringPi and map the stand-in.
+ * Read the baseline if we have one.
+ * Run each path, and print its CSV line, with the comparison columns
+ * if there's a baseline. Save the lines as a new baseline if asked.
+ */
+int main(int argc,char *argv[]){
+	const char *stand_in="/tmp/gpiomem";
+	const char *baseline_path=NULL;
+	const char *save_path=NULL;
+	double tolerance=10;
+	for (int a=1;a+1<argc;a+=2){
+		if (strcmp(argv[a],"--seconds")==0) run_seconds=atof(argv[a+1]);
+		else if (strcmp(argv[a],"--stand-in")==0) stand_in=argv[a+1];
+		else if (strcmp(argv[a],"--baseline")==0) baseline_path=argv[a+1];
+		else if (strcmp(argv[a],"--save-baseline")==0) save_path=argv[a+1];
+		else if (strcmp(argv[a],"--tolerance")==0) tolerance=atof(argv[a+1]);
+		else{
+			cerr<<"Unknown option "<<argv[a]<<endl;
+			return 1;
+		}
+	}
+	if (run_seconds<=0) run_seconds=1;
+
+	wiringPiSetupGpio();
+	if (!gpio.setup(stand_in)){
+		cerr<<"Unable to map "<<stand_in<<". Exiting."<<endl;
+		return 1;
+	}
+	for (int c=0;c<LEDs;c++){
+		gpio.output_mode(pins[c]);
+	}
+
+	map<string,double> baseline;
+	if (baseline_path!=NULL && !load_baseline(baseline_path,baseline)){
+		cerr<<"Unable to read baseline "<<baseline_path<<". Exiting."<<endl;
+		return 1;
+	}
+
+	bench_result (*paths[])()={bench_digitalWrite,bench_gpio_class,
+		bench_register_frame,bench_register_frame_traced,bench_threads,
+		bench_processes};
+	string header="path,calls,toggles_per_sec,frames_per_sec,bytes_per_sec,"
+				  "p50_ns,p99_ns,p999_ns";
+	vector<string> lines;
+	bool regressed=false;
+
+	cout<<header<<(baseline_path?",baseline_frames_per_sec,change_pct,status":"")<<endl;
+	for (bench_result (*path)() : paths){
+		bench_result *result=new bench_result(path()); //histograms are big.
+		string line=csv_line(*result);
+		lines.push_back(line);
+		cout<<line;
+		if (baseline_path){
+			double fps=result->calls/(result->seconds>0?result->seconds:1);
+			if (baseline.count(result->path)==0){
+				cout<<",,,new";
+			}else{
+				double before=baseline[result->path];
+				double change=before>0?100*(fps-before)/before:0;
+				const char *status="ok";
+				if (change< -tolerance){
+					status="regressed";
+					regressed=true;
+				}else if (change>tolerance){
+					status="improved";
+				}
+				cout<<","<<(uint64_t)before<<","<<(int)change<<","<<status;
+			}
+		}
+		cout<<endl;
+		delete result;
+	}
+
+	if (save_path!=NULL){
+		ofstream file(save_path);
+		file<<header<<"\n";
+		for (size_t l=0;l<lines.size();l++) file<<lines[l]<<"\n";
+		if (!file.good()){
+			cerr<<"Unable to write "<<save_path<<endl;
+			return 1;
+		}
+	}
+	gpio.write_leds(0,full_table.all_mask);
+	return regressed?3:0;
+}
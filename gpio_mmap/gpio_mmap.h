@@ -0,0 +1,229 @@
+ /*
+  * gpio_mmap.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * gpio_mmap.h
+ * This file implements gpio_register_class, a way to drive the GPIO
+ * pins without going through wiringPi one pin at a time. Instead of
+ * calling digitalWrite() twenty times for a frame of the Larson array,
+ * we map the Broadcom GPIO register block into our own memory and
+ * write two 32 bit words: one to the GPSET0 register, which switches
+ * every pin with a 1 in it HIGH, and one to the GPCLR0 register, which
+ * switches every pin with a 1 in it LOW. Pins with a 0 in both words
+ * are left alone.
+ *
+ * On a Pi, the register block comes from /dev/gpiomem, which the
+ * kernel provides so that members of the gpio group can do this
+ * without being root. Anywhere else (your desktop, say) you can hand
+ * setup() the name of an ordinary file instead, and the class will
+ * map that. Writing to a file doesn't switch any pins, of course, so
+ * in that mode we also keep the GPLEV0 (pin level) word up to date
+ * ourselves. That way read_levels() tells you what the pins WOULD be
+ * doing, which is what you want when testing off the Pi.
+ *
+ * Everything is in this header, so a program only has to
+ * #include "../gpio_mmap/gpio_mmap.h" to use it. No extra libraries.
+*/
+
+#ifndef GPIO_MMAP_H
+#define GPIO_MMAP_H
+
+#include <stdint.h> //uint32_t and friends.
+#include <fcntl.h> //open() and its O_ flags.
+#include <sys/mman.h> //mmap() and munmap().
+#include <sys/stat.h> //fstat(), so we can tell a device from a file.
+#include <unistd.h> //close(), ftruncate().
+#include <string.h> //strcmp().
+
+#define gpiomem_device "/dev/gpiomem" //the real thing. Never created.
+#ifndef gpiomem_path //compile with -Dgpiomem_path='"/tmp/gpiomem"' to test.
+#define gpiomem_path "/dev/gpiomem"
+#endif
+#define gpio_block_size 4096 //one page. The registers use the first 0xB4.
+
+/* Register offsets, in 32 bit words from the start of the block.
+ * These come from the BCM2835 ARM Peripherals datasheet, and haven't
+ * changed on any Pi since.
+ */
+#define GPFSEL0 0 //function select, 10 pins per register, 3 bits a pin.
+#define GPSET0 7 //write 1s to switch pins 0-31 HIGH.
+#define GPCLR0 10 //write 1s to switch pins 0-31 LOW.
+#define GPLEV0 13 //read the current level of pins 0-31.
+
+/* gpio_register_class declaration
+ * -------------------------------------------------------------------
+ * Objects of this class own one mapping of the GPIO register block.
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * registers		:Variable
+ * 					A pointer to the mapped block, volatile so the
+ * 					compiler actually performs every write we ask
+ * 					for instead of deciding they're redundant.
+ * file_backed		:Variable
+ * 					true if we mapped an ordinary file rather than
+ * 					the real register block.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Takes the path to map (/dev/gpiomem by default).
+ * 					Returns true if the block was mapped, false if
+ * 					not.
+ * How it works:
+ * ------------
+ * If we already have a block mapped, unmap it first.
+ * Open the path read/write. If it's a stand-in (anything but
+ * /dev/gpiomem), create it if it isn't there. /dev/gpiomem itself we
+ * never create: run as root on a machine without it, and we'd quietly
+ * make an ordinary file there and "drive" that. fstat it. If it's a
+ * character device, it's the real thing. If it's an ordinary file
+ * at /dev/gpiomem, something's wrong, so fail. Otherwise make sure
+ * it's at least gpio_block_size bytes long so mmap has something to
+ * map, and remember that we're file backed. Map it shared, so writes go to the
+ * device (or file) and not a private copy. We can close the file
+ * descriptor once the mapping exists; the mapping keeps it alive.
+ * -------------------------------------------------------------------
+ * output_mode()	:Method
+ * 					Takes a BCM pin number and sets it as an output,
+ * 					which is what pinMode(pin,OUTPUT) does.
+ * How it works:
+ * ------------
+ * Each GPFSEL register holds the mode of ten pins, three bits apiece.
+ * 001 is output. Find the right register and the right three bits,
+ * clear them, and or in the 1.
+ * -------------------------------------------------------------------
+ * write_frame()	:Method
+ * 					Takes a set mask and a clear mask, and writes
+ * 					them to GPSET0 and GPCLR0. Two writes, no matter
+ * 					how many pins change. Returns nothing.
+ * -------------------------------------------------------------------
+ * write_leds()		:Method
+ * 					Takes a mask of LEDs that should be lit and a mask
+ * 					of all the LED pins, and writes the frame. Our LEDs
+ * 					are switched on their cathode side, so lit means
+ * 					LOW (the clear mask) and dark means HIGH (the set
+ * 					mask). Pins outside all_mask are not touched, which
+ * 					is what lets two threads each drive their own half
+ * 					of the array without stepping on each other.
+ * -------------------------------------------------------------------
+ * read_levels()	:Method
+ * 					Returns the GPLEV0 register: bit n is pin n's level.
+ * -------------------------------------------------------------------
+ * pin_mask()		:Static Method
+ * 					Takes an array of pin numbers and how many there
+ * 					are, and returns a mask with those pins' bits set.
+ * -------------------------------------------------------------------
+ * The destructor unmaps the block. There's only one mapping, so
+ * there's no copying one: a copy would unmap it out from under the
+ * other when it went. Pass it by reference or pointer instead.
+ * -------------------------------------------------------------------
+ */
+class gpio_register_class {
+	private:
+ // ===================================================================
+	volatile uint32_t *registers=NULL;
+	bool file_backed=false;
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	gpio_register_class()=default;
+	gpio_register_class(const gpio_register_class &)=delete;
+	gpio_register_class &operator=(const gpio_register_class &)=delete;
+ // -------------------------------------------------------------------
+	bool setup(const char *path=gpiomem_path){
+		struct stat info;
+		bool device=strcmp(path,gpiomem_device)==0;
+		if (registers!=NULL){ //setup() again: let the old block go.
+			munmap((void *)registers,gpio_block_size);
+			registers=NULL;
+		}
+		int file_descriptor=open(path,device?O_RDWR|O_SYNC:O_RDWR|O_CREAT|O_SYNC,0644);
+		if (file_descriptor<0) return false; //no such device, or no perms.
+
+		if (fstat(file_descriptor,&info)<0){
+			close(file_descriptor);
+			return false;
+		}
+		file_backed=!S_ISCHR(info.st_mode); //a device, or a stand-in?
+		if (device && file_backed){ //not a Pi, or no driver.
+			close(file_descriptor);
+			return false;
+		}
+		if (file_backed && info.st_size<gpio_block_size){
+			if (ftruncate(file_descriptor,gpio_block_size)<0){
+				close(file_descriptor);
+				return false;
+			}
+		}
+
+		void *block=mmap(NULL,gpio_block_size,PROT_READ|PROT_WRITE,
+						MAP_SHARED,file_descriptor,0);
+		close(file_descriptor); //the mapping holds its own reference.
+		if (block==MAP_FAILED) return false;
+
+		registers=(volatile uint32_t *)block;
+		return true;
+	};
+ // -------------------------------------------------------------------
+	void output_mode(int pin){
+		int reg=GPFSEL0+(pin/10); //which function select register.
+		int shift=(pin%10)*3; //which three bits in it.
+		registers[reg]=(registers[reg] & ~(7u<<shift)) | (1u<<shift);
+	};
+ // -------------------------------------------------------------------
+	void write_frame(uint32_t set_mask,uint32_t clear_mask){
+		registers[GPSET0]=set_mask; //every 1 goes HIGH.
+		registers[GPCLR0]=clear_mask; //every 1 goes LOW.
+		if (file_backed){ //nobody's going to update the levels for us.
+			registers[GPLEV0]=(registers[GPLEV0] | set_mask) & ~clear_mask;
+		}
+	};
+ // -------------------------------------------------------------------
+	void write_leds(uint32_t lit_mask,uint32_t all_mask){
+		write_frame(all_mask & ~lit_mask,all_mask & lit_mask);
+	};
+ // -------------------------------------------------------------------
+	uint32_t read_levels(void){
+		return registers[GPLEV0];
+	};
+ // -------------------------------------------------------------------
+	bool is_file_backed(void){
+		return file_backed;
+	};
+ // -------------------------------------------------------------------
+	static uint32_t pin_mask(const int *pin_list,int count){
+		uint32_t mask=0;
+		for (int c=0;c<count;c++){
+			mask|=1u<<pin_list[c];
+		}
+		return mask;
+	};
+ // -------------------------------------------------------------------
+	~gpio_register_class(){
+		if (registers!=NULL) munmap((void *)registers,gpio_block_size);
+	};
+ // -------------------------------------------------------------------
+}; //end of gpio_register_class
+
+#endif
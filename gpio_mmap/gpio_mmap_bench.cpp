@@ -0,0 +1,161 @@
+ /*
+  * gpio_mmap_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * gpio_mmap_bench
+ * This program measures how many complete frames per second we can
+ * put on the 20 LED Larson array three different ways:
+ * 		digitalWrite		one wiringPi call per pin, the way larson.cpp
+ * 							does it. Only run on a real Pi.
+ * 		per-pin register	one register write per pin, through
+ * 							gpio_register_class. This is roughly what
+ * 							digitalWrite does once you take the library
+ * 							call away.
+ * 		frame register		one GPSET0 and one GPCLR0 write per frame,
+ * 							no matter how many pins change.
+ *
+ * Run it with no arguments on a Pi to use /dev/gpiomem. Give it the
+ * name of an ordinary file to run against the file-backed stand-in
+ * anywhere else, e.g.
+ * 		./gpio_mmap_bench /tmp/gpiomem
+ * Compile with:
+ * 		g++ -O2 -o gpio_mmap_bench gpio_mmap_bench.cpp -lwiringPi
+*/
+
+#include <iostream>
+#include <string>
+#include <time.h> //clock_gettime().
+#include <wiringPi.h>
+#include "gpio_mmap.h"
+
+#define LEDs 20
+#define bench_frames 200000
+
+using namespace std;
+
+int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+
+/* double seconds_now()
+ * Returns CLOCK_MONOTONIC as a double, in seconds. Monotonic, because
+ * we don't want NTP stepping the clock in the middle of a run.
+ */
+double seconds_now(){
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec+now.tv_nsec/1e9;
+}
+
+/* void report(string name, double elapsed)
+ * Print one line of results: the name of the path, frames per second,
+ * and nanoseconds per frame.
+ */
+void report(string name,double elapsed){
+	cout<<name<<": "<<(long)(bench_frames/elapsed)<<" frames/sec, "
+		<<(long)(elapsed*1e9/bench_frames)<<" ns/frame"<<endl;
+}
+
+/*
+ * Main()
+ * Parameters: argc and argv, so we can take a path.
+ * Returns: 0 if everything worked, 1 if we couldn't map the registers.
+ *
+ * How it works:
+ * -------------
+ * Map the register block (or the stand-in file). Set every LED pin
+ * as an output and build the mask of all the LED pins.
+ *
+ * Each frame lights exactly one LED, stepping along the array the
+ * way the scanner does, so every frame changes two pins.
+ *
+ * If we have a real device, set up wiringPi and time bench_frames
+ * frames of digitalWrite, twenty calls apiece.
+ * Then time the same frames with one register write per pin, and
+ * again with one set and one clear write per frame.
+ *
+ * In file-backed mode, check that the level word ended up showing
+ * the last frame we wrote. If it doesn't, the benchmark is measuring
+ * something broken, so say so.
+ *
+ * Finally turn all the LEDs off.
+ */
+int main(int argc,char *argv[]){
+	const char *path=gpiomem_path;
+	if (argc>1) path=argv[1];
+
+	gpio_register_class gpio;
+	if (!gpio.setup(path)){
+		cout<<"Unable to map "<<path<<". Exiting."<<endl;
+		return 1;
+	}
+	for (int c=0;c<LEDs;c++){
+		gpio.output_mode(pins[c]);
+	}
+	uint32_t all_mask=gpio_register_class::pin_mask(pins,LEDs);
+	cout<<"Mapped "<<path<<(gpio.is_file_backed()?" (file stand-in)":
+							" (GPIO registers)")<<endl;
+
+	double start;
+	int lit;
+
+	if (!gpio.is_file_backed()){
+		wiringPiSetupGpio();
+		start=seconds_now();
+		for (long f=0;f<bench_frames;f++){
+			lit=f%LEDs;
+			for (int c=0;c<LEDs;c++){ //one library call per pin.
+				digitalWrite(pins[c],c==lit?LOW:HIGH);
+			}
+		}
+		report("digitalWrite     ",seconds_now()-start);
+	}
+
+	start=seconds_now();
+	for (long f=0;f<bench_frames;f++){
+		lit=f%LEDs;
+		for (int c=0;c<LEDs;c++){ //one register write per pin.
+			if (c==lit){
+				gpio.write_frame(0,1u<<pins[c]);
+			}else{
+				gpio.write_frame(1u<<pins[c],0);
+			}
+		}
+	}
+	report("per-pin register ",seconds_now()-start);
+
+	start=seconds_now();
+	for (long f=0;f<bench_frames;f++){ //two register writes per frame.
+		gpio.write_leds(1u<<pins[f%LEDs],all_mask);
+	}
+	report("frame register   ",seconds_now()-start);
+
+	if (gpio.is_file_backed()){
+		uint32_t expected=all_mask & ~(1u<<pins[(bench_frames-1)%LEDs]);
+		if ((gpio.read_levels() & all_mask)!=expected){
+			cout<<"Level word doesn't match the last frame!"<<endl;
+			return 1;
+		}
+	}
+
+	gpio.write_leds(0,all_mask); //all HIGH, all off.
+	return 0;
+}
@@ -25,22 +25,32 @@
  * larson
  * This program implements the classic "Larson (memorial) scanner",
  * albeit a 20 pin Raspberry Pi version. It //requires// a Pi with a 
- * 40 pin GPIO bus, or it won't call the right pins in wiringPi.
- * It exists to demonstrate the use of wiringPi in its most basic mode,
- * digitalWrite.
+ * 40 pin GPIO bus, or it won't call the right pins.
+ * It started out demonstrating wiringPi in its most basic mode,
+ * digitalWrite, one pin at a time. Now it works out every frame of
+ * the scan at compile time, and writes each one whole, every LED at
+ * once, through the GPIO set and clear registers.
 */
 
 
 /* Iostream gives us cin and cout, which we might need for debugging.
- * wiringPi is the star of this show, the software interface to the 
- * GPIO pins.
+ * wiringPi still sets the GPIO system up, but the LEDs themselves
+ * are written through the register table gpio_mmap.h maps.
  * We define LEDs as 20, both to set the index of the pins array, and 
  * as the maximum index value of the loop that reads it.
  * Likewise delaymils is a constant value of how many milliseconds to
  * wait between changing LEDs.
+ * gpio_mmap.h lets us write a whole frame of LEDs at once, and 
+ * larson_frames.h works out every frame of the scan at compile time.
+ * frame_clock.h keeps the frames exactly delaymils apart, and 
+ * stop_signal.h lets it sleep through a frame and still hear SIGINT.
 */
 #include <iostream>
 #include <wiringPi.h>
+#include "../gpio_mmap/gpio_mmap.h"
+#include "larson_frames.h"
+#include "../frame_clock/frame_clock.h"
+#include "../stop_signal/stop_signal.h"
 #define LEDs 20
 #define delaymils 40
 
@@ -56,7 +66,16 @@ using namespace std;
  * order they're plugged into the LED arrays to its own index value (from 
  * 0 to LEDs.)
 */ 
-int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+
+/*
+ * The whole scan, low to high and back, as a table of pin masks. The
+ * compiler builds it from pins[], and the static_assert refuses to 
+ * compile the program if pins[] can't make a sane scan.
+*/
+constexpr larson_table scan_table=make_larson_table(pins,0,LEDs);
+static_assert(check_larson_table(scan_table,pins,0,LEDs),
+			  "pins[] does not produce a valid Larson scan.");
 
 /*
  * Main()
@@ -69,64 +88,82 @@ int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
  * really necessary, since it's initialized in the for loop below, but
  * it's good practice.
  * 
+ * Set up stop_signal, which blocks SIGINT and hands it to us through a
+ * file descriptor instead of a signal handler. If we can't, exit.
+ * 
  * Initialize wiringPi
  * Call the wiringPiSetupGpio() function. This function configures
  * the program's interface with the wiringPi/GPIO system. Critically, it
  * sets it up to use the Broadcom GPIO numbers instead of earlier wiringPi
  * specific pin numbers, physical pin numbers, or anything else.
  * 
+ * Map the GPIO registers with gpio_register_class. If we can't, 
+ * there's no point going on, so tell the user and exit.
+ * 
  * Initialize pins
- * In a for loop, we set all the pins to output mode and high. We're
- * using them for output.
+ * In a for loop, we set all the pins to output mode. We're using them
+ * for output. Then write an empty frame, which sets them all high.
  * Note Bene: We are switching the //low// or cathode side of each LED.
  * When the GPIO is //HIGH//, the LED is //off// Only when the GPIO is 
  * //LOW// does current flow. So we set them all high at initialization
  * to turn all the LEDs off.
  * 
- * Loop Forever scanning from low to high and high to low.
- * 		Scan Low to High LED #. Starting with LED 0, 
- * 			turn the LED on, 
- * 			wait delaymils, 
- * 			then turn the previous LED off.
- 
- * 		Scan High to Low by LED number. 
- * 			Switch the current LED on, 
- * 			Wait delaymils, 
- * 			then switch the previous LED off.
+ * Start the frame clock, delaymils per frame.
+ * 
+ * Loop until SIGINT, stepping through scan_table.
+ * 		Write frame c to the LEDs, all in one go.
+ * 		Wait for the frame clock, which wakes us delaymils after the 
+ * 		//last// frame started, no matter how long the write took. It
+ * 		sleeps in stop_signal, so SIGINT wakes it, and it returns 
+ * 		false: leave the loop.
+ * 		Work out c from the frame clock's frame_number(), skipping any
+ * 		frames we were too late for.
+ * The table already holds the scan from low to high and high to low,
+ * so there's nothing left to work out here.
  * 
- * We'll never reach the return(0). 
+ * Turn all the LEDs off, print the frame clock's lateness histogram, 
+ * and exit.
 */
 
 int main(void){
 	int c=0;
+	gpio_register_class gpio;
+	frame_clock_class frame_clock;
+	stop_signal_class stop_signal;
+	
+	//Take SIGINT through stop_signal.
+	if (!stop_signal.setup()){
+		cout<<"Unable to set up the stop signal. Exiting."<<endl;
+		return 1;
+	}
+	
 	//Initialize WiringPi.
 	wiringPiSetupGpio();
 	
+	//Map the GPIO registers.
+	if (!gpio.setup()){
+		cout<<"Unable to map "<<gpiomem_path<<". Exiting."<<endl;
+		return 1;
+	}
+	
 	//Initialize Pins.
 	for (c=0;c<LEDs;c++){
 		//cout<<"Setting pin "<<pins[c]<<"to output\n"<<flush;
-		pinMode (pins[c],OUTPUT);
-		digitalWrite(pins[c],HIGH);
+		gpio.output_mode(pins[c]);
 	}
+	gpio.write_leds(0,scan_table.all_mask);
 	
-	//Loop forever switching the LEDs on and off in sequence.
+	//Step through the precomputed frames until SIGINT.
+	c=0;
+	frame_clock.start(delaymils);
 	while(true){
-		
-		//loop from 0 to LEDs - "scan" from low LED # to high.
-		for (c=0;c<LEDs;c++){
-			//cout << "switching" << pins[c] <<"\n"<< flush;
-			digitalWrite(pins[c],LOW);
-			delay(delaymils);
-			if (c>0) digitalWrite(pins[c-1],HIGH);
-		}
-		
-		//loop from LEDs to 0 - scan from high LED # to low.
-		for (c=LEDs-1;c>=0;c--){
-			//cout << "switching" << pins[c] <<"\n"<< flush;
-			digitalWrite(pins[c],LOW);
-			delay(delaymils);
-			if (c<LEDs)digitalWrite(pins[c+1],HIGH);
-		}
+		gpio.write_leds(scan_table.frames[c],scan_table.all_mask);
+		if (!frame_clock.wait(&stop_signal)) break; //SIGINT.
+		c=frame_clock.frame_number()%scan_table.length; //skipping any we missed.
 	}
+	
+	//Turn off all the LEDs, and show how late the frames were.
+	gpio.write_leds(0,scan_table.all_mask);
+	frame_clock.dump("Scanner");
 	return 0;
 }
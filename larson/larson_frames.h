@@ -0,0 +1,160 @@
+ /*
+  * larson_frames.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * larson_frames.h
+ * The scanner's two for loops work out, on every step, which LED to
+ * switch on and which to switch off. But the answer never changes:
+ * the sequence is fixed by the pins[] map and the number of LEDs. So
+ * we let the compiler run those loops once, at compile time, and write
+ * down what the array looks like during each delay as a 32 bit mask
+ * of pins (bit n set means BCM pin n is lit). The scanner then just
+ * steps through the table and hands each mask to
+ * gpio_register_class::write_leds().
+ *
+ * make_larson_table() is constexpr, so if you declare your pins[]
+ * array constexpr and the table constexpr, it's all done before the
+ * program ever runs. check_larson_table() is constexpr too, and is
+ * meant to be used in a static_assert, so a bad pin map is a compile
+ * error instead of a mystery on the breadboard.
+ *
+ * Needs C++14 (the default for g++ 6 and later) for loops inside
+ * constexpr functions.
+*/
+
+#ifndef LARSON_FRAMES_H
+#define LARSON_FRAMES_H
+
+#include <stdint.h>
+
+#define larson_max_frames 64 //two frames per LED, so up to 32 LEDs.
+
+/* larson_table
+ * -------------------------------------------------------------------
+ * frames[]		the pin mask of lit LEDs for each step of the bounce.
+ * length		how many of frames[] are used. The up scan is
+ * 				frames[0] to frames[length/2-1], the down scan is the
+ * 				rest.
+ * all_mask		every pin this table drives. Pass it to write_leds()
+ * 				so we only ever touch our own pins.
+ * -------------------------------------------------------------------
+ */
+struct larson_table {
+	uint32_t frames[larson_max_frames];
+	int length;
+	uint32_t all_mask;
+};
+
+/* constexpr larson_table make_larson_table(pin_map, first, last)
+ * Parameters:
+ * 		pin_map is the pins[] array.
+ * 		first is the index of the lowest LED to scan.
+ * 		last is one past the index of the highest LED to scan.
+ * Returns: the larson_table for scanning pin_map[first] to
+ * 		pin_map[last-1].
+ *
+ * How it works:
+ * -------------
+ * This is the scan loop from larson.cpp, with digitalWrite replaced by
+ * setting and clearing bits in lit, and delay() replaced by writing lit
+ * into the next frame. So each frame is exactly what the LEDs showed
+ * while the old loop was sitting in delay():
+ * 		Scan Low to High. For each LED,
+ * 			turn it on,
+ * 			record the frame,
+ * 			then turn the previous LED off.
+ * 		Scan High to Low. For each LED,
+ * 			turn it on,
+ * 			record the frame,
+ * 			then turn the LED above it off.
+ * The old loop turned off pins[c+1] even when c was the top LED, which
+ * is past the end of the range (and for a half-array scanner, is the
+ * other eye's pin). We only turn off pins we own.
+ */
+constexpr larson_table make_larson_table(const int *pin_map,int first,int last){
+	larson_table table{};
+	uint32_t lit=0;
+	int f=0;
+
+	for (int c=first;c<last;c++){
+		table.all_mask|=1u<<pin_map[c];
+	}
+
+	for (int c=first;c<last;c++){ //scan low to high.
+		lit|=1u<<pin_map[c];
+		table.frames[f++]=lit;
+		if (c>first) lit&=~(1u<<pin_map[c-1]);
+	}
+	for (int c=last-1;c>=first;c--){ //scan high to low.
+		lit|=1u<<pin_map[c];
+		table.frames[f++]=lit;
+		if (c<last-1) lit&=~(1u<<pin_map[c+1]);
+	}
+	table.length=f;
+	return table;
+}
+
+/* constexpr bool check_larson_table(table, pin_map, first, last)
+ * Parameters: the table, and the same pin_map, first and last that
+ * 		built it.
+ * Returns: true if the table is sane.
+ *
+ * How it works:
+ * -------------
+ * Check the pin map first: every pin must fit in GPSET0/GPCLR0 (0-31)
+ * and no pin can appear twice, or two LEDs would share a bit.
+ * Then check the table: two frames per LED, every frame lights only
+ * pins in the map, and every frame lights one LED or two neighbors.
+ */
+constexpr bool check_larson_table(const larson_table &table,
+								  const int *pin_map,int first,int last){
+	int count=last-first;
+	if (count<1 || 2*count>larson_max_frames) return false;
+	if (table.length!=2*count) return false;
+
+	for (int c=first;c<last;c++){ //pins fit and are unique.
+		if (pin_map[c]<0 || pin_map[c]>31) return false;
+		for (int d=c+1;d<last;d++){
+			if (pin_map[c]==pin_map[d]) return false;
+		}
+	}
+
+	for (int f=0;f<table.length;f++){
+		uint32_t frame=table.frames[f];
+		if (frame==0 || (frame & ~table.all_mask)) return false;
+
+		int lit_leds=0;
+		int lowest=-1;
+		for (int c=first;c<last;c++){
+			if (frame & (1u<<pin_map[c])){
+				if (lowest<0) lowest=c;
+				else if (c!=lowest+1) return false; //not neighbors.
+				lit_leds++;
+			}
+		}
+		if (lit_leds>2) return false;
+	}
+	return true;
+}
+
+#endif
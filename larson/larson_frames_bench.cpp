@@ -0,0 +1,148 @@
+ /*
+  * larson_frames_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * larson_frames_bench
+ * This program measures what one step of the scanner costs, not
+ * counting the delay, two ways:
+ * 		nested loops	the two for loops from the old larson.cpp,
+ * 						calling a pin write function once or twice per
+ * 						step, the way they called digitalWrite().
+ * 		frame table		stepping an index through scan_table and
+ * 						handing one mask to a frame write function.
+ * Neither write function touches real hardware; they just update a
+ * shadow copy of the pin levels, so what we're timing is the work of
+ * deciding what to write, plus the calls themselves.
+ *
+ * Before timing anything, it runs the old loops once and checks that
+ * what the LEDs would show during each delay matches the table frame
+ * for frame.
+ * Doesn't need wiringPi. Compile with:
+ * 		g++ -O2 -o larson_frames_bench larson_frames_bench.cpp
+*/
+
+#include <iostream>
+#include <stdint.h>
+#include <time.h>
+#include "larson_frames.h"
+
+#define LEDs 20
+#define bench_steps 50000000L
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+constexpr larson_table scan_table=make_larson_table(pins,0,LEDs);
+static_assert(check_larson_table(scan_table,pins,0,LEDs),
+			  "pins[] does not produce a valid Larson scan.");
+
+volatile uint32_t shadow_levels=0; //1 bits are HIGH pins.
+uint32_t all_mask=scan_table.all_mask;
+
+/* pin_write() and frame_write()
+ * Stand-ins for digitalWrite() and gpio_register_class::write_leds().
+ * noinline, so the compiler can't fold them into the loops and make
+ * the comparison meaningless.
+ */
+__attribute__((noinline)) void pin_write(int pin,int level){
+	if (level) shadow_levels=shadow_levels | (1u<<pin);
+	else shadow_levels=shadow_levels & ~(1u<<pin);
+}
+
+__attribute__((noinline)) void frame_write(uint32_t lit_mask){
+	shadow_levels=(shadow_levels | all_mask) & ~lit_mask;
+}
+
+double seconds_now(){
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec+now.tv_nsec/1e9;
+}
+
+/* long nested_loops(long steps, bool check)
+ * The scan from the old larson.cpp, running for steps steps. Where the
+ * old loop called delay(), we count a step, and if check is true,
+ * compare the lit LEDs against the table. Returns the number of frames
+ * that didn't match.
+ */
+long nested_loops(long steps,bool check){
+	long step=0;
+	long mismatches=0;
+	int c;
+	while(step<steps){
+		for (c=0;c<LEDs && step<steps;c++){
+			pin_write(pins[c],0);
+			if (check && (~shadow_levels & all_mask)!=scan_table.frames[step%scan_table.length])
+				mismatches++;
+			step++;
+			if (c>0) pin_write(pins[c-1],1);
+		}
+		for (c=LEDs-1;c>=0 && step<steps;c--){
+			pin_write(pins[c],0);
+			if (check && (~shadow_levels & all_mask)!=scan_table.frames[step%scan_table.length])
+				mismatches++;
+			step++;
+			if (c<LEDs-1) pin_write(pins[c+1],1); //the old code ran off the end here.
+		}
+	}
+	return mismatches;
+}
+
+/* void table_steps(long steps)
+ * The new scan loop, running for steps steps.
+ */
+void table_steps(long steps){
+	int c=0;
+	for (long step=0;step<steps;step++){
+		frame_write(scan_table.frames[c]);
+		if (++c==scan_table.length) c=0;
+	}
+}
+
+/*
+ * Main()
+ * Check the table against the loops over a few full scans, then time
+ * bench_steps steps of each and print nanoseconds per step.
+ */
+int main(void){
+	shadow_levels=all_mask; //everything HIGH, everything off.
+	long mismatches=nested_loops(scan_table.length*3,true);
+	if (mismatches){
+		cout<<mismatches<<" frames don't match the old loops!"<<endl;
+		return 1;
+	}
+	cout<<"Table matches the old loops ("<<scan_table.length
+		<<" frames per scan)."<<endl;
+
+	double start=seconds_now();
+	nested_loops(bench_steps,false);
+	double loop_time=seconds_now()-start;
+
+	start=seconds_now();
+	table_steps(bench_steps);
+	double table_time=seconds_now()-start;
+
+	cout<<"nested loops: "<<loop_time*1e9/bench_steps<<" ns/step"<<endl;
+	cout<<"frame table:  "<<table_time*1e9/bench_steps<<" ns/step"<<endl;
+	return 0;
+}
@@ -0,0 +1,413 @@
+ /*
+  * edge_to_photon.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * edge_to_photon
+ * How long from a button press on GPIO12 until an LED changes? We
+ * press the button, over and over, at times we pick, and each press
+ * toggles LED 0. We time every press to the LED pin's next transition,
+ * and print the spread for each way the programs in this archive have
+ * of reading the button:
+ * 		polled		button_polled: button_sampler_class samples at
+ * 					10kHz and debounces, and the scanner loop, which
+ * 					checks it after every delaymils, toggles the LED.
+ * 		isr			button_interrupt: the ISR queues the press, and the
+ * 					loop checks the queue after every delaymils.
+ * 		isr-direct	the ISR toggles the LED itself. As fast as it gets,
+ * 					but the ISR is doing real work again.
+ * 		event		the ISR queues the press and pokes an eventfd. The
+ * 					loop sleeps in poll() on the eventfd until its next
+ * 					step, so a press wakes it at once, and the
+ * 					animation keeps its timing.
+ * Presses are clean (no bounce), 20ms long, and 60 to 100ms apart, at
+ * random, so they land all over the loop's 40ms step.
+ *
+ * There are two ways to press the button and watch the LED:
+ * 		simulated	the default. Built against wiringPi_sim, running in
+ * 					real time: presses are scripted inputs, and LED
+ * 					changes come from the simulation's transition
+ * 					trace. Latency includes the simulation's own input
+ * 					thread waking up, much as it would include the
+ * 					kernel's on a Pi.
+ * 		loopback	on a Pi, with a wire from another GPIO to GPIO12.
+ * 					Compile with -Dloopback_pin=that GPIO and the real
+ * 					wiringPi. A thread drives the wire, and another
+ * 					spins on digitalRead() of the LED pin, so this
+ * 					wants a Pi with more than one core.
+ * Every time is in ns of the same clock: sim_now_ns() simulated,
+ * CLOCK_MONOTONIC on a loopback.
+ *
+ * Usage: edge_to_photon [presses] [mode...]
+ * Compile with:
+ * 		g++ -O2 -I../wiringPi_sim -o edge_to_photon edge_to_photon.cpp
+ * 			../wiringPi_sim/wiringPi_sim.cpp -lpthread
+ * or, on a Pi with a wire from GPIO21 to GPIO12:
+ * 		g++ -O2 -Dloopback_pin=21 -o edge_to_photon edge_to_photon.cpp
+ * 			-lwiringPi -lpthread
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <wiringPi.h>
+#ifndef loopback_pin
+#include "wiringPi_sim.h"
+#endif
+#include "../event_queue/spsc_queue.h"
+#include "../button/button_sampler.h"
+
+#define button_pin 12
+#define reaction_pin 2 //LED 0.
+#define delaymils 40
+#define sample_hz 10000
+#define press_ms 20
+#define spacing_ms 60 //between presses, at least,
+#define jitter_ms 40 //plus up to this much.
+#define lead_ms 100 //from setting up a run to the first press.
+#define latency_buckets 24 //bucket n is 2^(n-1)us and up.
+#define bar_width 50
+
+using namespace std;
+
+enum input_mode { mode_polled, mode_isr, mode_isr_direct, mode_event, mode_count };
+const char *mode_names[mode_count]={"polled","isr","isr-direct","event"};
+
+/* What the modes share. The ISR is registered once, and does whatever
+ * current_mode says.
+ */
+std::atomic<int> current_mode{-1};
+spsc_queue_class<uint32_t,256> press_queue; //micros() of each press.
+button_sampler_class sampler;
+int wake_fd=-1;
+int reaction_level=HIGH; //off.
+int buttons[1]={button_pin};
+
+/* uint32_t next_random()
+ * xorshift32. Seeded, so every run gets the same presses.
+ */
+uint32_t random_state=2463534242u;
+uint32_t next_random(){
+	random_state^=random_state<<13;
+	random_state^=random_state>>17;
+	random_state^=random_state<<5;
+	return random_state;
+}
+
+/* void toggle_reaction()
+ * The LED's reaction to a press. Only ever called from one thread
+ * per mode.
+ */
+void toggle_reaction(){
+	reaction_level=!reaction_level;
+	digitalWrite(reaction_pin,reaction_level);
+}
+
+/* void button_ISR()
+ * On the press edge, in whatever way the current mode wants.
+ */
+void button_ISR(void){
+	switch (current_mode.load(std::memory_order_relaxed)){
+		case mode_isr:
+			press_queue.push(micros());
+			break;
+		case mode_isr_direct:
+			toggle_reaction();
+			break;
+		case mode_event:{
+			press_queue.push(micros());
+			uint64_t one=1;
+			if (write(wake_fd,&one,sizeof(one))<0){
+				//can't happen short of 2^64 presses; the loop still drains.
+			}
+			break;
+		}
+	}
+}
+
+/* The two ways to press the button and watch the LED. Each has:
+ * 		harness_ns()		the time.
+ * 		start_presses()		press at each of the times given, in the
+ * 							background.
+ * 		start_watching()	start recording the LED's transitions.
+ * 		stop()				stop both, and return the times the
+ * 							presses really happened and the LED's
+ * 							transitions.
+ */
+#ifndef loopback_pin
+
+int64_t harness_ns(){
+	return sim_now_ns();
+}
+
+vector<int64_t> scripted;
+
+void start_presses(const vector<int64_t> &at){
+	scripted=at;
+	for (size_t c=0;c<at.size();c++){
+		sim_script_input(button_pin,at[c],HIGH);
+		sim_script_input(button_pin,at[c]+press_ms*1000000LL,LOW);
+	}
+}
+
+void start_watching(){
+	sim_clear_transitions();
+}
+
+void stop(vector<int64_t> &presses,vector<int64_t> &changes){
+	presses=scripted;
+	changes.clear();
+	vector<sim_transition> trace=sim_transitions();
+	for (size_t c=0;c<trace.size();c++){
+		if (trace[c].pin==reaction_pin) changes.push_back(trace[c].ns);
+	}
+}
+
+#else
+
+int64_t harness_ns(){
+	return timespec_ns(clock_now());
+}
+
+std::thread *presser=NULL;
+std::thread *watcher=NULL;
+std::atomic<bool> watching{false};
+vector<int64_t> pressed_at,changed_at;
+
+/* sleep_until(ns)
+ * clock_nanosleep() to an absolute CLOCK_MONOTONIC time.
+ */
+void sleep_until(int64_t ns){
+	timespec until={(time_t)(ns/1000000000LL),(long)(ns%1000000000LL)};
+	while (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&until,NULL)==EINTR){
+		//same deadline, so no harm.
+	}
+}
+
+void start_presses(const vector<int64_t> &at){
+	pressed_at.clear();
+	presser=new std::thread([at](){
+		for (size_t c=0;c<at.size();c++){
+			sleep_until(at[c]);
+			pressed_at.push_back(harness_ns());
+			digitalWrite(loopback_pin,HIGH);
+			sleep_until(at[c]+press_ms*1000000LL);
+			digitalWrite(loopback_pin,LOW);
+		}
+	});
+}
+
+void start_watching(){
+	changed_at.clear();
+	watching=true;
+	watcher=new std::thread([](){
+		int last=digitalRead(reaction_pin);
+		while (watching.load(std::memory_order_relaxed)){
+			int level=digitalRead(reaction_pin);
+			if (level==last) continue;
+			changed_at.push_back(harness_ns());
+			last=level;
+		}
+	});
+}
+
+void stop(vector<int64_t> &presses,vector<int64_t> &changes){
+	presser->join();
+	watching=false;
+	watcher->join();
+	delete presser;
+	delete watcher;
+	presses=pressed_at;
+	changes=changed_at;
+}
+
+#endif
+
+/* void print_distribution(name, latencies, missed)
+ * Percentiles, then a histogram with a bucket for each power of two
+ * microseconds, like frame_clock_class::dump().
+ */
+void print_distribution(string name,vector<int64_t> latencies,size_t missed){
+	cout<<name<<": "<<latencies.size()<<" presses, "<<missed<<" with no reaction."<<endl;
+	if (latencies.empty()) return;
+	sort(latencies.begin(),latencies.end());
+	auto at=[&](double q){
+		return latencies[min((size_t)(q*latencies.size()),latencies.size()-1)]/1000;
+	};
+	cout<<"\tmin "<<latencies.front()/1000<<"us, p50 "<<at(0.5)<<"us, p90 "<<at(0.9)
+		<<"us, p99 "<<at(0.99)<<"us, p99.9 "<<at(0.999)<<"us, max "
+		<<latencies.back()/1000<<"us."<<endl;
+	uint64_t histogram[latency_buckets]={0};
+	uint64_t most=0;
+	for (size_t c=0;c<latencies.size();c++){
+		int64_t us=latencies[c]/1000;
+		int bucket=0;
+		while (us>0 && bucket<latency_buckets-1){
+			us>>=1;
+			bucket++;
+		}
+		most=max(most,++histogram[bucket]);
+	}
+	for (int b=0;b<latency_buckets;b++){
+		if (!histogram[b]) continue;
+		string range=b==0?"<1us":to_string(1LL<<(b-1))+"-"+to_string(1LL<<b)+"us";
+		cout<<"\t"<<range<<string(range.size()<16?16-range.size():1,' ')
+			<<histogram[b]<<"\t"<<string(histogram[b]*bar_width/most+1,'#')<<endl;
+	}
+}
+
+/* void run(mode, presses)
+ * One mode. Works out when to press, starts pressing and watching,
+ * and runs the mode's loop until a press's worth after the last one.
+ * Then matches each press with the first LED change after it (and
+ * before the next press), and prints.
+ */
+void run(int mode,int count){
+	vector<int64_t> at;
+	int64_t t=harness_ns()+lead_ms*1000000LL;
+	for (int c=0;c<count;c++){
+		t+=(spacing_ms+next_random()%jitter_ms)*1000000LL;
+		at.push_back(t);
+	}
+	int64_t end=t+(spacing_ms+jitter_ms)*1000000LL;
+
+	uint32_t stale;
+	while (press_queue.pop(stale)){
+		//left over from the last mode.
+	}
+	if (mode==mode_polled){
+		if (!sampler.setup(buttons,1,sample_hz) || !sampler.start()){
+			cout<<mode_names[mode]<<": unable to start the sampler."<<endl;
+			return;
+		}
+	}
+	current_mode=mode;
+	start_watching();
+	start_presses(at);
+
+	button_event event;
+	uint32_t press;
+	int64_t step=harness_ns();
+	while (harness_ns()<end){
+		switch (mode){
+			case mode_polled:
+				delay(delaymils);
+				while (sampler.next(event)) if (event.pressed) toggle_reaction();
+				break;
+			case mode_isr:
+				delay(delaymils);
+				while (press_queue.pop(press)) toggle_reaction();
+				break;
+			case mode_isr_direct:
+				delay(delaymils);
+				break;
+			case mode_event:{
+				step+=delaymils*1000000LL;
+				int64_t left=step-harness_ns();
+				while (left>0){
+					pollfd wake={wake_fd,POLLIN,0};
+					if (poll(&wake,1,(int)((left+999999)/1000000))>0){
+						uint64_t pokes;
+						if (read(wake_fd,&pokes,sizeof(pokes))<0){
+							//somebody else read it. Drain anyway.
+						}
+						while (press_queue.pop(press)) toggle_reaction();
+					}
+					left=step-harness_ns();
+				}
+				break; //a step of the animation would go here.
+			}
+		}
+	}
+	current_mode=-1;
+	if (mode==mode_polled) sampler.stop();
+
+	vector<int64_t> presses,changes,latencies;
+	stop(presses,changes);
+	size_t missed=0,next_change=0;
+	for (size_t p=0;p<presses.size();p++){
+		int64_t before=p+1<presses.size()?presses[p+1]:end;
+		while (next_change<changes.size() && changes[next_change]<presses[p]) next_change++;
+		if (next_change<changes.size() && changes[next_change]<before){
+			latencies.push_back(changes[next_change]-presses[p]);
+		}else{
+			missed++;
+		}
+	}
+	print_distribution(mode_names[mode],latencies,missed);
+}
+
+/*
+ * Main()
+ * Parameters: how many presses per mode (100 if left out), and which
+ * modes (all of them if left out).
+ * Returns 0, or 1 if we can't set up.
+ *
+ * How it works:
+ * -------------
+ * Set up wiringPi, the LED (off), the button (pulled down) and, on a
+ * loopback, the wire (low). Make the eventfd. Hook up the ISR on the
+ * press edge. Run each mode.
+ */
+int main(int argc,char *argv[]){
+	int count=argc>1?atoi(argv[1]):100;
+	if (count<1) count=100;
+	bool chosen[mode_count]={false};
+	bool any=false;
+	for (int c=2;c<argc;c++){
+		for (int m=0;m<mode_count;m++){
+			if (strcmp(argv[c],mode_names[m])==0) chosen[m]=any=true;
+		}
+	}
+
+#ifndef loopback_pin
+	sim_set_virtual_time(false);
+#endif
+	wiringPiSetupGpio();
+	pinMode(reaction_pin,OUTPUT);
+	digitalWrite(reaction_pin,reaction_level);
+	pinMode(button_pin,INPUT);
+	pullUpDnControl(button_pin,PUD_DOWN);
+#ifdef loopback_pin
+	pinMode(loopback_pin,OUTPUT);
+	digitalWrite(loopback_pin,LOW);
+#endif
+	wake_fd=eventfd(0,0);
+	if (wake_fd<0){
+		cout<<"Unable to make the eventfd. Exiting."<<endl;
+		return 1;
+	}
+	wiringPiISR(button_pin,INT_EDGE_RISING,&button_ISR);
+
+	for (int m=0;m<mode_count;m++){
+		if (!any || chosen[m]) run(m,count);
+	}
+	return 0;
+}
@@ -0,0 +1,217 @@
+ /*
+  * led_render.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * led_render.h
+ * Off the Pi, the only way to see what a scanner was doing used to be
+ * to uncomment its cout lines. Each one is a flush, which is a write()
+ * system call, for every pin, every frame, and the printing takes far
+ * longer than the scanning. And then you have to read a scrolling wall
+ * of hex.
+ *
+ * led_render_class draws the array instead, as one line of the
+ * terminal: 20 cells, in pins[] order, red when the LED is lit. It
+ * only redraws the cells that changed since the last frame, and it
+ * builds the whole frame in a buffer and hands it to the terminal with
+ * one write(), so a frame is one system call however many LEDs change,
+ * and a frame where nothing changed costs no system call at all.
+ *
+ * How it works:
+ * setup() works out, for each LED, the exact bytes that draw it lit
+ * and the bytes that draw it dark: an ANSI escape that moves the
+ * cursor to the LED's column on the current line (ESC [ n G), one to
+ * set the color, and the glyph. Then render() is just: compare the
+ * new lit mask with the one on screen, and for each LED that differs,
+ * copy its prepared bytes into the buffer. No formatting, no
+ * allocation.
+ *
+ * The renderer owns the line the cursor is on until finish(), so don't
+ * print anything else to the same terminal in between. led_watch does
+ * the drawing in a separate process, so the scanner never pays for it.
+*/
+
+#ifndef LED_RENDER_H
+#define LED_RENDER_H
+
+#include <stdint.h>
+#include <string.h> //memcpy().
+#include <stdio.h> //snprintf(), in setup() only.
+#include <errno.h>
+#include <unistd.h>
+
+#define led_render_max_leds 32
+#define led_render_cell_bytes 24 //the most one cell's escapes can take.
+#define led_render_label "LEDs "
+
+/* led_render_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * fd				:Variable. Where we draw. Usually 1, standard output.
+ * led_count		:Variable. How many LEDs.
+ * led_bits[]		:Variable. Each LED's bit in the lit mask: 1<<pins[n].
+ * lit_cells[][], dark_cells[][], lit_sizes[], dark_sizes[]
+ * 					:Variables. The prepared bytes for each LED's cell,
+ * 					and how many there are.
+ * buffer[]			:Variable. Where a frame gets built.
+ * shown			:Variable. The lit mask that's on the screen now.
+ * frames, drawn, writes, bytes
+ * 					:Variables. Frames rendered, frames that changed
+ * 					anything, write() calls, and bytes written.
+ * -------------------------------------------------------------------
+ * write_all()		:Method
+ * 					Writes the buffer, calling write() again if the
+ * 					terminal took only part of it. Counts the calls.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Takes the pins array, how many pins, and the fd to
+ * 					draw on (1 if left out). Prepares the cells, hides
+ * 					the cursor, and draws every LED dark. Returns false
+ * 					if there are too many LEDs or the first write
+ * 					fails.
+ * -------------------------------------------------------------------
+ * render()			:Method
+ * 					Takes a lit mask (bit n set means BCM pin n's LED
+ * 					is lit) and draws whatever changed, in one write().
+ * 					Returns how many LEDs it redrew.
+ * -------------------------------------------------------------------
+ * render_levels()	:Method
+ * 					The same, from pin levels (GPLEV0): our LEDs are
+ * 					lit when their pin is LOW.
+ * -------------------------------------------------------------------
+ * repaint()		:Method
+ * 					Takes a lit mask (what's on the screen now, if
+ * 					left out) and draws every LED, changed or not. One
+ * 					write().
+ * -------------------------------------------------------------------
+ * finish()			:Method
+ * 					Resets the colors, shows the cursor again and moves
+ * 					to the next line, so the terminal is usable.
+ * -------------------------------------------------------------------
+ * frame_count(), drawn_count(), write_count(), byte_count()
+ * 					:Methods. The counters.
+ * -------------------------------------------------------------------
+ */
+class led_render_class {
+	private:
+ // ===================================================================
+	int fd=1;
+	int led_count=0;
+	uint32_t led_bits[led_render_max_leds]={0};
+	char lit_cells[led_render_max_leds][led_render_cell_bytes];
+	char dark_cells[led_render_max_leds][led_render_cell_bytes];
+	int lit_sizes[led_render_max_leds]={0};
+	int dark_sizes[led_render_max_leds]={0};
+	char buffer[led_render_max_leds*led_render_cell_bytes+64];
+	uint32_t shown=0;
+	uint64_t frames=0;
+	uint64_t drawn=0;
+	uint64_t writes=0;
+	uint64_t bytes=0;
+ // -------------------------------------------------------------------
+	bool write_all(const char *data,size_t size){
+		while (size>0){
+			ssize_t done=write(fd,data,size);
+			writes++;
+			if (done<0){
+				if (errno==EINTR) continue;
+				return false;
+			}
+			data+=done;
+			size-=done;
+			bytes+=done;
+		}
+		return true;
+	}
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	bool setup(const int *pins,int count,int draw_fd=1){
+		if (count<1 || count>led_render_max_leds) return false;
+		fd=draw_fd;
+		led_count=count;
+		int label=(int)strlen(led_render_label);
+		for (int c=0;c<count;c++){
+			led_bits[c]=1u<<pins[c];
+			int column=label+1+2*c; //columns count from 1. Two per cell.
+			lit_sizes[c]=snprintf(lit_cells[c],led_render_cell_bytes,
+								  "\033[%dG\033[1;31m\xe2\x97\x8f",column);
+			dark_sizes[c]=snprintf(dark_cells[c],led_render_cell_bytes,
+								   "\033[%dG\033[2;37m\xc2\xb7",column);
+		}
+		shown=0;
+		const char *start="\033[?25l\r" led_render_label;
+		if (!write_all(start,strlen(start))) return false;
+		repaint();
+		return true;
+	};
+ // -------------------------------------------------------------------
+	int render(uint32_t lit){
+		frames++;
+		uint32_t changed=lit^shown;
+		int size=0,redrawn=0;
+		for (int c=0;c<led_count;c++){
+			if ((changed & led_bits[c])==0) continue;
+			if (lit & led_bits[c]){
+				memcpy(buffer+size,lit_cells[c],lit_sizes[c]);
+				size+=lit_sizes[c];
+			}else{
+				memcpy(buffer+size,dark_cells[c],dark_sizes[c]);
+				size+=dark_sizes[c];
+			}
+			redrawn++;
+		}
+		shown=lit;
+		if (size==0) return 0;
+		drawn++;
+		write_all(buffer,size);
+		return redrawn;
+	};
+ // -------------------------------------------------------------------
+	int render_levels(uint32_t levels){
+		return render(~levels);
+	};
+ // -------------------------------------------------------------------
+	void repaint(uint32_t lit){
+		shown=~lit; //everything looks changed.
+		render(lit);
+	};
+	void repaint(void){
+		repaint(shown);
+	};
+ // -------------------------------------------------------------------
+	void finish(void){
+		const char *end="\033[0m\033[?25h\n";
+		write_all(end,strlen(end));
+	};
+ // -------------------------------------------------------------------
+	uint64_t frame_count(void){ return frames; };
+	uint64_t drawn_count(void){ return drawn; };
+	uint64_t write_count(void){ return writes; };
+	uint64_t byte_count(void){ return bytes; };
+ // -------------------------------------------------------------------
+}; //end of led_render_class
+
+#endif
@@ -0,0 +1,141 @@
+ /*
+  * led_render_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * led_render_bench
+ * How fast can we show the Larson scan in a terminal? Three ways, each
+ * run flat out through the frames of larson.cpp's table:
+ * 		cout		what we used to do: a cout line, flushed, for every
+ * 					pin that changes.
+ * 		repaint		led_render_class, redrawing all 20 LEDs every frame.
+ * 		diff		led_render_class, redrawing only what changed, which
+ * 					is what led_watch does.
+ * For each we print frames/sec, write() calls and bytes per frame, and
+ * what a frame costs, which is what the scan loop would pay if it drew
+ * its own frames.
+ *
+ * The drawing goes to standard output and the results to standard
+ * error, so run it in a terminal to include the terminal's own time,
+ * or send standard output to /dev/null to see just our side:
+ * 		led_render_bench [seconds] > /dev/null
+ * Compile with:
+ * 		g++ -O2 -o led_render_bench led_render_bench.cpp
+*/
+
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+#include "led_render.h"
+#include "../larson/larson_frames.h"
+#include "../frame_clock/frame_clock.h"
+
+#define LEDs 20
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+constexpr larson_table full_table=make_larson_table(pins,0,LEDs);
+
+double run_seconds=1.0;
+
+/* void report(name, frames, writes, bytes, took_ns)
+ * Prints one line of results to cerr.
+ */
+void report(string name,uint64_t frames,uint64_t writes,uint64_t bytes,int64_t took_ns){
+	double seconds=took_ns/1e9;
+	cerr<<name<<": "<<(uint64_t)(frames/seconds)<<" frames/sec, "
+		<<(double)writes/frames<<" writes/frame, "<<(double)bytes/frames
+		<<" bytes/frame, "<<took_ns/(int64_t)frames<<"ns/frame."<<endl;
+}
+
+/* void bench_cout()
+ * The old way. Every changed pin gets a line, and every line a flush,
+ * which is a write(). We count them ourselves.
+ */
+void bench_cout(){
+	uint32_t shown=0;
+	uint64_t frames=0,writes=0,bytes=0;
+	int c=0;
+	int64_t start=timespec_ns(clock_now());
+	int64_t end=start+(int64_t)(run_seconds*1e9);
+	int64_t now=start;
+	while (now<end){
+		uint32_t lit=full_table.frames[c];
+		uint32_t changed=(lit^shown)&full_table.all_mask;
+		for (int pin=0;pin<32;pin++){
+			if ((changed & (1u<<pin))==0) continue;
+			string line="switching pin "+to_string(pin)+((lit>>pin)&1?" on\n":" off\n");
+			cout<<line<<flush;
+			writes++;
+			bytes+=line.size();
+		}
+		shown=lit;
+		frames++;
+		if (++c==full_table.length) c=0;
+		if ((frames & 255)==0) now=timespec_ns(clock_now());
+	}
+	report("cout",frames,writes,bytes,timespec_ns(clock_now())-start);
+}
+
+/* void bench_render(bool diff)
+ * led_render_class, either redrawing everything or just the changes.
+ */
+void bench_render(bool diff){
+	led_render_class led_render;
+	led_render.setup(pins,LEDs);
+	uint64_t writes_before=led_render.write_count();
+	uint64_t bytes_before=led_render.byte_count();
+	uint64_t frames=0;
+	int c=0;
+	int64_t start=timespec_ns(clock_now());
+	int64_t end=start+(int64_t)(run_seconds*1e9);
+	int64_t now=start;
+	while (now<end){
+		if (diff){
+			led_render.render(full_table.frames[c]);
+		}else{
+			led_render.repaint(full_table.frames[c]);
+		}
+		frames++;
+		if (++c==full_table.length) c=0;
+		if ((frames & 255)==0) now=timespec_ns(clock_now());
+	}
+	int64_t took=timespec_ns(clock_now())-start;
+	led_render.finish();
+	report(diff?"diff":"repaint",frames,led_render.write_count()-writes_before,
+		   led_render.byte_count()-bytes_before,took);
+}
+
+/*
+ * Main()
+ * Parameters: how many seconds to run each way (1 if left out).
+ * Returns 0.
+ */
+int main(int argc,char *argv[]){
+	if (argc>1) run_seconds=atof(argv[1]);
+	if (run_seconds<=0) run_seconds=1;
+	bench_cout();
+	bench_render(false);
+	bench_render(true);
+	return 0;
+}
@@ -0,0 +1,121 @@
+ /*
+  * led_watch.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * led_watch
+ * Shows the LED array in the terminal, live, while some other program
+ * drives it. It maps the same GPIO registers the scanner does (or the
+ * same stand-in file, off the Pi) and reads the pin levels, GPLEV0,
+ * fps times a second, and hands them to led_render_class, which draws
+ * whatever changed. The scanner doesn't know we're here: it doesn't
+ * print anything, doesn't call anything, and doesn't wait for us, so
+ * watching it can't slow it down. On a real Pi, GPLEV0 is the pins'
+ * actual levels, so this works there too.
+ *
+ * We only see the levels at the instant we sample, not what happened
+ * in between; GPLEV0 doesn't latch anything. So a scanner frame is
+ * only sure to be seen if it lasts longer than the gap between two
+ * samples: 1ms at 1000 fps, plus however late the watcher wakes up
+ * (the worst is printed at the end). A frame shorter than that can
+ * fall between two samples and never be drawn. Larson's 40ms frames
+ * are forty samples long, so we see every one. A sample where nothing
+ * changed costs one read of the register and no write at all.
+ *
+ * Usage: led_watch [stand-in] [fps]
+ * Defaults are the real /dev/gpiomem (or whatever gpiomem_path was
+ * compiled as) and 1000 fps. SIGINT stops it and prints what it did.
+ * Compile with:
+ * 		g++ -O2 -o led_watch led_watch.cpp
+ * and, to watch Larson_pthread off the Pi, run that with the same
+ * stand-in in another terminal.
+*/
+
+#include <iostream>
+#include <stdlib.h>
+#include "led_render.h"
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../frame_clock/frame_clock.h"
+#include "../stop_signal/stop_signal.h"
+
+#define LEDs 20
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+
+gpio_register_class gpio;
+led_render_class led_render;
+frame_clock_class watch_clock;
+stop_signal_class stop_signal;
+
+/*
+ * Main()
+ * Parameters: the options above.
+ * Returns 0, or 1 if we couldn't set up.
+ *
+ * How it works:
+ * -------------
+ * Set up the stop signal, map the GPIO, and set up the renderer on
+ * standard output.
+ * Loop until SIGINT: read the levels and render them, then wait for
+ * the next frame's deadline (start plus n frames), so a slow frame
+ * doesn't make the rest late.
+ * Put the terminal back, and print how many frames we looked at, how
+ * many changed anything, how many write()s and bytes that took, and
+ * how late the frames were.
+ */
+int main(int argc,char *argv[]){
+	if (!stop_signal.setup()){
+		cout<<"Unable to set up the stop signal. Exiting.\n"<<flush;
+		return 1;
+	}
+	const char *stand_in=argc>1?argv[1]:gpiomem_path;
+	int fps=argc>2?atoi(argv[2]):1000;
+	if (fps<1) fps=1000;
+
+	if (!gpio.setup(stand_in)){
+		cout<<"Unable to map "<<stand_in<<". Exiting."<<endl;
+		return 1;
+	}
+	if (!led_render.setup(pins,LEDs)){
+		cout<<"Unable to draw on standard output. Exiting."<<endl;
+		return 1;
+	}
+
+	int64_t start=timespec_ns(clock_now());
+	int64_t period=1000000000LL/fps;
+	for (int64_t frame=1;;frame++){
+		led_render.render_levels(gpio.read_levels());
+		if (!watch_clock.wait_until(start+frame*period,&stop_signal)) break;
+	}
+	int64_t took=timespec_ns(clock_now())-start;
+	led_render.finish();
+
+	uint64_t frames=led_render.frame_count();
+	cout<<frames<<" frames in "<<took/1000000<<"ms ("
+		<<(uint64_t)(frames*1e9/(took?took:1))<<" fps), "
+		<<led_render.drawn_count()<<" changed, "<<led_render.write_count()
+		<<" writes, "<<led_render.byte_count()<<" bytes."<<endl;
+	watch_clock.dump("Watch");
+	return 0;
+}
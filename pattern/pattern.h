@@ -0,0 +1,358 @@
+ /*
+  * pattern.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * pattern.h
+ * Every animation in this archive started as a copy of larson.cpp with
+ * its for loops bent into a new shape. larson_frames.h showed that the
+ * loops don't need to run at all while the LEDs are lit: the compiler
+ * can run them once and write down the frames. This takes that one
+ * step further. Instead of writing the loops, you describe the
+ * animation in a few words, and the compiler turns the words into a
+ * table of frames, each with its own delay:
+ * 		constexpr pattern_table larson=compile_pattern(pins,LEDs,
+ * 			"every 40; bounce 0 19");
+ * 		static_assert(larson.error==pattern_ok,"bad pattern");
+ * The program then just streams the table: write a frame, sleep its
+ * delay, next frame. A new pattern is a new string; the loop that
+ * plays it is the same one, and costs the same, for every pattern.
+ *
+ * The language:
+ * LEDs are numbered 0 to LEDs-1 in pins[] order, like the old loops'
+ * c. Statements are separated by semicolons or new lines, and # starts
+ * a comment. The array starts with every LED off, and each statement
+ * changes which are lit and records one or more frames:
+ * 		every ms		frames recorded after this last ms milliseconds.
+ * 						40 until you say otherwise. Records nothing.
+ * 		sweep a b		one LED moves from a to b (either direction),
+ * 						exactly the way the old loops did it: light the
+ * 						next LED, record a frame, then turn the last one
+ * 						off. So the eye has a one LED tail.
+ * 		bounce a b		sweep a b; sweep b a. "bounce 0 19" is
+ * 						larson.cpp.
+ * 		fill a b		light a, then a and the next, and so on to b, a
+ * 						frame each. A bar graph.
+ * 		empty a b		turn them off again the same way, a frame each.
+ * 		on a b			light a to b all at once. One frame.
+ * 		off a b			turn a to b off all at once. One frame.
+ * 		blink a b n		on a b; off a b; n times.
+ * 		hold ms			record the array as it is now, for ms. A pause.
+ * 		repeat n		play the statements from here to the matching
+ * 		...				end n times. Repeats can nest, up to
+ * 		end				pattern_max_depth deep.
+ * The whole table plays in a loop, so a pattern that ends where it
+ * started loops smoothly.
+ *
+ * Mistakes are caught by the compiler too: compile_pattern() never
+ * throws or fails to compile; it sets error (and error_at, the offset
+ * into the text) in the table, so a static_assert on error turns a
+ * typo into a compile error. pattern_error_text() says what went
+ * wrong, if you compile patterns at run time instead (from a file, or
+ * the command line), which works just as well.
+*/
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdint.h>
+
+#define pattern_max_frames 512
+#define pattern_max_depth 8 //how deep repeats can nest.
+#define pattern_default_ms 40
+
+/* Error codes. pattern_ok is 0, so !table.error means it's good. */
+#define pattern_ok 0
+#define pattern_unknown_word 1
+#define pattern_bad_number 2
+#define pattern_bad_led 3
+#define pattern_too_many_frames 4
+#define pattern_too_deep 5
+#define pattern_unmatched_end 6
+#define pattern_missing_end 7
+#define pattern_empty 8
+#define pattern_extra_text 9
+
+/* pattern_table
+ * -------------------------------------------------------------------
+ * frames[]		the pin mask of lit LEDs for each frame, like
+ * 				larson_table's.
+ * delays_ms[]	how long each frame stays up.
+ * length		how many of frames[] are used.
+ * all_mask		every pin in the pin map.
+ * total_ms		how long one pass through the table takes.
+ * error		pattern_ok, or what went wrong.
+ * error_at		where in the text it went wrong.
+ * -------------------------------------------------------------------
+ */
+struct pattern_table {
+	uint32_t frames[pattern_max_frames];
+	uint32_t delays_ms[pattern_max_frames];
+	int length;
+	uint32_t all_mask;
+	uint32_t total_ms;
+	int error;
+	int error_at;
+};
+
+/* pattern_parser
+ * Where compile_pattern() is in the text. The helpers below take it by
+ * reference and move it along.
+ */
+struct pattern_parser {
+	const char *text;
+	int at;
+};
+
+/* constexpr bool pattern_letter(char c)
+ * Letters are what words are made of.
+ */
+constexpr bool pattern_letter(char c){
+	return (c>='a' && c<='z') || (c>='A' && c<='Z') || c=='_';
+}
+
+/* constexpr void pattern_skip(parser, bool lines)
+ * Steps over spaces and tabs, and comments. If lines is true, steps
+ * over the things between statements, too: new lines and semicolons.
+ */
+constexpr void pattern_skip(pattern_parser &parser,bool lines){
+	while (true){
+		char c=parser.text[parser.at];
+		if (c==' ' || c=='\t' || c=='\r'){
+			parser.at++;
+		}else if (lines && (c=='\n' || c==';')){
+			parser.at++;
+		}else if (c=='#'){ //to the end of the line.
+			while (parser.text[parser.at]!=0 && parser.text[parser.at]!='\n'){
+				parser.at++;
+			}
+		}else{
+			return;
+		}
+	}
+}
+
+/* constexpr bool pattern_word(parser, word)
+ * If the next word is word, steps over it and returns true. Otherwise
+ * leaves the parser where it was and returns false.
+ */
+constexpr bool pattern_word(pattern_parser &parser,const char *word){
+	int c=0;
+	while (word[c]!=0){
+		if (parser.text[parser.at+c]!=word[c]) return false;
+		c++;
+	}
+	if (pattern_letter(parser.text[parser.at+c])) return false; //longer word.
+	parser.at+=c;
+	return true;
+}
+
+/* constexpr int pattern_number(parser)
+ * Reads a whole number (after any spaces). Returns -1 if there isn't
+ * one, or it's silly big.
+ */
+constexpr int pattern_number(pattern_parser &parser){
+	pattern_skip(parser,false);
+	char c=parser.text[parser.at];
+	if (c<'0' || c>'9') return -1;
+	int number=0;
+	while (parser.text[parser.at]>='0' && parser.text[parser.at]<='9'){
+		number=number*10+(parser.text[parser.at]-'0');
+		if (number>1000000) return -1;
+		parser.at++;
+	}
+	return number;
+}
+
+/* constexpr bool pattern_record(table, lit, ms)
+ * Adds a frame. Returns false (and sets the error) if the table's full.
+ */
+constexpr bool pattern_record(pattern_table &table,uint32_t lit,uint32_t ms){
+	if (table.length>=pattern_max_frames){
+		table.error=pattern_too_many_frames;
+		return false;
+	}
+	table.frames[table.length]=lit;
+	table.delays_ms[table.length]=ms;
+	table.total_ms+=ms;
+	table.length++;
+	return true;
+}
+
+/* constexpr pattern_table compile_pattern(pin_map, leds, text)
+ * Parameters:
+ * 		pin_map is the pins[] array.
+ * 		leds is how many LEDs there are in it.
+ * 		text is the pattern.
+ * Returns: the pattern_table, with error set if the text was bad.
+ *
+ * How it works:
+ * -------------
+ * Work out all_mask. Start with every LED off and a 40ms delay.
+ * Loop:
+ * 		Skip to the next statement. If that's the end of the text, we're
+ * 		done (unless a repeat is still open).
+ * 		Read the statement's word, then its numbers, checking each LED
+ * 		number is on the array. Do what it says to lit, recording frames
+ * 		as we go. Any error stops everything, with error_at pointing at
+ * 		the statement.
+ * 		repeat pushes where its body starts and how many more times to
+ * 		play it. end either jumps back to the start of the body and
+ * 		counts one off, or, on the last time, pops it.
+ * An empty table is an error too; there's nothing to play.
+ */
+constexpr pattern_table compile_pattern(const int *pin_map,int leds,const char *text){
+	pattern_table table{};
+	pattern_parser parser{text,0};
+	uint32_t lit=0;
+	uint32_t every=pattern_default_ms;
+	int repeat_at[pattern_max_depth]={0};
+	int repeat_left[pattern_max_depth]={0};
+	int depth=0;
+
+	for (int c=0;c<leds;c++){
+		table.all_mask|=1u<<pin_map[c];
+	}
+
+	while (table.error==pattern_ok){
+		pattern_skip(parser,true);
+		table.error_at=parser.at;
+		if (text[parser.at]==0){
+			if (depth>0) table.error=pattern_missing_end;
+			break;
+		}
+
+		if (pattern_word(parser,"every")){
+			int ms=pattern_number(parser);
+			if (ms<0) table.error=pattern_bad_number;
+			else every=ms;
+		}else if (pattern_word(parser,"hold")){
+			int ms=pattern_number(parser);
+			if (ms<0) table.error=pattern_bad_number;
+			else pattern_record(table,lit,ms);
+		}else if (pattern_word(parser,"repeat")){
+			int times=pattern_number(parser);
+			if (times<1){
+				table.error=pattern_bad_number;
+			}else if (depth>=pattern_max_depth){
+				table.error=pattern_too_deep;
+			}else{
+				repeat_at[depth]=parser.at;
+				repeat_left[depth]=times-1;
+				depth++;
+			}
+		}else if (pattern_word(parser,"end")){
+			if (depth==0){
+				table.error=pattern_unmatched_end;
+			}else if (repeat_left[depth-1]>0){
+				repeat_left[depth-1]--;
+				parser.at=repeat_at[depth-1];
+			}else{
+				depth--;
+			}
+		}else{
+			//Everything else takes two LEDs, and blink a count too.
+			int verb=0;
+			if (pattern_word(parser,"sweep")) verb=1;
+			else if (pattern_word(parser,"bounce")) verb=2;
+			else if (pattern_word(parser,"fill")) verb=3;
+			else if (pattern_word(parser,"empty")) verb=4;
+			else if (pattern_word(parser,"on")) verb=5;
+			else if (pattern_word(parser,"off")) verb=6;
+			else if (pattern_word(parser,"blink")) verb=7;
+			if (verb==0){
+				table.error=pattern_unknown_word;
+				break;
+			}
+			int a=pattern_number(parser);
+			int b=pattern_number(parser);
+			int times=verb==7?pattern_number(parser):1;
+			if (a<0 || b<0 || times<1){
+				table.error=pattern_bad_number;
+				break;
+			}
+			if (a>=leds || b>=leds){
+				table.error=pattern_bad_led;
+				break;
+			}
+			int step=b>=a?1:-1;
+			uint32_t range=0;
+			for (int c=a;c!=b+step;c+=step) range|=1u<<pin_map[c];
+
+			for (int pass=0;pass<(verb==2?2:1);pass++){
+				int from=pass==0?a:b;
+				int to=pass==0?b:a;
+				int dir=pass==0?step:-step;
+				if (verb==1 || verb==2){ //the old scan loop.
+					for (int c=from;c!=to+dir;c+=dir){
+						lit|=1u<<pin_map[c];
+						if (!pattern_record(table,lit,every)) break;
+						if (c!=from) lit&=~(1u<<pin_map[c-dir]);
+					}
+				}else if (verb==3 || verb==4){
+					for (int c=from;c!=to+dir;c+=dir){
+						if (verb==3) lit|=1u<<pin_map[c];
+						else lit&=~(1u<<pin_map[c]);
+						if (!pattern_record(table,lit,every)) break;
+					}
+				}
+			}
+			if (verb==5) pattern_record(table,lit|=range,every);
+			if (verb==6) pattern_record(table,lit&=~range,every);
+			for (int t=0;verb==7 && t<times && table.error==pattern_ok;t++){
+				pattern_record(table,lit|=range,every);
+				pattern_record(table,lit&=~range,every);
+			}
+		}
+		//Whatever's left on the line had better be the end of it.
+		if (table.error==pattern_ok){
+			pattern_skip(parser,false);
+			char c=text[parser.at];
+			if (c!=0 && c!='\n' && c!=';') table.error=pattern_extra_text;
+		}
+	}
+	if (table.error==pattern_ok && table.length==0){
+		table.error=pattern_empty;
+	}
+	return table;
+}
+
+/* const char *pattern_error_text(int error)
+ * Says what an error code means.
+ */
+inline const char *pattern_error_text(int error){
+	switch (error){
+		case pattern_ok: return "no error";
+		case pattern_unknown_word: return "unknown word";
+		case pattern_bad_number: return "missing or bad number";
+		case pattern_bad_led: return "no such LED";
+		case pattern_too_many_frames: return "too many frames";
+		case pattern_too_deep: return "repeats nested too deep";
+		case pattern_unmatched_end: return "end without repeat";
+		case pattern_missing_end: return "repeat without end";
+		case pattern_empty: return "no frames";
+		case pattern_extra_text: return "unexpected text after the statement";
+	}
+	return "unknown error";
+}
+
+#endif
@@ -0,0 +1,209 @@
+ /*
+  * pattern_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * pattern_bench
+ * What does a step of an animation cost, not counting the delay, when
+ * it's hand written loops against a compiled pattern? Two animations:
+ * 		larson		the nested loops from the old larson.cpp, against
+ * 					"every 40; bounce 0 19".
+ * 		bargraph	fill, hold, empty, hold, blink three times, as loops
+ * 					calling a pin write per LED, against the same thing
+ * 					as a pattern.
+ * The loops call pin_write() the way they called digitalWrite(), and
+ * add each delay to a deadline the way a frame clock would. The
+ * pattern stream calls frame_write() once per frame and adds the
+ * table's delay. Neither touches hardware; like larson_frames_bench,
+ * they update a shadow copy of the pin levels.
+ *
+ * Before timing, it runs each set of loops over a few passes and
+ * checks every frame, and every delay, against the pattern.
+ * Compile with:
+ * 		g++ -O2 -o pattern_bench pattern_bench.cpp
+*/
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <time.h>
+#include "pattern.h"
+
+#define LEDs 20
+#define bench_steps 50000000L
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+constexpr pattern_table larson_pattern=compile_pattern(pins,LEDs,
+	"every 40; bounce 0 19");
+constexpr pattern_table bargraph_pattern=compile_pattern(pins,LEDs,
+	"every 30; fill 0 19; hold 500; empty 19 0; hold 250; every 100; blink 0 19 3");
+static_assert(larson_pattern.error==pattern_ok,"larson pattern doesn't compile.");
+static_assert(bargraph_pattern.error==pattern_ok,"bargraph pattern doesn't compile.");
+
+volatile uint32_t shadow_levels=0; //1 bits are HIGH pins.
+volatile int64_t deadline_ms=0; //where a frame clock would be.
+uint32_t all_mask=larson_pattern.all_mask;
+
+/* pin_write() and frame_write()
+ * Stand-ins for digitalWrite() and gpio_register_class::write_leds().
+ * noinline, so the compiler can't fold them into the loops.
+ */
+__attribute__((noinline)) void pin_write(int pin,int level){
+	if (level) shadow_levels=shadow_levels | (1u<<pin);
+	else shadow_levels=shadow_levels & ~(1u<<pin);
+}
+
+__attribute__((noinline)) void frame_write(uint32_t lit_mask){
+	shadow_levels=(shadow_levels | all_mask) & ~lit_mask;
+}
+
+double seconds_now(){
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec+now.tv_nsec/1e9;
+}
+
+/* checker
+ * When a loop is being checked, each step() compares what the LEDs
+ * show, and the delay, with the next frame of the pattern.
+ */
+const pattern_table *check_pattern=NULL;
+long check_step=0;
+long mismatches=0;
+
+/* void step(long &steps, int ms)
+ * What the loops do where they used to call delay(ms): move the
+ * deadline on, check the frame if we're checking, and count the step.
+ */
+inline void step(long &steps,int ms){
+	deadline_ms=deadline_ms+ms;
+	if (check_pattern!=NULL){
+		int f=check_step%check_pattern->length;
+		if ((~shadow_levels & all_mask)!=check_pattern->frames[f] ||
+			(uint32_t)ms!=check_pattern->delays_ms[f]) mismatches++;
+		check_step++;
+	}
+	steps++;
+}
+
+/* void larson_loops(long steps)
+ * The old larson.cpp, for steps steps.
+ */
+void larson_loops(long steps){
+	long done=0;
+	while (done<steps){
+		for (int c=0;c<LEDs && done<steps;c++){
+			pin_write(pins[c],0);
+			step(done,40);
+			if (c>0) pin_write(pins[c-1],1);
+		}
+		for (int c=LEDs-1;c>=0 && done<steps;c--){
+			pin_write(pins[c],0);
+			step(done,40);
+			if (c<LEDs-1) pin_write(pins[c+1],1);
+		}
+	}
+}
+
+/* void bargraph_loops(long steps)
+ * The bar graph, the way it would have been written by hand.
+ */
+void bargraph_loops(long steps){
+	long done=0;
+	while (done<steps){
+		for (int c=0;c<LEDs && done<steps;c++){ //fill
+			pin_write(pins[c],0);
+			step(done,30);
+		}
+		if (done<steps) step(done,500); //hold
+		for (int c=LEDs-1;c>=0 && done<steps;c--){ //empty
+			pin_write(pins[c],1);
+			step(done,30);
+		}
+		if (done<steps) step(done,250); //hold
+		for (int b=0;b<3 && done<steps;b++){ //blink
+			for (int c=0;c<LEDs;c++) pin_write(pins[c],0);
+			step(done,100);
+			for (int c=0;c<LEDs;c++) pin_write(pins[c],1);
+			if (done<steps) step(done,100);
+		}
+	}
+}
+
+/* void stream(pattern, steps)
+ * The pattern runtime: the same loop for any pattern.
+ */
+void stream(const pattern_table &pattern,long steps){
+	int c=0;
+	for (long done=0;done<steps;done++){
+		frame_write(pattern.frames[c]);
+		deadline_ms=deadline_ms+pattern.delays_ms[c];
+		if (++c==pattern.length) c=0;
+	}
+}
+
+/* bool check(name, loops, pattern)
+ * Runs loops for three passes of pattern, checking every step.
+ */
+bool check(string name,void (*loops)(long),const pattern_table &pattern){
+	shadow_levels=all_mask; //everything off.
+	check_pattern=&pattern;
+	check_step=0;
+	mismatches=0;
+	loops(pattern.length*3);
+	check_pattern=NULL;
+	if (mismatches){
+		cout<<name<<": "<<mismatches<<" steps don't match the pattern!"<<endl;
+		return false;
+	}
+	cout<<name<<": pattern matches the loops ("<<pattern.length
+		<<" frames, "<<pattern.total_ms<<"ms a pass)."<<endl;
+	return true;
+}
+
+/* void time_both(name, loops, pattern)
+ * bench_steps steps of each, in ns per step.
+ */
+void time_both(string name,void (*loops)(long),const pattern_table &pattern){
+	double start=seconds_now();
+	loops(bench_steps);
+	double loop_time=seconds_now()-start;
+	start=seconds_now();
+	stream(pattern,bench_steps);
+	double stream_time=seconds_now()-start;
+	cout<<name<<": loops "<<loop_time*1e9/bench_steps<<" ns/step, pattern "
+		<<stream_time*1e9/bench_steps<<" ns/step."<<endl;
+}
+
+/*
+ * Main()
+ * Check both, then time both.
+ */
+int main(void){
+	if (!check("larson",larson_loops,larson_pattern)) return 1;
+	if (!check("bargraph",bargraph_loops,bargraph_pattern)) return 1;
+	time_both("larson",larson_loops,larson_pattern);
+	time_both("bargraph",bargraph_loops,bargraph_pattern);
+	return 0;
+}
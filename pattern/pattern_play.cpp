@@ -0,0 +1,185 @@
+ /*
+  * pattern_play.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * pattern_play
+ * Plays a pattern (see pattern.h) on the LED array until SIGINT. The
+ * patterns built in here are compiled with the program, so they're
+ * checked by the compiler and cost nothing to set up:
+ * 		larson		the scanner, the same frames as larson.cpp.
+ * 		bargraph	fill up, hold, empty down, flash the whole array.
+ * 		twin		one eye taking each half in turn: out across the
+ * 					low half, back across the high half, and so on,
+ * 					with one dark frame between halves. A pattern plays
+ * 					one statement at a time, so the halves never light
+ * 					together the way Larson_Threads' two eyes do.
+ * 		chase		a fast sweep with a pause at each end.
+ * Anything else on the command line is taken as the text of a pattern,
+ * compiled when the program starts:
+ * 		pattern_play "every 20; repeat 3; fill 0 9; empty 9 0; end"
+ * and if it doesn't compile, we show where it went wrong.
+ *
+ * How it works:
+ * The loop is the same for every pattern: write frame c, add its delay
+ * to the deadline, sleep until the deadline with
+ * frame_clock_class::wait_until(), next frame. The deadline only ever
+ * moves on by the table's delays, so timing errors don't add up.
+ *
+ * Usage: pattern_play [name|pattern] [stand-in]
+ * Compile with:
+ * 		g++ -O2 -o pattern_play pattern_play.cpp
+*/
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include "pattern.h"
+#include "../larson/larson_frames.h"
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../frame_clock/frame_clock.h"
+#include "../stop_signal/stop_signal.h"
+
+#define LEDs 20
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+
+constexpr pattern_table larson_pattern=compile_pattern(pins,LEDs,
+	"every 40; bounce 0 19");
+constexpr pattern_table bargraph_pattern=compile_pattern(pins,LEDs,
+	"every 30\n"
+	"fill 0 19; hold 500\n"
+	"empty 19 0; hold 250\n"
+	"every 100; blink 0 19 3");
+constexpr pattern_table twin_pattern=compile_pattern(pins,LEDs,
+	"every 40\n"
+	"repeat 10\n"
+	"sweep 0 9; off 9 9; sweep 19 10; off 10 10\n" //a sweep leaves its last LED lit.
+	"sweep 9 0; off 0 0; sweep 10 19; off 19 19\n"
+	"end");
+constexpr pattern_table chase_pattern=compile_pattern(pins,LEDs,
+	"every 10; sweep 0 19; hold 300; sweep 19 0; hold 300");
+static_assert(larson_pattern.error==pattern_ok,"larson pattern doesn't compile.");
+static_assert(bargraph_pattern.error==pattern_ok,"bargraph pattern doesn't compile.");
+static_assert(twin_pattern.error==pattern_ok,"twin pattern doesn't compile.");
+static_assert(chase_pattern.error==pattern_ok,"chase pattern doesn't compile.");
+
+/* constexpr bool same_frames(pattern, table)
+ * True if a pattern has exactly a larson_table's frames. So we know
+ * "bounce 0 19" really is larson.cpp.
+ */
+constexpr bool same_frames(const pattern_table &pattern,const larson_table &table){
+	if (pattern.length!=table.length) return false;
+	for (int f=0;f<table.length;f++){
+		if (pattern.frames[f]!=table.frames[f]) return false;
+	}
+	return true;
+}
+static_assert(same_frames(larson_pattern,make_larson_table(pins,0,LEDs)),
+			  "bounce 0 19 doesn't match larson.cpp's frames.");
+
+/* constexpr bool one_eye(pattern)
+ * True if every frame of a pattern is at most one eye: one LED lit, or
+ * two next to each other in pins[] order, the eye and the one LED tail
+ * a sweep gives it. So we know twin really is one eye, with no LED
+ * left behind in the other half.
+ */
+constexpr bool one_eye(const pattern_table &pattern){
+	for (int f=0;f<pattern.length;f++){
+		int lit=0,first=-1,last=-1;
+		for (int c=0;c<LEDs;c++){
+			if ((pattern.frames[f]>>pins[c]&1)==0) continue;
+			if (first<0) first=c;
+			last=c;
+			lit++;
+		}
+		if (lit>2 || (lit==2 && last!=first+1)) return false;
+	}
+	return true;
+}
+static_assert(one_eye(twin_pattern),"twin leaves an LED lit.");
+
+gpio_register_class gpio;
+frame_clock_class frame_clock;
+stop_signal_class stop_signal;
+pattern_table runtime_pattern; //big, so not on the stack.
+
+/*
+ * Main()
+ * Parameters: the options above.
+ * Returns 0, or 1 if the pattern doesn't compile or we can't set up.
+ *
+ * How it works:
+ * -------------
+ * Set up the stop signal. Pick the pattern: one of ours by name, or
+ * compile the argument. If it has an error, print the text with a ^
+ * under where it went wrong, and exit.
+ * Map the GPIO and set the pins as outputs.
+ * Loop until SIGINT: write the frame, move the deadline on by its
+ * delay, and sleep until the deadline.
+ * Turn the LEDs off, and print how late the frames were.
+ */
+int main(int argc,char *argv[]){
+	if (!stop_signal.setup()){
+		cout<<"Unable to set up the stop signal. Exiting.\n"<<flush;
+		return 1;
+	}
+	const char *choice=argc>1?argv[1]:"larson";
+	const char *stand_in=argc>2?argv[2]:gpiomem_path;
+	const pattern_table *pattern=&runtime_pattern;
+	if (strcmp(choice,"larson")==0) pattern=&larson_pattern;
+	else if (strcmp(choice,"bargraph")==0) pattern=&bargraph_pattern;
+	else if (strcmp(choice,"twin")==0) pattern=&twin_pattern;
+	else if (strcmp(choice,"chase")==0) pattern=&chase_pattern;
+	else runtime_pattern=compile_pattern(pins,LEDs,choice);
+	if (pattern->error!=pattern_ok){
+		cout<<"Pattern error: "<<pattern_error_text(pattern->error)<<"\n"
+			<<choice<<"\n"<<string(pattern->error_at,' ')<<"^\n";
+		return 1;
+	}
+
+	if (!gpio.setup(stand_in)){
+		cout<<"Unable to map "<<stand_in<<". Exiting."<<endl;
+		return 1;
+	}
+	for (int c=0;c<LEDs;c++){
+		gpio.output_mode(pins[c]);
+	}
+	gpio.write_leds(0,pattern->all_mask);
+	cout<<"Playing "<<pattern->length<<" frames, "<<pattern->total_ms
+		<<"ms a pass.\n"<<flush;
+
+	int c=0;
+	int64_t deadline=timespec_ns(clock_now());
+	while (true){
+		gpio.write_leds(pattern->frames[c],pattern->all_mask);
+		deadline+=(int64_t)pattern->delays_ms[c]*1000000LL;
+		if (!frame_clock.wait_until(deadline,&stop_signal)) break; //SIGINT.
+		if (++c==pattern->length) c=0;
+	}
+
+	gpio.write_leds(0,pattern->all_mask);
+	frame_clock.dump("Pattern");
+	return 0;
+}
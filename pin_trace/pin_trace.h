@@ -0,0 +1,356 @@
+ /*
+  * pin_trace.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * pin_trace.h
+ * When the eyes glitch, all we used to have to go on was a cout line,
+ * commented out because printing every frame is far too slow to leave
+ * in. pin_trace_class is cheap enough to leave on all the time. Every
+ * time a thread writes the LEDs, it records each pin that changed:
+ * when (CLOCK_MONOTONIC, in ns), which pin, what level it went to, and
+ * which thread did it. After something goes wrong, dump() the record
+ * to a file and turn it into a VCD file with pin_trace_vcd, and any
+ * waveform viewer (GTKWave, say) will show you exactly what the pins
+ * did and who did it.
+ *
+ * How it works:
+ * Each thread gets its own ring buffer the first time it records
+ * anything, so threads never share anything they write and nobody
+ * takes a lock. A ring holds the last pin_trace_ring_size transitions;
+ * older ones are written over. Recording is a clock read, a store
+ * saying which slots we're about to write over, four stores per
+ * changed pin, and a store of the ring's head count that tells readers
+ * the new records are there. The records are kept as relaxed atomic
+ * words, which cost no more than plain stores, so a reader copying one
+ * while it's written over gets a mix of old and new, but never
+ * undefined behaviour; and the first store tells it which those are.
+ *
+ * dump() can be called from any thread while the others keep writing,
+ * or from a signal handler: it only uses atomics, open(), write() and
+ * close(), and a buffer on its own stack. It copies each ring a chunk
+ * at a time, and after each chunk looks at how far the writer has
+ * claimed. Anything the writer could have written over while we were
+ * copying is thrown away rather than written out half old and half
+ * new.
+ *
+ * The file is a pin_trace_header (magic, version, record count) and
+ * then that many pin_trace_records, in the byte order of the machine
+ * that wrote it, one ring after another. pin_trace_vcd sorts them.
+ *
+ * Declare one pin_trace_class per program, as a global.
+*/
+
+#ifndef PIN_TRACE_H
+#define PIN_TRACE_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h> //memcpy().
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h> //SYS_gettid.
+
+#define pin_trace_ring_size 65536 //records per thread. Must be a power of 2.
+#define pin_trace_max_threads 64
+#define pin_trace_chunk 256 //records dump() copies at a time.
+#define pin_trace_words 4 //32 bit words in a record.
+#define pin_trace_magic "PINTRACE"
+#define pin_trace_version 1
+
+/* pin_trace_record
+ * One transition, 16 bytes.
+ * -------------------------------------------------------------------
+ * ns		CLOCK_MONOTONIC when the thread wrote it.
+ * tid		the kernel's id for the thread (what top -H shows).
+ * pin		the BCM pin number.
+ * level	the level it went to, 1 for HIGH, 0 for LOW. Our LEDs light
+ * 			on LOW.
+ * -------------------------------------------------------------------
+ */
+struct pin_trace_record {
+	int64_t ns;
+	int32_t tid;
+	uint8_t pin;
+	uint8_t level;
+	uint16_t unused;
+};
+static_assert(sizeof(pin_trace_record)==pin_trace_words*4,"pin_trace_record isn't 16 bytes.");
+
+/* pin_trace_slot
+ * Where a ring keeps one record, as 32 bit atomic words, which are
+ * lock free everywhere (even the ARMv6 Pis), so dump() is still safe
+ * from a signal handler.
+ */
+struct pin_trace_slot {
+	std::atomic<uint32_t> words[pin_trace_words];
+ // -------------------------------------------------------------------
+	void store(const pin_trace_record &record){
+		uint32_t copy[pin_trace_words];
+		memcpy(copy,&record,sizeof(copy));
+		for (int c=0;c<pin_trace_words;c++) words[c].store(copy[c],std::memory_order_relaxed);
+	};
+ // -------------------------------------------------------------------
+	pin_trace_record load(void) const {
+		uint32_t copy[pin_trace_words];
+		for (int c=0;c<pin_trace_words;c++) copy[c]=words[c].load(std::memory_order_relaxed);
+		pin_trace_record record;
+		memcpy(&record,copy,sizeof(record));
+		return record;
+	};
+};
+
+/* pin_trace_header
+ * The start of a trace file.
+ */
+struct pin_trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t count;
+};
+
+/* pin_trace_ring
+ * One thread's records.
+ * -------------------------------------------------------------------
+ * head		how many records this thread has ever written. Record n is
+ * 			in records[n%pin_trace_ring_size]. Only the owner writes it.
+ * claimed	head, plus the records a record() is part way through
+ * 			writing. Stored before the records are, so anybody who
+ * 			sees a new record sees the claim too.
+ * levels	the levels this thread last recorded, a bit per pin...
+ * known	...and which of those bits mean anything yet.
+ * -------------------------------------------------------------------
+ */
+struct pin_trace_ring {
+	std::atomic<uint64_t> head{0};
+	std::atomic<uint64_t> claimed{0};
+	int32_t tid=0;
+	uint32_t levels=0;
+	uint32_t known=0;
+	const void *owner=NULL;
+	pin_trace_slot records[pin_trace_ring_size];
+};
+
+/* pin_trace_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * rings[]			:Variable. Every thread's ring, in the order they
+ * 					first recorded. A ring is never freed while the
+ * 					program runs, so dump() can always read it.
+ * ring_count		:Variable. How many of rings[] are in use.
+ * dump_target, dump_path
+ * 					:Static Variables. What dump_on_signal() dumps, and
+ * 					where to.
+ * -------------------------------------------------------------------
+ * my_ring()		:Method
+ * 					Returns the calling thread's ring, making one and
+ * 					adding it to rings[] the first time. Returns NULL if
+ * 					we're out of room (that thread goes untraced).
+ * -------------------------------------------------------------------
+ * dump_handler()	:Static Method. The signal handler. Calls dump().
+ * -------------------------------------------------------------------
+ * claim()			:Static Method
+ * 					Takes a ring and the head it'll have once we've
+ * 					written what we're about to, and says so, with a
+ * 					release fence so the claim is seen before any of
+ * 					the records it covers.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * record()			:Method
+ * 					Takes the lit mask and the all mask, the same as
+ * 					gpio_register_class::write_leds(), and records
+ * 					every pin in all_mask whose level is different from
+ * 					what this thread last recorded (every pin in it,
+ * 					the first time).
+ * -------------------------------------------------------------------
+ * record_pin()		:Method
+ * 					Takes a pin and a level and records it, changed or
+ * 					not. For digitalWrite() programs.
+ * -------------------------------------------------------------------
+ * dump()			:Method
+ * 					Takes a path, and writes the trace there. Returns
+ * 					false if the file couldn't be written. Async signal
+ * 					safe.
+ * How it works:
+ * ------------
+ * Open the file and write a header with a count of 0.
+ * For each ring:
+ * 		Read its head. The oldest record still there is head minus the
+ * 		ring size (or 0).
+ * 		Copy up to pin_trace_chunk records at a time into a buffer on
+ * 		the stack. Then read how far the writer has claimed. It claims
+ * 		before it writes, so if we copied any record it has written
+ * 		over, we see the claim; anything older than the claim minus
+ * 		the ring size may have changed under us, so drop it. Write the
+ * 		rest.
+ * Go back and write the header again with the real count.
+ * -------------------------------------------------------------------
+ * dump_on_signal()	:Method
+ * 					Takes a signal number and a path, and installs a
+ * 					handler that dumps the trace to path every time the
+ * 					signal arrives. For dumps on demand: kill -USR1.
+ * -------------------------------------------------------------------
+ * recorded()		:Method. How many records have been written, by
+ * 					all threads, whether or not they're still in a ring.
+ * -------------------------------------------------------------------
+ */
+class pin_trace_class {
+	private:
+ // ===================================================================
+	std::atomic<pin_trace_ring *> rings[pin_trace_max_threads]={};
+	std::atomic<int> ring_count{0};
+	static inline pin_trace_class *dump_target=NULL;
+	static inline const char *dump_path=NULL;
+ // -------------------------------------------------------------------
+	pin_trace_ring *my_ring(void){
+		static thread_local pin_trace_ring *ring=NULL;
+		if (ring!=NULL && ring->owner==this) return ring;
+		int slot=ring_count.fetch_add(1);
+		if (slot>=pin_trace_max_threads){
+			ring_count--;
+			return NULL;
+		}
+		ring=new pin_trace_ring;
+		ring->tid=(int32_t)syscall(SYS_gettid);
+		ring->owner=this;
+		rings[slot].store(ring,std::memory_order_release);
+		return ring;
+	}
+ // -------------------------------------------------------------------
+	static void dump_handler(int signal_number){
+		if (dump_target!=NULL) dump_target->dump(dump_path);
+	}
+ // -------------------------------------------------------------------
+	static void claim(pin_trace_ring *ring,uint64_t end){
+		ring->claimed.store(end,std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release); //before the records.
+	}
+ // -------------------------------------------------------------------
+	static int64_t now_ns(){
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		return (int64_t)now.tv_sec*1000000000LL+now.tv_nsec;
+	}
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	void record(uint32_t lit_mask,uint32_t all_mask){
+		pin_trace_ring *ring=my_ring();
+		if (ring==NULL) return;
+		uint32_t levels=~lit_mask & all_mask; //lit is LOW.
+		uint32_t changed=((ring->levels^levels)|~ring->known) & all_mask;
+		if (changed==0) return;
+		int64_t ns=now_ns();
+		uint64_t head=ring->head.load(std::memory_order_relaxed);
+		claim(ring,head+__builtin_popcount(changed));
+		while (changed){
+			int pin=__builtin_ctz(changed);
+			changed&=changed-1;
+			ring->records[head&(pin_trace_ring_size-1)].store(
+				pin_trace_record{ns,ring->tid,(uint8_t)pin,(uint8_t)((levels>>pin)&1),0});
+			head++;
+		}
+		ring->levels=(ring->levels & ~all_mask)|levels;
+		ring->known|=all_mask;
+		ring->head.store(head,std::memory_order_release);
+	};
+ // -------------------------------------------------------------------
+	void record_pin(int pin,int level){
+		pin_trace_ring *ring=my_ring();
+		if (ring==NULL) return;
+		uint64_t head=ring->head.load(std::memory_order_relaxed);
+		claim(ring,head+1);
+		ring->records[head&(pin_trace_ring_size-1)].store(
+			pin_trace_record{now_ns(),ring->tid,(uint8_t)pin,(uint8_t)(level?1:0),0});
+		ring->head.store(head+1,std::memory_order_release);
+	};
+ // -------------------------------------------------------------------
+	bool dump(const char *path){
+		int file=open(path,O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if (file<0) return false;
+		pin_trace_header header;
+		memcpy(header.magic,pin_trace_magic,8);
+		header.version=pin_trace_version;
+		header.record_size=sizeof(pin_trace_record);
+		header.count=0;
+		bool ok=write(file,&header,sizeof(header))==sizeof(header);
+
+		pin_trace_record chunk[pin_trace_chunk];
+		int rings_in_use=ring_count.load();
+		if (rings_in_use>pin_trace_max_threads) rings_in_use=pin_trace_max_threads;
+		for (int r=0;r<rings_in_use && ok;r++){
+			pin_trace_ring *ring=rings[r].load(std::memory_order_acquire);
+			if (ring==NULL) continue; //still being set up.
+			uint64_t head=ring->head.load(std::memory_order_acquire);
+			uint64_t next=head>pin_trace_ring_size?head-pin_trace_ring_size:0;
+			while (next<head && ok){
+				uint64_t count=head-next;
+				if (count>pin_trace_chunk) count=pin_trace_chunk;
+				for (uint64_t c=0;c<count;c++){
+					chunk[c]=ring->records[(next+c)&(pin_trace_ring_size-1)].load();
+				}
+				std::atomic_thread_fence(std::memory_order_acquire); //pairs with claim()'s.
+				uint64_t claimed=ring->claimed.load(std::memory_order_relaxed);
+				uint64_t safe=claimed>pin_trace_ring_size?claimed-pin_trace_ring_size:0;
+				uint64_t skip=safe>next?safe-next:0; //written over.
+				if (skip<count){
+					ssize_t bytes=(count-skip)*sizeof(pin_trace_record);
+					ok=write(file,chunk+skip,bytes)==bytes;
+					header.count+=count-skip;
+				}
+				next+=count;
+				if (next<safe) next=safe; //we've fallen behind the writer.
+			}
+		}
+		if (ok) ok=pwrite(file,&header,sizeof(header),0)==sizeof(header);
+		if (close(file)<0) ok=false;
+		return ok;
+	};
+ // -------------------------------------------------------------------
+	bool dump_on_signal(int signal_number,const char *path){
+		dump_target=this;
+		dump_path=path;
+		struct sigaction action;
+		memset(&action,0,sizeof(action));
+		action.sa_handler=dump_handler;
+		action.sa_flags=SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		return sigaction(signal_number,&action,NULL)==0;
+	};
+ // -------------------------------------------------------------------
+	uint64_t recorded(void){
+		uint64_t total=0;
+		for (int r=0;r<ring_count.load() && r<pin_trace_max_threads;r++){
+			pin_trace_ring *ring=rings[r].load(std::memory_order_acquire);
+			if (ring!=NULL) total+=ring->head.load(std::memory_order_acquire);
+		}
+		return total;
+	};
+ // -------------------------------------------------------------------
+}; //end of pin_trace_class
+
+#endif
@@ -0,0 +1,206 @@
+ /*
+  * pin_trace_file.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * pin_trace_file.h
+ * Reads a pin trace back in, from either of the two forms it comes in:
+ * the binary file pin_trace_class::dump() writes, or a VCD file, like
+ * the ones pin_trace_vcd writes or a logic analyzer saves. Either way
+ * you get a vector of pin_trace_records sorted by time, so the
+ * programs that use a trace don't care where it came from.
+ *
+ * A VCD file names its signals, and we need BCM pin numbers, so:
+ * 		a wire named gpioN is BCM pin N (that's what pin_trace_vcd
+ * 		writes),
+ * 		a wire named ledN is LED N of the array, which is BCM pin
+ * 		led_pins[N], if you hand us led_pins (larson.cpp's pins[]),
+ * 		anything else, and anything wider than one bit, is skipped.
+ * A scope named thread_N (pin_trace_vcd -t) gives its wires tid N. Times
+ * are scaled from the file's $timescale to ns. x and z values, which
+ * mean "don't know," aren't transitions, so they're skipped too.
+*/
+
+#ifndef PIN_TRACE_FILE_H
+#define PIN_TRACE_FILE_H
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <stdlib.h>
+#include "pin_trace.h"
+
+/* bool load_pin_trace_binary(path, records, error)
+ * Reads a dump() file into records. Returns false, with a reason in
+ * error, if it isn't one or is cut short.
+ */
+inline bool load_pin_trace_binary(const char *path,std::vector<pin_trace_record> &records,
+								  std::string &error){
+	std::ifstream trace(path,std::ios::binary);
+	pin_trace_header header;
+	if (!trace.read((char *)&header,sizeof(header)) ||
+		memcmp(header.magic,pin_trace_magic,8)!=0 ||
+		header.version!=pin_trace_version ||
+		header.record_size!=sizeof(pin_trace_record)){
+		error="not a pin trace";
+		return false;
+	}
+	records.resize(header.count);
+	if (header.count>0 &&
+		!trace.read((char *)records.data(),header.count*sizeof(pin_trace_record))){
+		error="cut short";
+		return false;
+	}
+	return true;
+}
+
+/* int64_t vcd_timescale_ps(string scale)
+ * Takes the inside of a $timescale (1ns, 10 us, 1ps...) and returns
+ * how many ps one tick is. 0 if we can't tell.
+ */
+inline int64_t vcd_timescale_ps(std::string scale){
+	scale.erase(std::remove(scale.begin(),scale.end(),' '),scale.end());
+	int64_t number=atoll(scale.c_str());
+	size_t digits=scale.find_first_not_of("0123456789");
+	if (number<=0 || digits==std::string::npos) return 0;
+	std::string unit=scale.substr(digits);
+	if (unit=="s") return number*1000000000000LL;
+	if (unit=="ms") return number*1000000000LL;
+	if (unit=="us") return number*1000000LL;
+	if (unit=="ns") return number*1000LL;
+	if (unit=="ps") return number;
+	return 0; //fs is finer than we can keep.
+}
+
+/* bool load_pin_trace_vcd(path, records, error, led_pins, led_count)
+ * Reads a VCD file into records, as described at the top.
+ * Returns false, with a reason in error, if it can't.
+ * How it works:
+ * ------------
+ * Read it a word at a time; VCD doesn't care about lines.
+ * In the definitions, keep track of the scope we're in, and for each
+ * one bit $var, work out its pin (and tid, from the scope) and map its
+ * id to them. Note the $timescale.
+ * After $enddefinitions, #N sets the time; 0id or 1id is a transition
+ * of that id at that time; anything else (x, z, vectors, $dumpvars and
+ * friends) we step over.
+ */
+inline bool load_pin_trace_vcd(const char *path,std::vector<pin_trace_record> &records,
+							   std::string &error,const int *led_pins=NULL,
+							   int led_count=0){
+	std::ifstream vcd(path);
+	if (!vcd.is_open()){
+		error="can't open it";
+		return false;
+	}
+	std::map<std::string,pin_trace_record> signals; //id to pin and tid.
+	int64_t picoseconds=1000; //1ns, unless the file says otherwise.
+	int32_t scope_tid=0;
+	bool definitions=true;
+	int64_t now_ns=0;
+	std::string word;
+	while (vcd>>word){
+		if (definitions){
+			if (word=="$timescale"){
+				std::string scale,part;
+				while (vcd>>part && part!="$end") scale+=part;
+				picoseconds=vcd_timescale_ps(scale);
+				if (picoseconds==0){
+					error="unknown $timescale "+scale;
+					return false;
+				}
+			}else if (word=="$scope"){
+				std::string kind,name;
+				vcd>>kind>>name;
+				scope_tid=name.compare(0,7,"thread_")==0?atoi(name.c_str()+7):0;
+			}else if (word=="$var"){
+				std::string kind,width,id,name,part;
+				vcd>>kind>>width>>id>>name;
+				while (vcd>>part && part!="$end"){} //maybe a [bit] range.
+				pin_trace_record signal={0,scope_tid,0,0,0};
+				int pin=-1;
+				if (name.compare(0,4,"gpio")==0) pin=atoi(name.c_str()+4);
+				if (name.compare(0,3,"led")==0 && led_pins!=NULL){
+					int led=atoi(name.c_str()+3);
+					if (led>=0 && led<led_count) pin=led_pins[led];
+				}
+				if (width!="1" || pin<0 || pin>31) continue; //not one of ours.
+				signal.pin=(uint8_t)pin;
+				signals[id]=signal;
+			}else if (word=="$enddefinitions"){
+				definitions=false;
+			}else if (word[0]=='$' && word!="$end"){
+				std::string part; //$date, $comment... skip to $end.
+				while (vcd>>part && part!="$end"){}
+			}
+			continue;
+		}
+		if (word[0]=='#'){
+			now_ns=atoll(word.c_str()+1)*picoseconds/1000;
+		}else if (word[0]=='0' || word[0]=='1'){
+			auto signal=signals.find(word.substr(1));
+			if (signal==signals.end()) continue;
+			pin_trace_record record=signal->second;
+			record.ns=now_ns;
+			record.level=word[0]=='1';
+			records.push_back(record);
+		}else if (word[0]=='b' || word[0]=='r'){
+			vcd>>word; //a vector's value is followed by its id.
+		}
+	}
+	if (definitions){
+		error="no $enddefinitions";
+		return false;
+	}
+	return true;
+}
+
+/* bool load_pin_trace(path, records, error, led_pins, led_count)
+ * Reads either kind of trace, by looking at the first 8 bytes, and
+ * sorts it by time. Records with the same time stay in the order they
+ * were in the file, which is the order their thread wrote them.
+ */
+inline bool load_pin_trace(const char *path,std::vector<pin_trace_record> &records,
+						   std::string &error,const int *led_pins=NULL,int led_count=0){
+	char magic[8]={0};
+	std::ifstream probe(path,std::ios::binary);
+	if (!probe.is_open()){
+		error="can't open it";
+		return false;
+	}
+	probe.read(magic,8);
+	probe.close();
+	records.clear();
+	bool loaded=memcmp(magic,pin_trace_magic,8)==0?
+		load_pin_trace_binary(path,records,error):
+		load_pin_trace_vcd(path,records,error,led_pins,led_count);
+	if (!loaded) return false;
+	std::stable_sort(records.begin(),records.end(),
+		[](const pin_trace_record &a,const pin_trace_record &b){ return a.ns<b.ns; });
+	return true;
+}
+
+#endif
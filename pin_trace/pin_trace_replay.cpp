@@ -0,0 +1,236 @@
+ /*
+  * pin_trace_replay.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * pin_trace_replay
+ * Plays a recorded pin trace back onto the LED array: a binary trace
+ * from pin_trace_class::dump(), or a VCD file (see pin_trace_file.h).
+ * At 1x speed the LEDs do what they did when the trace was recorded,
+ * glitches and all, so a timing problem from the field can be watched
+ * on the bench. At Nx they do it N times faster. At max, we don't wait
+ * at all, which makes a real recorded workload into a benchmark of the
+ * output path.
+ *
+ * The array is larson.cpp's: LED n is BCM pin pins[n]. Transitions on
+ * pins that aren't in pins[] are counted and skipped. In a VCD file,
+ * wires named led0 to led19 are mapped through pins[] too.
+ *
+ * How it works:
+ * Load the trace, sorted by time. Every run of transitions with the
+ * same timestamp (one record() call's worth, usually) is one frame,
+ * and is written with one gpio_register_class::write_frame(), so pins
+ * that changed together still change together. Each frame's deadline
+ * is the replay's start time plus its offset into the trace divided by
+ * the speed, and we sleep until it with frame_clock_class::wait_until().
+ * Since every deadline is worked out from the start, not from the last
+ * frame, a late wakeup never pushes the rest of the replay back. We
+ * print how late the frames were when we're done, along with how long
+ * the replay took against how long the trace was.
+ *
+ * Usage: pin_trace_replay trace_file [speed|max] [loops] [stand-in]
+ * speed is a number (1 by default, 0.5 for half speed); loops is how
+ * many times to play it (1 by default, 0 for forever). SIGINT stops
+ * it. Off the Pi, give it a GPIO stand-in file (see gpio_mmap.h).
+ * Compile with:
+ * 		g++ -O2 -o pin_trace_replay pin_trace_replay.cpp
+*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <stdlib.h>
+#include "pin_trace_file.h"
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../frame_clock/frame_clock.h"
+#include "../stop_signal/stop_signal.h"
+
+#define LEDs 20
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+
+/* replay_frame
+ * -------------------------------------------------------------------
+ * offset_ns		when it happens, in ns from the first frame.
+ * set_mask			pins that go HIGH (LED off).
+ * clear_mask		pins that go LOW (LED on).
+ * -------------------------------------------------------------------
+ */
+struct replay_frame {
+	int64_t offset_ns;
+	uint32_t set_mask;
+	uint32_t clear_mask;
+};
+
+gpio_register_class gpio;
+frame_clock_class replay_clock;
+stop_signal_class stop_signal;
+
+/* vector<replay_frame> build_frames(records, array_mask, skipped, per_led)
+ * Turns a sorted trace into frames, as above. Counts the records for
+ * pins outside array_mask in skipped, and the transitions each LED
+ * gets in per_led[], in pins[] order.
+ */
+vector<replay_frame> build_frames(const vector<pin_trace_record> &records,
+								  uint32_t array_mask,uint64_t &skipped,
+								  uint64_t per_led[LEDs]){
+	vector<replay_frame> frames;
+	int led_of_pin[32];
+	for (int p=0;p<32;p++) led_of_pin[p]=-1;
+	for (int c=0;c<LEDs;c++) led_of_pin[pins[c]]=c;
+
+	int64_t first=records.empty()?0:records[0].ns;
+	for (const pin_trace_record &record : records){
+		uint32_t bit=record.pin<32?1u<<record.pin:0;
+		if ((bit & array_mask)==0){
+			skipped++;
+			continue;
+		}
+		per_led[led_of_pin[record.pin]]++;
+		int64_t offset=record.ns-first;
+		if (frames.empty() || frames.back().offset_ns!=offset){
+			frames.push_back(replay_frame{offset,0,0});
+		}
+		replay_frame &frame=frames.back();
+		if (record.level){ //the last write of a pin in a frame wins.
+			frame.set_mask|=bit;
+			frame.clear_mask&=~bit;
+		}else{
+			frame.clear_mask|=bit;
+			frame.set_mask&=~bit;
+		}
+	}
+	return frames;
+}
+
+/*
+ * Main()
+ * Parameters: the options above.
+ * Returns 0, or 1 if we couldn't load the trace or map the GPIO.
+ *
+ * How it works:
+ * -------------
+ * Set up stop_signal before anything else, so SIGINT comes to us.
+ * Read the options, load the trace and build the frames.
+ * Map the GPIO, set the array's pins as outputs, and turn the LEDs off.
+ * For each loop:
+ * 		For each frame, wait until the loop's start plus offset/speed
+ * 		(unless we're going flat out), then write it. Stop if SIGINT
+ * 		comes.
+ * 		The next loop starts one average frame gap after the last
+ * 		frame, so the wrap isn't a glitch of its own. That's worked out
+ * 		from this loop's start, not from now, so loops don't drift.
+ * Turn the LEDs off, and print what we did: frames, transitions, how
+ * long the trace was against how long we took, the frame rate, and how
+ * late the frames were.
+ */
+int main(int argc,char *argv[]){
+	if (!stop_signal.setup()){
+		cout<<"Unable to set up the stop signal. Exiting.\n"<<flush;
+		return 1;
+	}
+	if (argc<2){
+		cout<<"Usage: pin_trace_replay trace_file [speed|max] [loops] [stand-in]\n";
+		return 1;
+	}
+	double speed=1;
+	bool flat_out=false;
+	if (argc>2){
+		if (strcmp(argv[2],"max")==0) flat_out=true;
+		else speed=atof(argv[2]);
+		if (!flat_out && speed<=0){
+			cout<<"Speed has to be more than 0, or max.\n";
+			return 1;
+		}
+	}
+	int loops=argc>3?atoi(argv[3]):1;
+	const char *stand_in=argc>4?argv[4]:gpiomem_path;
+
+	vector<pin_trace_record> records;
+	string error;
+	if (!load_pin_trace(argv[1],records,error,pins,LEDs)){
+		cout<<"Unable to read "<<argv[1]<<": "<<error<<endl;
+		return 1;
+	}
+	uint32_t array_mask=gpio_register_class::pin_mask(pins,LEDs);
+	uint64_t skipped=0;
+	uint64_t per_led[LEDs]={0};
+	vector<replay_frame> frames=build_frames(records,array_mask,skipped,per_led);
+	if (frames.empty()){
+		cout<<"Nothing in "<<argv[1]<<" for the LED array to do.\n";
+		return 1;
+	}
+	int64_t span_ns=frames.back().offset_ns;
+	int64_t wrap_ns=frames.size()>1?span_ns/(int64_t)(frames.size()-1):0;
+
+	if (!gpio.setup(stand_in)){
+		cout<<"Unable to map "<<stand_in<<". Exiting."<<endl;
+		return 1;
+	}
+	for (int c=0;c<LEDs;c++){
+		gpio.output_mode(pins[c]);
+	}
+	gpio.write_leds(0,array_mask);
+
+	cout<<"Replaying "<<frames.size()<<" frames ("<<records.size()-skipped
+		<<" transitions, "<<span_ns/1000000<<"ms)"
+		<<" at ";
+	if (flat_out) cout<<"max.\n"<<flush; else cout<<speed<<"x.\n"<<flush;
+
+	uint64_t frames_written=0;
+	int64_t started=timespec_ns(clock_now());
+	bool stopped=false;
+	int64_t loop_start=started;
+	for (int loop=0;(loops==0 || loop<loops) && !stopped;loop++){
+		for (const replay_frame &frame : frames){
+			if (!flat_out){
+				int64_t deadline=loop_start+(int64_t)(frame.offset_ns/speed);
+				if (!replay_clock.wait_until(deadline,&stop_signal)){
+					stopped=true;
+					break;
+				}
+			}else if ((frames_written & 1023)==0 && stop_signal.check()){
+				stopped=true; //a syscall every frame would be the benchmark.
+				break;
+			}
+			gpio.write_frame(frame.set_mask,frame.clear_mask);
+			frames_written++;
+		}
+		loop_start+=(int64_t)((span_ns+wrap_ns)/speed); //ignored flat out.
+		if (flat_out) loop_start=timespec_ns(clock_now());
+	}
+	int64_t took_ns=timespec_ns(clock_now())-started;
+
+	gpio.write_leds(0,array_mask);
+	cout<<(stopped?"Stopped":"Done")<<" after "<<frames_written<<" frames in "
+		<<took_ns/1000000<<"ms ("<<(uint64_t)(frames_written*1e9/(took_ns?took_ns:1))
+		<<" frames/sec).\n";
+	if (skipped) cout<<skipped<<" transitions on pins outside the array skipped.\n";
+	cout<<"Transitions per LED, in pins[] order:";
+	for (int c=0;c<LEDs;c++) cout<<" "<<per_led[c];
+	cout<<"\n"<<flush;
+	if (!flat_out) replay_clock.dump("Replay");
+	return 0;
+}
@@ -0,0 +1,165 @@
+ /*
+  * pin_trace_vcd.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * pin_trace_vcd
+ * Turns a trace file written by pin_trace_class::dump() into a Value
+ * Change Dump (VCD) file, the plain text format logic analyzers and
+ * HDL simulators write, so it can be opened in a waveform viewer such
+ * as GTKWave. Each pin in the trace gets its own one bit wire, named
+ * gpioN after its BCM number. Time 0 is the first record, and the
+ * timescale is 1ns. The threads that wrote the trace, and how many
+ * transitions each wrote, go in a comment at the top.
+ *
+ * If a thread wrote a pin that another thread owns, which is exactly
+ * the sort of glitch we're looking for, the wire shows the last write.
+ * Add -t to get a separate wire per pin per thread instead (gpioN in a
+ * scope named after the thread), and you can see who did what.
+ *
+ * Usage: pin_trace_vcd [-t] trace_file [vcd_file]
+ * The VCD goes to standard output if there's no vcd_file.
+ * Compile with:
+ * 		g++ -O2 -o pin_trace_vcd pin_trace_vcd.cpp
+*/
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstring>
+#include "pin_trace_file.h"
+
+using namespace std;
+
+/* string vcd_id(int n)
+ * VCD names its signals with short strings of printable characters,
+ * ! to ~. This gives us the nth one.
+ */
+string vcd_id(int n){
+	string id;
+	do {
+		id+=(char)('!'+n%94);
+		n/=94;
+	} while (n>0);
+	return id;
+}
+
+/*
+ * Main()
+ * Parameters: the options above.
+ * Returns 0, or 1 if the trace can't be read or the VCD written.
+ *
+ * How it works:
+ * -------------
+ * Read the trace, sorted by time, with load_pin_trace(). (That takes
+ * a VCD file too, which is handy for pulling the gpio wires out of a
+ * bigger one.)
+ * Give every signal (a pin, or a pin and a thread with -t) an id.
+ * Write the VCD header: the date, the timescale, a comment with the
+ * threads, and a $var for every signal. Every signal starts at x
+ * (unknown), since we don't know what it was before the trace began.
+ * Then for every record, write a #time line if the time moved, and
+ * the new level of its signal.
+ */
+int main(int argc,char *argv[]){
+	bool per_thread=false;
+	int arg=1;
+	if (arg<argc && strcmp(argv[arg],"-t")==0){
+		per_thread=true;
+		arg++;
+	}
+	if (arg>=argc){
+		cerr<<"Usage: pin_trace_vcd [-t] trace_file [vcd_file]"<<endl;
+		return 1;
+	}
+
+	vector<pin_trace_record> records;
+	string error;
+	if (!load_pin_trace(argv[arg],records,error)){
+		cerr<<"Unable to read "<<argv[arg]<<": "<<error<<endl;
+		return 1;
+	}
+
+	ofstream vcd_file;
+	if (arg+1<argc){
+		vcd_file.open(argv[arg+1]);
+		if (!vcd_file.is_open()){
+			cerr<<"Unable to write "<<argv[arg+1]<<endl;
+			return 1;
+		}
+	}
+	ostream &vcd=vcd_file.is_open()?vcd_file:cout;
+
+	//Signals are keyed by (thread, pin). Without -t, thread is always 0.
+	map<pair<int32_t,int>,string> ids;
+	map<int32_t,uint64_t> per_tid;
+	for (const pin_trace_record &record : records){
+		per_tid[record.tid]++;
+		pair<int32_t,int> key(per_thread?record.tid:0,record.pin);
+		if (ids.count(key)==0) ids[key]="";
+	}
+	int next_id=0;
+	for (auto &signal : ids) signal.second=vcd_id(next_id++);
+
+	vcd<<"$date pin trace "<<argv[arg]<<" $end\n"
+	   <<"$version pin_trace_vcd "<<pin_trace_version<<" $end\n"
+	   <<"$comment "<<records.size()<<" transitions.";
+	for (auto &thread : per_tid){
+		vcd<<" Thread "<<thread.first<<": "<<thread.second<<".";
+	}
+	vcd<<" $end\n$timescale 1ns $end\n";
+	int32_t scope=-1;
+	for (auto &signal : ids){
+		if (signal.first.first!=scope || scope==-1){
+			if (scope!=-1) vcd<<"$upscope $end\n";
+			scope=signal.first.first;
+			vcd<<"$scope module ";
+			if (per_thread) vcd<<"thread_"<<scope; else vcd<<"gpio";
+			vcd<<" $end\n";
+		}
+		vcd<<"$var wire 1 "<<signal.second<<" gpio"<<signal.first.second<<" $end\n";
+	}
+	if (scope!=-1) vcd<<"$upscope $end\n";
+	vcd<<"$enddefinitions $end\n#0\n$dumpvars\n";
+	for (auto &signal : ids) vcd<<"x"<<signal.second<<"\n";
+	vcd<<"$end\n";
+
+	int64_t start=records.empty()?0:records[0].ns;
+	int64_t last=0;
+	for (const pin_trace_record &record : records){
+		int64_t at=record.ns-start;
+		if (at!=last){
+			vcd<<"#"<<at<<"\n";
+			last=at;
+		}
+		pair<int32_t,int> key(per_thread?record.tid:0,record.pin);
+		vcd<<(record.level?'1':'0')<<ids[key]<<"\n";
+	}
+	vcd<<flush;
+	if (!vcd){
+		cerr<<"Unable to write the VCD."<<endl;
+		return 1;
+	}
+	return 0;
+}
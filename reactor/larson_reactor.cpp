@@ -0,0 +1,275 @@
+ /*
+  * larson_reactor.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * larson_reactor
+ * The Larson scanner, button_interrupt's button, a control socket and
+ * SIGINT, all in one thread, none of it polling or sleeping. It all
+ * runs from reactor_class:
+ * 		a timer steps the scan every delaymils,
+ * 		GPIO12's rising edges, from the GPIO character device, count
+ * 		as presses, with button_interrupt's 100ms debounce, using the
+ * 		kernel's timestamps,
+ * 		a TCP socket on localhost takes lines from any number of
+ * 		clients (nc localhost 8012 will do):
+ * 			status		replies with frames, late ticks and presses.
+ * 			press		fakes a press, if we're using the stand-in.
+ * 		and every client is told about every press.
+ * 		SIGINT or SIGTERM turn the LEDs off and end it.
+ * If you give "-" for the chip, or we can't open it (off the Pi), the
+ * button is a gpio_event_pipe_class stand-in, which only the press
+ * command presses.
+ *
+ * The button is wired like button_interrupt's, between GPIO12 and the
+ * positive rail, so turn its pulldown on first ("gpio -g mode 12 down").
+ *
+ * Usage: larson_reactor [stand-in] [chip] [port]
+ * 		stand-in	what to map for the GPIO registers, gpiomem_path if
+ * 					left out.
+ * 		chip		the GPIO character device, /dev/gpiochip0 if left
+ * 					out, or - for the stand-in.
+ * 		port		the control socket's port, 8012 if left out.
+ * Compile with:
+ * 		g++ -O2 -o larson_reactor larson_reactor.cpp
+*/
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "reactor.h"
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../larson/larson_frames.h"
+
+#define LEDs 20
+#define delaymils 40
+#define button_pin 12
+#define button_debounce_delay 100 //ms, as button_interrupt.
+#define control_port 8012
+#define control_backlog 8
+#define max_command_length 256
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+constexpr larson_table scan_table=make_larson_table(pins,0,LEDs);
+static_assert(check_larson_table(scan_table,pins,0,LEDs),
+			  "pins[] does not produce a valid Larson scan.");
+
+reactor_class reactor;
+gpio_register_class gpio;
+gpio_event_pipe_class stand_in;
+bool using_stand_in=false;
+map<int,string> clients; //socket to the part of a line we have so far.
+
+int frame=0;
+uint64_t frames=0;
+uint64_t late_ticks=0;
+uint64_t presses=0;
+uint64_t last_edge_ns=0;
+
+/* void tell_clients(string text)
+ * Sends text to every client. The sockets are non-blocking, and a
+ * client too slow to take a line this short misses it.
+ */
+void tell_clients(const string &text){
+	for (auto &client:clients){
+		send(client.first,text.data(),text.size(),MSG_NOSIGNAL | MSG_DONTWAIT);
+	}
+}
+
+/* void scan_tick(uint64_t expirations)
+ * The frame timer. expirations is how many frames have gone by since
+ * the last tick: more than one and we were late, and skip ahead so the
+ * scan stays in time.
+ */
+void scan_tick(uint64_t expirations){
+	frames+=expirations;
+	late_ticks+=expirations-1;
+	frame=(frame+expirations)%scan_table.length;
+	gpio.write_leds(scan_table.frames[frame],scan_table.all_mask);
+}
+
+/* void button_edge(const gpioevent_data &event)
+ * A rising edge on the button. It's a press if the last edge was more
+ * than button_debounce_delay ago, by the kernel's clock, not ours, so
+ * it doesn't matter how long the event waited for us.
+ */
+void button_edge(const gpioevent_data &event){
+	if (event.id!=GPIOEVENT_EVENT_RISING_EDGE) return;
+	bool press=event.timestamp-last_edge_ns>button_debounce_delay*1000000ULL;
+	last_edge_ns=event.timestamp;
+	if (!press) return;
+	presses++;
+	cout<<"Button is Pressed ("<<presses<<")"<<endl;
+	tell_clients("pressed "+to_string(presses)+"\n");
+}
+
+/* void command(int client, string line)
+ * One line from a client.
+ */
+void command(int client,const string &line){
+	string reply;
+	if (line=="status"){
+		reply="frames "+to_string(frames)+" late "+to_string(late_ticks)
+			 +" presses "+to_string(presses)+"\n";
+	} else if (line=="press"){
+		if (!using_stand_in) reply="the button is real; press it\n";
+		else if (!stand_in.inject(true)) reply="the stand-in is full\n";
+	} else if (!line.empty()){
+		reply="commands: status, press\n";
+	}
+	if (!reply.empty()) send(client,reply.data(),reply.size(),MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+/* void client_ready(int client, uint32_t events)
+ * Reads what there is, and runs each whole line. A client that hangs
+ * up, errors, or sends a line longer than max_command_length is
+ * dropped.
+ */
+void client_ready(int client,uint32_t events){
+	char buffer[max_command_length];
+	ssize_t got;
+	while ((got=recv(client,buffer,sizeof(buffer),MSG_DONTWAIT))>0){
+		string &pending=clients[client];
+		pending.append(buffer,got);
+		size_t end;
+		while ((end=pending.find('\n'))!=string::npos){
+			string line=pending.substr(0,end);
+			pending.erase(0,end+1);
+			if (!line.empty() && line.back()=='\r') line.pop_back();
+			command(client,line);
+		}
+		if (pending.size()>max_command_length) got=0;
+		if (got==0) break;
+	}
+	if (got==0 || (got<0 && errno!=EAGAIN && errno!=EWOULDBLOCK) || (events & EPOLLERR)){
+		reactor.remove(client);
+		clients.erase(client);
+		close(client);
+	}
+}
+
+/* void accept_clients(int listener)
+ * Takes every client waiting, non-blocking, and watches it.
+ */
+void accept_clients(int listener){
+	int client;
+	while ((client=accept4(listener,NULL,NULL,SOCK_NONBLOCK | SOCK_CLOEXEC))>=0){
+		clients[client]="";
+		reactor.add(client,EPOLLIN | EPOLLRDHUP,[client](uint32_t events){
+			client_ready(client,events);
+		});
+	}
+}
+
+/* int listen_on(int port)
+ * A non-blocking TCP socket listening on localhost:port, or -1.
+ */
+int listen_on(int port){
+	int listener=socket(AF_INET,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,0);
+	if (listener<0) return -1;
+	int yes=1;
+	setsockopt(listener,SOL_SOCKET,SO_REUSEADDR,&yes,sizeof(yes));
+	sockaddr_in address;
+	memset(&address,0,sizeof(address));
+	address.sin_family=AF_INET;
+	address.sin_port=htons(port);
+	address.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+	if (bind(listener,(sockaddr *)&address,sizeof(address))<0 ||
+		listen(listener,control_backlog)<0){
+		close(listener);
+		return -1;
+	}
+	return listener;
+}
+
+/*
+ * Main()
+ * Parameters: the options above.
+ * Returns 0, or 1 if we can't set up.
+ *
+ * How it works:
+ * -------------
+ * Block SIGINT and SIGTERM into a signalfd first, so nothing else gets
+ * them. Map the GPIO and make the LED pins outputs, all off.
+ * Get GPIO12's events from the chip, or set up the stand-in.
+ * Listen on the control port.
+ * Start the frame timer, and run the reactor until a signal stops it.
+ * Turn the LEDs off, close the clients, and print the counters.
+ */
+int main(int argc,char *argv[]){
+	const char *gpio_path=argc>1?argv[1]:gpiomem_path;
+	const char *chip=argc>2?argv[2]:"/dev/gpiochip0";
+	int port=argc>3?atoi(argv[3]):control_port;
+
+	if (!reactor.setup() ||
+		reactor.add_signals({SIGINT,SIGTERM},[](int){ reactor.stop(); })<0){
+		cout<<"Unable to set up the reactor. Exiting."<<endl;
+		return 1;
+	}
+	if (!gpio.setup(gpio_path)){
+		cout<<"Unable to map "<<gpio_path<<". Exiting."<<endl;
+		return 1;
+	}
+	for (int c=0;c<LEDs;c++) gpio.output_mode(pins[c]);
+	gpio.write_leds(0,scan_table.all_mask);
+
+	int button=string(chip)=="-"?-1:gpio_line_events(chip,button_pin,
+														GPIOEVENT_REQUEST_RISING_EDGE,
+														"larson_reactor");
+	if (button<0){
+		if (!stand_in.setup()){
+			cout<<"Unable to set up the button stand-in. Exiting."<<endl;
+			return 1;
+		}
+		using_stand_in=true;
+		button=stand_in.read_fd();
+		cout<<"Button: stand-in (send \"press\" to the control port)."<<endl;
+	} else {
+		cout<<"Button: GPIO"<<button_pin<<" on "<<chip<<"."<<endl;
+	}
+	reactor.add_gpio_events(button,button_edge);
+
+	int listener=listen_on(port);
+	if (listener<0){
+		cout<<"Unable to listen on port "<<port<<". Exiting."<<endl;
+		return 1;
+	}
+	reactor.add(listener,EPOLLIN,[listener](uint32_t){ accept_clients(listener); });
+	cout<<"Control: localhost:"<<port<<"."<<endl;
+
+	reactor.add_timer(delaymils*1000000LL,scan_tick);
+	reactor.run();
+
+	gpio.write_leds(0,scan_table.all_mask);
+	for (auto &client:clients) close(client.first);
+	close(listener);
+	if (!using_stand_in) close(button);
+	cout<<"\n"<<frames<<" frames, "<<late_ticks<<" late, "<<presses<<" presses, "
+		<<reactor.wakeup_count()<<" wakeups, "<<reactor.dispatch_count()<<" events."<<endl;
+	return 0;
+}
@@ -0,0 +1,394 @@
+ /*
+  * reactor.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * reactor.h
+ * Every program in this archive waits for things its own way: the
+ * scanners sleep in delay(), Socket.cpp blocks in recv(),
+ * button_interrupt has wiringPi's interrupt thread, and SIGINT flips a
+ * bool that somebody checks now and then. Put two of them in one
+ * program and you need a thread for each, and locks between them.
+ *
+ * reactor_class waits for all of them at once, on one thread, with
+ * epoll. Everything Linux can tell us about comes in as a file
+ * descriptor that becomes readable:
+ * 		GPIO edges		the GPIO character device (/dev/gpiochip0)
+ * 						gives each line we ask for a file descriptor,
+ * 						and the kernel queues a gpioevent_data, with a
+ * 						timestamp, for every edge. No thread, no missed
+ * 						edges while we're busy.
+ * 		frame ticks		a timerfd, which becomes readable every period,
+ * 						on absolute times, and tells us how many periods
+ * 						have gone by since we last looked.
+ * 		signals			a signalfd, like stop_signal_class uses.
+ * 		sockets			are file descriptors already.
+ * You hand the reactor a file descriptor and a function to call when
+ * it's ready; run() sleeps in epoll_wait() until one or more are, and
+ * calls their functions, one at a time, on its own thread. Nothing
+ * else ever runs, so nothing needs a lock. The functions must not
+ * block, or everything waits for them: use non-blocking sockets.
+ *
+ * For testing off the Pi, gpio_event_pipe_class is a stand-in for a
+ * GPIO line: a pipe that you write gpioevent_data into with inject(),
+ * and that the reactor reads exactly as it reads the real thing.
+ *
+ * This is the GPIO character device's first version of its interface
+ * (Linux 4.8 on). Its timestamps are CLOCK_REALTIME before Linux 5.7
+ * and CLOCK_MONOTONIC after; the stand-in uses CLOCK_MONOTONIC.
+*/
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <initializer_list>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#define reactor_max_events 16 //per epoll_wait().
+
+typedef std::function<void(uint32_t)> reactor_handler; //takes the epoll events.
+
+/* int gpio_line_events(chip, line, edges, label)
+ * Asks the GPIO character device chip (say "/dev/gpiochip0") for
+ * events on line (the BCM number, on a Pi's first chip): rising,
+ * falling or both edges, GPIOEVENT_REQUEST_BOTH_EDGES if left out.
+ * The line becomes an input. Returns a non-blocking file descriptor
+ * that gpioevent_data can be read from, or -1 if we couldn't get one.
+ */
+inline int gpio_line_events(const char *chip,int line,
+							uint32_t edges=GPIOEVENT_REQUEST_BOTH_EDGES,
+							const char *label="reactor"){
+	int chip_fd=open(chip,O_RDONLY | O_CLOEXEC);
+	if (chip_fd<0) return -1;
+	gpioevent_request request;
+	memset(&request,0,sizeof(request));
+	request.lineoffset=line;
+	request.handleflags=GPIOHANDLE_REQUEST_INPUT;
+	request.eventflags=edges;
+	strncpy(request.consumer_label,label,sizeof(request.consumer_label)-1);
+	int result=ioctl(chip_fd,GPIO_GET_LINEEVENT_IOCTL,&request);
+	close(chip_fd); //the line's descriptor lives on without it.
+	if (result<0) return -1;
+	fcntl(request.fd,F_SETFL,fcntl(request.fd,F_GETFL) | O_NONBLOCK);
+	return request.fd;
+}
+
+/* gpio_event_pipe_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * ends[]			:Variable. The pipe: read end, write end.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Makes the pipe, both ends non-blocking. Returns
+ * 					false if it couldn't.
+ * -------------------------------------------------------------------
+ * read_fd()		:Method
+ * 					The end to give reactor_class::add_gpio_events().
+ * -------------------------------------------------------------------
+ * inject()			:Method
+ * 					Takes true for a rising edge, false for falling,
+ * 					and a timestamp in ns (CLOCK_MONOTONIC now, if
+ * 					left out), and writes the gpioevent_data the
+ * 					kernel would have. Returns false if the pipe is
+ * 					full. Safe from any thread, since pipe writes this
+ * 					small are atomic.
+ * -------------------------------------------------------------------
+ * The destructor closes both ends.
+ * -------------------------------------------------------------------
+ */
+class gpio_event_pipe_class {
+	private:
+ // ===================================================================
+	int ends[2]={-1,-1};
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	bool setup(void){
+		return pipe2(ends,O_NONBLOCK | O_CLOEXEC)==0;
+	};
+ // -------------------------------------------------------------------
+	int read_fd(void){ return ends[0]; };
+ // -------------------------------------------------------------------
+	bool inject(bool rising,uint64_t timestamp_ns=0){
+		if (timestamp_ns==0){
+			timespec now;
+			clock_gettime(CLOCK_MONOTONIC,&now);
+			timestamp_ns=(uint64_t)now.tv_sec*1000000000ULL+now.tv_nsec;
+		}
+		gpioevent_data event;
+		memset(&event,0,sizeof(event));
+		event.timestamp=timestamp_ns;
+		event.id=rising?GPIOEVENT_EVENT_RISING_EDGE:GPIOEVENT_EVENT_FALLING_EDGE;
+		return write(ends[1],&event,sizeof(event))==(ssize_t)sizeof(event);
+	};
+ // -------------------------------------------------------------------
+	~gpio_event_pipe_class(){
+		if (ends[0]>=0) close(ends[0]);
+		if (ends[1]>=0) close(ends[1]);
+	};
+}; //end of gpio_event_pipe_class
+
+/* reactor_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * epoll_fd			:Variable. The epoll instance.
+ * handlers			:Variable. File descriptor to the function to call
+ * 					when it's ready. Shared, so run_once() can hold on
+ * 					to the one it's calling: if the function remove()s
+ * 					itself, it's destroyed when it returns, not while
+ * 					it's running.
+ * owned			:Variable. The file descriptors we made (timers,
+ * 					signalfds), which we close when they're removed.
+ * stopping			:Variable. run() returns when this is set.
+ * wakeups, dispatched
+ * 					:Variables. Returns from epoll_wait(), and
+ * 					functions called.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Creates the epoll instance. Returns false if it
+ * 					couldn't.
+ * -------------------------------------------------------------------
+ * add()			:Method
+ * 					Takes a file descriptor, the epoll events to wait
+ * 					for (EPOLLIN, EPOLLOUT, ...) and a function to call
+ * 					with the events that happened. Returns false if
+ * 					epoll won't take it.
+ * -------------------------------------------------------------------
+ * modify()			:Method
+ * 					Takes a file descriptor we have and new events to
+ * 					wait for, for a socket that now has something to
+ * 					write, say.
+ * -------------------------------------------------------------------
+ * remove()			:Method
+ * 					Stops watching a file descriptor, and closes it if
+ * 					it's one we made. Safe to call from inside any
+ * 					handler, including the file descriptor's own.
+ * -------------------------------------------------------------------
+ * add_timer()		:Method
+ * 					Takes a period in ns and a function, and calls the
+ * 					function every period, on absolute times, with how
+ * 					many periods have gone by since the last call
+ * 					(more than 1 means we were late). The first call is
+ * 					one period from now, or at first_ns (CLOCK_MONOTONIC)
+ * 					if given. Returns the timerfd, or -1.
+ * -------------------------------------------------------------------
+ * add_signals()	:Method
+ * 					Takes a list of signals and a function. Blocks the
+ * 					signals in this thread (so call it before making
+ * 					any threads) and calls the function with each one
+ * 					that arrives. Returns the signalfd, or -1.
+ * -------------------------------------------------------------------
+ * add_gpio_events():Method
+ * 					Takes a file descriptor from gpio_line_events() or
+ * 					gpio_event_pipe_class, and a function, and calls
+ * 					the function with each gpioevent_data, until the
+ * 					file descriptor is removed. Returns false if epoll
+ * 					won't take it.
+ * -------------------------------------------------------------------
+ * run_once()		:Method
+ * 					Takes a timeout in ms (-1 for forever). Waits once,
+ * 					and calls the function for everything that's ready
+ * 					and still watched. Returns how many were ready, or
+ * 					-1 on an error.
+ * -------------------------------------------------------------------
+ * run()			:Method
+ * 					run_once() until stop(), or until there's nothing
+ * 					left to watch.
+ * -------------------------------------------------------------------
+ * stop()			:Method
+ * 					Makes run() return after the current batch.
+ * -------------------------------------------------------------------
+ * watch_count(), wakeup_count(), dispatch_count()
+ * 					:Methods. How many file descriptors we're watching,
+ * 					and the counters.
+ * -------------------------------------------------------------------
+ * The destructor closes the file descriptors we made, and epoll.
+ * -------------------------------------------------------------------
+ */
+class reactor_class {
+	private:
+ // ===================================================================
+	int epoll_fd=-1;
+	std::map<int,std::shared_ptr<reactor_handler>> handlers;
+	std::vector<int> owned;
+	bool stopping=false;
+	uint64_t wakeups=0;
+	uint64_t dispatched=0;
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	bool setup(void){
+		epoll_fd=epoll_create1(EPOLL_CLOEXEC);
+		return epoll_fd>=0;
+	};
+ // -------------------------------------------------------------------
+	bool add(int fd,uint32_t events,reactor_handler handler){
+		epoll_event watch;
+		memset(&watch,0,sizeof(watch));
+		watch.events=events;
+		watch.data.fd=fd;
+		if (epoll_ctl(epoll_fd,EPOLL_CTL_ADD,fd,&watch)<0) return false;
+		handlers[fd]=std::make_shared<reactor_handler>(std::move(handler));
+		return true;
+	};
+ // -------------------------------------------------------------------
+	bool modify(int fd,uint32_t events){
+		epoll_event watch;
+		memset(&watch,0,sizeof(watch));
+		watch.events=events;
+		watch.data.fd=fd;
+		return epoll_ctl(epoll_fd,EPOLL_CTL_MOD,fd,&watch)==0;
+	};
+ // -------------------------------------------------------------------
+	void remove(int fd){
+		auto found=handlers.find(fd);
+		if (found==handlers.end()) return;
+		epoll_ctl(epoll_fd,EPOLL_CTL_DEL,fd,NULL);
+		handlers.erase(found); //run_once() may still hold it.
+		for (size_t c=0;c<owned.size();c++){
+			if (owned[c]!=fd) continue;
+			close(fd);
+			owned.erase(owned.begin()+c);
+			break;
+		}
+	};
+ // -------------------------------------------------------------------
+	int add_timer(int64_t period_ns,std::function<void(uint64_t)> tick,int64_t first_ns=0){
+		int fd=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK | TFD_CLOEXEC);
+		if (fd<0) return -1;
+		if (first_ns==0){
+			timespec now;
+			clock_gettime(CLOCK_MONOTONIC,&now);
+			first_ns=(int64_t)now.tv_sec*1000000000LL+now.tv_nsec+period_ns;
+		}
+		itimerspec times;
+		times.it_value.tv_sec=first_ns/1000000000LL;
+		times.it_value.tv_nsec=first_ns%1000000000LL;
+		times.it_interval.tv_sec=period_ns/1000000000LL;
+		times.it_interval.tv_nsec=period_ns%1000000000LL;
+		if (timerfd_settime(fd,TFD_TIMER_ABSTIME,&times,NULL)<0 ||
+			!add(fd,EPOLLIN,[fd,tick](uint32_t){
+				uint64_t expirations=0;
+				if (read(fd,&expirations,sizeof(expirations))==sizeof(expirations)){
+					tick(expirations);
+				}
+			})){
+			close(fd);
+			return -1;
+		}
+		owned.push_back(fd);
+		return fd;
+	};
+ // -------------------------------------------------------------------
+	int add_signals(std::initializer_list<int> signals,std::function<void(int)> handler){
+		sigset_t set;
+		sigemptyset(&set);
+		for (int signal_number:signals) sigaddset(&set,signal_number);
+		if (pthread_sigmask(SIG_BLOCK,&set,NULL)!=0) return -1;
+		int fd=signalfd(-1,&set,SFD_NONBLOCK | SFD_CLOEXEC);
+		if (fd<0) return -1;
+		if (!add(fd,EPOLLIN,[fd,handler](uint32_t){
+				signalfd_siginfo info;
+				while (read(fd,&info,sizeof(info))==sizeof(info)){
+					handler((int)info.ssi_signo);
+				}
+			})){
+			close(fd);
+			return -1;
+		}
+		owned.push_back(fd);
+		return fd;
+	};
+ // -------------------------------------------------------------------
+	bool add_gpio_events(int fd,std::function<void(const gpioevent_data &)> handler){
+		return add(fd,EPOLLIN,[this,fd,handler](uint32_t){
+			const reactor_handler *self=handlers[fd].get();
+			gpioevent_data events[reactor_max_events];
+			ssize_t got;
+			while ((got=read(fd,events,sizeof(events)))>0){
+				for (size_t c=0;c<(size_t)got/sizeof(gpioevent_data);c++){
+					handler(events[c]);
+					auto found=handlers.find(fd);
+					if (found==handlers.end() || found->second.get()!=self) return; //removed.
+				}
+			}
+		});
+	};
+ // -------------------------------------------------------------------
+	int run_once(int timeout_ms){
+		epoll_event ready[reactor_max_events];
+		int count=epoll_wait(epoll_fd,ready,reactor_max_events,timeout_ms);
+		if (count<0) return errno==EINTR?0:-1;
+		wakeups++;
+		for (int c=0;c<count;c++){
+			auto found=handlers.find(ready[c].data.fd);
+			if (found==handlers.end()) continue; //removed earlier in this batch.
+			std::shared_ptr<reactor_handler> handler=found->second; //outlives remove().
+			dispatched++;
+			(*handler)(ready[c].events);
+		}
+		return count;
+	};
+ // -------------------------------------------------------------------
+	void run(void){
+		stopping=false;
+		while (!stopping && !handlers.empty()){
+			if (run_once(-1)<0) break;
+		}
+	};
+ // -------------------------------------------------------------------
+	void stop(void){
+		stopping=true;
+	};
+ // -------------------------------------------------------------------
+	size_t watch_count(void){ return handlers.size(); };
+	uint64_t wakeup_count(void){ return wakeups; };
+	uint64_t dispatch_count(void){ return dispatched; };
+ // -------------------------------------------------------------------
+	~reactor_class(){
+		for (size_t c=0;c<owned.size();c++) close(owned[c]);
+		if (epoll_fd>=0) close(epoll_fd);
+	};
+}; //end of reactor_class
+
+#endif
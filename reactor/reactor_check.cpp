@@ -0,0 +1,213 @@
+ /*
+  * reactor_check.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * reactor_check
+ * Puts reactor_class through its paces with gpio_event_pipe_class
+ * stand-ins, so it runs anywhere, and says whether each check passed:
+ * 		edges		inject a burst of edges on one line, and count
+ * 					that every one is dispatched, in order, with its
+ * 					direction and timestamp.
+ * 		self remove	a handler that removes its own line on the first
+ * 					of several edges. It must be called once, and the
+ * 					reactor must not touch the handler after.
+ * 		other remove
+ * 					a handler that removes another line that's ready
+ * 					in the same batch. The other line's handler may or
+ * 					may not have run first, but never runs after.
+ * 		timer		a timer that removes itself on its third tick,
+ * 					which closes its timerfd from inside its own
+ * 					handler.
+ * The removing handlers are small enough that std::function keeps them
+ * inside itself rather than on the heap, which is the case where
+ * destroying one while it runs goes wrong. Build with
+ * -fsanitize=address to have that caught rather than just noticed.
+ *
+ * Usage: reactor_check
+ * Returns 0 if everything passed, 1 if not.
+ * Compile with:
+ * 		g++ -O2 -o reactor_check reactor_check.cpp
+*/
+
+#include <iostream>
+#include <string>
+#include "reactor.h"
+
+#define burst_edges 100
+
+using namespace std;
+
+int failures=0;
+
+/* void check(name, passed, detail)
+ * Prints one result, and counts it if it failed.
+ */
+void check(const string &name,bool passed,const string &detail){
+	cout<<(passed?"pass  ":"FAIL  ")<<name<<": "<<detail<<endl;
+	if (!passed) failures++;
+}
+
+/* void drain(reactor)
+ * run_once() until nothing's ready.
+ */
+void drain(reactor_class &reactor){
+	while (reactor.run_once(0)>0){
+		//until the batch is empty.
+	}
+}
+
+/* void check_edges()
+ * A burst of alternating edges, each with its own timestamp.
+ */
+void check_edges(){
+	reactor_class reactor;
+	gpio_event_pipe_class line;
+	if (!reactor.setup() || !line.setup()) return check("edges",false,"unable to set up");
+	int seen=0,in_order=0;
+	reactor.add_gpio_events(line.read_fd(),[&](const gpioevent_data &event){
+		bool rising=event.id==GPIOEVENT_EVENT_RISING_EDGE;
+		if (rising==(seen%2==0) && event.timestamp==(uint64_t)seen+1) in_order++;
+		seen++;
+	});
+	for (int c=0;c<burst_edges;c++) line.inject(c%2==0,c+1);
+	drain(reactor);
+	check("edges",seen==burst_edges && in_order==burst_edges,
+		  to_string(seen)+" of "+to_string(burst_edges)+" dispatched, "+to_string(in_order)
+		  +" in order");
+}
+
+/* remover
+ * What the removing handlers capture, through one pointer, so the
+ * handler is small: the reactor, the file descriptor to remove, our
+ * own (to read), and how many times we've been called.
+ */
+struct remover {
+	reactor_class *reactor;
+	int fd;
+	int own_fd;
+	int calls;
+};
+
+/* void check_self_remove()
+ * One line, two handlers that remove themselves: one raw, one through
+ * add_gpio_events() with several edges waiting.
+ */
+void check_self_remove(){
+	reactor_class reactor;
+	gpio_event_pipe_class raw_line,event_line;
+	if (!reactor.setup() || !raw_line.setup() || !event_line.setup()){
+		return check("self remove",false,"unable to set up");
+	}
+	remover raw={&reactor,raw_line.read_fd(),raw_line.read_fd(),0};
+	remover *state=&raw;
+	reactor.add(raw.fd,EPOLLIN,[state](uint32_t){
+		state->reactor->remove(state->fd);
+		state->calls++; //after remove(): the capture must still be there.
+	});
+	remover events={&reactor,event_line.read_fd(),event_line.read_fd(),0};
+	remover *event_state=&events;
+	reactor.add_gpio_events(events.fd,[event_state](const gpioevent_data &){
+		event_state->reactor->remove(event_state->fd);
+		event_state->calls++;
+	});
+	raw_line.inject(true);
+	for (int c=0;c<3;c++) event_line.inject(c%2==0);
+	drain(reactor);
+	raw_line.inject(false);
+	event_line.inject(false);
+	drain(reactor);
+	check("self remove",raw.calls==1 && events.calls==1 && reactor.watch_count()==0,
+		  "raw handler called "+to_string(raw.calls)+" times, gpio handler "
+		  +to_string(events.calls)+" times for 3 edges, "+to_string(reactor.watch_count())
+		  +" still watched");
+}
+
+/* void check_other_remove()
+ * Two lines ready at once; the first handler to run removes the other.
+ * Then both lines get another edge, and only the survivor hears it.
+ */
+void check_other_remove(){
+	reactor_class reactor;
+	gpio_event_pipe_class lines[2];
+	if (!reactor.setup() || !lines[0].setup() || !lines[1].setup()){
+		return check("other remove",false,"unable to set up");
+	}
+	remover states[2]={{&reactor,lines[1].read_fd(),lines[0].read_fd(),0},
+					   {&reactor,lines[0].read_fd(),lines[1].read_fd(),0}};
+	for (int c=0;c<2;c++){
+		remover *state=&states[c];
+		reactor.add(lines[c].read_fd(),EPOLLIN,[state](uint32_t){
+			gpioevent_data event;
+			while (read(state->own_fd,&event,sizeof(event))>0){
+				//empty the line, so it isn't ready again.
+			}
+			state->calls++;
+			state->reactor->remove(state->fd); //the other line.
+		});
+	}
+	lines[0].inject(true);
+	lines[1].inject(true);
+	int batch=reactor.run_once(0);
+	int in_batch=states[0].calls+states[1].calls;
+	lines[0].inject(false);
+	lines[1].inject(false);
+	drain(reactor);
+	int survivor=states[0].calls>0?0:1;
+	check("other remove",batch==2 && in_batch==1 && states[survivor].calls==2
+		  && states[1-survivor].calls==0 && reactor.watch_count()==1,
+		  to_string(batch)+" ready, "+to_string(in_batch)+" handler ran in the batch, "
+		  "then the survivor "+to_string(states[survivor].calls)+" times and the removed "
+		  +to_string(states[1-survivor].calls));
+}
+
+/* void check_timer()
+ * A 1ms timer that removes itself on its third tick.
+ */
+void check_timer(){
+	reactor_class reactor;
+	if (!reactor.setup()) return check("timer",false,"unable to set up");
+	int ticks=0;
+	int fd=-1;
+	fd=reactor.add_timer(1000000,[&](uint64_t){
+		if (++ticks==3) reactor.remove(fd);
+	});
+	if (fd<0) return check("timer",false,"no timerfd");
+	reactor.run(); //returns when there's nothing left to watch.
+	bool closed=fcntl(fd,F_GETFD)<0 && errno==EBADF;
+	check("timer",ticks==3 && closed,to_string(ticks)+" ticks, timerfd "
+		  +(closed?"closed":"still open"));
+}
+
+/*
+ * Main()
+ * Parameters: none.
+ * Returns 0 if every check passed, 1 if not.
+ */
+int main(void){
+	check_edges();
+	check_self_remove();
+	check_other_remove();
+	check_timer();
+	cout<<(failures==0?"All passed.":to_string(failures)+" failed.")<<endl;
+	return failures==0?0:1;
+}
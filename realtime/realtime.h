@@ -0,0 +1,150 @@
+ /*
+  * realtime.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * realtime.h
+ * Linux is not a real time operating system, but it can act a lot like
+ * one if you ask nicely. This file holds the asking:
+ * 		realtime_lock_memory()	locks every page we have, and every
+ * 								page we'll ever get, into RAM, so
+ * 								we never wait on the SD card for a
+ * 								page fault.
+ * 		realtime_thread_attr()	fills in a pthread_attr_t so the
+ * 								thread it creates runs SCHED_FIFO at
+ * 								the priority we ask for, pinned to
+ * 								one CPU. A SCHED_FIFO thread runs as
+ * 								soon as it's ready, ahead of every
+ * 								normal process on that CPU.
+ * 		realtime_prefault_stack()
+ * 								touches the first part of the calling
+ * 								thread's stack, so the pages are there
+ * 								before we need them.
+ * 		realtime_cpu_for()		picks a CPU for thread n, staying off
+ * 								CPU 0 if there are enough to go round,
+ * 								since that's where most interrupts land.
+ * 		realtime_pin_process()	pins the calling process to one CPU.
+ * 								Anybody can do this; it doesn't need
+ * 								root.
+ *
+ * SCHED_FIFO and mlockall() need root, or CAP_SYS_NICE and
+ * CAP_IPC_LOCK. Without them, pthread_create() fails with EPERM.
+*/
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE //for CPU_SET and pthread_attr_setaffinity_np.
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <string.h> //memset().
+#include <sys/mman.h> //mlockall().
+#include <unistd.h> //sysconf().
+
+#define realtime_priority 80 //out of 99. Leaves room above for the kernel.
+#define realtime_stack_size (256*1024) //bytes per realtime thread.
+#define realtime_prefault_size (64*1024) //bytes of that we touch up front.
+
+/* bool realtime_lock_memory()
+ * Returns true if all our memory, now and later, is locked into RAM.
+ */
+inline bool realtime_lock_memory(){
+	return mlockall(MCL_CURRENT|MCL_FUTURE)==0;
+}
+
+/* int realtime_cpu_for(int thread_number)
+ * Returns the CPU thread number thread_number should be pinned to.
+ * With three or more CPUs, threads go on CPUs 1 and up and CPU 0 is
+ * left for everything else. With fewer, they share what there is.
+ */
+inline int realtime_cpu_for(int thread_number){
+	long cpus=sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus<1) cpus=1;
+	if (cpus>2) return 1+thread_number%(cpus-1);
+	return thread_number%cpus;
+}
+
+/* bool realtime_pin_process(int cpu)
+ * Returns true if the calling process (its main thread, and any
+ * threads or children it starts after) now only runs on cpu.
+ */
+inline bool realtime_pin_process(int cpu){
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpu,&cpu_set);
+	return sched_setaffinity(0,sizeof(cpu_set),&cpu_set)==0;
+}
+
+/* bool realtime_thread_attr(pthread_attr_t *attr, int priority, int cpu)
+ * Parameters:
+ * 		attr is the attribute object to fill in. It's initialized here;
+ * 		call pthread_attr_destroy() on it when you're done.
+ * 		priority is the SCHED_FIFO priority, 1 to 99.
+ * 		cpu is the CPU to pin the thread to.
+ * Returns true if every attribute took.
+ *
+ * How it works:
+ * -------------
+ * Threads normally inherit the scheduling policy of whoever created
+ * them, and ignore whatever is in attr. PTHREAD_EXPLICIT_SCHED tells
+ * pthread_create() to use ours instead. Then set the policy, the
+ * priority, the CPU, and a stack size big enough that we know how much
+ * of it to prefault.
+ */
+inline bool realtime_thread_attr(pthread_attr_t *attr,int priority,int cpu){
+	sched_param param;
+	cpu_set_t cpu_set;
+
+	memset(&param,0,sizeof(param));
+	param.sched_priority=priority;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpu,&cpu_set);
+
+	if (pthread_attr_init(attr)) return false;
+	if (pthread_attr_setinheritsched(attr,PTHREAD_EXPLICIT_SCHED) ||
+		pthread_attr_setschedpolicy(attr,SCHED_FIFO) ||
+		pthread_attr_setschedparam(attr,&param) ||
+		pthread_attr_setaffinity_np(attr,sizeof(cpu_set),&cpu_set) ||
+		pthread_attr_setstacksize(attr,realtime_stack_size)){
+		pthread_attr_destroy(attr);
+		return false;
+	}
+	return true;
+}
+
+/* void realtime_prefault_stack()
+ * Touch realtime_prefault_size bytes of stack below us, one byte per
+ * page is enough, so the kernel maps them now. noinline, so the array
+ * really lives in its own stack frame.
+ */
+__attribute__((noinline)) inline void realtime_prefault_stack(){
+	volatile char stack_pages[realtime_prefault_size];
+	long page_size=sysconf(_SC_PAGESIZE);
+	for (long c=0;c<realtime_prefault_size;c+=page_size){
+		stack_pages[c]=0;
+	}
+	(void)stack_pages; //we only wanted the pages, not the data.
+}
+
+#endif
@@ -0,0 +1,332 @@
+ /*
+  * shared_frame.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * shared_frame.h
+ * After fork(), the two Larson processes share nothing. Each one wrote
+ * its own half of the array straight to the pins whenever it woke up,
+ * so for a moment after every step one half was showing the new frame
+ * and the other half the old one. On the breadboard that's a tear.
+ *
+ * shared_frame_class gives the processes one frame to share instead.
+ * It's a few words of memory mapped MAP_SHARED before the fork, so
+ * after the fork both processes see the same memory. Each process
+ * (each "segment" owner) writes only its own slot: its bits of the
+ * frame, and the number of the frame they belong to. One process, the
+ * flusher, reads every slot and writes the whole frame to the pins.
+ * Nobody else touches the pins at all.
+ *
+ * Each slot is protected by its own seqlock. A sequence number sits
+ * next to the slot's bits. The slot's writer makes it odd before it
+ * changes anything and even again after, so:
+ * 		a reader that sees the same even number before and after it
+ * 		reads knows nobody wrote in between, and its copy is whole,
+ * 		a reader that sees an odd number, or a different number after,
+ * 		reads again.
+ * Readers never block the writer, and since every slot has exactly
+ * one writer, writers never wait for each other either. There's no
+ * lock between processes at all. That matters, because a process can
+ * be killed at any moment: if one dies in the middle of a write, its
+ * slot's number stays odd. The flusher only tries a slot a few times
+ * before giving up on it for this frame (using the last bits it did
+ * read), so it can't get stuck there, and the replacement worker,
+ * which owns the slot now, finds the number odd and simply carries on
+ * from the next even one.
+ *
+ * The flusher also checks that every segment's frame number matches
+ * the frame it's flushing. If one is behind (its process woke up
+ * late), it waits a little while for it. If it's still behind, it
+ * writes the frame anyway and counts a tear.
+ *
+ * Everything in the shared memory is a std::atomic, and it has to be
+ * a lock free one. One that isn't gets its lock from libatomic, in the
+ * process's own memory, so two processes would each take their own
+ * lock and the atomic wouldn't be atomic between them at all. The
+ * static_asserts below refuse to build where that would happen.
+ *
+ * Call setup() BEFORE fork(), or the processes won't share anything.
+*/
+
+#ifndef SHARED_FRAME_H
+#define SHARED_FRAME_H
+
+#include <iostream>
+#include <string>
+#include <atomic> //std::atomic. Lock free ones work between processes.
+#include <new> //placement new.
+#include <stdint.h>
+#include <time.h>
+#include <sched.h> //sched_yield().
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../gpio_mmap/gpio_mmap.h"
+
+#define shared_frame_max_segments 32
+#define shared_frame_poll_us 20 //how long the flusher naps while it waits.
+#define shared_frame_read_tries 64 //reads of a slot before we give up on it.
+
+/* shared_frame_slot
+ * One segment's part of the shared memory, on a cache line of its own
+ * so the writers don't slow each other down.
+ * -------------------------------------------------------------------
+ * sequence			the slot's seqlock sequence number. Odd while its
+ * 					writer is in the middle of a write.
+ * lit				the segment's bits: bit n set means pin n is lit.
+ * stamp			the frame number they belong to.
+ * -------------------------------------------------------------------
+ */
+struct alignas(64) shared_frame_slot {
+	std::atomic<uint32_t> sequence;
+	std::atomic<uint32_t> lit;
+	std::atomic<int64_t> stamp;
+};
+
+/* shared_frame_block
+ * The part that lives in shared memory. Everything in it is atomic,
+ * since the other process can change it at any moment.
+ * -------------------------------------------------------------------
+ * slots[]			one per segment.
+ * writes, recoveries, retries, stuck, flushes, tears
+ * 					counters: writes by any segment, writes that found
+ * 					their slot left odd by a writer that died, slot
+ * 					reads that had to be done again, slot reads we gave
+ * 					up on, frames flushed, and frames flushed with a
+ * 					segment from the wrong frame.
+ * -------------------------------------------------------------------
+ */
+struct shared_frame_block {
+	shared_frame_slot slots[shared_frame_max_segments];
+	std::atomic<uint64_t> writes;
+	std::atomic<uint64_t> recoveries;
+	std::atomic<uint64_t> retries;
+	std::atomic<uint64_t> stuck;
+	std::atomic<uint64_t> flushes;
+	std::atomic<uint64_t> tears;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,"shared_frame needs lock free 32 bit atomics.");
+static_assert(std::atomic<int64_t>::is_always_lock_free,"shared_frame needs lock free 64 bit atomics.");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,"shared_frame needs lock free 64 bit atomics.");
+
+/* shared_frame_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * block			:Variable. The shared memory.
+ * segment_masks[]	:Variable. The pins each segment owns.
+ * last_lit[]		:Variable. The last bits the flusher read whole from
+ * 					each slot, to use when it can't read one.
+ * segment_count	:Variable. How many segments there are.
+ * all_mask			:Variable. Every pin in any segment.
+ * wait_total_ns, wait_worst_ns
+ * 					:Variables. How long flush() waited for the
+ * 					segments to match, all told and at worst. These,
+ * 					and last_lit, only mean anything in the flusher, so
+ * 					they aren't shared.
+ * -------------------------------------------------------------------
+ * read_slot()		:Method
+ * 					The seqlock read of one slot. Takes the segment,
+ * 					and copies its bits and stamp. Tries up to
+ * 					shared_frame_read_tries times, yielding the CPU
+ * 					between tries so a writer on the same CPU can
+ * 					finish. Returns false if it never got a whole copy
+ * 					(the writer is slow, or dead).
+ * -------------------------------------------------------------------
+ * read()			:Method
+ * 					read_slot() for every segment. Puts the frame
+ * 					together, using last_lit for a slot it couldn't
+ * 					read, and returns whether every slot was read whole
+ * 					with the stamp we want.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Takes an array of segment pin masks and how many
+ * 					there are. Maps the shared block and zeroes it.
+ * 					Returns false if it couldn't, or the masks overlap.
+ * -------------------------------------------------------------------
+ * write()			:Method
+ * 					Takes a segment number, the lit mask for it, and
+ * 					the frame number it belongs to. Only that segment's
+ * 					process may call it.
+ * How it works:
+ * ------------
+ * Load our slot's sequence number. If it's odd, the process that had
+ * the slot before us died in the middle of a write; count a recovery
+ * and start from the next even number. Store the number plus one
+ * (odd), then the bits and the stamp, then the number plus two (even
+ * again). The fence after the odd store, and the release ordering on
+ * the even one, make sure a reader can't see the new bits without
+ * seeing the number change.
+ * -------------------------------------------------------------------
+ * flush()			:Method
+ * 					Takes the gpio to write, the frame number, and how
+ * 					long in ns we're willing to wait for a segment
+ * 					that's behind. Returns the frame it wrote.
+ * How it works:
+ * ------------
+ * read() until every stamp matches, napping shared_frame_poll_us
+ * between tries, or until the wait is up. Write whatever we have to
+ * the pins, and count a tear if it wasn't a match. Add up how long we
+ * waited; with more segments, the slowest one makes us wait longer.
+ * -------------------------------------------------------------------
+ * mask()			:Method. Every pin in any segment.
+ * -------------------------------------------------------------------
+ * dump()			:Method
+ * 					Takes a name and prints the counters, with the
+ * 					tear rate as a percentage, and the average and
+ * 					worst flush wait.
+ * -------------------------------------------------------------------
+ */
+class shared_frame_class {
+	private:
+ // ===================================================================
+	shared_frame_block *block=NULL;
+	uint32_t segment_masks[shared_frame_max_segments]={0};
+	uint32_t last_lit[shared_frame_max_segments]={0};
+	int segment_count=0;
+	uint32_t all_mask=0;
+	int64_t wait_total_ns=0;
+	int64_t wait_worst_ns=0;
+ // -------------------------------------------------------------------
+	bool read_slot(int segment,uint32_t &lit,int64_t &stamp){
+		shared_frame_slot &slot=block->slots[segment];
+		for (int tries=0;tries<shared_frame_read_tries;tries++){
+			if (tries>0){
+				block->retries++;
+				sched_yield(); //let the writer finish.
+			}
+			uint32_t before=slot.sequence.load(std::memory_order_acquire);
+			if (before & 1) continue; //the writer's in the middle of it.
+			uint32_t copy=slot.lit.load(std::memory_order_relaxed);
+			int64_t copy_stamp=slot.stamp.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed)==before){
+				lit=copy;
+				stamp=copy_stamp;
+				return true;
+			}
+		}
+		block->stuck++;
+		return false;
+	}
+ // -------------------------------------------------------------------
+	bool read(uint32_t &lit,int64_t stamp){
+		bool coherent=true;
+		lit=0;
+		for (int s=0;s<segment_count;s++){
+			uint32_t bits;
+			int64_t slot_stamp;
+			if (read_slot(s,bits,slot_stamp)){
+				last_lit[s]=bits & segment_masks[s];
+				if (slot_stamp!=stamp) coherent=false;
+			}else{
+				coherent=false; //use what we had.
+			}
+			lit|=last_lit[s];
+		}
+		return coherent;
+	}
+ // -------------------------------------------------------------------
+	static int64_t now_ns(){
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		return (int64_t)now.tv_sec*1000000000LL+now.tv_nsec;
+	}
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	bool setup(const uint32_t *masks,int count){
+		if (count<1 || count>shared_frame_max_segments) return false;
+		for (int s=0;s<count;s++){
+			if (all_mask & masks[s]) return false; //two owners for a pin.
+			segment_masks[s]=masks[s];
+			all_mask|=masks[s];
+		}
+		segment_count=count;
+
+		void *memory=mmap(NULL,sizeof(shared_frame_block),
+						  PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+		if (memory==MAP_FAILED) return false;
+		block=new (memory) shared_frame_block();
+		for (int s=0;s<shared_frame_max_segments;s++){
+			block->slots[s].stamp=-1; //nothing written yet.
+		}
+		return true;
+	};
+ // -------------------------------------------------------------------
+	void write(int segment,uint32_t lit,int64_t stamp){
+		shared_frame_slot &slot=block->slots[segment];
+		uint32_t sequence=slot.sequence.load(std::memory_order_relaxed);
+		if (sequence & 1){ //our predecessor died mid-write.
+			sequence++;
+			block->recoveries++;
+		}
+		slot.sequence.store(sequence+1,std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.lit.store(lit & segment_masks[segment],std::memory_order_relaxed);
+		slot.stamp.store(stamp,std::memory_order_relaxed);
+		slot.sequence.store(sequence+2,std::memory_order_release);
+		block->writes++;
+	};
+ // -------------------------------------------------------------------
+	uint32_t flush(gpio_register_class &gpio,int64_t stamp,int64_t wait_ns){
+		int64_t started=now_ns();
+		uint32_t lit;
+		bool coherent=read(lit,stamp);
+		while (!coherent && now_ns()<started+wait_ns){
+			usleep(shared_frame_poll_us);
+			coherent=read(lit,stamp);
+		}
+		gpio.write_leds(lit,all_mask);
+		int64_t waited=now_ns()-started;
+		wait_total_ns+=waited;
+		if (waited>wait_worst_ns) wait_worst_ns=waited;
+		block->flushes++;
+		if (!coherent) block->tears++;
+		return lit;
+	};
+ // -------------------------------------------------------------------
+	uint32_t mask(void){
+		return all_mask;
+	};
+ // -------------------------------------------------------------------
+	void dump(std::string name){
+		uint64_t flushes=block->flushes;
+		std::cout<<name<<": "<<block->writes<<" writes, "<<block->recoveries
+				 <<" recovered from a dead writer, "<<flushes<<" flushes, "
+				 <<block->tears<<" torn ("<<(flushes?100.0*block->tears/flushes:0)
+				 <<"%), "<<block->retries<<" read retries, "<<block->stuck
+				 <<" slots given up on."<<std::endl;
+		int64_t average_ns=flushes?wait_total_ns/(int64_t)flushes:0;
+		std::cout<<"\tflush wait average "<<average_ns/1000<<"us, worst "
+				 <<wait_worst_ns/1000<<"us."<<std::endl;
+	};
+ // -------------------------------------------------------------------
+	~shared_frame_class(){
+		if (block!=NULL) munmap(block,sizeof(shared_frame_block));
+	};
+ // -------------------------------------------------------------------
+}; //end of shared_frame_class
+
+#endif
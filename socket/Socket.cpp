@@ -45,10 +45,14 @@
 #include <sys/socket.h> //the socket library.
 #include <netdb.h> //addrinfo struct, plus a bunch of defines.
 #include <unistd.h> //NULL pointer definition, general POSIX compliance.
+#include <string_view> //lines, without copying them.
+#include "http_connection.h" //keeps the connection open between fetches.
+#include "happy_eyeballs.h" //connects to whichever address answers first.
+#include "dns_cache.h" //remembers what DNS said.
+#include <vector> //lists of paths to fetch.
 
 #define LEDs 20
 #define delaymils 100
-#define buffer_length 150
 
 #define debug_messages 1
 
@@ -113,18 +117,20 @@ using namespace std;
  * account for our call, it's a fatal error.)
  * 
  * gpio_write_string()		:Method
- * 							This public method takes a std::string
+ * 							This public method takes a string_view
  * 							called the_string, iterates through its data 
  * 							one character at a time and calls 
  * 							gpio_write() with each character, pausing 
  * 							after each one for delaymils milliseconds. 
  * 							It also prints out the string's data and
  * 							each letter as it's sent to gpio_write.
- * 							This method takes a std::string and returns 
+ * 							This method takes a string_view and returns 
  * 							nothing.
  * How it works:
  * ------------
- * Take a C++ string //object// called "the_string" as a parameter.
+ * Take a string_view called "the_string" as a parameter. It's a 
+ * window onto somebody else's characters (the HTTP connection's
+ * buffer, usually), so nothing gets copied to call us.
  * Declare an integer string_length and set it to the length attribute 
  * of the_string.
  * Print the string to the terminal.
@@ -170,7 +176,7 @@ class gpio_class {
  // -------------------------------------------------------------------
 	public:
  // ===================================================================
-	void gpio_write_string(string the_string){ //Write strings LEDs.
+	void gpio_write_string(string_view the_string){ //Write strings LEDs.
 		int string_length=the_string.length();//store this number in an
 										      //int so we don't call the
 											 //function as much.
@@ -206,7 +212,8 @@ class gpio_class {
  * The class socket_class contains the entire mechanism for connecting
  * to and exchanging data with an internet host. It makes a few
  * assumptions: first, that we'll always be creating TCP connections
- * (SOCK_STREAMS). Second, it assumes that DNS always works.
+ * (SOCK_STREAMS). Second, it assumes a name's addresses don't change
+ * much from one minute to the next, so it remembers them.
  * This class does understand IPv6 as well as IPv4 and impliments
  * as neat a class as possible to do both.
  * -------------------------------------------------------------------
@@ -216,94 +223,74 @@ class gpio_class {
  * 					  An integer, the file descriptor of whatever
  * 				   	  socket we use.
  * -------------------------------------------------------------------
- * exit_error		: Method.
- * 					  accept an error message, display it, and 
- * 					  terminate the program with error status.
- * 					  Accepts a std::string. Returns nothing.
- * How it works
- * ------------ 		
- * 	Accept a std::string into the variable msg. 
- *	Display the string with cout.
- * 	Call the exit function with a status of 1. 
+ * dns_cache		: Variable.
+ * 					  A dns_cache_class, which remembers what DNS said
+ * 					  about each address and port, and looks them up
+ * 					  again, on a thread of its own, when they're a
+ * 					  minute old.
+ * -------------------------------------------------------------------
+ * connector		: Variable.
+ * 					  A happy_eyeballs_class, which connects to
+ * 					  whichever of the server's addresses answers
+ * 					  first.
+ * -------------------------------------------------------------------
+ * keep_alive		: Variable.
+ * 					  An http_connection_class, for fetch(). It has
+ * 					  its own socket, which it keeps open between
+ * 					  fetches.
+ * -------------------------------------------------------------------
+ * keep_alive_address, keep_alive_port
+ * 					: Variables.
+ * 					  Who keep_alive is connected to.
  * -------------------------------------------------------------------
  * dns_lookup		: Method
  * 					  Accepts a string containing an internet address
  * 					  and an integer with a port number. Returns a 
- * 					  pointer to an addrinfo linked list containing
- * 					  address information, IP version information,
- * 					  port information, and so on. Everything 
- * 					  connect() needs to function.
+ * 					  dns_result, a pointer to an addrinfo linked list
+ * 					  containing address information, IP version
+ * 					  information, port information, and so on.
+ * 					  Everything connect() needs to function. NULL
+ * 					  if the address didn't resolve.
  * 					  Accepts a string and an integer. Returns
- * 					  an addrinfo *.
+ * 					  a dns_result.
  * How it works
  * ------------
  * 
- * 	Declare a pointer called server_info to an adderinfo data structure.
- * 
- *  Declare an adderinfo datastructure called hints.
- *  (Hints is used to filter the output of the DNS lookup.)
- * 
- *  Set the hints.ai_socktype member to SOCK_STREAM. We only want to see
- *  TCP addresses.
- * 
- *  Set all other fields in hints to 0, which will cause no filtering
- *  on those fields.
- * 
- *  call the to_string function with port as its parameter and set
- *  the string text_port to the result. We need the port as a string
- *  containing the letters "80" rather than the integer value 80.
- * 
- *  Send output to the user telling them what text_port is set to.
- * 
- *  Do the actual dns lookup with getaddrinfo. Pass that function the 
- *  c string version of text_address and text_port, and the address
- *  of the hints addrinfo struct. Also pass in the address of the pointer
- *  server_info_pointer, so the //value// of server_info_pointer can 
- *  be set to point at the linked list returned by getaddrinfo.
+ *  We used to call getaddrinfo() here every time we connected, and it
+ *  waits for the DNS server, and exit the program if DNS failed. Now
+ *  we ask dns_cache, which only calls getaddrinfo() the first time we
+ *  look up an address and port. After that it hands back what it 
+ *  remembers, and when that's a minute old, keeps handing it back
+ *  while it looks the address up again in the background. 
  *  
- * If the dns lookup is successful, 
- * 		declare an addrinfo pointer temp_addr,
- * 		and a char array host, with 256 chars of space. It would have been
- * 		nice to use a string here, but getnameinfo absolutely refused 
- * 		to deal with them. 
- * 
- *		Iterate through the linked list that getaddrinfo returned with a 
- * 		for loop on the ptr, a pointer to adderinfo structs. When ptr is
- * 		NULL, stop. Iterate ptr by setting it to the .ai_next field of
- *	    the addrinfo struct ptr currently points at.
- * 
- * 			Because dereferncing pointers complicates reading the code, 
- * 			we declare temp_addr as an adder_info struct, and set that 
- * 			to the struct that ptr is currently pointing at.
- * 
- *	 		Next, we call getnameinfo on tempaddr,ai_adr,temp_addr.
- * 			aiaddrlen,pass it the host char array so it can fill it in, 
- * 			tell it how big the host array is,decline to pass it flags, 
- * 			and tell it we want the numeric hostname. 
- * 
- *	 		Display the hostname with cout. Don't pass endl yet. 
- * 			There's more that goes in this output line.
- * 
- *	 		If tempaddr_aifamily is AF_INET6, 
- * 				then we must be dealing with an IPv6 address. Tell the 
- * 				user so. 
- *				Otherwise tell them it's an IPv4 address.
- * 
- *			Now write the endl.
- *
- *  	Go back to the top of the for loop unless we're done.
- * 
- * 		Having exited the for loop, return server_info_ptr, exiting the
- * 		method.
- * 
- * If we reach this point, the getaddrinfo call returned something 
- * besides 0. Remember we tested that clear up at the top? If it did that
- * we had a DNS error, and can't proceed.
- * call the exit_error() function and tell the user DNS failed. Terminate
- * the whole program.
- * 
- * We can't ever get here, but we have to tell C++ that we're returning 
- * data, or it will complain.
+ *  The dns_result is a shared_ptr, so we don't call freeaddrinfo() on
+ *  it: the list is freed when the cache and everybody using it are 
+ *  done with it.
+ * 
+ * If the lookup worked, and we're showing debug messages, 
+ * 		declare a char array host, with 256 chars of space. It would 
+ * 		have been nice to use a string here, but getnameinfo absolutely
+ * 		refused to deal with them. 
+ * 
+ *		Iterate through the linked list with a for loop on ptr, a 
+ * 		pointer to adderinfo structs. When ptr is NULL, stop. Iterate 
+ * 		ptr by setting it to the .ai_next field of the addrinfo struct
+ * 		ptr currently points at.
+ * 
+ *	 		Call getnameinfo on ptr->ai_addr and ptr->ai_addrlen, pass it
+ * 			the host char array so it can fill it in, tell it how big 
+ * 			the host array is, decline to pass it flags, and tell it we
+ * 			want the numeric hostname. 
+ * 
+ *	 		Display the hostname with cout, and whether it's an IPv6 or
+ * 			an IPv4 address.
+ * 
+ * 		Then tell the user the cache's hit rate, and how long lookups
+ * 		take on average.
+ * 
+ * If it didn't work, we had a DNS error, and can't connect. Tell the
+ * user why, and return NULL. connect_socket() will return false, and
+ * the program carries on: the name might resolve next time.
  * -------------------------------------------------------------------
  * 
  * Public
@@ -315,158 +302,96 @@ class gpio_class {
  * 						 returns to create a socket with the right
  * 						 configuration and connect it to the address.
  * 						 This method takes a std::string address and
- * 						 an integer port and returns nothing.
+ * 						 an integer port and returns true if it 
+ * 						 connected, false if it couldn't connect to any
+ * 						 of the addresses (and then file_descriptor is
+ * 						 -1, not a socket we've already closed).
  * How it Works
  * ------------
  * 	Take the string parameter address and the int parameter port.
  * 
- * 	Declare a 256 char array to hold text addresses, since 
- * 	getnameinfo refuses to work with std::strings.
- * 
- * 	Declare a pointer named dns_results and point it to the results
+ * 	Declare a dns_result named dns_results and point it to the results
  *  returned by dnslookup on the address and port we were given.
  * 
- * Declare an addrinfo struct called temp_addr, because dereferencing
- * pointers constantly is a nuisance.
+ * If that's NULL, the address didn't resolve. Set file_descriptor to
+ * -1 and return false.
  * 
- * As with dnslookup, iterate on the adderinfo pointer ptr from
- * dns_results to NULL.
+ * We used to try the addresses one at a time, in order, with a
+ * blocking connect(). If the first address was dead, connect() waited
+ * for the kernel to give up on it, which takes over two minutes,
+ * before we tried the next. Now happy_eyeballs_class tries them the way
+ * RFC 8305 says: it starts on the first, and every 250ms that nothing
+ * has connected (or straight away when an attempt fails), it starts on
+ * another as well, taking turns between IPv6 and IPv4 addresses. The
+ * first to connect wins, and the rest are closed.
  * 
- * 		Set temp_addr equal to the struct pointed at by ptr. Saves
- * 		a lot of dereferencing pointers.
- * 		
- * 		Call getnameinfo on temp_addr.ai_addr,temp_addr.ai_addrlen,
- * 		host, the size of host, no flags, and request a numeric host.
+ * Set file_descriptor to the socket it returns, -1 if nothing 
+ * connected within its timeout.
  * 
- * 		Now that host[] is set, use it to tell the user which address
- * 		we're trying.
+ * Tell the user which address won and how long it took, or that 
+ * nothing connected.
  * 
- * 		Create the socket by setting file_descriptor to the output of
- * 		the socket() function called with temp_addr.aifamily, SOCK_STREAM,
- * 		and 0. temp_addr.aifamily will be AF_INET for IPv4 and AF_INET6
- * 		for IPv6. So our socket() call will work for either one.
- * 
- * 		If file_descriptor is -1, the socket didn't create.
- * 			exit program on error.
- * 
- * 		Call connect() on the socket by passing connect the socket's
- * 		file_descriptor,the address as stored in temp_addr.ai_addr
- * 		(which includes the port) and the address length stored in 
- * 		temp_addr.aiadderlen.
- * 
- * 		If we're successful (connect returns 0),
- * 			tell the user and  
- * 			exit the for loop with break.
- * 
- * 		otherwise close the socket.
- * 	Go back to the top of the for loop and try the next address.
- * 
- * When we get here. either the for loop has exited and we've had no
- * successful connections, or we've exited the for loop with the break
- * on a successful connection. Either way, free the linked list that 
- * dns_lookup originally returned so as not to waste memory.
+ * If nothing connected, tell dns_cache to forget the addresses it
+ * gave us: the server might have moved, and the next connect_socket()
+ * should ask DNS again rather than use them.
  * -------------------------------------------------------------------
- * read_socket() 		:Method
- * 						 This method reads up to buffer_length
- * 						 characters from the socket, which were received
- * 						 from the remote host, and returns them in a
- * 						 std::string.
- * 						 It takes no parameters and returns a
- * 						 std::string.
- * How it works
- * ------------
- * Declare a char array of buffer_length called from_server, because 
- * recv doesn't like std::strings.
- * 
- * Declare an integer called bytes, and set it to the output of the
- * recv() function, which we pass the socket's id (file_descriptor),
- * the from_server char array, buffer_length -1 (because strings
- * always have a null terminator attached)  and no flags.
- * 
- * If bytes is less than zero
- * 		exit on error. Receive has failed.
- * 
- * If we reach this point, the recv call worked. tell the user
- * how many bytes we got from the server.
- * 
- * load from_server into a std::string and return that std::string.
- * This contains the buffer_length characters the remote host sent.
- * -------------------------------------------------------------------
- * write_socket()		:Method
- * 						This method takes a std::string and writes
- * 						its contents to the socket, sending them to
- * 						the remote host.
- * 						It takes a std::string parameter and returns 
- * 						nothing.
+ * fetch()				:Method
+ * 						This method GETs a list of paths from a web
+ * 						server, keeping the connection open afterwards,
+ * 						so the next fetch() from the same server 
+ * 						doesn't have to look it up and connect again.
+ * 						It takes a std::string address, an integer 
+ * 						port, a vector of paths, and a function to hand
+ * 						each body to, a piece at a time, with the index
+ * 						of its path. It returns how many paths it got.
  * How it Works
  * ------------
- * Accept a std::string into the variable text.
- * 
- * declare an integer, bytes, and set it to the output of a call to
- * the send() function, which we pass the socket's file_descriptor. We 
- * next pass the results of the std::string text's c_str() member 
- * function, the results of the std::string text's length() function,
- * and 0 flags.
- * 
- * If bytes is less than zero
- * 		exit on error - the write failed.
- * 
- * If we reach this point, tell the user how many bytes we sent. 
+ * If we're not already talking to address and port, set keep_alive up
+ * for them. We give it a function it can call whenever it needs a 
+ * connection: that function calls connect_socket(), and hands the
+ * socket over to keep_alive, which closes it when it's done with it.
+ * 
+ * Then keep_alive.fetch() does the work: it sends up to 
+ * http_pipeline_depth GETs at once without waiting for the answers 
+ * (pipelining), reads the answers in order, and connects again if the
+ * server hangs up on us.
  * -------------------------------------------------------------------
- * close_socket()		:Method
- * 						Closes the socket.
- * 						Takes no parameters, returns nothing.
+ * resolve_ahead()		:Method
+ * 						This method starts looking up an address and
+ * 						port in the background, so connect_socket()
+ * 						needn't wait for DNS when it gets there.
+ * 						It takes a std::string address and an integer
+ * 						port, and returns nothing.
  * How it Works
  * ------------
- * Call the close function with our socket's file descriptor, set in
- * the class private variable file_descriptor.
- * ------------------------------------------------------------------- 
+ * Call dns_cache.lookup() without waiting. If it already has the 
+ * address, that's that; if not, its thread looks it up.
+ * -------------------------------------------------------------------
  */ 
  
 class socket_class {
 	private:
  // ===================================================================
-	int file_descriptor=0; 		//The all-important name of our socket.
- // -------------------------------------------------------------------
-	void exit_error(string msg){ //display the message and terminate
-		cout <<msg<<endl;		//the program. Something's gone wrong.
-		exit(1);
-	}
+	int file_descriptor=-1; 		//The all-important name of our socket.
+	dns_cache_class dns_cache; //Looks up addresses.
+	happy_eyeballs_class connector; //Connects.
+	http_connection_class keep_alive; //For fetch().
+	string keep_alive_address="";
+	int keep_alive_port=0;
  // -------------------------------------------------------------------
-	
 	//look up the text address and return critical data: the ip address,
 	//what kind of address it is, etc, in an adderinfo struct.
 	
-	addrinfo *dns_lookup(string text_address,int port){
-		//declare variables
-		addrinfo *server_info_ptr;
+	dns_result dns_lookup(string text_address,int port){
+		dns_result server_info_ptr=dns_cache.lookup(text_address,port);
 		
-		//declare and set up hints
-		addrinfo hints;
-		hints.ai_socktype=SOCK_STREAM;
-		hints.ai_family=0;
-		hints.ai_protocol=0;
-		hints.ai_flags=0;
-		
-		//declare and load the text_port string.
-		string text_port=to_string(port);
-		
-		#ifdef debug_messages
-			cout<<"Using port# "<<text_port<<endl;
-		#endif
-		
-		if (getaddrinfo(text_address.c_str(),
-						text_port.c_str(),
-						&hints,
-						&server_info_ptr)==0){
+		if (server_info_ptr){
 			#ifdef debug_messages
-				addrinfo temp_addr;
 				char host[256]; //buffer for host names.
 				
-				for (addrinfo *ptr=server_info_ptr;ptr!=NULL;ptr=(*ptr).ai_next){
-					temp_addr=*ptr;
-					getnameinfo(temp_addr.ai_addr,
-								temp_addr.ai_addrlen,
+				for (addrinfo *ptr=server_info_ptr.get();ptr!=NULL;ptr=ptr->ai_next){
+					getnameinfo(ptr->ai_addr,
+								ptr->ai_addrlen,
 								host,
 								sizeof(host),
 								NULL,
@@ -474,130 +399,106 @@ class socket_class {
 								NI_NUMERICHOST);
 
 					cout<<"Found SOCK_STREAM address: "<<host;
-					if (temp_addr.ai_family==AF_INET6){
+					if (ptr->ai_family==AF_INET6){
 						cout <<" IPv6";
 					}else{ //equal to AF_INET
 						cout<<" IPv4";
 					}
 					cout<<"."<<endl;
 				}
+				cout<<"DNS cache: "<<dns_cache.hit_rate()*100<<"% hits, "
+					<<dns_cache.average_lookup_ns()/1000.0<<"us a lookup."<<endl;
 			#endif
-
-			return server_info_ptr;
 		}else{
-			exit_error("DNS Failed.");
-			return server_info_ptr;
-		}		
+			cout<<"DNS Failed: "<<dns_cache.error_text()<<endl;
+		}
+		return server_info_ptr;
 	}; //end of dns_lookup.
  // -------------------------------------------------------------------	
 	 
 	public:
  // ===================================================================
-	void connect_socket(string address,int port){ //creates and connects socket.
-		#ifdef debug_messages
-			char host[256]; //buffer for host address text.
-		#endif
+	bool connect_socket(string address,int port){ //creates and connects socket.
+		dns_result dns_results_ptr=dns_lookup(address,port);
+		if (!dns_results_ptr){
+			file_descriptor=-1;
+			return false;
+		}
 		
-		addrinfo *dns_results_ptr=dns_lookup(address,port);
-		addrinfo temp_addr; 
+		file_descriptor=connector.connect_to(dns_results_ptr.get());
 		
-		for (addrinfo *ptr=dns_results_ptr;ptr!=NULL;ptr=(*ptr).ai_next){
-			temp_addr=*ptr;
-						
-			//Text-ify the address and tell the user we're trying it.
-			#ifdef debug_messages
-				getnameinfo(temp_addr.ai_addr,
-							temp_addr.ai_addrlen,
-							host,
-							sizeof(host),
-							NULL,
-							0,
-							NI_NUMERICHOST);
-				cout<<"Trying: "<<host<<endl;
-			#endif
-			
-			//create socket.
-			file_descriptor=socket(temp_addr.ai_family,
-								   SOCK_STREAM,
-								   0);
-			if (file_descriptor==-1){ //socket returns -1 on fail.
-				exit_error("Unable to create socket.");
-			}
-			
-			//connect socket.			
-			 if (connect(file_descriptor,
-						temp_addr.ai_addr,
-						temp_addr.ai_addrlen)==0){ 
-				 
-				#ifdef debug_messages
-					cout<<"Connected!"<<endl;
-				#endif
-				
-				break;
-			}else{ //connect returns -1 on failures.
-				close(file_descriptor);
+		#ifdef debug_messages
+			if (file_descriptor>=0){
+				cout<<"Connected to "<<connector.winner_text()<<" in "
+					<<connector.connect_time_ns()/1000000.0<<"ms, "
+					<<connector.attempt_count()<<" attempts, "
+					<<connector.failure_count()<<" failed."<<endl;
+			}else{
+				cout<<"Unable to connect to "<<address<<" ("
+					<<connector.attempt_count()<<" attempts, "
+					<<connector.failure_count()<<" failed, "
+					<<connector.connect_time_ns()/1000000.0<<"ms)."<<endl;
 			}
+		#endif
+		
+		if (file_descriptor<0){
+			dns_cache.forget(address,port); //ask DNS again next time.
+			return false;
 		}
-		freeaddrinfo(dns_results_ptr); //clear memory used by dns results.
+		return true;
 	}; //end of connect_socket.
  // -------------------------------------------------------------------
-	string read_socket(){
-		char from_server[buffer_length]=""; //recv hates std::string.
-		//also, as with all arrays, from_server is implicitly a pointer.
-								// like here.
-		int bytes=0;			//	VVV 
-		bytes=recv(file_descriptor,from_server,buffer_length-1,0);
-		if (bytes<0){ //recv returns -1 on fails.
-			exit_error("Error on Receive.");
-		};
+	size_t fetch(string address,int port,const vector<string> &paths,
+				 const http_fetch_handler &body){
+		if (address!=keep_alive_address || port!=keep_alive_port){
+			keep_alive_address=address;
+			keep_alive_port=port;
+			keep_alive.setup(address,[this,address,port]{
+				connect_socket(address,port); //-1 if it couldn't.
+				int connected=file_descriptor; //keep_alive's now.
+				file_descriptor=-1;
+				return connected;
+			});
+		}
+		size_t fetched=keep_alive.fetch(paths,body);
 		
 		#ifdef debug_messages
-			cout<<"Received "<<bytes<<" bytes from server."<<endl;
+			cout<<"Fetched "<<fetched<<" of "<<paths.size()<<" paths; "
+				<<keep_alive.connection_count()<<" connections for "
+				<<keep_alive.response_count()<<" responses so far."<<endl;
 		#endif
 		
-		return string(from_server); //calls the constructor of an unnamed 
-									//std::string.
-	}; //end of read_socket
- // -------------------------------------------------------------------	
-	void write_socket(string text){
-		int bytes=send(file_descriptor,text.c_str(),text.length(),0);
-		if (bytes<0){ //send returns -1 on fails.
-			exit_error("Error on Send.");
-		};
-		
-		#ifdef debug_messages
-			cout<<"Sent "<<bytes<<" bytes to server."<<endl;
-		#endif
-	}; //end of write_socket
- // -------------------------------------------------------------------	
-	void close_socket(){ //just a wrapper for the close() function.
-		close(file_descriptor);
-	}; //end of close_socket.
+		return fetched;
+	}; //end of fetch.
+ // -------------------------------------------------------------------
+	void resolve_ahead(string address,int port){
+		dns_cache.lookup(address,port,false); //don't wait for it.
+	}; //end of resolve_ahead.
  // -------------------------------------------------------------------
 }; //end of socket_class.
 
 
 int main(void){
-	string message="";  //declare our message string
 	int number_of_lines=0; //how many lines to read.
+	int lines_shown=0; //how many we have.
+	int number_of_fetches=1; //how many times to fetch the page.
 	string target_address; //what address should we use?
-	string http_request=""; //what should we send the http server?
 	wiringPiSetupGpio(); //setup the GPIO system to use GPIO pin #s.
 	
 		//connect up the signal handler to fire on SIGINT.
 	signal(SIGINT,SIGINT_handler);
 
+	cout<<"Setting up socket object."<<endl;
+	socket_class socket; //instantiate our socket_class object.
+	
 	cout<<"What address should I connect to?"<<endl;
 	getline(cin,target_address);
+	socket.resolve_ahead(target_address,80); //while you answer the rest.
 	cout<<"How many lines should I read?"<<endl;
 	cin>>number_of_lines;
-	
-	//http requests have to be sent quickly, or the server times out.
-	//here, we're building a simple request to send us the website's 
-	//top level index file. You could put any path in here, however.
-	cout <<"Building HTTP request."<<endl;
-	http_request="GET http://"+target_address+"/index.html";
-	http_request+=" HTTP/1.1\r\nhost:"+target_address+"\r\n\r\n";
+	cout<<"How many times should I fetch the page?"<<endl;
+	cin>>number_of_fetches;
+	if (number_of_fetches<1) number_of_fetches=1; //nothing, or nonsense.
 	
 	cout<<"Setting up GPIO bus object."<<endl;
  	gpio_class gpio; //instantiate our gpio_class object. 
@@ -605,28 +506,33 @@ int main(void){
 	cout<<"Clearing GPIO pins."<<endl;
 	gpio.clear_pins(); //use the gpio_class method clear_pins().
 	
-	cout<<"Setting up socket object."<<endl;
-	socket_class socket; //instantiate our socket_class object.
-	
-	cout<<"Connecting socket to "<<target_address<<"on port 80."<<endl;
-	socket.connect_socket(target_address,80); //connect our 
-	//socket object to the target address the user specified, on port 80.
-	//port 80 is the standard for http (web) servers.
-	
-	cout <<"Sending HTTP request: "+http_request<<endl;
-	socket.write_socket(http_request);
-	socket.write_socket("\r\n"); //send our request and an extra linefeed
-	//to the http server at that address.
-	
-	for (int c=0;c<number_of_lines;c++){ //iterate on c for all the lines
-		if (!running) break; //if our sigint handler fired, break.
-		
-		message=socket.read_socket(); //read from the socket into message
-		cout<<"Received: "<<message<<"."<<endl; //show message
-		gpio.gpio_write_string(message); //gpio_write_string message
-		//so all the bytes of the lines wind up displayed on the LEDs.
-	};
-	socket.close_socket(); //close the socket. You only get so many,
+	//fetch the website's top level index file, number_of_fetches 
+	//times, from port 80, the standard for http (web) servers. You could
+	//put any paths in here, however. socket.fetch() connects the first
+	//time, and keeps the connection open for the next.
+	//The status line and headers are for us, not the LEDs, so 
+	//http_response_class strips them off, along with any chunk sizes,
+	//and hands this function the page, a piece at a time. We show the
+	//first number_of_lines lines of it, and ignore the rest.
+	vector<string> paths={"/index.html"};
+	for (int c=0;c<number_of_fetches && running;c++){
+		cout<<"Fetching "<<paths[0]<<" from "<<target_address<<" on port 80."<<endl;
+		lines_shown=0;
+		socket.fetch(target_address,80,paths,[&](size_t,string_view body){
+			while (!body.empty() && lines_shown<number_of_lines && running){
+				size_t newline=body.find('\n');
+				string_view message=body.substr(0,newline); //up to the newline,
+				//or the whole piece if the line goes on in the next one.
+				cout<<"Received: "<<message<<"."<<endl; //show message
+				gpio.gpio_write_string(message); //so all the bytes of the 
+				//lines wind up displayed on the LEDs.
+				if (newline==string_view::npos) break;
+				lines_shown++;
+				body.remove_prefix(newline+1);
+			}
+		});
+	}
+	//socket's keep_alive closes the connection when it's destroyed. You only get so many,
 	//so clean up after yourself.
 
 	gpio.clear_pins(); //turn all the LEDs off.
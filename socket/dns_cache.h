@@ -0,0 +1,392 @@
+ /*
+  * dns_cache.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * dns_cache.h
+ * socket_class used to call getaddrinfo() every time it connected.
+ * getaddrinfo() blocks until the name's resolved: microseconds if the
+ * name's in /etc/hosts, a round trip to the DNS server if not, and
+ * seconds if the DNS server's slow or gone. And if it failed,
+ * socket_class exited the program.
+ *
+ * dns_cache_class remembers what getaddrinfo() said for each host and
+ * port, for ttl_ms (a minute, if you don't say). getaddrinfo() doesn't
+ * tell us the TTL the DNS server gave, so it's a setting, not the
+ * record's. After that, the answer is stale, but for stale_ms more we
+ * keep handing it out while a thread of ours asks getaddrinfo() again,
+ * so only the very first lookup of a name has to wait. Names rarely
+ * move, and if this one has, we'll have the new address moments
+ * later. A name that won't resolve is remembered too, for
+ * negative_ttl_ms, so we don't ask again on every connect.
+ *
+ * lookup() can also be told not to wait at all: if we have nothing,
+ * it asks the thread to look the name up and returns NULL, and you
+ * can ask again later. That's the form for anything that mustn't
+ * stall, like a loop that's driving the display.
+ *
+ * How it works:
+ * The answers live in a map keyed on "host:port". Each one is a
+ * dns_result, a shared_ptr to the addrinfo list getaddrinfo() returned,
+ * which calls freeaddrinfo() when the last copy goes away, so a
+ * refresh can replace an answer somebody's still connecting with.
+ * The map is behind a mutex, which is never held while getaddrinfo()
+ * runs. Refreshes go in a queue for the resolver thread, which we
+ * start the first time one's needed (glibc's getaddrinfo_a() would do
+ * much the same with a thread of its own, and signals). A name is
+ * only queued once, however often it's looked up while stale.
+ * If a refresh fails, we keep the stale answer until stale_ms is up,
+ * and try again every negative_ttl_ms; it's still counted as stale.
+ * A lookup that has to wait for a name the thread is already looking
+ * up (resolve_ahead() and then connect_socket() straight away, say)
+ * waits for the thread's answer rather than asking getaddrinfo() a
+ * second time.
+ *
+ * We count lookups, and how many were answered fresh, stale, or not at
+ * all, and time every lookup and every getaddrinfo() call, so you can
+ * see the hit rate and what the cache saves.
+*/
+
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <string>
+#include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#define dns_cache_ttl_ms 60000 //how long an answer is fresh.
+#define dns_cache_stale_ms 600000 //how long after that we'll still use it.
+#define dns_cache_negative_ttl_ms 5000 //how long a failure is remembered.
+
+typedef std::shared_ptr<addrinfo> dns_result; //NULL if the name didn't resolve.
+
+/* dns_cache_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * entry			:Struct. One host and port's answer.
+ * 					addresses	what getaddrinfo() said, or NULL.
+ * 					fresh_until	when it goes stale (or, for a
+ * 								failure, when we ask again).
+ * 					stale_until	when we stop using it.
+ * 					error		getaddrinfo()'s last error, or 0.
+ * 					queued		a refresh is on its way.
+ * 					is_stale	the addresses are left over from
+ * 								before a refresh failed, so they're
+ * 								stale even before fresh_until.
+ * -------------------------------------------------------------------
+ * ttl_ns, stale_ns, negative_ttl_ns
+ * 					:Variables. The settings.
+ * lock				:Variable. Guards everything below it.
+ * entries			:Variable. The map of answers.
+ * queue			:Variable. Host, port pairs the thread should look up.
+ * wake				:Variable. Tells the thread there's work.
+ * answered			:Variable. Tells waiting lookups the thread has
+ * 					stored an answer.
+ * thread, thread_running
+ * 					:Variables. The resolver thread, and whether we've
+ * 					started it (it stops when that goes false).
+ * last_error		:Variable. The last failure, as text.
+ * lookups, fresh_hits, stale_hits, misses, failures, refreshes,
+ * resolves, lookup_ns, lookup_max_ns, resolve_ns, resolve_max_ns
+ * 					:Variables. The counters.
+ * -------------------------------------------------------------------
+ * now_ns()			:Static Method. CLOCK_MONOTONIC, in ns.
+ * -------------------------------------------------------------------
+ * resolve()		:Method
+ * 					Takes a host and port, and calls getaddrinfo(),
+ * 					timing it. Takes the lock only to count. Returns
+ * 					the list, or NULL with error set.
+ * -------------------------------------------------------------------
+ * store()			:Method
+ * 					Takes a key and what resolve() got, and puts it in
+ * 					the map, keeping a stale answer if the new one's a
+ * 					failure. Call it with the lock held. Returns what
+ * 					lookup() should hand back.
+ * -------------------------------------------------------------------
+ * queue_refresh()	:Method
+ * 					Queues a lookup for the thread, starting the
+ * 					thread if need be. Call it with the lock held.
+ * -------------------------------------------------------------------
+ * resolver()		:Static Method
+ * 					The thread. Takes lookups off the queue, does them,
+ * 					and stores the answers, telling anybody waiting,
+ * 					until told to stop.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Takes ttl_ms, stale_ms and negative_ttl_ms (60s,
+ * 					10 minutes and 5s, if left out). Applies to answers
+ * 					stored from now on.
+ * -------------------------------------------------------------------
+ * lookup()			:Method
+ * 					Takes a host and a port, and returns the addresses,
+ * 					fresh or stale, or NULL if the name doesn't resolve.
+ * 					If we have nothing, it calls getaddrinfo() and waits,
+ * 					or, if the thread's already looking the name up,
+ * 					waits for its answer; unless wait is false, when it
+ * 					queues the lookup and returns NULL straight away.
+ * -------------------------------------------------------------------
+ * forget()			:Method
+ * 					Takes a host and a port, and drops the answer, so
+ * 					the next lookup() asks getaddrinfo() again. For when
+ * 					none of the addresses would connect.
+ * -------------------------------------------------------------------
+ * error_text()		:Method. Why the last failed lookup failed.
+ * -------------------------------------------------------------------
+ * lookup_count(), fresh_count(), stale_count(), miss_count(),
+ * failure_count(), refresh_count(), resolve_count(), hit_rate(),
+ * average_lookup_ns(), max_lookup_ns(), average_resolve_ns(),
+ * max_resolve_ns()
+ * 					:Methods. The counters. Lookups, and of those, how
+ * 					many were answered fresh, answered stale, missed the
+ * 					cache, and came back NULL. Then refreshes the thread
+ * 					did, and getaddrinfo() calls in all. The hit rate
+ * 					is fresh and stale answers over lookups. The times
+ * 					are what lookup() took the caller, and what
+ * 					getaddrinfo() took.
+ * -------------------------------------------------------------------
+ * The destructor stops the thread, after the lookup it's on, if any.
+ * -------------------------------------------------------------------
+ */
+class dns_cache_class {
+	private:
+ // ===================================================================
+	struct entry {
+		dns_result addresses;
+		int64_t fresh_until=0;
+		int64_t stale_until=0;
+		int error=0;
+		bool queued=false;
+		bool is_stale=false;
+	};
+ // -------------------------------------------------------------------
+	int64_t ttl_ns=dns_cache_ttl_ms*1000000LL;
+	int64_t stale_ns=dns_cache_stale_ms*1000000LL;
+	int64_t negative_ttl_ns=dns_cache_negative_ttl_ms*1000000LL;
+	std::mutex lock;
+	std::map<std::string,entry> entries;
+	std::deque<std::pair<std::string,int>> queue;
+	std::condition_variable wake;
+	std::condition_variable answered;
+	pthread_t thread;
+	bool thread_running=false;
+	std::string last_error;
+	uint64_t lookups=0;
+	uint64_t fresh_hits=0;
+	uint64_t stale_hits=0;
+	uint64_t misses=0;
+	uint64_t failures=0;
+	uint64_t refreshes=0;
+	uint64_t resolves=0;
+	int64_t lookup_ns=0;
+	int64_t lookup_max_ns=0;
+	int64_t resolve_ns=0;
+	int64_t resolve_max_ns=0;
+ // -------------------------------------------------------------------
+	static int64_t now_ns(void){
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		return (int64_t)now.tv_sec*1000000000LL+now.tv_nsec;
+	};
+ // -------------------------------------------------------------------
+	dns_result resolve(const std::string &host,int port,int &error){
+		addrinfo hints;
+		memset(&hints,0,sizeof(hints));
+		hints.ai_socktype=SOCK_STREAM;
+		addrinfo *list=NULL;
+		int64_t start=now_ns();
+		error=getaddrinfo(host.c_str(),std::to_string(port).c_str(),&hints,&list);
+		int64_t took=now_ns()-start;
+		std::lock_guard<std::mutex> guard(lock);
+		resolves++;
+		resolve_ns+=took;
+		if (took>resolve_max_ns) resolve_max_ns=took;
+		if (error!=0) return dns_result();
+		return dns_result(list,freeaddrinfo);
+	};
+ // -------------------------------------------------------------------
+	dns_result store(const std::string &key,dns_result addresses,int error){
+		int64_t now=now_ns();
+		entry &answer=entries[key];
+		answer.queued=false;
+		answer.error=error;
+		if (addresses){
+			answer.addresses=addresses;
+			answer.is_stale=false;
+			answer.fresh_until=now+ttl_ns;
+			answer.stale_until=answer.fresh_until+stale_ns;
+			return addresses;
+		}
+		last_error=key+": "+gai_strerror(error);
+		if (!answer.addresses || now>=answer.stale_until){ //nothing to fall back on.
+			answer.addresses.reset();
+			answer.stale_until=0;
+		}
+		answer.is_stale=(bool)answer.addresses;
+		answer.fresh_until=now+negative_ttl_ns; //when we ask again.
+		if (answer.addresses && answer.fresh_until>answer.stale_until){
+			answer.fresh_until=answer.stale_until;
+		}
+		return answer.addresses;
+	};
+ // -------------------------------------------------------------------
+	void queue_refresh(const std::string &host,int port,entry &answer){
+		if (answer.queued) return;
+		if (!thread_running){
+			thread_running=true;
+			if (pthread_create(&thread,NULL,resolver,this)!=0){
+				thread_running=false;
+				return; //the next lookup() will wait instead.
+			}
+		}
+		answer.queued=true;
+		queue.push_back(std::make_pair(host,port));
+		wake.notify_one();
+	};
+ // -------------------------------------------------------------------
+	static void *resolver(void *self_pointer){
+		dns_cache_class &self=*(dns_cache_class *)self_pointer;
+		std::unique_lock<std::mutex> guard(self.lock);
+		while (true){
+			self.wake.wait(guard,[&self]{ return !self.queue.empty() || !self.thread_running; });
+			if (!self.thread_running) break;
+			std::pair<std::string,int> name=self.queue.front();
+			self.queue.pop_front();
+			guard.unlock();
+			int error;
+			dns_result addresses=self.resolve(name.first,name.second,error);
+			guard.lock();
+			self.refreshes++;
+			self.store(name.first+":"+std::to_string(name.second),addresses,error);
+			self.answered.notify_all();
+		}
+		return NULL;
+	};
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	void setup(int ttl_ms=dns_cache_ttl_ms,int stale_ms=dns_cache_stale_ms,
+			   int negative_ttl_ms=dns_cache_negative_ttl_ms){
+		std::lock_guard<std::mutex> guard(lock);
+		ttl_ns=(int64_t)ttl_ms*1000000LL;
+		stale_ns=(int64_t)stale_ms*1000000LL;
+		negative_ttl_ns=(int64_t)negative_ttl_ms*1000000LL;
+	};
+ // -------------------------------------------------------------------
+	dns_result lookup(const std::string &host,int port,bool wait=true){
+		int64_t start=now_ns();
+		std::string key=host+":"+std::to_string(port);
+		dns_result found;
+		std::unique_lock<std::mutex> guard(lock);
+		lookups++;
+		auto answer=entries.find(key);
+		if (answer!=entries.end() && start<answer->second.fresh_until){
+			found=answer->second.addresses; //NULL if it failed recently.
+			if (found && answer->second.is_stale) stale_hits++;
+			else if (found) fresh_hits++;
+		} else if (answer!=entries.end() && answer->second.addresses &&
+				   start<answer->second.stale_until){
+			found=answer->second.addresses;
+			stale_hits++;
+			queue_refresh(host,port,answer->second);
+		} else {
+			misses++;
+			if (!wait){
+				queue_refresh(host,port,entries[key]);
+			} else if (answer!=entries.end() && answer->second.queued){
+				//the thread's on it. Wait for that, not a lookup of our own.
+				answered.wait(guard,[&]{
+					answer=entries.find(key); //forget() may have erased it; store() puts it back.
+					return answer!=entries.end() && !answer->second.queued;
+				});
+				found=answer->second.addresses;
+			} else {
+				guard.unlock();
+				int error;
+				dns_result addresses=resolve(host,port,error);
+				guard.lock();
+				found=store(key,addresses,error);
+			}
+		}
+		if (!found) failures++;
+		int64_t took=now_ns()-start;
+		lookup_ns+=took;
+		if (took>lookup_max_ns) lookup_max_ns=took;
+		return found;
+	};
+ // -------------------------------------------------------------------
+	void forget(const std::string &host,int port){
+		std::lock_guard<std::mutex> guard(lock);
+		auto answer=entries.find(host+":"+std::to_string(port));
+		if (answer!=entries.end()) entries.erase(answer);
+	};
+ // -------------------------------------------------------------------
+	std::string error_text(void){
+		std::lock_guard<std::mutex> guard(lock);
+		return last_error;
+	};
+ // -------------------------------------------------------------------
+	uint64_t lookup_count(void){ std::lock_guard<std::mutex> guard(lock); return lookups; };
+	uint64_t fresh_count(void){ std::lock_guard<std::mutex> guard(lock); return fresh_hits; };
+	uint64_t stale_count(void){ std::lock_guard<std::mutex> guard(lock); return stale_hits; };
+	uint64_t miss_count(void){ std::lock_guard<std::mutex> guard(lock); return misses; };
+	uint64_t failure_count(void){ std::lock_guard<std::mutex> guard(lock); return failures; };
+	uint64_t refresh_count(void){ std::lock_guard<std::mutex> guard(lock); return refreshes; };
+	uint64_t resolve_count(void){ std::lock_guard<std::mutex> guard(lock); return resolves; };
+	double hit_rate(void){
+		std::lock_guard<std::mutex> guard(lock);
+		return lookups==0?0:(double)(fresh_hits+stale_hits)/lookups;
+	};
+	int64_t average_lookup_ns(void){
+		std::lock_guard<std::mutex> guard(lock);
+		return lookups==0?0:lookup_ns/(int64_t)lookups;
+	};
+	int64_t max_lookup_ns(void){ std::lock_guard<std::mutex> guard(lock); return lookup_max_ns; };
+	int64_t average_resolve_ns(void){
+		std::lock_guard<std::mutex> guard(lock);
+		return resolves==0?0:resolve_ns/(int64_t)resolves;
+	};
+	int64_t max_resolve_ns(void){ std::lock_guard<std::mutex> guard(lock); return resolve_max_ns; };
+ // -------------------------------------------------------------------
+	~dns_cache_class(){
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (!thread_running) return;
+			thread_running=false;
+		}
+		wake.notify_one();
+		pthread_join(thread,NULL);
+	};
+}; //end of dns_cache_class
+
+#endif
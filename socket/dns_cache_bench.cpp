@@ -0,0 +1,219 @@
+ /*
+  * dns_cache_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * dns_cache_bench
+ * What does dns_cache_class save over calling getaddrinfo() every
+ * time, and does it behave? Names in /etc/hosts resolve without the
+ * network, so they make good test names: localhost is always there,
+ * and you can add your own (127.0.0.2 dns-cache-test, say) and pass
+ * them on the command line.
+ *
+ * For each name:
+ * 		getaddrinfo()	called lookups times, as socket_class used to.
+ * 		cached			dns_cache_class's lookup() called as often.
+ * 						Only the first should call getaddrinfo().
+ * 		stale, refreshing
+ * 						lookup() without waiting, every 100us for a
+ * 						second, with a 20ms TTL, so the answer goes
+ * 						stale fifty times and the thread refreshes it.
+ * 						None of these lookups waits for getaddrinfo(),
+ * 						so the slowest is whatever the scheduler adds.
+ * Then a name that can't resolve (anything under .invalid), looked up
+ * twice: both should come back NULL, without exiting, and the second
+ * from the cache.
+ * For each we print average and slowest lookup times, the hit rate,
+ * and how many times getaddrinfo() was called.
+ *
+ * Watch mode looks a name up without waiting every 10ms, and prints
+ * its addresses whenever they change. Run it, edit the name's line
+ * in /etc/hosts, and the new address turns up within the TTL. Take
+ * the line out, and the old address stays, stale, for stale_ms: a
+ * failed refresh doesn't throw away an answer that probably works.
+ *
+ * Usage: dns_cache_bench [lookups] [name ...]
+ * 		  dns_cache_bench watch name [ttl ms] [seconds]
+ * 10000 lookups of localhost if left out; watch uses a 1s TTL for 30s.
+ * Compile with:
+ * 		g++ -O2 -o dns_cache_bench dns_cache_bench.cpp -lpthread
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include "dns_cache.h"
+#include "../frame_clock/frame_clock.h"
+
+#define failing_name "no-such-host.invalid"
+
+using namespace std;
+
+/* string address_list(addrinfo *list)
+ * The numeric addresses in list, one space between.
+ */
+string address_list(addrinfo *list){
+	string text;
+	char host[NI_MAXHOST];
+	for (addrinfo *ptr=list;ptr!=NULL;ptr=ptr->ai_next){
+		getnameinfo(ptr->ai_addr,ptr->ai_addrlen,host,sizeof(host),NULL,0,NI_NUMERICHOST);
+		if (!text.empty()) text+=" ";
+		text+=host;
+	}
+	return text.empty()?"(nothing)":text;
+}
+
+/* void report(name, average_ns, max_ns, hit_rate, resolves)
+ * One line of results.
+ */
+void report(const string &name,int64_t average_ns,int64_t max_ns,double hit_rate,
+			uint64_t resolves){
+	cout<<"  "<<left<<setw(20)<<name<<std::right<<fixed<<setprecision(2)<<setw(10)
+		<<average_ns/1e3<<"us average, "<<setw(10)<<max_ns/1e3<<"us slowest, "
+		<<setprecision(1)<<setw(5)<<hit_rate*100<<"% hits, "<<resolves<<" getaddrinfo()s"<<endl;
+}
+
+/* void uncached(name, lookups)
+ * getaddrinfo() every time.
+ */
+void uncached(const string &name,int lookups){
+	addrinfo hints;
+	memset(&hints,0,sizeof(hints));
+	hints.ai_socktype=SOCK_STREAM;
+	int64_t total=0,slowest=0;
+	for (int c=0;c<lookups;c++){
+		addrinfo *list;
+		int64_t start=timespec_ns(clock_now());
+		int error=getaddrinfo(name.c_str(),"80",&hints,&list);
+		int64_t took=timespec_ns(clock_now())-start;
+		if (error==0) freeaddrinfo(list);
+		total+=took;
+		if (took>slowest) slowest=took;
+	}
+	report("getaddrinfo()",total/lookups,slowest,0,lookups);
+}
+
+/* void cached(name, lookups)
+ * lookup() every time.
+ */
+void cached(const string &name,int lookups){
+	dns_cache_class cache;
+	for (int c=0;c<lookups;c++) cache.lookup(name,80);
+	report("cached",cache.average_lookup_ns(),cache.max_lookup_ns(),cache.hit_rate(),
+		   cache.resolve_count());
+}
+
+/* void refreshing(name)
+ * lookup() without waiting, with a short TTL, for a second.
+ */
+void refreshing(const string &name){
+	dns_cache_class cache;
+	cache.setup(20,dns_cache_stale_ms,dns_cache_negative_ttl_ms);
+	cache.lookup(name,80); //the one lookup that waits.
+	int64_t end=timespec_ns(clock_now())+1000000000LL;
+	uint64_t empty=0,count=0;
+	int64_t total=0,slowest=0; //of these lookups, not the first.
+	while (timespec_ns(clock_now())<end){
+		int64_t start=timespec_ns(clock_now());
+		if (!cache.lookup(name,80,false)) empty++;
+		int64_t took=timespec_ns(clock_now())-start;
+		total+=took;
+		if (took>slowest) slowest=took;
+		count++;
+		usleep(100);
+	}
+	report("stale, refreshing",total/(int64_t)count,slowest,cache.hit_rate(),
+		   cache.resolve_count());
+	cout<<"  "<<setw(20)<<""<<cache.fresh_count()<<" fresh, "<<cache.stale_count()
+		<<" stale, "<<cache.refresh_count()<<" refreshes, "<<empty<<" came back empty"<<endl;
+}
+
+/* void failing()
+ * A name that won't resolve, twice.
+ */
+void failing(){
+	dns_cache_class cache;
+	dns_result first=cache.lookup(failing_name,80);
+	dns_result second=cache.lookup(failing_name,80);
+	cout<<failing_name<<":\n  "<<(first || second?"RESOLVED?":"NULL both times")<<", "
+		<<cache.resolve_count()<<" getaddrinfo(), "<<cache.failure_count()<<" failures ("
+		<<cache.error_text()<<")"<<endl;
+}
+
+/* int watch(name, ttl_ms, seconds)
+ * Prints the name's addresses whenever they change.
+ */
+int watch(const string &name,int ttl_ms,int seconds){
+	dns_cache_class cache;
+	cache.setup(ttl_ms,dns_cache_stale_ms,ttl_ms);
+	string shown;
+	int64_t start=timespec_ns(clock_now());
+	int64_t end=start+seconds*1000000000LL;
+	cout<<"Watching "<<name<<" for "<<seconds<<"s, TTL "<<ttl_ms<<"ms."<<endl;
+	while (timespec_ns(clock_now())<end){
+		dns_result addresses=cache.lookup(name,80,false);
+		string now=addresses?address_list(addresses.get()):"(not resolved)";
+		if (now!=shown){
+			cout<<fixed<<setprecision(3)<<setw(8)<<(timespec_ns(clock_now())-start)/1e9
+				<<"s  "<<now<<endl;
+			shown=now;
+		}
+		usleep(10000);
+	}
+	report("lookups",cache.average_lookup_ns(),cache.max_lookup_ns(),cache.hit_rate(),
+		   cache.resolve_count());
+	return 0;
+}
+
+/*
+ * Main()
+ * Parameters: how many lookups, and the names to look up, or watch
+ * and a name.
+ * Returns 0.
+ */
+int main(int argc,char *argv[]){
+	if (argc>2 && string(argv[1])=="watch"){
+		int ttl_ms=argc>3?atoi(argv[3]):1000;
+		int seconds=argc>4?atoi(argv[4]):30;
+		return watch(argv[2],ttl_ms>0?ttl_ms:1000,seconds>0?seconds:30);
+	}
+	int lookups=argc>1?atoi(argv[1]):10000;
+	if (lookups<1) lookups=10000;
+	vector<string> names;
+	for (int c=2;c<argc;c++) names.push_back(argv[c]);
+	if (names.empty()) names.push_back("localhost");
+
+	for (const string &name:names){
+		dns_cache_class probe;
+		dns_result addresses=probe.lookup(name,80);
+		cout<<name<<" ("<<(addresses?address_list(addresses.get()):probe.error_text())
+			<<"), "<<lookups<<" lookups:"<<endl;
+		uncached(name,lookups);
+		cached(name,lookups);
+		refreshing(name);
+	}
+	failing();
+	return 0;
+}
@@ -0,0 +1,246 @@
+ /*
+  * happy_eyeballs.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * happy_eyeballs.h
+ * A web server's name usually comes back from DNS as several
+ * addresses, IPv6 first. socket_class used to try them in order with
+ * a blocking connect(), so if the first one was dead (an IPv6 address
+ * with no IPv6 route behind it is the classic), connect() sat there
+ * until the kernel gave up, which with its default six SYN retries is
+ * over two minutes, before it tried the next.
+ *
+ * happy_eyeballs_class connects the way RFC 8305 ("Happy Eyeballs")
+ * says to: it starts on the first address, and if that hasn't
+ * connected within a short stagger (250ms), starts on the next as
+ * well, without giving up on the first, and so on, every stagger, or
+ * at once when an attempt fails outright. Whichever connects first
+ * wins, and the rest are closed. A dead address costs us one stagger,
+ * not two minutes.
+ *
+ * How it works:
+ * The addresses are put in order first: the family (IPv6 or IPv4) of
+ * the first one, then the other, then the first, and so on, so a
+ * broken family can only hold us up one stagger at a time. Each
+ * attempt is a non-blocking socket whose connect() is in progress;
+ * poll() tells us when one finishes (it becomes writable), and
+ * SO_ERROR tells us whether it connected. poll() waits until the
+ * next attempt is due (if there's an address left and room for it),
+ * or the whole thing has taken timeout_ms, when we give up, and
+ * never less than no time at all. The winner goes back to blocking, as socket_class
+ * expects, and comes back with how long it took, and which address
+ * it was.
+*/
+
+#ifndef HAPPY_EYEBALLS_H
+#define HAPPY_EYEBALLS_H
+
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#define happy_eyeballs_stagger_ms 250 //RFC 8305's recommendation.
+#define happy_eyeballs_timeout_ms 10000
+#define happy_eyeballs_max_attempts 32
+
+/* happy_eyeballs_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * stagger_ns, timeout_ns
+ * 					:Variables. Time between starting attempts, and the
+ * 					most to spend on all of them.
+ * connect_ns		:Variable. How long the last connect() took.
+ * attempts, failures
+ * 					:Variables. Attempts the last connect() started,
+ * 					and how many of those failed outright.
+ * winner			:Variable. The address that won, as text.
+ * -------------------------------------------------------------------
+ * now_ns()			:Static Method. CLOCK_MONOTONIC, in ns.
+ * -------------------------------------------------------------------
+ * interleave()		:Static Method
+ * 					Takes the addrinfo list, and returns it as a vector
+ * 					with the families taking turns.
+ * -------------------------------------------------------------------
+ * start()			:Method
+ * 					Takes an address, and starts a non-blocking connect()
+ * 					to it. Returns the socket, or -1 if it failed
+ * 					already. Sets connected if it connected already
+ * 					(loopback sometimes does).
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Takes the stagger and the timeout in ms, 250 and
+ * 					10000 if left out. RFC 8305 says the stagger should
+ * 					be no less than 10ms.
+ * -------------------------------------------------------------------
+ * connect_to()		:Method
+ * 					Takes an addrinfo list from getaddrinfo(), and
+ * 					returns a connected, blocking socket, or -1 if no
+ * 					address connected within the timeout.
+ * -------------------------------------------------------------------
+ * connect_time_ns(), attempt_count(), failure_count(), winner_text()
+ * 					:Methods. How the last connect_to() went.
+ * -------------------------------------------------------------------
+ */
+class happy_eyeballs_class {
+	private:
+ // ===================================================================
+	int64_t stagger_ns=happy_eyeballs_stagger_ms*1000000LL;
+	int64_t timeout_ns=happy_eyeballs_timeout_ms*1000000LL;
+	int64_t connect_ns=0;
+	int attempts=0;
+	int failures=0;
+	char winner[NI_MAXHOST]="";
+ // -------------------------------------------------------------------
+	static int64_t now_ns(void){
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		return (int64_t)now.tv_sec*1000000000LL+now.tv_nsec;
+	};
+ // -------------------------------------------------------------------
+	static std::vector<addrinfo *> interleave(addrinfo *list){
+		std::vector<addrinfo *> first,second,order;
+		if (list==NULL) return order;
+		for (addrinfo *ptr=list;ptr!=NULL;ptr=ptr->ai_next){
+			if (ptr->ai_family==list->ai_family) first.push_back(ptr);
+			else second.push_back(ptr);
+		}
+		for (size_t c=0;c<first.size() || c<second.size();c++){
+			if (c<first.size()) order.push_back(first[c]);
+			if (c<second.size()) order.push_back(second[c]);
+		}
+		return order;
+	};
+ // -------------------------------------------------------------------
+	int start(addrinfo *address,bool &connected){
+		connected=false;
+		attempts++;
+		int fd=socket(address->ai_family,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+					  address->ai_protocol);
+		if (fd<0){
+			failures++;
+			return -1;
+		}
+		if (connect(fd,address->ai_addr,address->ai_addrlen)==0){
+			connected=true;
+			return fd;
+		}
+		if (errno==EINPROGRESS) return fd;
+		close(fd);
+		failures++;
+		return -1;
+	};
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	void setup(int stagger_ms=happy_eyeballs_stagger_ms,int timeout_ms=happy_eyeballs_timeout_ms){
+		stagger_ns=(int64_t)stagger_ms*1000000LL;
+		timeout_ns=(int64_t)timeout_ms*1000000LL;
+	};
+ // -------------------------------------------------------------------
+	int connect_to(addrinfo *list){
+		std::vector<addrinfo *> order=interleave(list);
+		std::vector<pollfd> waiting; //attempts in progress.
+		std::vector<addrinfo *> waiting_address;
+		int64_t started=now_ns();
+		int64_t deadline=started+timeout_ns;
+		int64_t next_start=started;
+		size_t next=0;
+		int won=-1;
+		addrinfo *won_address=NULL;
+		attempts=failures=0;
+		winner[0]='\0';
+		while (won<0){
+			int64_t now=now_ns();
+			if (now>=deadline) break;
+			if (next<order.size() && (waiting.empty() || now>=next_start) &&
+				waiting.size()<happy_eyeballs_max_attempts){
+				bool connected;
+				int fd=start(order[next],connected);
+				if (connected){
+					won=fd;
+					won_address=order[next];
+					break;
+				}
+				if (fd>=0){
+					waiting.push_back(pollfd{fd,POLLOUT,0});
+					waiting_address.push_back(order[next]);
+					next_start=now+stagger_ns;
+				}
+				next++;
+				continue; //a failure starts the next one right away.
+			}
+			if (waiting.empty()) break; //every address failed.
+			int64_t until=deadline;
+			bool can_start=next<order.size() && waiting.size()<happy_eyeballs_max_attempts;
+			if (can_start && next_start<until) until=next_start;
+			if (until<now) until=now; //a late start means don't wait, not forever.
+			int timeout_ms=(int)((until-now+999999)/1000000);
+			if (poll(waiting.data(),waiting.size(),timeout_ms)<0 && errno!=EINTR) break;
+			for (size_t c=0;c<waiting.size();){
+				if (waiting[c].revents==0){
+					c++;
+					continue;
+				}
+				int error=0;
+				socklen_t length=sizeof(error);
+				getsockopt(waiting[c].fd,SOL_SOCKET,SO_ERROR,&error,&length);
+				if (error==0){
+					won=waiting[c].fd;
+					won_address=waiting_address[c];
+					waiting.erase(waiting.begin()+c);
+					waiting_address.erase(waiting_address.begin()+c);
+					break;
+				}
+				close(waiting[c].fd);
+				failures++;
+				waiting.erase(waiting.begin()+c);
+				waiting_address.erase(waiting_address.begin()+c);
+				next_start=now_ns(); //start the next one now.
+			}
+		}
+		for (size_t c=0;c<waiting.size();c++) close(waiting[c].fd); //the losers.
+		connect_ns=now_ns()-started;
+		if (won<0) return -1;
+		fcntl(won,F_SETFL,fcntl(won,F_GETFL) & ~O_NONBLOCK);
+		getnameinfo(won_address->ai_addr,won_address->ai_addrlen,winner,sizeof(winner),
+					NULL,0,NI_NUMERICHOST);
+		return won;
+	};
+ // -------------------------------------------------------------------
+	int64_t connect_time_ns(void){ return connect_ns; };
+	int attempt_count(void){ return attempts; };
+	int failure_count(void){ return failures; };
+	const char *winner_text(void){ return winner; };
+}; //end of happy_eyeballs_class
+
+#endif
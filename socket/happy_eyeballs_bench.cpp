@@ -0,0 +1,264 @@
+ /*
+  * happy_eyeballs_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * happy_eyeballs_bench
+ * How long does it take to connect when some of a server's addresses
+ * are dead? Times happy_eyeballs_class, and socket_class's old way (a
+ * blocking connect() to each address in turn), on address lists made
+ * of three kinds of local address, on 127.0.0.1 and ::1:
+ * 		up			a listening socket. connect() completes.
+ * 		refused		a port nobody's listening on. connect() fails at
+ * 					once.
+ * 		blackholed	a listening socket with a backlog of 0 that we've
+ * 					filled up and never accept from, so the kernel
+ * 					drops our SYNs, as a dead route on the internet
+ * 					would, and connect() waits.
+ * For each list we print how long each way took, and which address
+ * won. The old way waits for the kernel to give up on a blackholed
+ * address, which takes 2^(tcp_syn_retries+1)-1 seconds, 127 with the
+ * default 6; so it doesn't take all day, we give up on it after
+ * old_cap_s, and print it as at least that. When nothing connects,
+ * the old way also left socket_class holding a socket it had already
+ * closed; we say so.
+ *
+ * Usage: happy_eyeballs_bench [runs]
+ * happy_eyeballs_class is timed runs times (5 if left out) a list,
+ * and we print the median.
+ * Compile with:
+ * 		g++ -O2 -o happy_eyeballs_bench happy_eyeballs_bench.cpp
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "happy_eyeballs.h"
+#include "../frame_clock/frame_clock.h"
+
+#define old_cap_s 3
+#define all_dead_timeout_ms 2000 //happy_eyeballs_class's, for the lists where nothing's up.
+
+using namespace std;
+
+enum endpoint_kind {up,refused,blackholed};
+
+/* endpoint
+ * -------------------------------------------------------------------
+ * address		where to connect.
+ * listener		the listening socket, if there is one.
+ * fillers		connections filling a blackholed backlog.
+ * name			for the results.
+ * -------------------------------------------------------------------
+ */
+struct endpoint {
+	sockaddr_storage address;
+	socklen_t length;
+	int listener;
+	vector<int> fillers;
+	string name;
+};
+
+/* bool make_endpoint(endpoint &point, int family, endpoint_kind kind)
+ * Sets up an endpoint of the kind on the family's loopback address.
+ */
+bool make_endpoint(endpoint &point,int family,endpoint_kind kind){
+	memset(&point.address,0,sizeof(point.address));
+	point.listener=-1;
+	if (family==AF_INET){
+		sockaddr_in *v4=(sockaddr_in *)&point.address;
+		v4->sin_family=AF_INET;
+		v4->sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+		point.length=sizeof(sockaddr_in);
+	} else {
+		sockaddr_in6 *v6=(sockaddr_in6 *)&point.address;
+		v6->sin6_family=AF_INET6;
+		v6->sin6_addr=in6addr_loopback;
+		point.length=sizeof(sockaddr_in6);
+	}
+	int fd=socket(family,SOCK_STREAM | SOCK_CLOEXEC,0);
+	if (fd<0 || bind(fd,(sockaddr *)&point.address,point.length)<0) return false;
+	getsockname(fd,(sockaddr *)&point.address,&point.length);
+	point.name=string(family==AF_INET?"IPv4 ":"IPv6 ")
+			   +(kind==up?"up":kind==refused?"refused":"blackholed");
+	if (kind==refused){ //bound, so the port's ours, but not listening.
+		close(fd);
+		return true;
+	}
+	if (listen(fd,kind==up?64:0)<0) return false;
+	point.listener=fd;
+	if (kind==up) return true;
+	//fill the backlog, then check a SYN goes unanswered.
+	for (int c=0;c<4;c++){
+		int filler=socket(family,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,0);
+		connect(filler,(sockaddr *)&point.address,point.length);
+		point.fillers.push_back(filler);
+	}
+	pollfd probe={point.fillers.back(),POLLOUT,0};
+	return poll(&probe,1,200)==0;
+}
+
+/* void free_endpoint(endpoint &point)
+ */
+void free_endpoint(endpoint &point){
+	if (point.listener>=0) close(point.listener);
+	for (int filler:point.fillers) close(filler);
+	point.fillers.clear();
+}
+
+/* addrinfo *make_list(vector<endpoint> &points)
+ * The endpoints as the addrinfo list getaddrinfo() would return.
+ * The nodes point into points, so they're freed with delete.
+ */
+addrinfo *make_list(vector<endpoint> &points){
+	addrinfo *list=NULL;
+	for (size_t c=points.size();c-->0;){
+		addrinfo *node=new addrinfo;
+		memset(node,0,sizeof(*node));
+		node->ai_family=points[c].address.ss_family;
+		node->ai_socktype=SOCK_STREAM;
+		node->ai_addr=(sockaddr *)&points[c].address;
+		node->ai_addrlen=points[c].length;
+		node->ai_next=list;
+		list=node;
+	}
+	return list;
+}
+
+/* string address_text(addrinfo *address)
+ */
+string address_text(addrinfo *address){
+	char host[NI_MAXHOST];
+	getnameinfo(address->ai_addr,address->ai_addrlen,host,sizeof(host),NULL,0,NI_NUMERICHOST);
+	return host;
+}
+
+/* int old_way(list, ns, winner, capped, closed_fd)
+ * socket_class's old connect_socket(), with connect() given up on
+ * after old_cap_s (capped says it was). Returns the socket it left in
+ * file_descriptor.
+ */
+int old_way(addrinfo *list,int64_t &ns,string &winner,bool &capped,bool &closed_fd){
+	int file_descriptor=-1;
+	capped=closed_fd=false;
+	int64_t start=timespec_ns(clock_now());
+	for (addrinfo *ptr=list;ptr!=NULL;ptr=ptr->ai_next){
+		file_descriptor=socket(ptr->ai_family,SOCK_STREAM,0);
+		timeval cap={old_cap_s,0};
+		setsockopt(file_descriptor,SOL_SOCKET,SO_SNDTIMEO,&cap,sizeof(cap));
+		if (connect(file_descriptor,ptr->ai_addr,ptr->ai_addrlen)==0){
+			winner=address_text(ptr);
+			ns=timespec_ns(clock_now())-start;
+			return file_descriptor;
+		}
+		if (errno==EINPROGRESS || errno==EAGAIN) capped=true; //timed out.
+		close(file_descriptor);
+	}
+	ns=timespec_ns(clock_now())-start;
+	closed_fd=file_descriptor>=0; //the bug: we hand back a closed socket.
+	winner="none";
+	return file_descriptor;
+}
+
+/* void run(string name, vector<pair<int,endpoint_kind>> spec, int runs)
+ * Sets up the endpoints, times both ways, prints, and tears down.
+ */
+void run(const string &name,const vector<pair<int,endpoint_kind>> &spec,int runs){
+	vector<endpoint> points(spec.size());
+	bool any_up=false;
+	for (size_t c=0;c<spec.size();c++){
+		if (!make_endpoint(points[c],spec[c].first,spec[c].second)){
+			cout<<name<<": unable to set up "<<points[c].name<<"."<<endl;
+			for (size_t d=0;d<=c;d++) free_endpoint(points[d]);
+			return;
+		}
+		any_up|=spec[c].second==up;
+	}
+	addrinfo *list=make_list(points);
+
+	happy_eyeballs_class connector;
+	if (!any_up) connector.setup(happy_eyeballs_stagger_ms,all_dead_timeout_ms);
+	vector<double> ms;
+	string winner="none";
+	int attempts=0,failures=0;
+	for (int c=0;c<runs;c++){
+		int fd=connector.connect_to(list);
+		ms.push_back(connector.connect_time_ns()/1e6);
+		winner=fd>=0?connector.winner_text():"none";
+		attempts=connector.attempt_count();
+		failures=connector.failure_count();
+		if (fd>=0) close(fd);
+	}
+	sort(ms.begin(),ms.end());
+
+	int64_t old_ns;
+	string old_winner;
+	bool capped,closed_fd;
+	int old_fd=old_way(list,old_ns,old_winner,capped,closed_fd);
+	if (old_fd>=0 && !closed_fd) close(old_fd);
+
+	cout<<name<<":\n  happy eyeballs "<<fixed<<setprecision(2)<<setw(9)<<ms[ms.size()/2]
+		<<"ms  winner "<<winner<<", "<<attempts<<" attempts, "<<failures<<" failed"
+		<<"\n  old way       "<<(capped?">":" ")<<setw(9)<<old_ns/1e6<<"ms  winner "
+		<<old_winner<<(capped?" (gave up on a blackhole after "+to_string(old_cap_s)+"s)":"")
+		<<(closed_fd?", returned fd "+to_string(old_fd)+", already closed":"")<<endl;
+
+	while (list!=NULL){
+		addrinfo *next=list->ai_next;
+		delete list;
+		list=next;
+	}
+	for (endpoint &point:points) free_endpoint(point);
+}
+
+/*
+ * Main()
+ * Parameters: how many runs a list.
+ * Returns 0.
+ */
+int main(int argc,char *argv[]){
+	int runs=argc>1?atoi(argv[1]):5;
+	if (runs<1) runs=5;
+	FILE *retries=fopen("/proc/sys/net/ipv4/tcp_syn_retries","r");
+	int syn_retries=6;
+	if (retries!=NULL){
+		if (fscanf(retries,"%d",&syn_retries)!=1) syn_retries=6;
+		fclose(retries);
+	}
+	cout<<"The kernel gives up on a blackholed connect() after "<<(1<<(syn_retries+1))-1
+		<<"s here.\n"<<endl;
+
+	run("IPv4 up",{{AF_INET,up}},runs);
+	run("IPv6 refused, IPv4 up",{{AF_INET6,refused},{AF_INET,up}},runs);
+	run("IPv6 blackholed, IPv4 up",{{AF_INET6,blackholed},{AF_INET,up}},runs);
+	run("2 IPv6 blackholed, IPv4 up",{{AF_INET6,blackholed},{AF_INET6,blackholed},
+									   {AF_INET,up}},runs);
+	run("IPv4 blackholed, IPv6 up",{{AF_INET,blackholed},{AF_INET6,up}},runs);
+	run("all refused",{{AF_INET6,refused},{AF_INET,refused}},runs);
+	run("all blackholed",{{AF_INET6,blackholed},{AF_INET,blackholed}},1);
+	return 0;
+}
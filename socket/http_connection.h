@@ -0,0 +1,257 @@
+ /*
+  * http_connection.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * http_connection.h
+ * Socket.cpp used to connect, send one GET, read the response, and
+ * hang up. Fetch the same page again and it's another DNS lookup and
+ * another TCP handshake, for a request that takes a fraction of that
+ * to answer.
+ *
+ * http_connection_class keeps the connection to one web server open
+ * between fetches (HTTP/1.1 does that unless somebody says
+ * "Connection: close"), and pipelines: it sends several GETs without
+ * waiting for the answers, and then reads the answers, which come back
+ * in the order we asked. So a batch of fetches costs one round trip,
+ * not one each.
+ *
+ * It doesn't know how to connect; you give it a function that returns
+ * a connected socket (socket_class's, or a loopback one in a
+ * benchmark), and it calls it when it needs a connection.
+ *
+ * How it works:
+ * fetch() takes a list of paths. It keeps up to depth requests in
+ * flight: it sends as many as it may in one send(), then reads one
+ * response with http_response_class, hands its body on, and sends
+ * another, until every path has its response.
+ * 		If a response says the server is closing the connection, we
+ * 		close our end after it, and send whatever's left on a new one.
+ * 		If the connection dies before a response starts (a server that
+ * 		closed an idle connection while we weren't looking, most
+ * 		likely), we connect again and resend the requests that weren't
+ * 		answered. They're all GETs, so asking twice does no harm. If
+ * 		it dies partway through a response, we give up, rather than
+ * 		hand part of a body on twice.
+ * 		Before reusing an idle connection, we peek at it, so one the
+ * 		server has already closed is replaced before we send anything.
+ * We turn Nagle's algorithm off (TCP_NODELAY): with requests still in
+ * flight it would hold each new one back until the server ACKs, and
+ * servers delay their ACKs.
+*/
+
+#ifndef HTTP_CONNECTION_H
+#define HTTP_CONNECTION_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "line_reader.h"
+#include "http_response.h"
+
+#define http_pipeline_depth 8 //requests in flight at once.
+#define http_retries 2 //new connections per fetch() when one dies early.
+
+typedef std::function<int(void)> http_dial_function; //a connected socket, or -1.
+typedef std::function<void(size_t,std::string_view)> http_fetch_handler; //path index, body.
+
+/* http_connection_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * dial				:Variable. The function that connects.
+ * host				:Variable. What goes in the Host: header.
+ * fd				:Variable. The connection, or -1.
+ * reader			:Variable. Buffers what the server sends. Bytes
+ * 					of a response we haven't asked for yet stay in it.
+ * response			:Variable. The response we're reading.
+ * connections, requests, responses, reconnects
+ * 					:Variables. The counters.
+ * -------------------------------------------------------------------
+ * drop()			:Method. Closes the connection.
+ * -------------------------------------------------------------------
+ * idle_closed()	:Method
+ * 					True if the server has hung up (or sent something
+ * 					we didn't ask for) while the connection sat idle.
+ * -------------------------------------------------------------------
+ * send_text()		:Method
+ * 					send()s a string until it's all gone. Returns false
+ * 					if the connection fails.
+ * -------------------------------------------------------------------
+ * request()		:Method. Takes a path, and returns the GET for it.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Takes the host name, for the Host: header, and the
+ * 					function to connect with. Drops any connection we
+ * 					had.
+ * -------------------------------------------------------------------
+ * fetch()			:Method
+ * 					Takes a list of paths, a function to hand bodies to
+ * 					(with the index of their path), and optionally a
+ * 					vector to fill with the statuses and the most
+ * 					requests to have in flight (http_pipeline_depth).
+ * 					Returns how many paths got complete responses, in
+ * 					order, so anything less than all of them means the
+ * 					rest failed.
+ * -------------------------------------------------------------------
+ * close_connection()	:Method. Hangs up, if we're connected.
+ * -------------------------------------------------------------------
+ * connection_count(), request_count(), response_count(),
+ * reconnect_count()
+ * 					:Methods. The counters. Connections made, requests
+ * 					sent (more than responses if we had to resend),
+ * 					responses read, and connections that died early.
+ * -------------------------------------------------------------------
+ * The destructor hangs up.
+ * -------------------------------------------------------------------
+ */
+class http_connection_class {
+	private:
+ // ===================================================================
+	http_dial_function dial;
+	std::string host;
+	int fd=-1;
+	line_reader_class reader;
+	http_response_class response;
+	uint64_t connections=0;
+	uint64_t requests=0;
+	uint64_t responses=0;
+	uint64_t reconnects=0;
+ // -------------------------------------------------------------------
+	void drop(void){
+		if (fd>=0) close(fd);
+		fd=-1;
+		reader.reset();
+	};
+ // -------------------------------------------------------------------
+	bool idle_closed(void){
+		pollfd check={fd,POLLIN,0};
+		return poll(&check,1,0)!=0; //an idle connection should be quiet.
+	};
+ // -------------------------------------------------------------------
+	bool send_text(const std::string &text){
+		size_t at=0;
+		while (at<text.size()){
+			ssize_t sent=send(fd,text.data()+at,text.size()-at,MSG_NOSIGNAL);
+			if (sent<0 && errno==EINTR) continue;
+			if (sent<=0) return false;
+			at+=sent;
+		}
+		return true;
+	};
+ // -------------------------------------------------------------------
+	std::string request(const std::string &path){
+		return "GET "+path+" HTTP/1.1\r\nHost: "+host+"\r\nConnection: keep-alive\r\n\r\n";
+	};
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	void setup(const std::string &host_name,http_dial_function dial_function){
+		drop();
+		host=host_name;
+		dial=dial_function;
+	};
+ // -------------------------------------------------------------------
+	size_t fetch(const std::vector<std::string> &paths,const http_fetch_handler &body,
+				 std::vector<int> *statuses=NULL,size_t depth=http_pipeline_depth){
+		size_t sent=0; //paths we've sent on this connection, counting from 0.
+		size_t done=0; //paths with complete responses.
+		int retries=0;
+		if (depth<1) depth=1;
+		if (statuses!=NULL) statuses->clear();
+		if (fd>=0 && idle_closed()) drop();
+		while (done<paths.size()){
+			if (fd<0){
+				fd=dial();
+				if (fd<0) return done;
+				connections++;
+				int yes=1; //requests go out as soon as we have them.
+				setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&yes,sizeof(yes));
+				sent=done; //nothing's in flight on a new connection.
+			}
+			std::string batch;
+			for (;sent<paths.size() && sent-done<depth;sent++){
+				batch+=request(paths[sent]);
+				requests++;
+			}
+			if (!batch.empty() && !send_text(batch)){
+				drop();
+				if (++retries>http_retries) return done;
+				reconnects++;
+				continue;
+			}
+			//the counts are for every response; how far did this one get?
+			uint64_t header_before=response.header_count();
+			uint64_t body_before=response.body_count();
+			size_t index=done;
+			response.reset();
+			std::string_view data;
+			while (!response.complete() && !response.failed()){
+				if (!reader.read_some(fd,data)){
+					response.finish();
+					break;
+				}
+				reader.consume(response.feed(data.data(),data.size(),
+											 [&](std::string_view piece){ body(index,piece); }));
+			}
+			if (!response.complete()){
+				//it may have come in with the last response's read, so
+				//what the reader took in since doesn't tell us.
+				bool started=response.header_count()!=header_before ||
+							 response.body_count()!=body_before;
+				drop();
+				if (started || ++retries>http_retries) return done;
+				reconnects++;
+				continue;
+			}
+			responses++;
+			if (statuses!=NULL) statuses->push_back(response.status());
+			done++;
+			if (!response.keep_alive()) drop();
+		}
+		return done;
+	};
+ // -------------------------------------------------------------------
+	void close_connection(void){
+		drop();
+	};
+ // -------------------------------------------------------------------
+	uint64_t connection_count(void){ return connections; };
+	uint64_t request_count(void){ return requests; };
+	uint64_t response_count(void){ return responses; };
+	uint64_t reconnect_count(void){ return reconnects; };
+ // -------------------------------------------------------------------
+	~http_connection_class(){
+		drop();
+	};
+}; //end of http_connection_class
+
+#endif
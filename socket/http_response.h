@@ -0,0 +1,411 @@
+ /*
+  * http_response.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * http_response.h
+ * Socket.cpp sends a GET and used to put everything that came back on
+ * the LEDs: the status line, the headers, and, if the server sent the
+ * page in chunks, the chunk sizes too. What we want on the LEDs is the
+ * page.
+ *
+ * http_response_class reads an HTTP/1.1 response as it arrives, in
+ * whatever pieces recv() happens to return, and hands the body, and
+ * only the body, to a function you give it. It keeps track of the
+ * status, and of the three headers that say where the body ends:
+ * 		Content-Length			the body is this many bytes.
+ * 		Transfer-Encoding		chunked: the body comes in pieces, each
+ * 								after a line with its size in hex, and
+ * 								ends with a piece of size 0.
+ * 		Connection				whether the server will keep the
+ * 								connection open after this response.
+ * If there's neither of the first two, the body is everything until
+ * the server hangs up.
+ *
+ * How it works:
+ * feed() takes a piece of the response and works through it, a state
+ * at a time. The status line, headers and chunk size lines are lines,
+ * so in those states we memchr() for the newline; if the whole line is
+ * in this piece we read it where it is, and only if it's split across
+ * two pieces do we copy it into a little buffer of our own (and count
+ * that). Body bytes are never copied: the function gets a string_view
+ * of them where they sit in the piece we were fed.
+ *
+ * feed() stops at the end of the response and returns how far it got,
+ * so if the server sent the start of the next response in the same
+ * piece (it will if we pipeline requests), that's left for the next
+ * response. Call reset() before feeding that one.
+ *
+ * Responses to HEAD, and 1xx, 204 and 304 responses, have no body
+ * whatever the headers say. The 1xx ones are skipped (we wait for the
+ * real response after them); call expect_no_body() before feeding a
+ * response to HEAD.
+*/
+
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#define http_max_line 8192 //status, header or chunk size line.
+
+typedef std::function<void(std::string_view)> http_body_handler;
+
+/* http_response_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * state			:Variable. What we're reading now: the status line,
+ * 					headers, a body of known length, a chunk size line,
+ * 					chunk data, the line end after chunk data, trailers,
+ * 					a body that ends when the server hangs up, or
+ * 					nothing, because we're done or have failed.
+ * partial			:Variable. A line split across two pieces, so far.
+ * status_code		:Variable. 200, 404, ...
+ * version_minor	:Variable. The 1 or 0 of HTTP/1.1 or HTTP/1.0.
+ * length			:Variable. Content-Length, or -1 if there wasn't one.
+ * remaining		:Variable. Body or chunk bytes still to come.
+ * is_chunked		:Variable. Transfer-Encoding: chunked.
+ * connection_close, connection_keep_alive
+ * 					:Variables. What the Connection header said.
+ * no_body			:Variable. This response has no body.
+ * error_text		:Variable. Why we failed, if we did.
+ * header_bytes, body_bytes, copied_bytes
+ * 					:Variables. Bytes of status line, headers and
+ * 					chunk framing; of body; and that we had to copy
+ * 					because a line was split.
+ * -------------------------------------------------------------------
+ * take_line()		:Method
+ * 					Takes the piece, where we are in it, and a
+ * 					string_view to set. Sets it to the next whole line,
+ * 					without its line end, and moves past it, returning
+ * 					true. If there's no newline in the rest of the
+ * 					piece, copies the rest into partial and returns
+ * 					false. Fails if a line is longer than http_max_line.
+ * -------------------------------------------------------------------
+ * status_line(), header_line(), chunk_size_line()
+ * 					:Methods. Each takes a whole line and does what it
+ * 					says, failing if the line makes no sense.
+ * -------------------------------------------------------------------
+ * headers_done()	:Method
+ * 					After the blank line: works out where the body
+ * 					ends, and the state to read it in.
+ * -------------------------------------------------------------------
+ * fail()			:Method. Takes the reason, and stops.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * feed()			:Method
+ * 					Takes a piece of the response, how long it is, and
+ * 					the function to hand body bytes to. Returns how many
+ * 					bytes of the piece were this response's. That's all
+ * 					of them unless the response ended in this piece.
+ * -------------------------------------------------------------------
+ * finish()			:Method
+ * 					For when the server hangs up. Ends a body that runs
+ * 					until it does; anything else not done has failed.
+ * -------------------------------------------------------------------
+ * reset()			:Method. Ready for the next response.
+ * -------------------------------------------------------------------
+ * expect_no_body()	:Method. For a response to HEAD.
+ * -------------------------------------------------------------------
+ * complete(), failed(), error()
+ * 					:Methods. Done, failed, and why.
+ * -------------------------------------------------------------------
+ * status(), content_length(), chunked(), keep_alive()
+ * 					:Methods. What the response said. keep_alive() is
+ * 					true if we can send the next request on the same
+ * 					connection after this response.
+ * -------------------------------------------------------------------
+ * header_count(), body_count(), copied_count()
+ * 					:Methods. The counters.
+ * -------------------------------------------------------------------
+ */
+class http_response_class {
+	private:
+ // ===================================================================
+	enum read_state {
+		reading_status,reading_headers,reading_body,reading_chunk_size,
+		reading_chunk_data,reading_chunk_end,reading_trailers,
+		reading_until_close,reading_done,reading_failed
+	};
+	read_state state=reading_status;
+	std::string partial;
+	int status_code=0;
+	int version_minor=1;
+	int64_t length=-1;
+	uint64_t remaining=0;
+	bool is_chunked=false;
+	bool connection_close=false;
+	bool connection_keep_alive=false;
+	bool no_body=false;
+	const char *error_text="";
+	uint64_t header_bytes=0;
+	uint64_t body_bytes=0;
+	uint64_t copied_bytes=0;
+ // -------------------------------------------------------------------
+	void fail(const char *why){
+		error_text=why;
+		state=reading_failed;
+	};
+ // -------------------------------------------------------------------
+	bool take_line(const char *data,size_t size,size_t &at,std::string_view &line){
+		const char *newline=(const char *)memchr(data+at,'\n',size-at);
+		if (newline==NULL){
+			if (partial.size()+(size-at)>http_max_line){
+				fail("line too long");
+				return false;
+			}
+			partial.append(data+at,size-at);
+			copied_bytes+=size-at;
+			header_bytes+=size-at;
+			at=size;
+			return false;
+		}
+		size_t next=newline-data+1;
+		header_bytes+=next-at;
+		if (partial.empty()){
+			line=std::string_view(data+at,newline-(data+at));
+		} else {
+			if (partial.size()+(next-at)>http_max_line){
+				fail("line too long");
+				return false;
+			}
+			partial.append(data+at,newline-(data+at));
+			copied_bytes+=newline-(data+at);
+			line=partial;
+		}
+		at=next;
+		if (!line.empty() && line.back()=='\r') line.remove_suffix(1);
+		return true;
+	};
+ // -------------------------------------------------------------------
+	void status_line(std::string_view line){
+		// HTTP/1.x nnn reason
+		if (line.size()<12 || line.compare(0,7,"HTTP/1.")!=0 || line[8]!=' ' ||
+			line[9]<'0' || line[9]>'9' || line[10]<'0' || line[10]>'9' ||
+			line[11]<'0' || line[11]>'9'){
+			fail("bad status line");
+			return;
+		}
+		version_minor=line[7]-'0';
+		status_code=(line[9]-'0')*100+(line[10]-'0')*10+(line[11]-'0');
+		state=reading_headers;
+	};
+ // -------------------------------------------------------------------
+	static std::string_view trim(std::string_view text){
+		while (!text.empty() && (text.front()==' ' || text.front()=='\t')) text.remove_prefix(1);
+		while (!text.empty() && (text.back()==' ' || text.back()=='\t')) text.remove_suffix(1);
+		return text;
+	};
+ // -------------------------------------------------------------------
+	static bool same(std::string_view text,const char *word){
+		size_t word_length=strlen(word);
+		return text.size()==word_length && strncasecmp(text.data(),word,word_length)==0;
+	};
+ // -------------------------------------------------------------------
+	void header_line(std::string_view line){
+		if (line.empty()){
+			headers_done();
+			return;
+		}
+		size_t colon=line.find(':');
+		if (colon==std::string_view::npos || colon==0){
+			fail("bad header");
+			return;
+		}
+		std::string_view name=line.substr(0,colon);
+		std::string_view value=trim(line.substr(colon+1));
+		if (same(name,"Content-Length")){
+			if (value.empty()){
+				fail("bad Content-Length");
+				return;
+			}
+			int64_t parsed=0;
+			for (char digit:value){
+				if (digit<'0' || digit>'9' || parsed>(INT64_MAX-9)/10){
+					fail("bad Content-Length");
+					return;
+				}
+				parsed=parsed*10+(digit-'0');
+			}
+			if (length>=0 && length!=parsed){
+				fail("two different Content-Lengths");
+				return;
+			}
+			length=parsed;
+		} else if (same(name,"Transfer-Encoding")){
+			// the last coding listed is the one that frames the body.
+			size_t comma=value.rfind(',');
+			is_chunked=same(trim(comma==std::string_view::npos?value:value.substr(comma+1)),"chunked");
+		} else if (same(name,"Connection")){
+			// a list of options; we only care about two of them.
+			while (!value.empty()){
+				size_t comma=value.find(',');
+				std::string_view option=trim(value.substr(0,comma));
+				if (same(option,"close")) connection_close=true;
+				if (same(option,"keep-alive")) connection_keep_alive=true;
+				if (comma==std::string_view::npos) break;
+				value.remove_prefix(comma+1);
+			}
+		}
+	};
+ // -------------------------------------------------------------------
+	void headers_done(void){
+		if (status_code>=100 && status_code<200){ //interim: the real one follows.
+			int minor=version_minor;
+			bool head=no_body;
+			reset();
+			version_minor=minor;
+			no_body=head;
+			return;
+		}
+		if (no_body || status_code==204 || status_code==304){
+			state=reading_done;
+		} else if (is_chunked){
+			state=reading_chunk_size;
+		} else if (length>=0){
+			remaining=length;
+			state=remaining>0?reading_body:reading_done;
+		} else {
+			state=reading_until_close;
+		}
+	};
+ // -------------------------------------------------------------------
+	void chunk_size_line(std::string_view line){
+		uint64_t size=0;
+		size_t c=0;
+		for (;c<line.size();c++){
+			char digit=line[c];
+			int value;
+			if (digit>='0' && digit<='9') value=digit-'0';
+			else if (digit>='a' && digit<='f') value=digit-'a'+10;
+			else if (digit>='A' && digit<='F') value=digit-'A'+10;
+			else break;
+			if (size>(UINT64_MAX>>4)){
+				fail("chunk too big");
+				return;
+			}
+			size=(size<<4)|value;
+		}
+		if (c==0 || (c<line.size() && line[c]!=';' && line[c]!=' ' && line[c]!='\t')){
+			fail("bad chunk size");
+			return;
+		}
+		remaining=size;
+		state=size>0?reading_chunk_data:reading_trailers;
+	};
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	size_t feed(const char *data,size_t size,const http_body_handler &body){
+		size_t at=0;
+		std::string_view line;
+		while (at<size){
+			switch (state){
+			case reading_status:
+			case reading_headers:
+			case reading_chunk_size:
+			case reading_chunk_end:
+			case reading_trailers:
+				if (!take_line(data,size,at,line)) break;
+				if (state==reading_status){
+					if (!line.empty()) status_line(line); //stray line ends between responses.
+				}
+				else if (state==reading_headers) header_line(line);
+				else if (state==reading_chunk_size) chunk_size_line(line);
+				else if (state==reading_chunk_end){
+					if (line.empty()) state=reading_chunk_size;
+					else fail("no line end after chunk");
+				} else if (line.empty()) state=reading_done; //end of trailers.
+				partial.clear();
+				break;
+			case reading_body:
+			case reading_chunk_data: {
+				size_t take=size-at<remaining?size-at:(size_t)remaining;
+				body(std::string_view(data+at,take));
+				body_bytes+=take;
+				remaining-=take;
+				at+=take;
+				if (remaining==0){
+					state=state==reading_body?reading_done:reading_chunk_end;
+				}
+				break;
+			}
+			case reading_until_close:
+				body(std::string_view(data+at,size-at));
+				body_bytes+=size-at;
+				at=size;
+				break;
+			case reading_done:
+			case reading_failed:
+				return at;
+			}
+		}
+		return at;
+	};
+ // -------------------------------------------------------------------
+	void finish(void){
+		if (state==reading_until_close) state=reading_done;
+		else if (state!=reading_done && state!=reading_failed) fail("connection closed early");
+	};
+ // -------------------------------------------------------------------
+	void reset(void){
+		state=reading_status;
+		partial.clear();
+		status_code=0;
+		version_minor=1;
+		length=-1;
+		remaining=0;
+		is_chunked=false;
+		connection_close=false;
+		connection_keep_alive=false;
+		no_body=false;
+		error_text="";
+	};
+ // -------------------------------------------------------------------
+	void expect_no_body(void){ no_body=true; };
+ // -------------------------------------------------------------------
+	bool complete(void){ return state==reading_done; };
+	bool failed(void){ return state==reading_failed; };
+	const char *error(void){ return error_text; };
+	int status(void){ return status_code; };
+	int64_t content_length(void){ return length; };
+	bool chunked(void){ return is_chunked; };
+	bool keep_alive(void){
+		if (!is_chunked && length<0 && !no_body && status_code!=204 && status_code!=304){
+			return false; //the body ended when the server hung up.
+		}
+		return version_minor>=1?!connection_close:connection_keep_alive;
+	};
+ // -------------------------------------------------------------------
+	uint64_t header_count(void){ return header_bytes; };
+	uint64_t body_count(void){ return body_bytes; };
+	uint64_t copied_count(void){ return copied_bytes; };
+}; //end of http_response_class
+
+#endif
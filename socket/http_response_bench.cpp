@@ -0,0 +1,308 @@
+ /*
+  * http_response_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * http_response_bench
+ * Checks http_response_class, then times it on big responses.
+ *
+ * First, the checks. Each of these responses is fed to the parser cut
+ * into seeded random pieces, from 1 byte to a few KB, the way recv()
+ * might return them, and the body that comes out is compared with the
+ * body that went in:
+ * 		a Content-Length body, a chunked body (with chunk extensions
+ * 		and trailers), a body that ends when the server hangs up, a
+ * 		100 Continue before the real response, a 204 with no body, and
+ * 		two responses back to back, as pipelining gets them.
+ *
+ * Then the timing, with a body of the size you ask for, sent with
+ * Content-Length and again chunked (in random chunks up to 16KB):
+ * 		in memory	the response fed in 64KB pieces, to time the
+ * 					parser alone, against the obvious way: keep the
+ * 					whole response in a string, find the blank line,
+ * 					and copy out the body (chunk by chunk, if chunked).
+ * 					The parser never touches body bytes, so its time
+ * 					is per piece, not per byte, and its MB/s is
+ * 					silly for a Content-Length body.
+ * 		loopback	the same, from a loopback_server_class, through
+ * 					line_reader_class and the parser, against reading
+ * 					the whole response into a string first and then
+ * 					doing it the obvious way.
+ * The timed runs only count the body bytes, since hashing them would
+ * take longer than parsing them; each response's body is checked by
+ * hash, untimed, before it's timed.
+ *
+ * Usage: http_response_bench [megabytes]
+ * 64 megabytes if left out.
+ * Compile with:
+ * 		g++ -O2 -o http_response_bench http_response_bench.cpp -lpthread
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include "http_response.h"
+#include "line_reader.h"
+#include "loopback_server.h"
+#include "../frame_clock/frame_clock.h"
+
+#define piece_bytes 65536
+#define max_chunk 16384
+
+using namespace std;
+
+/* uint32_t next_random()
+ * xorshift32. Seeded, so every run gets the same responses.
+ */
+uint32_t random_state=2463534242u;
+uint32_t next_random(){
+	random_state^=random_state<<13;
+	random_state^=random_state>>17;
+	random_state^=random_state<<5;
+	return random_state;
+}
+
+/* uint64_t hash_bytes(uint64_t hash, string_view data)
+ * FNV-1a, carried on from hash.
+ */
+uint64_t hash_bytes(uint64_t hash,string_view data){
+	for (unsigned char byte:data) hash=(hash^byte)*1099511628211ULL;
+	return hash;
+}
+#define hash_start 14695981039346656037ULL
+
+/* string random_body(size_t bytes)
+ * Printable junk, with line ends.
+ */
+string random_body(size_t bytes){
+	string body(bytes,' ');
+	for (size_t c=0;c<bytes;c++){
+		body[c]=next_random()%64==0?'\n':(char)(' '+next_random()%95);
+	}
+	return body;
+}
+
+/* string length_response(body), chunked_response(body, extensions)
+ * The body, with Content-Length, or in random chunks up to max_chunk,
+ * with or without chunk extensions and a trailer.
+ */
+string length_response(const string &body){
+	return "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: "
+		   +to_string(body.size())+"\r\n\r\n"+body;
+}
+string chunked_response(const string &body,bool extensions){
+	string response="HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+					"Transfer-Encoding: chunked\r\n\r\n";
+	char size_text[32];
+	for (size_t at=0;at<body.size();){
+		size_t size=min((size_t)(1+next_random()%max_chunk),body.size()-at);
+		snprintf(size_text,sizeof(size_text),extensions?"%zX;x=y\r\n":"%zx\r\n",size);
+		response+=size_text;
+		response.append(body,at,size);
+		response+="\r\n";
+		at+=size;
+	}
+	response+=extensions?"0\r\nX-Trailer: yes\r\n\r\n":"0\r\n\r\n";
+	return response;
+}
+
+/* bool check(name, response, body, after, hang_up)
+ * Feeds response in random pieces, and says whether the body that
+ * came out was body, and the parser stopped at the end of the first
+ * response with after left over. hang_up calls finish() at the end,
+ * as if the server hung up.
+ */
+bool check(const string &name,const string &response,const string &body,
+		   const string &after="",bool hang_up=false){
+	http_response_class parser;
+	uint64_t hash=hash_start;
+	auto collect=[&](string_view piece){ hash=hash_bytes(hash,piece); };
+	size_t at=0;
+	while (at<response.size() && !parser.complete() && !parser.failed()){
+		size_t size=min((size_t)(1+next_random()%(next_random()%4==0?4096:16)),response.size()-at);
+		at+=parser.feed(response.data()+at,size,collect);
+	}
+	if (hang_up) parser.finish();
+	bool right=parser.complete() && hash==hash_bytes(hash_start,body)
+			   && response.substr(at)==after;
+	cout<<left<<setw(28)<<name<<(right?"ok":"FAILED")<<" (status "<<parser.status()
+		<<", "<<parser.body_count()<<" body bytes, "<<parser.copied_count()
+		<<" copied"<<(parser.failed()?string(", ")+parser.error():"")<<")"<<endl;
+	return right;
+}
+
+/* bool run_checks()
+ * All of them. True if they all pass.
+ */
+bool run_checks(){
+	string body=random_body(50000);
+	string small="hello\nworld\n";
+	bool right=true;
+	right&=check("Content-Length",length_response(body),body);
+	right&=check("chunked",chunked_response(body,false),body);
+	right&=check("chunked, extensions",chunked_response(body,true),body);
+	right&=check("until hang up","HTTP/1.0 200 OK\r\nServer: x\r\n\r\n"+body,body,"",true);
+	right&=check("100 Continue first","HTTP/1.1 100 Continue\r\n\r\n"+length_response(small),small);
+	right&=check("204, no body","HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n","");
+	string second=chunked_response(small,false);
+	right&=check("pipelined",length_response(small)+second,small,second);
+	return right;
+}
+
+/* string obvious_body(const string &response)
+ * The obvious way: the whole response is in a string; copy the body
+ * out of it.
+ */
+string obvious_body(const string &response){
+	size_t blank=response.find("\r\n\r\n");
+	if (blank==string::npos) return "";
+	string headers=response.substr(0,blank);
+	string rest=response.substr(blank+4);
+	if (headers.find("chunked")==string::npos) return rest;
+	string body;
+	size_t at=0;
+	while (true){
+		size_t line_end=rest.find("\r\n",at);
+		size_t size=stoul(rest.substr(at,line_end-at),NULL,16);
+		if (size==0) break;
+		body+=rest.substr(line_end+2,size);
+		at=line_end+2+size+2;
+	}
+	return body;
+}
+
+/* void report(name, bytes, ns, right, note)
+ * One line of results.
+ */
+void report(const string &name,size_t bytes,int64_t ns,bool right,const string &note=""){
+	cout<<"  "<<left<<setw(30)<<name<<fixed<<setprecision(3)<<std::right<<setw(9)
+		<<ns/1e6<<"ms, "<<setprecision(1)<<setw(10)<<bytes/(ns/1e9)/1e6<<" MB/s, "
+		<<(right?"body right":"body WRONG")<<note<<endl;
+}
+
+/* size_t parse_all(response, body)
+ * Feeds the parser the whole response, piece_bytes at a time. Returns
+ * how much of it was body.
+ */
+size_t parse_all(const string &response,const http_body_handler &body){
+	http_response_class parser;
+	for (size_t at=0;at<response.size() && !parser.complete() && !parser.failed();){
+		at+=parser.feed(response.data()+at,min((size_t)piece_bytes,response.size()-at),body);
+	}
+	return parser.complete()?parser.body_count():0;
+}
+
+/* void in_memory(name, response, body_hash)
+ * Checks the body the parser gets, then times the parser, then the
+ * obvious way.
+ */
+void in_memory(const string &name,const string &response,uint64_t body_hash){
+	uint64_t hash=hash_start;
+	parse_all(response,[&](string_view piece){ hash=hash_bytes(hash,piece); });
+	bool right=hash==body_hash;
+
+	size_t counted=0;
+	int64_t start=timespec_ns(clock_now());
+	size_t body_size=parse_all(response,[&](string_view piece){ counted+=piece.size(); });
+	int64_t ns=timespec_ns(clock_now())-start;
+	report(name+", parser",response.size(),ns,right && counted==body_size,
+		   ", 0 body bytes copied");
+
+	start=timespec_ns(clock_now());
+	string body=obvious_body(response);
+	ns=timespec_ns(clock_now())-start;
+	report(name+", obvious way",response.size(),ns,hash_bytes(hash_start,body)==body_hash);
+}
+
+/* void loopback(name, port, response_size, body_size)
+ * The response from the server through line_reader_class and the
+ * parser, then read whole into a string and done the obvious way.
+ * The bodies are the ones in_memory() checked; here we check they're
+ * all there.
+ */
+void loopback(const string &name,int port,size_t response_size,size_t body_size){
+	int fd=connect_loopback(port);
+	if (fd<0) return;
+	line_reader_class reader(piece_bytes);
+	http_response_class parser;
+	size_t counted=0;
+	string_view data;
+	int64_t start=timespec_ns(clock_now());
+	while (!parser.complete() && !parser.failed() && reader.read_some(fd,data)){
+		reader.consume(parser.feed(data.data(),data.size(),
+								   [&](string_view piece){ counted+=piece.size(); }));
+	}
+	int64_t ns=timespec_ns(clock_now())-start;
+	close(fd);
+	report(name+", parser",response_size,ns,parser.complete() && counted==body_size,
+		   ", "+to_string(reader.receive_count())+" recv()s");
+
+	fd=connect_loopback(port);
+	if (fd<0) return;
+	string response;
+	vector<char> buffer(piece_bytes);
+	start=timespec_ns(clock_now());
+	ssize_t got;
+	while ((got=recv(fd,buffer.data(),buffer.size(),0))>0) response.append(buffer.data(),got);
+	string body=obvious_body(response);
+	ns=timespec_ns(clock_now())-start;
+	close(fd);
+	report(name+", obvious way",response_size,ns,body.size()==body_size);
+}
+
+/*
+ * Main()
+ * Parameters: megabytes of body.
+ * Returns 0, or 1 if a check fails or the server won't start.
+ */
+int main(int argc,char *argv[]){
+	int megabytes=argc>1?atoi(argv[1]):64;
+	if (megabytes<1) megabytes=64;
+
+	cout<<"Checks, fed in random pieces:"<<endl;
+	if (!run_checks()) return 1;
+
+	string body=random_body((size_t)megabytes<<20);
+	uint64_t body_hash=hash_bytes(hash_start,body);
+	string responses[2]={length_response(body),chunked_response(body,false)};
+	string names[2]={"Content-Length","chunked"};
+
+	cout<<"\nIn memory, "<<megabytes<<"MB body:"<<endl;
+	for (int c=0;c<2;c++) in_memory(names[c],responses[c],body_hash);
+
+	cout<<"\nLoopback, "<<megabytes<<"MB body:"<<endl;
+	for (int c=0;c<2;c++){
+		loopback_server_class server;
+		const string &response=responses[c];
+		if (!server.start([&response](int client){
+				send_all(client,response.data(),response.size());
+			})){
+			cout<<"Unable to start the server."<<endl;
+			return 1;
+		}
+		loopback(names[c],server.port(),response.size(),body.size());
+		server.stop();
+	}
+	return 0;
+}
@@ -0,0 +1,235 @@
+ /*
+  * keep_alive_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * keep_alive_bench
+ * How many GETs a second do we get from a local web server, connecting
+ * for each one the way Socket.cpp used to, and keeping the connection
+ * open with http_connection_class, one request at a time and
+ * pipelined?
+ *
+ * The server is a loopback_server_class that speaks just enough
+ * HTTP/1.1: it reads requests with line_reader_class, and answers each
+ * one as soon as it's read with a body that starts with the path asked
+ * for, so we can tell the answers came back in order. It hangs up
+ * after a response if the request said "Connection: close", or after
+ * max_requests responses on one connection if we tell it to (real
+ * servers do: nginx's default is 100), saying so in the response, or,
+ * to play a server that drops idle connections, without saying so.
+ * It hangs up the way real servers do, too: it shuts down its side,
+ * and reads and ignores whatever we'd already pipelined until we close
+ * ours.
+ *
+ * The runs, each of the same number of GETs:
+ * 		connect each time		connect, GET with Connection: close,
+ * 								read the response, hang up.
+ * 		keep-alive				one fetch() per GET, so one request in
+ * 								flight at a time.
+ * 		keep-alive, one fetch()	one fetch() of every path, still one
+ * 								request in flight.
+ * 		pipelined, depth n		one fetch() of every path, n requests
+ * 								in flight.
+ * 		pipelined, server limit	the same, depth 8, with the server
+ * 								hanging up every 100 responses.
+ * 		silent hang-ups			one fetch() per GET, the server hanging
+ * 								up without a word after each response:
+ * 								each fetch() has to notice and connect
+ * 								again.
+ * For each we print requests a second, connections made, requests
+ * sent, and whether every body came back, in order.
+ *
+ * On loopback a round trip is tens of microseconds. To a real server
+ * it's tens of milliseconds, so the handshakes keep-alive saves, and
+ * the round trips pipelining saves, are worth that much more there.
+ *
+ * Usage: keep_alive_bench [requests] [body bytes]
+ * 5000 requests of 512 bytes if left out.
+ * Compile with:
+ * 		g++ -O2 -o keep_alive_bench keep_alive_bench.cpp -lpthread
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdlib.h>
+#include "http_connection.h"
+#include "http_response.h"
+#include "line_reader.h"
+#include "loopback_server.h"
+#include "../frame_clock/frame_clock.h"
+
+#define server_limit 100
+
+using namespace std;
+
+size_t body_bytes=512;
+atomic<int> max_requests{0}; //per connection; 0 for no limit.
+atomic<bool> silent_hang_up{false};
+
+/* void serve(int client)
+ * Answers GETs until the client hangs up, asks us to, or we've hit
+ * max_requests.
+ */
+void serve(int client){
+	line_reader_class reader;
+	string_view line;
+	string path;
+	bool close_after=false;
+	int served=0;
+	while (reader.read_line(client,line)){
+		if (line.compare(0,4,"GET ")==0){
+			path=string(line.substr(4,line.find(' ',4)-4));
+		} else if (line=="Connection: close"){
+			close_after=true;
+		} else if (line.empty() && !path.empty()){
+			served++;
+			bool last=close_after || (max_requests>0 && served>=max_requests);
+			string body=path+"\n";
+			body.resize(max(body_bytes,body.size()),'.');
+			string response="HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: "
+							+to_string(body.size())+"\r\n"
+							+(last && !silent_hang_up?"Connection: close\r\n":"")+"\r\n"+body;
+			if (!send_all(client,response.data(),response.size())) return;
+			if (last){
+				//close gently. Closing with pipelined requests unread
+				//would send a reset, which can destroy responses the
+				//client hasn't read yet.
+				shutdown(client,SHUT_WR);
+				while (reader.read_line(client,line)) ;
+				return;
+			}
+			path.clear();
+		}
+	}
+}
+
+/* bool body_right(size_t index, string_view body, vector<string> &paths)
+ * Whether body is the one for paths[index].
+ */
+bool body_right(size_t index,string_view body,const vector<string> &paths){
+	return body.size()==max(body_bytes,paths[index].size()+1) &&
+		   body.compare(0,paths[index].size()+1,paths[index]+"\n")==0;
+}
+
+/* void report(name, count, ns, connections, sent, right)
+ * One line of results.
+ */
+void report(const string &name,size_t count,int64_t ns,uint64_t connections,
+			uint64_t sent,bool right){
+	cout<<"  "<<left<<setw(26)<<name<<std::right<<fixed<<setprecision(0)<<setw(8)
+		<<count/(ns/1e9)<<" req/s, "<<setw(5)<<connections<<" connections, "<<setw(6)
+		<<sent<<" sent, "<<(right?"bodies right":"bodies WRONG")<<endl;
+}
+
+/* void connect_each_time(port, paths)
+ * The old way.
+ */
+void connect_each_time(int port,const vector<string> &paths){
+	bool right=true;
+	int64_t start=timespec_ns(clock_now());
+	for (size_t c=0;c<paths.size();c++){
+		int fd=connect_loopback(port);
+		if (fd<0){
+			right=false;
+			break;
+		}
+		string request="GET "+paths[c]+" HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+		send_all(fd,request.data(),request.size());
+		line_reader_class reader;
+		http_response_class response;
+		string body;
+		string_view data;
+		while (!response.complete() && !response.failed() && reader.read_some(fd,data)){
+			reader.consume(response.feed(data.data(),data.size(),
+										 [&](string_view piece){ body.append(piece); }));
+		}
+		close(fd);
+		right&=response.complete() && body_right(c,body,paths);
+	}
+	int64_t ns=timespec_ns(clock_now())-start;
+	report("connect each time",paths.size(),ns,paths.size(),paths.size(),right);
+}
+
+/* void keep_alive(name, port, paths, depth, one_at_a_time)
+ * http_connection_class, with one fetch() per path or one for all.
+ */
+void keep_alive(const string &name,int port,const vector<string> &paths,size_t depth,
+				bool one_at_a_time){
+	http_connection_class connection;
+	connection.setup("localhost",[port]{ return connect_loopback(port); });
+	vector<string> bodies(paths.size());
+	size_t done=0;
+	int64_t start=timespec_ns(clock_now());
+	if (one_at_a_time){
+		for (size_t c=0;c<paths.size();c++){
+			vector<string> one={paths[c]};
+			if (connection.fetch(one,[&](size_t,string_view piece){ bodies[c].append(piece); },
+								 NULL,depth)!=1) break;
+			done++;
+		}
+	} else {
+		done=connection.fetch(paths,[&](size_t index,string_view piece){
+			bodies[index].append(piece);
+		},NULL,depth);
+	}
+	int64_t ns=timespec_ns(clock_now())-start;
+	bool right=done==paths.size();
+	for (size_t c=0;c<paths.size() && right;c++) right=body_right(c,bodies[c],paths);
+	report(name,paths.size(),ns,connection.connection_count(),connection.request_count(),right);
+}
+
+/*
+ * Main()
+ * Parameters: how many requests, and how big a body.
+ * Returns 0, or 1 if the server won't start.
+ */
+int main(int argc,char *argv[]){
+	int count=argc>1?atoi(argv[1]):5000;
+	if (count<1) count=5000;
+	if (argc>2 && atoi(argv[2])>0) body_bytes=atoi(argv[2]);
+	vector<string> paths;
+	for (int c=0;c<count;c++) paths.push_back("/page/"+to_string(c));
+
+	loopback_server_class server;
+	if (!server.start(serve)){
+		cout<<"Unable to start the server."<<endl;
+		return 1;
+	}
+	cout<<count<<" GETs of "<<body_bytes<<" byte bodies:"<<endl;
+	connect_each_time(server.port(),paths);
+	keep_alive("keep-alive",server.port(),paths,1,true);
+	keep_alive("keep-alive, one fetch()",server.port(),paths,1,false);
+	size_t depths[]={4,16};
+	for (size_t depth:depths){
+		keep_alive("pipelined, depth "+to_string(depth),server.port(),paths,depth,false);
+	}
+	max_requests=server_limit;
+	keep_alive("pipelined, server limit",server.port(),paths,8,false);
+	max_requests=1;
+	silent_hang_up=true;
+	keep_alive("silent hang-ups",server.port(),paths,1,true);
+	server.stop();
+	return 0;
+}
@@ -0,0 +1,224 @@
+ /*
+  * line_reader.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * line_reader.h
+ * Socket.cpp's read_socket() used to do one recv() into a 150 byte
+ * buffer and call whatever came back a line. TCP doesn't know about
+ * lines: a recv() gets whatever has arrived, which might be half a
+ * line or twenty of them. And it made a string out of the buffer as a
+ * C string, so a NUL in the data cut the rest off.
+ *
+ * line_reader_class reads real lines. It keeps one buffer per socket,
+ * fills it with as much as one recv() will give, and hands out the
+ * lines in it one at a time, as string_views pointing into the buffer,
+ * so nothing is copied. Only when it runs out of whole lines does it
+ * recv() again. NULs are just bytes.
+ *
+ * How it works:
+ * The buffer holds the bytes we've received and not handed out yet,
+ * from start to end. read_line() looks for a newline between start
+ * and end with memchr() (picking up where it last left off, so no byte
+ * is looked at twice), and if it finds one, the line is start to the
+ * newline, and start moves past it. If not, it moves what's left down
+ * to the front of the buffer to make room, and recv()s more on the
+ * end. If a line won't fit in the buffer at all, the buffer doubles,
+ * up to line_reader_max_bytes, past which we hand the line out in
+ * buffer sized pieces rather than let a server that never sends a
+ * newline have all our memory.
+ *
+ * A line comes without its newline, and without a carriage return
+ * before it, since HTTP ends its lines with both. The string_view is
+ * only good until the next read_line().
+ *
+ * For data that isn't lines (an HTTP body, say), read_some() hands out
+ * whatever is buffered, as it is, and consume() says how much of it
+ * you used. The rest stays buffered for the next read_line() or
+ * read_some().
+*/
+
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <vector>
+#include <string_view>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#define line_reader_bytes 4096 //to start with.
+#define line_reader_max_bytes (1<<20)
+
+/* line_reader_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * buffer			:Variable. The bytes.
+ * start, end		:Variables. The bytes we haven't handed out yet.
+ * scanned			:Variable. How far past start we've already looked
+ * 					for a newline.
+ * at_end, failed	:Variables. The socket's closed, or errored.
+ * receives, lines, bytes, grows, splits
+ * 					:Variables. The counters.
+ * -------------------------------------------------------------------
+ * fill()			:Method
+ * 					Makes room, then one recv(). Returns false at the
+ * 					end of the stream, or on an error.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * The constructor takes the size to start the buffer at,
+ * line_reader_bytes if left out.
+ * -------------------------------------------------------------------
+ * read_line()		:Method
+ * 					Takes the socket and a string_view to set. Returns
+ * 					true with the next line, or false at the end of the
+ * 					stream or on an error. A last line without a newline
+ * 					still comes back, before the false.
+ * -------------------------------------------------------------------
+ * read_some()		:Method
+ * 					Takes the socket and a string_view to set to all
+ * 					the bytes we have buffered, recv()ing first if we
+ * 					have none. Returns false at the end of the stream
+ * 					or on an error. Nothing is handed out until you
+ * 					consume() it.
+ * -------------------------------------------------------------------
+ * consume()		:Method
+ * 					Takes how many of read_some()'s bytes were used.
+ * -------------------------------------------------------------------
+ * reset()			:Method
+ * 					Forgets anything buffered, for a new connection.
+ * 					Keeps the counters and the buffer's size.
+ * -------------------------------------------------------------------
+ * error()			:Method
+ * 					True if read_line() or read_some() returned false
+ * 					on an error rather than at the end of the stream.
+ * -------------------------------------------------------------------
+ * receive_count(), line_count(), byte_count(), grow_count(),
+ * split_count(), capacity()
+ * 					:Methods. The counters, and the buffer's size now.
+ * -------------------------------------------------------------------
+ */
+class line_reader_class {
+	private:
+ // ===================================================================
+	std::vector<char> buffer;
+	size_t start=0;
+	size_t end=0;
+	size_t scanned=0;
+	bool at_end=false;
+	bool failed=false;
+	uint64_t receives=0;
+	uint64_t lines=0;
+	uint64_t bytes=0;
+	uint64_t grows=0;
+	uint64_t splits=0;
+ // -------------------------------------------------------------------
+	bool fill(int socket_fd){
+		if (start>0){ //move what's left to the front.
+			memmove(buffer.data(),buffer.data()+start,end-start);
+			end-=start;
+			start=0;
+		}
+		if (end==buffer.size()){
+			buffer.resize(buffer.size()*2);
+			grows++;
+		}
+		ssize_t got;
+		do {
+			got=recv(socket_fd,buffer.data()+end,buffer.size()-end,0);
+		} while (got<0 && errno==EINTR);
+		receives++;
+		if (got<=0){
+			at_end=true;
+			failed=got<0;
+			return false;
+		}
+		end+=got;
+		bytes+=got;
+		return true;
+	};
+ // -------------------------------------------------------------------
+	void hand_out(std::string_view &line,size_t length,size_t next){
+		line=std::string_view(buffer.data()+start,length);
+		if (length>0 && line.back()=='\r') line.remove_suffix(1);
+		start=next;
+		scanned=0;
+		lines++;
+	};
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	line_reader_class(size_t size=line_reader_bytes):buffer(size>0?size:1){};
+ // -------------------------------------------------------------------
+	bool read_line(int socket_fd,std::string_view &line){
+		while (true){
+			const char *newline=(const char *)memchr(buffer.data()+start+scanned,'\n',
+													  end-start-scanned);
+			if (newline!=NULL){
+				size_t length=newline-(buffer.data()+start);
+				hand_out(line,length,start+length+1);
+				return true;
+			}
+			scanned=end-start;
+			if (at_end){
+				if (start==end) return false;
+				hand_out(line,end-start,end); //the last line, with no newline.
+				return true;
+			}
+			if (start==0 && end==buffer.size() && buffer.size()>=line_reader_max_bytes){
+				splits++;
+				hand_out(line,end,end); //too long. Here's what we have.
+				return true;
+			}
+			fill(socket_fd);
+		}
+	};
+ // -------------------------------------------------------------------
+	bool read_some(int socket_fd,std::string_view &data){
+		if (start==end && (at_end || !fill(socket_fd))) return false;
+		data=std::string_view(buffer.data()+start,end-start);
+		return true;
+	};
+ // -------------------------------------------------------------------
+	void consume(size_t count){
+		start+=count<end-start?count:end-start;
+		scanned=0;
+	};
+ // -------------------------------------------------------------------
+	void reset(void){
+		start=end=scanned=0;
+		at_end=failed=false;
+	};
+ // -------------------------------------------------------------------
+	bool error(void){ return failed; };
+	uint64_t receive_count(void){ return receives; };
+	uint64_t line_count(void){ return lines; };
+	uint64_t byte_count(void){ return bytes; };
+	uint64_t grow_count(void){ return grows; };
+	uint64_t split_count(void){ return splits; };
+	size_t capacity(void){ return buffer.size(); };
+}; //end of line_reader_class
+
+#endif
@@ -0,0 +1,198 @@
+ /*
+  * line_reader_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * line_reader_bench
+ * Reads the same text from a loopback_server_class the old way and
+ * with line_reader_class, and prints for each how many recv()s it took
+ * a line, how fast it went, and whether the lines that came out were
+ * the lines that went in.
+ *
+ * The text is seeded random lines: mostly up to 120 bytes, one in a
+ * thousand 5 to 20KB, half ending in a carriage return and newline and
+ * half in just a newline, and one byte in 500 a NUL. Then:
+ * 		recv per line	Socket.cpp's old read_socket(): one recv() of
+ * 						149 bytes is a "line", made into a string as a C
+ * 						string. We count the "lines" it thinks it read,
+ * 						and the bytes its strings lost at NULs.
+ * 		line_reader		line_reader_class, starting at 256 bytes, 4KB
+ * 						(line_reader_bytes) and 64KB. The small one has
+ * 						to grow for the long lines.
+ * Lines are checked by hashing them all, in order, against a hash of
+ * the lines we sent.
+ *
+ * Usage: line_reader_bench [megabytes]
+ * 8 megabytes if left out.
+ * Compile with:
+ * 		g++ -O2 -o line_reader_bench line_reader_bench.cpp -lpthread
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include "line_reader.h"
+#include "loopback_server.h"
+#include "../frame_clock/frame_clock.h"
+
+#define old_buffer_length 150 //Socket.cpp's buffer_length.
+#define send_chunk 65536
+
+using namespace std;
+
+string payload; //what the server sends.
+uint64_t payload_lines=0;
+uint64_t payload_hash=0;
+
+/* uint32_t next_random()
+ * xorshift32. Seeded, so every run gets the same text.
+ */
+uint32_t random_state=2463534242u;
+uint32_t next_random(){
+	random_state^=random_state<<13;
+	random_state^=random_state>>17;
+	random_state^=random_state<<5;
+	return random_state;
+}
+
+/* void hash_line(uint64_t &hash, const char *data, size_t length)
+ * FNV-1a over the line and a newline, so the hash of all the lines
+ * also says where they split.
+ */
+void hash_line(uint64_t &hash,const char *data,size_t length){
+	for (size_t c=0;c<length;c++){
+		hash=(hash^(uint8_t)data[c])*1099511628211ULL;
+	}
+	hash=(hash^'\n')*1099511628211ULL;
+}
+
+/* void make_payload(size_t bytes)
+ * The text, and the count and hash of its lines, without their line
+ * ends.
+ */
+void make_payload(size_t bytes){
+	payload_hash=14695981039346656037ULL;
+	while (payload.size()<bytes){
+		size_t length=next_random()%1000==0?5000+next_random()%15000:next_random()%121;
+		size_t start=payload.size();
+		for (size_t c=0;c<length;c++){
+			payload+=next_random()%500==0?'\0':(char)(' '+next_random()%95);
+		}
+		hash_line(payload_hash,payload.data()+start,length);
+		payload+=next_random()%2?"\r\n":"\n";
+		payload_lines++;
+	}
+}
+
+/* void serve(int client)
+ * Sends the whole text, in send_chunk pieces, and hangs up.
+ */
+void serve(int client){
+	for (size_t at=0;at<payload.size();at+=send_chunk){
+		if (!send_all(client,payload.data()+at,min((size_t)send_chunk,payload.size()-at))) return;
+	}
+}
+
+/* void report(name, lines, receives, bytes, ns, correct, note)
+ * One line of results.
+ */
+void report(const string &name,uint64_t lines,uint64_t receives,uint64_t bytes,
+			int64_t ns,bool correct,const string &note){
+	cout<<left<<setw(22)<<name<<right<<setw(9)<<lines<<" lines, "<<fixed<<setprecision(3)
+		<<setw(7)<<(double)receives/payload_lines<<" recv()s a line, "<<setprecision(1)
+		<<setw(7)<<bytes/(ns/1e9)/1e6<<" MB/s, "<<(correct?"lines right":"lines WRONG")
+		<<note<<endl;
+}
+
+/* void old_way(int port)
+ * Socket.cpp's old read_socket(), until the server hangs up.
+ */
+void old_way(int port){
+	int fd=connect_loopback(port);
+	if (fd<0){
+		cout<<"Unable to connect."<<endl;
+		return;
+	}
+	uint64_t said_lines=0,receives=0,bytes=0,kept=0;
+	int64_t start=timespec_ns(clock_now());
+	while (true){
+		char from_server[old_buffer_length]="";
+		int got=recv(fd,from_server,old_buffer_length-1,0);
+		receives++;
+		if (got<=0) break;
+		said_lines++;
+		bytes+=got;
+		kept+=string(from_server).size();
+	}
+	int64_t ns=timespec_ns(clock_now())-start;
+	close(fd);
+	report("recv per line",said_lines,receives,bytes,ns,false,
+		   ", "+to_string(bytes-kept)+" bytes lost at NULs");
+}
+
+/* void new_way(int port, size_t size)
+ * line_reader_class starting at size bytes, until the server hangs up.
+ */
+void new_way(int port,size_t size){
+	int fd=connect_loopback(port);
+	if (fd<0){
+		cout<<"Unable to connect."<<endl;
+		return;
+	}
+	line_reader_class reader(size);
+	uint64_t hash=14695981039346656037ULL;
+	string_view line;
+	int64_t start=timespec_ns(clock_now());
+	while (reader.read_line(fd,line)) hash_line(hash,line.data(),line.size());
+	int64_t ns=timespec_ns(clock_now())-start;
+	close(fd);
+	bool correct=hash==payload_hash && reader.line_count()==payload_lines && !reader.error();
+	report("line_reader "+to_string(size),reader.line_count(),reader.receive_count(),
+		   reader.byte_count(),ns,correct,", grew "+to_string(reader.grow_count())
+		   +" times to "+to_string(reader.capacity()));
+}
+
+/*
+ * Main()
+ * Parameters: megabytes of text.
+ * Returns 0, or 1 if the server won't start.
+ */
+int main(int argc,char *argv[]){
+	int megabytes=argc>1?atoi(argv[1]):8;
+	if (megabytes<1) megabytes=8;
+	make_payload((size_t)megabytes<<20);
+	cout<<payload.size()<<" bytes, "<<payload_lines<<" lines."<<endl;
+
+	loopback_server_class server;
+	if (!server.start(serve)){
+		cout<<"Unable to start the server."<<endl;
+		return 1;
+	}
+	old_way(server.port());
+	new_way(server.port(),256);
+	new_way(server.port(),line_reader_bytes);
+	new_way(server.port(),65536);
+	server.stop();
+	return 0;
+}
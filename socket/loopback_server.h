@@ -0,0 +1,189 @@
+ /*
+  * loopback_server.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * loopback_server.h
+ * A stand-in for the web server Socket.cpp talks to, for the socket
+ * benchmarks. It listens on 127.0.0.1, on a port the kernel picks, and
+ * on a thread of its own accepts connections one at a time and hands
+ * each to a function you give it, which does whatever the benchmark
+ * needs (sends a canned response, say) and returns. Then we close the
+ * connection and wait for the next.
+ *
+ * Since connections are served one at a time, a benchmark that wants
+ * several at once has to start several servers.
+*/
+
+#ifndef LOOPBACK_SERVER_H
+#define LOOPBACK_SERVER_H
+
+#include <atomic>
+#include <functional>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define loopback_backlog 64
+
+/* bool send_all(int fd, const char *data, size_t length)
+ * send()s until it's all gone. Returns false if the socket fails.
+ */
+inline bool send_all(int fd,const char *data,size_t length){
+	while (length>0){
+		ssize_t sent=send(fd,data,length,MSG_NOSIGNAL);
+		if (sent<0 && errno==EINTR) continue;
+		if (sent<=0) return false;
+		data+=sent;
+		length-=sent;
+	}
+	return true;
+}
+
+/* int connect_loopback(int port)
+ * A blocking TCP socket connected to 127.0.0.1:port, or -1.
+ */
+inline int connect_loopback(int port){
+	int fd=socket(AF_INET,SOCK_STREAM | SOCK_CLOEXEC,0);
+	if (fd<0) return -1;
+	sockaddr_in address;
+	memset(&address,0,sizeof(address));
+	address.sin_family=AF_INET;
+	address.sin_port=htons(port);
+	address.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+	if (connect(fd,(sockaddr *)&address,sizeof(address))<0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* loopback_server_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * listener			:Variable. The listening socket.
+ * listen_port		:Variable. The port it got.
+ * serve			:Variable. The function that handles a connection.
+ * running			:Variable. The thread stops when this goes false.
+ * thread			:Variable. The thread.
+ * served			:Variable. Connections handled.
+ * -------------------------------------------------------------------
+ * run()			:Static Method
+ * 					The thread. Waits for a connection (or 50ms, to
+ * 					check running), and serves it.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * start()			:Method
+ * 					Takes the function to hand each connection to.
+ * 					Listens, and starts the thread. Returns false if it
+ * 					couldn't.
+ * -------------------------------------------------------------------
+ * port()			:Method. The port to connect to.
+ * -------------------------------------------------------------------
+ * serve_count()	:Method. How many connections we've handled.
+ * -------------------------------------------------------------------
+ * stop()			:Method
+ * 					Stops the thread after the connection it's on, and
+ * 					closes the listener.
+ * -------------------------------------------------------------------
+ */
+class loopback_server_class {
+	private:
+ // ===================================================================
+	int listener=-1;
+	int listen_port=0;
+	std::function<void(int)> serve;
+	std::atomic<bool> running{false};
+	pthread_t thread;
+	std::atomic<uint64_t> served{0};
+ // -------------------------------------------------------------------
+	static void *run(void *self_pointer){
+		loopback_server_class &self=*(loopback_server_class *)self_pointer;
+		while (self.running){
+			pollfd waiting={self.listener,POLLIN,0};
+			if (poll(&waiting,1,50)<=0) continue;
+			int client=accept(self.listener,NULL,NULL);
+			if (client<0) continue;
+			int yes=1;
+			setsockopt(client,IPPROTO_TCP,TCP_NODELAY,&yes,sizeof(yes));
+			self.serve(client);
+			close(client);
+			self.served++;
+		}
+		return NULL;
+	};
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	bool start(std::function<void(int)> handler){
+		if (running) return false;
+		listener=socket(AF_INET,SOCK_STREAM | SOCK_CLOEXEC,0);
+		if (listener<0) return false;
+		sockaddr_in address;
+		memset(&address,0,sizeof(address));
+		address.sin_family=AF_INET;
+		address.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+		socklen_t length=sizeof(address);
+		if (bind(listener,(sockaddr *)&address,sizeof(address))<0 ||
+			listen(listener,loopback_backlog)<0 ||
+			getsockname(listener,(sockaddr *)&address,&length)<0){
+			close(listener);
+			listener=-1;
+			return false;
+		}
+		listen_port=ntohs(address.sin_port);
+		serve=handler;
+		running=true;
+		if (pthread_create(&thread,NULL,run,this)!=0){
+			running=false;
+			close(listener);
+			listener=-1;
+			return false;
+		}
+		return true;
+	};
+ // -------------------------------------------------------------------
+	int port(void){ return listen_port; };
+	uint64_t serve_count(void){ return served; };
+ // -------------------------------------------------------------------
+	void stop(void){
+		if (!running) return;
+		running=false;
+		pthread_join(thread,NULL);
+		close(listener);
+		listener=-1;
+	};
+ // -------------------------------------------------------------------
+	~loopback_server_class(){
+		stop();
+	};
+}; //end of loopback_server_class
+
+#endif
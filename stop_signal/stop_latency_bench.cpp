@@ -0,0 +1,197 @@
+ /*
+  * stop_latency_bench.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * stop_latency_bench
+ * How long is it from SIGINT to every LED being off? This program
+ * runs the two eyes of Larson_pthread against the file-backed GPIO
+ * stand-in, sends itself SIGINT at a random moment, and times how long
+ * it takes until both eyes have stopped and the LEDs are off. It does
+ * that a number of times each for two ways of stopping:
+ * 		polled		the old way: a signal handler locks a mutex and
+ * 					clears running, and each eye checks running with
+ * 					pthread_mutex_trylock once per sweep, sleeping in
+ * 					delay() in between.
+ * 		stop_signal	stop_signal_class: no handler, SIGINT comes in on a
+ * 					signalfd, and every eye's sleep is cut short.
+ * and prints the fastest, median and slowest for each.
+ *
+ * Usage: stop_latency_bench [trials] [stand-in file]
+ * Defaults are 10 trials and /tmp/gpiomem. The polled trials take
+ * about half a sweep (400ms) each, so be patient.
+ * Compile with:
+ * 		g++ -O2 -o stop_latency_bench stop_latency_bench.cpp -lpthread
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm> //sort().
+#include <csignal>
+#include <stdlib.h>
+#include <pthread.h>
+#include "stop_signal.h"
+#include "../gpio_mmap/gpio_mmap.h"
+#include "../larson/larson_frames.h"
+#include "../frame_clock/frame_clock.h"
+
+#define LEDs 20
+#define delaymils 40
+
+using namespace std;
+
+constexpr int pins[LEDs]={2,3,4,14,15,18,17,27,22,23,24,10,9,11,25,8,7,1,0,5};
+constexpr larson_table low_table=make_larson_table(pins,0,LEDs/2);
+constexpr larson_table high_table=make_larson_table(pins,LEDs/2,LEDs);
+gpio_register_class gpio;
+
+volatile bool running=true; //for the polled eyes.
+pthread_mutex_t running_lock;
+stop_signal_class *stop_signal=NULL; //for the stop_signal eyes.
+
+/* SIGINT_handler
+ * The old handler, mutex and all.
+ */
+void SIGINT_handler(int signal_number){
+	pthread_mutex_lock(&running_lock);
+	running=false;
+	pthread_mutex_unlock(&running_lock);
+}
+
+/* void *polled_eye(void *vp) and void *signal_eye(void *vp)
+ * One eye each way. vp points at the eye's larson_table.
+ * polled_eye is scan() as it was before stop_signal: a frame, a
+ * delay, and a trylock on running_lock at the end of every sweep.
+ * signal_eye is scan() as it is now.
+ */
+void *polled_eye(void *vp){
+	const larson_table &table=*(const larson_table *)vp;
+	bool local_running=true;
+	int c=0;
+	while(local_running){
+		gpio.write_leds(table.frames[c],table.all_mask);
+		usleep(delaymils*1000);
+		if (++c==table.length){
+			c=0;
+			if (!pthread_mutex_trylock(&running_lock)){
+				local_running=running;
+				pthread_mutex_unlock(&running_lock);
+			}
+		}
+	}
+	return(NULL);
+}
+
+void *signal_eye(void *vp){
+	const larson_table &table=*(const larson_table *)vp;
+	frame_clock_class frame_clock;
+	int c=0;
+	frame_clock.start(delaymils);
+	while(true){
+		gpio.write_leds(table.frames[c],table.all_mask);
+		if (!frame_clock.wait(stop_signal)) break;
+		if (++c==table.length) c=0;
+	}
+	return(NULL);
+}
+
+/* int64_t trial(bool polled)
+ * Start two eyes, let them run somewhere between 0 and one sweep, send
+ * ourselves SIGINT, and wait for both eyes. Then switch the LEDs off.
+ * Returns the time from kill() to LEDs off, in ns.
+ */
+int64_t trial(bool polled){
+	pthread_t lower_thread,upper_thread;
+	void *(*eye)(void *)=polled?polled_eye:signal_eye;
+
+	running=true;
+	if (!polled){
+		stop_signal=new stop_signal_class;
+		stop_signal->setup();
+	}
+	pthread_create(&lower_thread,NULL,eye,(void *)&low_table);
+	pthread_create(&upper_thread,NULL,eye,(void *)&high_table);
+
+	usleep(rand()%(low_table.length*delaymils*1000));
+
+	int64_t start=timespec_ns(clock_now());
+	kill(getpid(),SIGINT);
+	pthread_join(lower_thread,NULL);
+	pthread_join(upper_thread,NULL);
+	gpio.write_leds(0,low_table.all_mask|high_table.all_mask);
+	int64_t elapsed=timespec_ns(clock_now())-start;
+
+	if (!polled){
+		delete stop_signal;
+		stop_signal=NULL;
+	}
+	return elapsed;
+}
+
+/* void report(string name, vector<int64_t> &times)
+ * Sort the times and print the fastest, median and slowest, in us.
+ */
+void report(string name,vector<int64_t> &times){
+	sort(times.begin(),times.end());
+	cout<<name<<": min "<<times.front()/1000<<"us, median "
+		<<times[times.size()/2]/1000<<"us, max "<<times.back()/1000
+		<<"us SIGINT to LEDs off."<<endl;
+}
+
+/*
+ * Main()
+ * Map the stand-in, set up the pins, and run the polled trials with the
+ * old signal handler installed. Then run the stop_signal trials. Those
+ * block SIGINT for good, so they have to come second.
+ */
+int main(int argc,char *argv[]){
+	int trials=10;
+	const char *path="/tmp/gpiomem";
+	if (argc>1) trials=atoi(argv[1]);
+	if (argc>2) path=argv[2];
+	if (trials<1) trials=1;
+
+	if (!gpio.setup(path)){
+		cout<<"Unable to map "<<path<<". Exiting."<<endl;
+		return 1;
+	}
+	for (int c=0;c<LEDs;c++){
+		gpio.output_mode(pins[c]);
+	}
+	pthread_mutex_init(&running_lock,NULL);
+
+	vector<int64_t> polled_times;
+	vector<int64_t> signal_times;
+
+	signal(SIGINT,SIGINT_handler);
+	for (int t=0;t<trials;t++){
+		polled_times.push_back(trial(true));
+	}
+	for (int t=0;t<trials;t++){
+		signal_times.push_back(trial(false));
+	}
+
+	report("polled     ",polled_times);
+	report("stop_signal",signal_times);
+	return 0;
+}
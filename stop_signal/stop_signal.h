@@ -0,0 +1,236 @@
+ /*
+  * stop_signal.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * stop_signal.h
+ * The threaded scanners used to stop like this: the SIGINT handler
+ * locked a mutex and set running false, and each thread checked
+ * running once per sweep. That has two problems. Locking a mutex in a
+ * signal handler isn't safe (if the signal lands while the thread it
+ * interrupted holds the lock, it waits forever). And a thread asleep
+ * in delay() doesn't notice anything until it wakes up and finishes
+ * its sweep, which can be most of a second.
+ *
+ * stop_signal_class fixes both. We don't use a signal handler at all.
+ * Instead, setup() blocks SIGINT and SIGTERM and asks the kernel to
+ * deliver them through a signalfd, a file descriptor that becomes
+ * readable when one arrives. It also creates an eventfd, a file
+ * descriptor we can make readable ourselves. Threads sleep in ppoll()
+ * on both, with a timeout, instead of in delay(). So:
+ * 		a signal wakes up whichever thread is watching,
+ * 		that thread calls stop(), which sets an atomic flag and writes
+ * 		to the eventfd,
+ * 		we never read the eventfd, so it stays readable, and every
+ * 		other thread's ppoll() returns at once.
+ * Nothing locks anything, and nobody sleeps through the stop.
+ *
+ * Call setup() in main() BEFORE creating any threads. Threads inherit
+ * their creator's signal mask, and if any thread has SIGINT unblocked,
+ * the kernel may hand the signal to it instead of the signalfd.
+*/
+
+#ifndef STOP_SIGNAL_H
+#define STOP_SIGNAL_H
+
+#include <atomic> //std::atomic, for the flag.
+#include <stdint.h>
+#include <signal.h>
+#include <poll.h> //ppoll().
+#include <time.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+
+#define stop_poll_limit_ns 3600000000000LL //an hour. Keeps a 32 bit time_t happy.
+
+/* stop_signal_class declaration
+ * -------------------------------------------------------------------
+ * Private members:
+ * ===================================================================
+ * stopping			:Variable. std::atomic<bool>, true once we've been
+ * 					told to stop. Safe to read from any thread without
+ * 					a lock.
+ * stop_time		:Variable. CLOCK_MONOTONIC, in ns, when stop()
+ * 					was first called. For SIGINT, that's when we read
+ * 					it from the signalfd, not when it was sent: the
+ * 					kernel doesn't timestamp signals, so the time it
+ * 					took to wake us isn't in here. stop_latency_bench
+ * 					stamps the time on the sending side, and counts it.
+ * signal_fd		:Variable. The signalfd for SIGINT and SIGTERM.
+ * event_fd			:Variable. The eventfd we use to wake everybody.
+ * -------------------------------------------------------------------
+ * Public members:
+ * ===================================================================
+ * setup()			:Method
+ * 					Blocks SIGINT and SIGTERM in this thread (and so
+ * 					in every thread it creates after), and creates the
+ * 					two file descriptors. Returns false if it couldn't.
+ * -------------------------------------------------------------------
+ * stop()			:Method
+ * 					Sets stopping, records the time if we weren't
+ * 					already stopping, and writes the eventfd. Safe to
+ * 					call from any thread, any number of times.
+ * -------------------------------------------------------------------
+ * stop_requested()	:Method
+ * 					Returns stopping. Cheap enough to call every frame.
+ * -------------------------------------------------------------------
+ * sleep_until()	:Method
+ * 					Takes a deadline in ns of CLOCK_MONOTONIC. Returns
+ * 					true when the deadline comes, or false as soon as
+ * 					we're told to stop, whichever is first.
+ * How it works:
+ * ------------
+ * Loop:
+ * 		If stopping is set, return false.
+ * 		Work out how long until the deadline. If it's passed, return
+ * 		true.
+ * 		ppoll() on the signalfd and the eventfd for that long.
+ * 		If the signalfd is readable, read the signal (so it's used up)
+ * 		and call stop().
+ * 		If the eventfd is readable, somebody else called stop().
+ * Since we work out the time left from the deadline on every pass,
+ * waking early for any reason doesn't make us late.
+ * -------------------------------------------------------------------
+ * check()			:Method
+ * 					Looks for a signal without sleeping, and returns
+ * 					true if we've been told to stop. stop_requested()
+ * 					only sees a signal once somebody has read it, so a
+ * 					loop that never sleeps calls this now and then.
+ * -------------------------------------------------------------------
+ * wait()			:Method
+ * 					sleep_until() forever. Returns when we're told to
+ * 					stop.
+ * -------------------------------------------------------------------
+ * stop_time_ns()	:Method
+ * 					Returns when stop() was first called, in ns, or 0.
+ * 					Measuring from here leaves out the wakeup: see
+ * 					stop_time.
+ * -------------------------------------------------------------------
+ */
+class stop_signal_class {
+	private:
+ // ===================================================================
+	std::atomic<bool> stopping{false};
+	std::atomic<int64_t> stop_time{0};
+	int signal_fd=-1;
+	int event_fd=-1;
+ // -------------------------------------------------------------------
+	static int64_t now_ns(){
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		return (int64_t)now.tv_sec*1000000000LL+now.tv_nsec;
+	}
+ // -------------------------------------------------------------------
+	public:
+ // ===================================================================
+	bool setup(void){
+		sigset_t stop_signals;
+		sigemptyset(&stop_signals);
+		sigaddset(&stop_signals,SIGINT);
+		sigaddset(&stop_signals,SIGTERM);
+		if (pthread_sigmask(SIG_BLOCK,&stop_signals,NULL)) return false;
+
+		signal_fd=signalfd(-1,&stop_signals,SFD_NONBLOCK|SFD_CLOEXEC);
+		event_fd=eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+		return signal_fd>=0 && event_fd>=0;
+	};
+ // -------------------------------------------------------------------
+	void stop(void){
+		int64_t never=0;
+		stop_time.compare_exchange_strong(never,now_ns()); //first one wins.
+		stopping.store(true,std::memory_order_release);
+		uint64_t one=1;
+		if (write(event_fd,&one,sizeof(one))<0){
+			//the counter is full, so it's readable already. Fine.
+		}
+	};
+ // -------------------------------------------------------------------
+	bool stop_requested(void){
+		return stopping.load(std::memory_order_acquire);
+	};
+ // -------------------------------------------------------------------
+	bool sleep_until(int64_t deadline){
+		pollfd fds[2];
+		fds[0].fd=signal_fd;
+		fds[0].events=POLLIN;
+		fds[1].fd=event_fd;
+		fds[1].events=POLLIN;
+
+		while (!stop_requested()){
+			int64_t remaining=deadline-now_ns();
+			if (remaining<=0) return true;
+			if (remaining>stop_poll_limit_ns) remaining=stop_poll_limit_ns;
+
+			timespec timeout;
+			timeout.tv_sec=remaining/1000000000LL;
+			timeout.tv_nsec=remaining%1000000000LL;
+			if (ppoll(fds,2,&timeout,NULL)<=0) continue; //timeout or EINTR.
+
+			if (fds[0].revents & POLLIN){
+				signalfd_siginfo info;
+				if (read(signal_fd,&info,sizeof(info))==sizeof(info)) stop();
+			}
+			if (fds[1].revents & POLLIN){
+				stopping.store(true,std::memory_order_release);
+			}
+		}
+		return false;
+	};
+ // -------------------------------------------------------------------
+	bool check(void){
+		pollfd fds[2];
+		fds[0].fd=signal_fd;
+		fds[0].events=POLLIN;
+		fds[1].fd=event_fd;
+		fds[1].events=POLLIN;
+		timespec no_wait={0,0};
+		if (!stop_requested() && ppoll(fds,2,&no_wait,NULL)>0){
+			if (fds[0].revents & POLLIN){
+				signalfd_siginfo info;
+				if (read(signal_fd,&info,sizeof(info))==sizeof(info)) stop();
+			}
+			if (fds[1].revents & POLLIN){
+				stopping.store(true,std::memory_order_release);
+			}
+		}
+		return stop_requested();
+	};
+ // -------------------------------------------------------------------
+	void wait(void){
+		while (sleep_until(INT64_MAX)){
+			//sleep_until only returns true at the deadline. Not soon.
+		}
+	};
+ // -------------------------------------------------------------------
+	int64_t stop_time_ns(void){
+		return stop_time.load();
+	};
+ // -------------------------------------------------------------------
+	~stop_signal_class(){
+		if (signal_fd>=0) close(signal_fd);
+		if (event_fd>=0) close(event_fd);
+	};
+ // -------------------------------------------------------------------
+}; //end of stop_signal_class
+
+#endif
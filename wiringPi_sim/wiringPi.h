@@ -0,0 +1,87 @@
+ /*
+  * wiringPi.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * wiringPi.h (simulated)
+ * This is NOT the real wiringPi.h. It declares the part of wiringPi
+ * that the programs in this archive use, with the same names, values
+ * and signatures, so that any of them can be built off the Pi against
+ * wiringPi_sim.cpp instead of the real library. Put this directory
+ * ahead of the system include path and swap -lwiringPi for the .cpp:
+ * 		g++ -O2 -I../wiringPi_sim -o larson larson.cpp \
+ * 			../wiringPi_sim/wiringPi_sim.cpp -lpthread
+ *
+ * To script inputs or look at what the outputs did, include
+ * wiringPi_sim.h as well. See wiringPi_sim.cpp for how the simulation
+ * works.
+*/
+
+#ifndef WIRINGPI_SIM_WIRINGPI_H
+#define WIRINGPI_SIM_WIRINGPI_H
+
+#define LOW 0
+#define HIGH 1
+
+#define INPUT 0
+#define OUTPUT 1
+
+#define PUD_OFF 0
+#define PUD_DOWN 1
+#define PUD_UP 2
+
+#define INT_EDGE_SETUP 0
+#define INT_EDGE_FALLING 1
+#define INT_EDGE_RISING 2
+#define INT_EDGE_BOTH 3
+
+#ifndef TRUE
+#define TRUE (1==1)
+#define FALSE (!TRUE)
+#endif
+
+#define PI_THREAD(X) void *X(void *dummy)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int wiringPiSetup(void);
+int wiringPiSetupGpio(void);
+void pinMode(int pin,int mode);
+void pullUpDnControl(int pin,int pud);
+void digitalWrite(int pin,int value);
+int digitalRead(int pin);
+int wiringPiISR(int pin,int mode,void (*function)(void));
+void piLock(int key);
+void piUnlock(int key);
+int piThreadCreate(void *(*fn)(void *));
+void delay(unsigned int howLong);
+void delayMicroseconds(unsigned int howLong);
+unsigned int millis(void);
+unsigned int micros(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
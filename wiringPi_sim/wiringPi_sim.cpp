@@ -0,0 +1,546 @@
+ /*
+  * wiringPi_sim.cpp
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * wiringPi_sim.cpp
+ * A pretend Raspberry Pi, just big enough for the programs in this
+ * archive. It implements the wiringPi calls they make (see wiringPi.h
+ * in this directory) on top of an array of simulated pins:
+ * 		digitalWrite() sets a pin's output level, and if the level
+ * 		changed, records the transition with a nanosecond timestamp.
+ * 		digitalRead() returns an output pin's level, or an input pin's
+ * 		level, which comes from its pull resistor until a script says
+ * 		otherwise.
+ * 		wiringPiISR() registers a function to call when a scripted
+ * 		input makes the right edge.
+ * 		piLock(), piUnlock() and piThreadCreate() are the same thin
+ * 		wrappers around pthreads that wiringPi has.
+ * 		delay(), delayMicroseconds(), millis() and micros() use the
+ * 		simulation's clock.
+ * Pin numbers are always BCM numbers, whichever setup you call.
+ *
+ * The clock runs in one of two modes:
+ * 		real time		the clock is CLOCK_MONOTONIC, and delay()
+ * 						really sleeps. Scripted inputs happen on time
+ * 						even if nobody calls us; a background thread
+ * 						waits for each one and calls its ISR, just like
+ * 						wiringPi's own interrupt thread. Like wiringPi,
+ * 						it only knows that a pin has had an edge since
+ * 						it last looked, not how many: edges that come
+ * 						while an ISR is still running, or before it gets
+ * 						its turn, become one call.
+ * 		virtual time	delay() doesn't sleep. It moves the clock on and
+ * 						returns at once, so a program that spends all
+ * 						its time in delay() runs as fast as the CPU can
+ * 						go, and everything that isn't delay() is what's
+ * 						left to profile. Scripted inputs happen when the
+ * 						clock passes them, and their ISRs are called
+ * 						right there, from inside delay().
+ * In virtual time, each thread has its own clock, which starts at the
+ * latest time any thread has reached, and delay() moves just that
+ * thread's clock on. So two threads that each delay(40) ten times both
+ * end up at 400ms, not one of them at 800ms. Timestamps and millis()
+ * come from the calling thread's clock.
+ *
+ * Everything is protected by one mutex. That's much slower than the
+ * real digitalWrite(), but it's the same for every program, so it
+ * doesn't change which of two loops is faster.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdlib.h>
+#include <stdio.h> //sscanf().
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h> //_exit().
+#include "wiringPi_sim.h"
+
+#define sim_pin_count 64
+#define sim_lock_count 4 //piLock() keys 0 to 3, like wiringPi.
+#define sim_trace_limit (1<<20) //transitions kept. The oldest go first.
+
+/* sim_pin
+ * -------------------------------------------------------------------
+ * mode			INPUT or OUTPUT.
+ * output		the level we're driving, or -1 if we never have.
+ * input		the level on the pin when it's an input.
+ * scripted		true once a script has set input, after which the pull
+ * 				resistor doesn't.
+ * isr, isr_edge
+ * 				the function wiringPiISR() gave us, and which edges
+ * 				to call it on.
+ * isr_pending	real time only. An edge has come that the input thread
+ * 				hasn't called isr for yet.
+ * -------------------------------------------------------------------
+ */
+struct sim_pin {
+	int mode;
+	int output;
+	int input;
+	bool scripted;
+	void (*isr)(void);
+	int isr_edge;
+	bool isr_pending;
+};
+
+/*
+ * The simulation's state. All of it is guarded by sim_lock, except the
+ * clocks and the write counter, which are atomic or per thread.
+ * The trace is a ring: once it holds sim_trace_limit transitions, each
+ * new one replaces the oldest, at trace_start. Like script_changed, 
+ * it's never destroyed, so a thread that's still running while the 
+ * program exits can't write into a vector that's gone.
+ */
+static std::mutex sim_lock;
+static std::condition_variable &script_changed= //wakes the input thread.
+	*new std::condition_variable; //never destroyed: exit() would wait for the input thread.
+static sim_pin pins[sim_pin_count];
+static std::vector<sim_transition> &trace=*new std::vector<sim_transition>;
+static size_t trace_start=0; //the oldest, once the ring is full.
+static uint64_t trace_dropped=0;
+static uint64_t trace_recorded=0; //every transition ever, kept or not.
+static std::multimap<int64_t,std::pair<int,int>> script; //at_ns to (pin, level).
+static bool set_up=false;
+static bool time_mode_chosen=false;
+static bool virtual_time=false;
+static std::atomic<int64_t> virtual_ns{0}; //the latest any thread has got to.
+static thread_local int64_t thread_ns=-1; //this thread's virtual clock.
+static std::atomic<uint64_t> writes{0};
+static uint64_t isr_calls=0;
+static uint64_t isr_coalesced=0; //edges that didn't get a call of their own.
+static int64_t stop_after_ns=-1;
+static const char *trace_path=NULL;
+static pthread_mutex_t pi_locks[sim_lock_count]={
+	PTHREAD_MUTEX_INITIALIZER,PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_MUTEX_INITIALIZER,PTHREAD_MUTEX_INITIALIZER};
+
+/* int64_t monotonic_ns()
+ * CLOCK_MONOTONIC in ns. epoch_ns is when we were loaded, which is as
+ * good as when the program started.
+ */
+static int64_t monotonic_ns(){
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (int64_t)now.tv_sec*1000000000LL+now.tv_nsec;
+}
+static const int64_t epoch_ns=monotonic_ns();
+
+/* int64_t sim_now_ns()
+ * Real time: ns since epoch_ns. Virtual time: this thread's clock,
+ * which starts at virtual_ns the first time the thread asks.
+ */
+int64_t sim_now_ns(){
+	if (!virtual_time) return monotonic_ns()-epoch_ns;
+	if (thread_ns<0) thread_ns=virtual_ns.load();
+	return thread_ns;
+}
+
+/* void record(sim_transition transition)
+ * Call with sim_lock held. Adds a transition to the trace, replacing
+ * the oldest if it's full.
+ */
+static void record(const sim_transition &transition){
+	trace_recorded++;
+	if (trace.size()<sim_trace_limit){
+		trace.push_back(transition);
+		return;
+	}
+	trace[trace_start]=transition;
+	trace_start=(trace_start+1)%sim_trace_limit;
+	trace_dropped++;
+}
+
+/* std::vector<sim_transition> ordered_trace()
+ * Call with sim_lock held. The trace, oldest first.
+ */
+static std::vector<sim_transition> ordered_trace(){
+	std::vector<sim_transition> copy(trace.begin()+trace_start,trace.end());
+	copy.insert(copy.end(),trace.begin(),trace.begin()+trace_start);
+	return copy;
+}
+
+/* bool write_transitions(path, transitions)
+ * Writes transitions to path, one "ns,pin,level" line each.
+ */
+static bool write_transitions(const char *path,const std::vector<sim_transition> &transitions){
+	std::ofstream file(path);
+	if (!file.is_open()) return false;
+	for (size_t c=0;c<transitions.size();c++){
+		file<<transitions[c].ns<<","<<transitions[c].pin<<","<<transitions[c].level<<"\n";
+	}
+	return file.good();
+}
+
+/* void apply_script(int64_t now, isrs)
+ * Call with sim_lock held. Apply every scripted input that's due by
+ * now, in order. Each one that changes a pin is recorded, with the
+ * time it was scripted for. If that pin has an ISR for that edge, then
+ * in virtual time the ISR goes on the isrs list, once per edge. In real
+ * time, the pin is marked isr_pending for the input thread, and if it
+ * was already pending, the edge is coalesced into the call that's
+ * already coming. Returns true if it marked anything pending.
+ */
+static bool apply_script(int64_t now,std::vector<void (*)(void)> &isrs){
+	bool marked=false;
+	while (!script.empty() && script.begin()->first<=now){
+		int64_t at=script.begin()->first;
+		int pin=script.begin()->second.first;
+		int level=script.begin()->second.second;
+		script.erase(script.begin());
+
+		sim_pin &p=pins[pin];
+		int was=p.input;
+		p.input=level;
+		p.scripted=true;
+		if (was==level) continue;
+		record(sim_transition{at,pin,level});
+		if (p.isr==NULL) continue;
+		bool rising=level==HIGH;
+		if (p.isr_edge==INT_EDGE_BOTH || p.isr_edge==INT_EDGE_SETUP ||
+			(p.isr_edge==INT_EDGE_RISING && rising) ||
+			(p.isr_edge==INT_EDGE_FALLING && !rising)){
+			if (virtual_time){
+				isrs.push_back(p.isr);
+			}else if (p.isr_pending){
+				isr_coalesced++;
+			}else{
+				p.isr_pending=true;
+				marked=true;
+			}
+		}
+	}
+	return marked;
+}
+
+/* void run_script(int64_t now)
+ * apply_script() up to now. In virtual time, call the ISRs it lists,
+ * after we let go of sim_lock, since they'll probably call
+ * digitalRead() or millis() themselves. In real time, ISRs are only
+ * ever called from the input thread, as in wiringPi, so if anything is
+ * pending we just wake it up.
+ */
+static void run_script(int64_t now){
+	std::vector<void (*)(void)> isrs;
+	{
+		std::lock_guard<std::mutex> guard(sim_lock);
+		if (apply_script(now,isrs)) script_changed.notify_all();
+		isr_calls+=isrs.size();
+	}
+	for (size_t c=0;c<isrs.size();c++) isrs[c]();
+}
+
+/* void input_thread()
+ * Real time only. Forever:
+ * 		call the ISR of every pin that's pending, one at a time, without
+ * 		holding sim_lock,
+ * 		or if nothing's pending, sleep until the next scripted input is
+ * 		due (or the script changes) and apply it.
+ * An ISR that takes a long time holds up the others, and the edges
+ * that come in the meantime pile up as one pending call per pin.
+ */
+static void input_thread(){
+	std::vector<void (*)(void)> unused;
+	std::unique_lock<std::mutex> guard(sim_lock);
+	while(true){
+		int pending=-1;
+		for (int c=0;c<sim_pin_count && pending<0;c++){
+			if (pins[c].isr_pending) pending=c;
+		}
+		if (pending>=0){
+			pins[pending].isr_pending=false;
+			void (*isr)(void)=pins[pending].isr;
+			isr_calls++;
+			guard.unlock();
+			isr();
+			guard.lock();
+			continue;
+		}
+		if (script.empty()){
+			script_changed.wait(guard);
+			continue;
+		}
+		int64_t next=script.begin()->first;
+		if (monotonic_ns()-epoch_ns<next){
+			std::chrono::steady_clock::time_point due{
+				std::chrono::nanoseconds(epoch_ns+next)}; //steady_clock is CLOCK_MONOTONIC.
+			script_changed.wait_until(guard,due);
+			continue;
+		}
+		apply_script(monotonic_ns()-epoch_ns,unused);
+	}
+}
+
+/* void write_trace_at_exit()
+ * atexit() handler for WIRINGPI_SIM_TRACE.
+ */
+static void write_trace_at_exit(){
+	if (!sim_write_trace(trace_path)){
+		std::cerr<<"wiringPi_sim: unable to write "<<trace_path<<std::endl;
+	}
+}
+
+/* void check_stop()
+ * Stop if WIRINGPI_SIM_SECONDS is up. Called from delay(), from any
+ * thread. We take sim_lock and never let it go, so every other thread
+ * stops at its next wiringPi call and nothing can change the trace
+ * while we write it. Then flush what the program has printed, and
+ * _exit(): exit() would run the atexit handlers and static destructors
+ * while the other threads are still running.
+ */
+static void check_stop(){
+	if (stop_after_ns<0 || sim_now_ns()<stop_after_ns) return;
+	sim_lock.lock(); //for good.
+	if (trace_path!=NULL && !write_transitions(trace_path,ordered_trace())){
+		std::cerr<<"wiringPi_sim: unable to write "<<trace_path<<std::endl;
+	}
+	std::cout<<std::flush;
+	fflush(NULL);
+	_exit(0);
+}
+
+/* void sim_sleep(int64_t ns)
+ * The guts of delay(). In virtual time, move this thread's clock on,
+ * move virtual_ns on if we're now the latest, and run the script up to
+ * there. In real time, sleep, then run the script in case the input
+ * thread hasn't got to it yet.
+ */
+static void sim_sleep(int64_t ns){
+	if (virtual_time){
+		int64_t now=sim_now_ns()+ns;
+		thread_ns=now;
+		int64_t latest=virtual_ns.load();
+		while (latest<now && !virtual_ns.compare_exchange_weak(latest,now)){
+			//somebody else moved it; latest is their time. Try again.
+		}
+		run_script(virtual_ns.load());
+	}else{
+		timespec wait;
+		wait.tv_sec=ns/1000000000LL;
+		wait.tv_nsec=ns%1000000000LL;
+		while (clock_nanosleep(CLOCK_MONOTONIC,0,&wait,&wait)==EINTR){
+			//interrupted. wait now holds what's left.
+		}
+		run_script(sim_now_ns());
+	}
+	check_stop();
+}
+
+/* The wiringPi calls. Same names and behavior as the real ones, as far
+ * as these programs can tell.
+ */
+extern "C" {
+
+/* int wiringPiSetupGpio()
+ * The first time through, read the environment (see wiringPi_sim.h),
+ * set every pin to an input with no pull, and in real time, start the
+ * input thread. Always returns 0, like wiringPi does when it works.
+ */
+int wiringPiSetupGpio(void){
+	{
+		std::lock_guard<std::mutex> guard(sim_lock);
+		if (set_up) return 0;
+		set_up=true;
+
+		const char *setting=getenv("WIRINGPI_SIM_TIME");
+		if (!time_mode_chosen && setting!=NULL){
+			virtual_time=std::string(setting)=="virtual";
+		}
+		setting=getenv("WIRINGPI_SIM_SECONDS");
+		if (setting!=NULL) stop_after_ns=(int64_t)(atof(setting)*1e9);
+		trace_path=getenv("WIRINGPI_SIM_TRACE");
+		if (trace_path!=NULL) atexit(write_trace_at_exit);
+
+		for (int c=0;c<sim_pin_count;c++){
+			pins[c]=sim_pin{INPUT,-1,LOW,false,NULL,INT_EDGE_SETUP,false};
+		}
+		if (!virtual_time) std::thread(input_thread).detach();
+	}
+
+	const char *script_path=getenv("WIRINGPI_SIM_SCRIPT"); //takes the lock itself.
+	if (script_path!=NULL && !sim_load_script(script_path)){
+		std::cerr<<"wiringPi_sim: unable to read "<<script_path<<std::endl;
+	}
+	return 0;
+}
+
+int wiringPiSetup(void){
+	return wiringPiSetupGpio();
+}
+
+void pinMode(int pin,int mode){
+	if (pin<0 || pin>=sim_pin_count) return;
+	std::lock_guard<std::mutex> guard(sim_lock);
+	pins[pin].mode=mode;
+}
+
+void pullUpDnControl(int pin,int pud){
+	if (pin<0 || pin>=sim_pin_count) return;
+	std::lock_guard<std::mutex> guard(sim_lock);
+	if (!pins[pin].scripted) pins[pin].input=pud==PUD_UP?HIGH:LOW;
+}
+
+void digitalWrite(int pin,int value){
+	if (pin<0 || pin>=sim_pin_count) return;
+	int level=value?HIGH:LOW;
+	writes++;
+	std::lock_guard<std::mutex> guard(sim_lock);
+	if (pins[pin].output==level) return; //no transition.
+	pins[pin].output=level;
+	record(sim_transition{sim_now_ns(),pin,level});
+}
+
+int digitalRead(int pin){
+	if (pin<0 || pin>=sim_pin_count) return LOW;
+	run_script(virtual_time?virtual_ns.load():sim_now_ns());
+	std::lock_guard<std::mutex> guard(sim_lock);
+	const sim_pin &p=pins[pin];
+	if (p.mode==OUTPUT) return p.output==HIGH?HIGH:LOW;
+	return p.input;
+}
+
+int wiringPiISR(int pin,int mode,void (*function)(void)){
+	if (pin<0 || pin>=sim_pin_count) return -1;
+	std::lock_guard<std::mutex> guard(sim_lock);
+	pins[pin].isr=function;
+	pins[pin].isr_edge=mode;
+	return 0;
+}
+
+void piLock(int key){
+	pthread_mutex_lock(&pi_locks[key & (sim_lock_count-1)]);
+}
+
+void piUnlock(int key){
+	pthread_mutex_unlock(&pi_locks[key & (sim_lock_count-1)]);
+}
+
+int piThreadCreate(void *(*fn)(void *)){
+	pthread_t thread;
+	int result=pthread_create(&thread,NULL,fn,NULL);
+	if (result==0) pthread_detach(thread);
+	return result;
+}
+
+void delay(unsigned int howLong){
+	sim_sleep(howLong*1000000LL);
+}
+
+void delayMicroseconds(unsigned int howLong){
+	sim_sleep(howLong*1000LL);
+}
+
+unsigned int millis(void){
+	return (unsigned int)(sim_now_ns()/1000000LL);
+}
+
+unsigned int micros(void){
+	return (unsigned int)(sim_now_ns()/1000LL);
+}
+
+} //extern "C"
+
+/* The simulation's own knobs. See wiringPi_sim.h.
+ */
+void sim_set_virtual_time(bool on){
+	std::lock_guard<std::mutex> guard(sim_lock);
+	virtual_time=on;
+	time_mode_chosen=true;
+}
+
+void sim_script_input(int pin,int64_t at_ns,int level){
+	if (pin<0 || pin>=sim_pin_count) return;
+	std::lock_guard<std::mutex> guard(sim_lock);
+	script.insert(std::make_pair(at_ns,std::make_pair(pin,level?HIGH:LOW)));
+	script_changed.notify_all();
+}
+
+bool sim_load_script(const char *path){
+	std::ifstream file(path);
+	if (!file.is_open()) return false;
+	std::string line;
+	while (std::getline(file,line)){
+		size_t comment=line.find('#');
+		if (comment!=std::string::npos) line.erase(comment);
+		double ms;
+		int pin,level;
+		if (sscanf(line.c_str(),"%lf %d %d",&ms,&pin,&level)==3){
+			sim_script_input(pin,(int64_t)(ms*1e6),level);
+		}
+	}
+	return true;
+}
+
+size_t sim_transition_count(){
+	std::lock_guard<std::mutex> guard(sim_lock);
+	return trace.size();
+}
+
+uint64_t sim_write_count(){
+	return writes;
+}
+
+uint64_t sim_isr_count(){
+	std::lock_guard<std::mutex> guard(sim_lock);
+	return isr_calls;
+}
+
+uint64_t sim_coalesced_count(){
+	std::lock_guard<std::mutex> guard(sim_lock);
+	return isr_coalesced;
+}
+
+uint64_t sim_dropped_count(){
+	std::lock_guard<std::mutex> guard(sim_lock);
+	return trace_dropped;
+}
+
+uint64_t sim_recorded_count(){
+	std::lock_guard<std::mutex> guard(sim_lock);
+	return trace_recorded;
+}
+
+std::vector<sim_transition> sim_transitions(){
+	std::lock_guard<std::mutex> guard(sim_lock);
+	return ordered_trace();
+}
+
+void sim_clear_transitions(){
+	std::lock_guard<std::mutex> guard(sim_lock);
+	trace.clear();
+	trace_start=0;
+	trace_dropped=0;
+}
+
+bool sim_write_trace(const char *path){
+	return write_transitions(path,sim_transitions());
+}
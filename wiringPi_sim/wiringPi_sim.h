@@ -0,0 +1,151 @@
+ /*
+  * wiringPi_sim.h
+  *
+  * Copyright 2018 Jim Strickland <jrs@jamesrstrickland.com>
+  *
+  * Standard GNU boilerplate:
+  * This program is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program; if not, write to the Free Software
+  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  * MA 02110-1301, USA.
+  *
+ */
+
+/*
+ * wiringPi_sim.h
+ * The knobs on the simulated wiringPi. A program built against the
+ * simulation doesn't have to use any of these; everything can also be
+ * set from the environment, which is how you'd run the unchanged
+ * programs in this archive:
+ * 		WIRINGPI_SIM_TIME=virtual	run in virtual time. delay() returns
+ * 									at once and moves the clock on.
+ * 		WIRINGPI_SIM_SCRIPT=file	script the inputs. Each line of the
+ * 									file is "milliseconds pin level",
+ * 									and # starts a comment.
+ * 		WIRINGPI_SIM_TRACE=file		write every pin transition to file
+ * 									(as "ns,pin,level" lines) when the
+ * 									program exits. Only the latest
+ * 									sim_trace_limit (a million) are
+ * 									kept, so a long run can't eat all
+ * 									the memory.
+ * 		WIRINGPI_SIM_SECONDS=n		stop at the first delay() after n
+ * 									seconds (of virtual time, in virtual
+ * 									mode): write the trace, flush cout,
+ * 									and _exit(0). Every other thread is
+ * 									stopped where it is, at its next
+ * 									wiringPi call, and the program's own
+ * 									exit handlers and destructors don't
+ * 									run, since they'd run alongside
+ * 									threads that are still going. Most
+ * 									of the programs here loop forever,
+ * 									so this is how you get a trace out
+ * 									of them.
+ * Benchmarks and tests can call the functions below instead.
+ *
+ * Only wiringPi's own clock is virtual. Programs that time their frames
+ * with frame_clock_class, or write the registers with
+ * gpio_register_class, still run in real time and still need the GPIO
+ * stand-in file (compile them with -Dgpiomem_path='"/tmp/gpiomem"').
+*/
+
+#ifndef WIRINGPI_SIM_H
+#define WIRINGPI_SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "wiringPi.h"
+
+/* sim_transition
+ * -------------------------------------------------------------------
+ * ns		when it happened, in ns since the program started.
+ * pin		the BCM pin number.
+ * level	the level it went to, HIGH or LOW.
+ * -------------------------------------------------------------------
+ */
+struct sim_transition {
+	int64_t ns;
+	int pin;
+	int level;
+};
+
+/* void sim_set_virtual_time(bool on)
+ * Switch virtual time on or off. Call it before wiringPiSetupGpio(),
+ * which would otherwise set it from WIRINGPI_SIM_TIME.
+ */
+void sim_set_virtual_time(bool on);
+
+/* void sim_script_input(int pin, int64_t at_ns, int level)
+ * At at_ns (ns since the program started), input pin goes to level.
+ * Any ISR watching that edge is called. Scripted inputs can be added
+ * at any time.
+ */
+void sim_script_input(int pin,int64_t at_ns,int level);
+
+/* bool sim_load_script(const char *path)
+ * Reads a script file (see above) and scripts every line of it.
+ * Returns false if the file can't be opened.
+ */
+bool sim_load_script(const char *path);
+
+/* int64_t sim_now_ns()
+ * The simulation's clock, in ns since the program started: real or
+ * virtual.
+ */
+int64_t sim_now_ns();
+
+/* size_t sim_transition_count(), sim_write_count()
+ * How many transitions the trace holds, and how many times
+ * digitalWrite() has been called, whether or not it changed anything.
+ * The trace stops growing at sim_trace_limit, so to count transitions
+ * over a stretch of time, use sim_recorded_count() instead.
+ */
+size_t sim_transition_count();
+uint64_t sim_write_count();
+
+/* uint64_t sim_isr_count(), sim_coalesced_count()
+ * How many times an ISR has been called, and how many edges an ISR
+ * wanted but didn't get a call of its own for, because a call for an
+ * earlier edge on the same pin was still waiting or running. That only
+ * happens in real time; in virtual time every edge gets its call.
+ */
+uint64_t sim_isr_count();
+uint64_t sim_coalesced_count();
+
+/* uint64_t sim_dropped_count(), sim_recorded_count()
+ * How many of the oldest transitions have been thrown away to keep
+ * the trace to sim_trace_limit since it was last cleared, and how many
+ * transitions there have been in all, kept or not. The second never
+ * goes down, even when the trace is cleared, so the difference between
+ * two of them is always how many transitions happened in between.
+ */
+uint64_t sim_dropped_count();
+uint64_t sim_recorded_count();
+
+/* std::vector<sim_transition> sim_transitions()
+ * A copy of every transition kept so far, oldest first.
+ */
+std::vector<sim_transition> sim_transitions();
+
+/* void sim_clear_transitions()
+ * Forget every transition recorded so far.
+ */
+void sim_clear_transitions();
+
+/* bool sim_write_trace(const char *path)
+ * Writes the transitions to path, one "ns,pin,level" line each.
+ * Returns false if the file can't be written.
+ */
+bool sim_write_trace(const char *path);
+
+#endif